@@ -0,0 +1,171 @@
+/*
+ * Value types of queryable attributes.
+ *
+ * Copyright (C) 2007 OSD Team <pvfs-osd@osc.edu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+
+#include "osd-types.h"
+#include "osd-util/osd-util.h"
+#include "attr-type.h"
+
+/*
+ * Add the declaration val of ROOT_QUERY_PG to at. A pair declared more
+ * than once keeps the type it was first declared with.
+ *
+ * returns:
+ * -EINVAL: not a declaration
+ * -ENOMEM: out of memory
+ * OSD_OK: success
+ */
+int attr_types_add(struct attr_types *at, const void *decl, uint16_t len)
+{
+	uint32_t i = 0;
+	uint32_t page = 0;
+	uint32_t number = 0;
+	uint32_t type = ROOT_QUERY_BLOB;
+	const uint8_t *d = decl;
+	void *p = NULL;
+
+	if (len != ROOT_QUERY_ATTR_LEN && len != ROOT_QUERY_TYPED_ATTR_LEN)
+		return -EINVAL;
+	page = get_ntohl(&d[0]);
+	number = get_ntohl(&d[4]);
+	if (len == ROOT_QUERY_TYPED_ATTR_LEN)
+		type = get_ntohl(&d[8]);
+	if (type > ROOT_QUERY_STRING)
+		return -EINVAL;
+
+	for (i = 0; i < at->n; i++)
+		if (at->ent[i].page == page && at->ent[i].number == number)
+			return OSD_OK;
+
+	p = realloc(at->ent, (at->n + 1) * sizeof(*at->ent));
+	if (!p)
+		return -ENOMEM;
+	at->ent = p;
+	at->ent[at->n].page = page;
+	at->ent[at->n].number = number;
+	at->ent[at->n].type = type;
+	at->n++;
+	return OSD_OK;
+}
+
+void attr_types_free(struct attr_types *at)
+{
+	if (!at)
+		return;
+	free(at->ent);
+	free(at);
+}
+
+/*
+ * returns 1 if (page, number) is declared, so has a value index, 0 if not
+ */
+int attr_types_declared(const struct attr_types *at, uint32_t page,
+			uint32_t number)
+{
+	uint32_t i = 0;
+
+	for (i = 0; at && i < at->n; i++)
+		if (at->ent[i].page == page && at->ent[i].number == number)
+			return 1;
+	return 0;
+}
+
+/*
+ * returns the declared type of (page, number), ROOT_QUERY_BLOB if it is
+ * not declared
+ */
+uint8_t attr_types_get(const struct attr_types *at, uint32_t page,
+		       uint32_t number)
+{
+	uint32_t i = 0;
+
+	for (i = 0; at && i < at->n; i++)
+		if (at->ent[i].page == page && at->ent[i].number == number)
+			return at->ent[i].type;
+	return ROOT_QUERY_BLOB;
+}
+
+/*
+ * Decode val under type. Numbers are big-endian, 1 to 8 bytes; an
+ * unsigned one gets its top bit flipped so that it orders right as an
+ * int64_t. A string ends at its first NUL, if it has one.
+ *
+ * returns:
+ * -EINVAL: val is not of the type
+ * OSD_OK: success
+ */
+int attr_key_decode(uint8_t type, const void *val, uint32_t len,
+		    struct attr_key *k)
+{
+	uint32_t i = 0;
+	uint64_t v = 0;
+	const uint8_t *b = val;
+	const uint8_t *nul = NULL;
+
+	k->type = type;
+	k->num = 0;
+	k->val = val;
+	k->len = len;
+
+	switch (type) {
+	case ROOT_QUERY_BLOB:
+		return OSD_OK;
+	case ROOT_QUERY_STRING:
+		nul = memchr(val, '\0', len);
+		if (nul)
+			k->len = nul - b;
+		return OSD_OK;
+	case ROOT_QUERY_U64:
+	case ROOT_QUERY_I64:
+		if (len == 0 || len > 8)
+			return -EINVAL;
+		/* sign extend a short signed number */
+		if (type == ROOT_QUERY_I64 && (b[0] & 0x80))
+			v = ~0ULL;
+		for (i = 0; i < len; i++)
+			v = (v << 8) | b[i];
+		if (type == ROOT_QUERY_U64)
+			v ^= 1ULL << 63;
+		k->num = (int64_t)v;
+		k->val = NULL;
+		k->len = 0;
+		return OSD_OK;
+	default:
+		return -EINVAL;
+	}
+}
+
+/*
+ * order of two keys of the same type; bytes compare the way SQLite
+ * orders BLOBs
+ */
+int attr_key_cmp(const struct attr_key *a, const struct attr_key *b)
+{
+	int c = 0;
+
+	if (a->type == ROOT_QUERY_U64 || a->type == ROOT_QUERY_I64)
+		return (a->num > b->num) - (a->num < b->num);
+
+	c = memcmp(a->val, b->val, a->len < b->len ? a->len : b->len);
+	if (c != 0)
+		return c;
+	return (a->len > b->len) - (a->len < b->len);
+}
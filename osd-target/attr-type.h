@@ -0,0 +1,63 @@
+/*
+ * Value types of queryable attributes.
+ *
+ * Copyright (C) 2007 OSD Team <pvfs-osd@osc.edu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __ATTR_TYPE_H
+#define __ATTR_TYPE_H
+
+#include <stdint.h>
+
+/*
+ * The (page, number) pairs declared in ROOT_QUERY_PG with their value
+ * type, in declaration order. Undeclared pairs are ROOT_QUERY_BLOB.
+ */
+struct attr_types {
+	uint32_t n;
+	struct {
+		uint32_t page;
+		uint32_t number;
+		uint8_t type;
+	} *ent;
+};
+
+/*
+ * A value or criterion bound decoded under a type: numbers map to num so
+ * that signed order is the order of the type, blobs and strings keep
+ * their bytes in val and len.
+ */
+struct attr_key {
+	uint8_t type;
+	int64_t num;
+	const void *val;
+	uint32_t len;
+};
+
+int attr_types_add(struct attr_types *at, const void *decl, uint16_t len);
+
+void attr_types_free(struct attr_types *at);
+
+int attr_types_declared(const struct attr_types *at, uint32_t page,
+			uint32_t number);
+
+uint8_t attr_types_get(const struct attr_types *at, uint32_t page,
+		       uint32_t number);
+
+int attr_key_decode(uint8_t type, const void *val, uint32_t len,
+		    struct attr_key *k);
+
+int attr_key_cmp(const struct attr_key *a, const struct attr_key *b);
+
+#endif /* __ATTR_TYPE_H */
@@ -0,0 +1,133 @@
+/*
+ * Virtual attributes.
+ *
+ * Copyright (C) 2007 OSD Team <pvfs-osd@osc.edu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+
+#include "osd.h"
+#include "osd-types.h"
+#include "list-entry.h"
+#include "attr-virt.h"
+
+struct attr_virt {
+	uint32_t page;
+	uint32_t number;
+	char val[ATTR_PAGE_ID_LEN];
+};
+
+/*
+ * Constant attributes every object has without a stored row: the names
+ * of the standard pages that are not computed on retrieval. They used to
+ * be written on the first GET ALL ATTRIBUTES of an object; a stored value
+ * still takes precedence. Kept in (page, number) order for the merge.
+ */
+static const struct attr_virt attr_virt[] = {
+	{USER_TMSTMP_PG, 0, "INCITS  T10 User Object Timestamps     "},
+	{USER_ATOMICS_PG, 0, "INCITS  T10 User Atomics               "},
+};
+
+#define NR_ATTR_VIRT (sizeof(attr_virt) / sizeof(attr_virt[0]))
+
+/*
+ * returns:
+ * value of the virtual attribute, ATTR_PAGE_ID_LEN bytes
+ * NULL: there is none
+ */
+const void *attr_virt_get(uint32_t page, uint32_t number)
+{
+	uint32_t i = 0;
+
+	for (i = 0; i < NR_ATTR_VIRT; i++)
+		if (attr_virt[i].page == page && attr_virt[i].number == number)
+			return attr_virt[i].val;
+	return NULL;
+}
+
+void attr_virt_open(struct attr_virt_cursor *vc, uint32_t page,
+		    uint32_t number)
+{
+	vc->i = 0;
+	vc->page = page;
+	vc->number = number;
+	vc->isdir = 0;
+	vc->dir_page = 0;
+}
+
+void attr_virt_open_dir(struct attr_virt_cursor *vc, uint32_t dir_page)
+{
+	attr_virt_open(vc, GETALLATTR_PG, 0);
+	vc->isdir = 1;
+	vc->dir_page = dir_page;
+}
+
+/*
+ * Pack the selected virtual attributes that sort before (page, number),
+ * the key of the next stored attribute, into buf. One with that very key
+ * is passed over since the stored value wins. (GETALLATTR_PG,
+ * ATTRNUM_GETALL) packs all that are left. The key of a directory page
+ * entry is (page, 0).
+ *
+ * returns:
+ * -EINVAL: invalid listfmt or misaligned buffer
+ * -EOVERFLOW: no room for the next entry, used is set
+ * OSD_OK: success, used is set
+ */
+int attr_virt_merge(struct attr_virt_cursor *vc, uint32_t page,
+		    uint32_t number, uint64_t oid, void *buf, uint32_t buflen,
+		    uint8_t listfmt, uint32_t *used)
+{
+	int ret = 0;
+	uint8_t *cp = buf;
+	const struct attr_virt *v = NULL;
+
+	*used = 0;
+	for (; vc->i < NR_ATTR_VIRT; vc->i++) {
+		v = &attr_virt[vc->i];
+		if (v->page > page || (v->page == page && v->number >= number)) {
+			if (v->page == page && v->number == number)
+				vc->i++;
+			break;
+		}
+		if ((vc->page != GETALLATTR_PG && v->page != vc->page) ||
+		    (vc->number != ATTRNUM_GETALL && v->number != vc->number))
+			continue;
+
+		if (listfmt == RTRVD_SET_ATTR_LIST && vc->isdir)
+			ret = le_pack_attr(cp, buflen, vc->dir_page, v->page,
+					   ATTR_PAGE_ID_LEN, v->val);
+		else if (listfmt == RTRVD_SET_ATTR_LIST)
+			ret = le_pack_attr(cp, buflen, v->page, v->number,
+					   ATTR_PAGE_ID_LEN, v->val);
+		else if (listfmt == RTRVD_CREATE_MULTIOBJ_LIST && vc->isdir)
+			ret = le_multiobj_pack_attr(cp, buflen, oid,
+						    vc->dir_page, v->page,
+						    ATTR_PAGE_ID_LEN, v->val);
+		else if (listfmt == RTRVD_CREATE_MULTIOBJ_LIST)
+			ret = le_multiobj_pack_attr(cp, buflen, oid, v->page,
+						    v->number,
+						    ATTR_PAGE_ID_LEN, v->val);
+		else
+			ret = -EINVAL;
+		if (ret < 0)
+			return ret;
+		cp += ret;
+		buflen -= ret;
+		*used += ret;
+	}
+	return OSD_OK;
+}
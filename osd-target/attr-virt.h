@@ -0,0 +1,47 @@
+/*
+ * Virtual attributes.
+ *
+ * Copyright (C) 2007 OSD Team <pvfs-osd@osc.edu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __ATTR_VIRT_H
+#define __ATTR_VIRT_H
+
+#include <stdint.h>
+
+/*
+ * Walks the virtual attributes selected by page and number alongside a
+ * list of stored ones; GETALLATTR_PG and ATTRNUM_GETALL select all. For a
+ * directory page it yields the names of the virtual pages instead.
+ */
+struct attr_virt_cursor {
+	uint32_t i;
+	uint32_t page;
+	uint32_t number;
+	uint8_t isdir;
+	uint32_t dir_page;
+};
+
+const void *attr_virt_get(uint32_t page, uint32_t number);
+
+void attr_virt_open(struct attr_virt_cursor *vc, uint32_t page,
+		    uint32_t number);
+
+void attr_virt_open_dir(struct attr_virt_cursor *vc, uint32_t dir_page);
+
+int attr_virt_merge(struct attr_virt_cursor *vc, uint32_t page,
+		    uint32_t number, uint64_t oid, void *buf, uint32_t buflen,
+		    uint8_t listfmt, uint32_t *used);
+
+#endif /* __ATTR_VIRT_H */
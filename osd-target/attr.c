@@ -28,8 +28,11 @@
 #include "osd-types.h"
 #include "db.h"
 #include "attr.h"
+#include "backend.h"
 #include "osd-util/osd-util.h"
 #include "list-entry.h"
+#include "attr-virt.h"
+#include "attr-type.h"
 
 #define min(x,y) ({ \
         typeof(x) _x = (x);     \
@@ -44,6 +47,7 @@ static const char unid_page[ATTR_PAGE_ID_LEN] =
 "        unidentified attributes page   ";
 
 static const char *attr_tab_name = "attr";
+static const char *attrdir_tab_name = "attrdir";
 struct attr_tab {
     char *name;             /* name of the table */
     sqlite3_stmt *setattr;  /* set an attr by inserting row */
@@ -55,9 +59,92 @@ struct attr_tab {
     sqlite3_stmt *forallpg; /* for all pages get an attribute */
     sqlite3_stmt *getall;   /* get all attributes of an object */
     sqlite3_stmt *dirpage;  /* get directory page of object's attr */
+    sqlite3_stmt *dirins;   /* add a page to object's page directory */
+    sqlite3_stmt *dirdel;   /* drop a page from directory if it is empty */
+    sqlite3_stmt *dirdelall;/* drop object's page directory */
+    sqlite3_stmt *cas;      /* swap a value if it matches */
+    sqlite3_stmt *fa;       /* add to an 8 byte value */
 };
 
 
+/*
+ * SQL function osd_add64(value, add, orig): the 8 byte integer value plus
+ * add, in the host byte order osd_fa has always stored it in. The value
+ * before the addition is written to orig, a pointer bound with
+ * sqlite3_bind_pointer, which spares the UPDATE a RETURNING clause.
+ */
+static void attr_sql_add64(sqlite3_context *ctx, int argc,
+        sqlite3_value **argv)
+{
+    uint64_t val = 0;
+    uint64_t *orig = sqlite3_value_pointer(argv[2], "osd_u64");
+
+    if (sqlite3_value_bytes(argv[0]) != sizeof(val) || orig == NULL) {
+        sqlite3_result_error(ctx, "osd_add64: value is not 8 bytes", -1);
+        return;
+    }
+    memcpy(&val, sqlite3_value_blob(argv[0]), sizeof(val));
+    *orig = val;
+    val += (uint64_t)sqlite3_value_int64(argv[1]);
+    sqlite3_result_blob(ctx, &val, sizeof(val), SQLITE_TRANSIENT);
+}
+
+/*
+ * SQL function osd_qkey(value, type): value decoded under a declared
+ * query type, see attr_key_decode. Numbers come out as integers, strings
+ * and blobs as blobs, and values not of the type as NULL. The typed
+ * query indexes are built on it.
+ */
+static void attr_sql_qkey(sqlite3_context *ctx, int argc,
+        sqlite3_value **argv)
+{
+    struct attr_key k;
+    const void *val = sqlite3_value_blob(argv[0]);
+    int len = sqlite3_value_bytes(argv[0]);
+
+    if (attr_key_decode(sqlite3_value_int(argv[1]), val, len, &k) !=
+            OSD_OK)
+        sqlite3_result_null(ctx);
+    else if (k.type == ROOT_QUERY_U64 || k.type == ROOT_QUERY_I64)
+        sqlite3_result_int64(ctx, k.num);
+    else if (k.len == 0)
+        sqlite3_result_zeroblob(ctx, 0);
+    else
+        sqlite3_result_blob(ctx, k.val, k.len, SQLITE_TRANSIENT);
+}
+
+/*
+ * Register the SQL functions the attr statements use. Defining a function
+ * expires every prepared statement of the connection, so this is done
+ * once right after the database is opened, not in attr_initialize.
+ *
+ * returns:
+ * -EIO: sqlite3_create_function failed
+ * OSD_OK: success
+ */
+int attr_create_functions(void *db)
+{
+    int ret = 0;
+    struct db_context *dbc = (struct db_context*)db;
+
+    ret = sqlite3_create_function(dbc->db, "osd_add64", 3, SQLITE_UTF8,
+            NULL, attr_sql_add64,
+            NULL, NULL);
+    if (ret != SQLITE_OK) {
+        error_sql(dbc->db, "%s: create osd_add64 failed", __func__);
+        return -EIO;
+    }
+    /* deterministic, or SQLite refuses it in an index */
+    ret = sqlite3_create_function(dbc->db, "osd_qkey", 2,
+            SQLITE_UTF8 | SQLITE_DETERMINISTIC, NULL, attr_sql_qkey,
+            NULL, NULL);
+    if (ret != SQLITE_OK) {
+        error_sql(dbc->db, "%s: create osd_qkey failed", __func__);
+        return -EIO;
+    }
+    return OSD_OK;
+}
+
 /*
  * returns:
  * -ENOMEM: out of memory
@@ -146,33 +233,81 @@ int attr_initialize(void *db)
     if (ret != SQLITE_OK)
         goto out_finalize_getall;
 
-    /* 
-     * We need to compute the directory page since we don't maintain any.
-     * This SQL statement is inefficient. Its complexity is O(N) where
-     * 'N' is the total number of defined attributes of the object.
-     * Further the statement executes 3 iterations over all the
-     * attributes of the object, hence the constant term is also
-     * significant. There is some advantage in adding an index on
-     * (pid,oid,number) but that will hit performance of insertions and
-     * deletions which are more critical than dirpage.
+    /*
+     * The directory page is built from attrdir, which holds one row per
+     * defined page of an object. Page names (number 0) are picked from
+     * attr through its primary key, so the cost is O(pages) and the
+     * attribute values of the object are never scanned. A page without a
+     * stored name gets its virtual one or is unidentified.
      */
     sprintf(SQL, 
-            " SELECT page, @uip  FROM %s"
-            "   WHERE pid = @pid AND oid = @oid GROUP BY page "
-            " EXCEPT "
-            " SELECT page, @uip  FROM attr "
-            "   WHERE pid = @pid AND oid = @oid AND number = 0 "
-            " UNION ALL "
-            " SELECT page, value FROM attr "
-            "   WHERE pid = @pid AND oid = @oid AND number = 0;", 
-            dbc->attr->name);
+            " SELECT d.page, a.value FROM %s AS d "
+            "   LEFT JOIN %s AS a ON a.pid = d.pid AND a.oid = d.oid "
+            "     AND a.page = d.page AND a.number = 0 "
+            "   WHERE d.pid = ? AND d.oid = ?;", 
+            attrdir_tab_name, dbc->attr->name);
     ret = sqlite3_prepare(dbc->db, SQL, -1, &dbc->attr->dirpage, NULL);
     if (ret != SQLITE_OK)
         goto out_finalize_dirpage;
 
+    sprintf(SQL, "INSERT OR IGNORE INTO %s VALUES (?, ?, ?);",
+            attrdir_tab_name);
+    ret = sqlite3_prepare(dbc->db, SQL, -1, &dbc->attr->dirins, NULL);
+    if (ret != SQLITE_OK)
+        goto out_finalize_dirins;
+
+    sprintf(SQL, "DELETE FROM %s WHERE pid = ?1 AND oid = ?2 AND "
+            " page = ?3 AND NOT EXISTS (SELECT 1 FROM %s WHERE "
+            " pid = ?1 AND oid = ?2 AND page = ?3);", attrdir_tab_name,
+            dbc->attr->name);
+    ret = sqlite3_prepare(dbc->db, SQL, -1, &dbc->attr->dirdel, NULL);
+    if (ret != SQLITE_OK)
+        goto out_finalize_dirdel;
+
+    sprintf(SQL, "DELETE FROM %s WHERE pid = ? AND oid = ?;",
+            attrdir_tab_name);
+    ret = sqlite3_prepare(dbc->db, SQL, -1, &dbc->attr->dirdelall, NULL);
+    if (ret != SQLITE_OK)
+        goto out_finalize_dirdelall;
+
+    /*
+     * Atomics keep their 8 byte values in attr, so GET ATTRIBUTES sees
+     * them unchanged; CAS and FA each update them in one statement.
+     * GEN CAS swaps values of any length with the same statement.
+     */
+    sprintf(SQL, "UPDATE %s SET value = ?6 WHERE pid = ?1 AND oid = ?2 "
+            " AND page = ?3 AND number = ?4 AND value = ?5;",
+            dbc->attr->name);
+    ret = sqlite3_prepare(dbc->db, SQL, -1, &dbc->attr->cas, NULL);
+    if (ret != SQLITE_OK)
+        goto out_finalize_cas;
+
+    sprintf(SQL, "UPDATE %s SET value = osd_add64(value, ?5, ?6) WHERE "
+            " pid = ?1 AND oid = ?2 AND page = ?3 AND number = ?4;",
+            dbc->attr->name);
+    ret = sqlite3_prepare(dbc->db, SQL, -1, &dbc->attr->fa, NULL);
+    if (ret != SQLITE_OK)
+        goto out_finalize_fa;
+
     ret = OSD_OK; /* success */
     goto out;
 
+out_finalize_fa:
+    db_sqfinalize(dbc->db, dbc->attr->fa, SQL);
+    SQL[0] = '\0';
+out_finalize_cas:
+    db_sqfinalize(dbc->db, dbc->attr->cas, SQL);
+    SQL[0] = '\0';
+
+out_finalize_dirdelall:
+    db_sqfinalize(dbc->db, dbc->attr->dirdelall, SQL);
+    SQL[0] = '\0';
+out_finalize_dirdel:
+    db_sqfinalize(dbc->db, dbc->attr->dirdel, SQL);
+    SQL[0] = '\0';
+out_finalize_dirins:
+    db_sqfinalize(dbc->db, dbc->attr->dirins, SQL);
+    SQL[0] = '\0';
 out_finalize_dirpage:
     db_sqfinalize(dbc->db, dbc->attr->dirpage, SQL);
     SQL[0] = '\0';
@@ -221,6 +356,11 @@ int attr_finalize(void *db)
     sqlite3_finalize(dbc->attr->forallpg);
     sqlite3_finalize(dbc->attr->getall);
     sqlite3_finalize(dbc->attr->dirpage);
+    sqlite3_finalize(dbc->attr->dirins);
+    sqlite3_finalize(dbc->attr->dirdel);
+    sqlite3_finalize(dbc->attr->dirdelall);
+    sqlite3_finalize(dbc->attr->cas);
+    sqlite3_finalize(dbc->attr->fa);
     free(dbc->attr->name);
     free(dbc->attr);
     dbc->attr = NULL;
@@ -315,7 +455,8 @@ if(page == USER_INFO_PG) {
 }
 }
 
-    return _attr_set_attr(ohandle, pid, oid, page, number, val, len);
+    return osd->be->_attr_set_attr(ohandle, pid, oid, page, number, val,
+                                   len);
 
 }
 
@@ -333,7 +474,7 @@ int _attr_set_attr(void *ohandle, uint64_t pid, uint64_t oid,
         uint32_t page, uint32_t number, const void *val, 
         uint16_t len)
 {
-    struct db_context *dbc = ((struct handle*)ohandle)->dbc;
+    struct db_context *dbc = db_shard(ohandle, pid);
     int ret = 0;
     sqlite3_stmt *stmt = NULL;
 
@@ -350,6 +491,18 @@ repeat:
     ret = db_exec_dms(dbc, stmt, ret, __func__);
     if (ret == OSD_REPEAT)
         goto repeat;
+    if (ret != OSD_OK)
+        return ret;
+
+repeat_dir:
+    ret = 0;
+    stmt = dbc->attr->dirins;
+    ret |= sqlite3_bind_int64(stmt, 1, pid);
+    ret |= sqlite3_bind_int64(stmt, 2, oid);
+    ret |= sqlite3_bind_int(stmt, 3, page);
+    ret = db_exec_dms(dbc, stmt, ret, __func__);
+    if (ret == OSD_REPEAT)
+        goto repeat_dir;
 
     return ret;
 }
@@ -364,7 +517,7 @@ repeat:
 int attr_delete_attr(void *ohandle, uint64_t pid, uint64_t oid, 
         uint32_t page, uint32_t number)
 {
-    struct db_context *dbc = ((struct handle*)ohandle)->dbc;
+    struct db_context *dbc = db_shard(ohandle, pid);
     int ret = 0;
     sqlite3_stmt *stmt = NULL;
 
@@ -380,6 +533,19 @@ repeat:
     ret = db_exec_dms(dbc, stmt, ret, __func__);
     if (ret == OSD_REPEAT)
         goto repeat;
+    if (ret != OSD_OK)
+        return ret;
+
+    /* drop the page from the directory if that was its last attribute */
+repeat_dir:
+    ret = 0;
+    stmt = dbc->attr->dirdel;
+    ret |= sqlite3_bind_int64(stmt, 1, pid);
+    ret |= sqlite3_bind_int64(stmt, 2, oid);
+    ret |= sqlite3_bind_int(stmt, 3, page);
+    ret = db_exec_dms(dbc, stmt, ret, __func__);
+    if (ret == OSD_REPEAT)
+        goto repeat_dir;
 
     return ret;
 }
@@ -393,7 +559,7 @@ repeat:
  */
 int attr_delete_all(void *ohandle, uint64_t pid, uint64_t oid)
 {
-    struct db_context *dbc = ((struct handle*)ohandle)->dbc;
+    struct db_context *dbc = db_shard(ohandle, pid);
     int ret = 0;
 
     assert(dbc && dbc->db && dbc->attr && dbc->attr->delall);
@@ -405,11 +571,95 @@ repeat:
     ret = db_exec_dms(dbc, dbc->attr->delall, ret, __func__);
     if (ret == OSD_REPEAT)
         goto repeat;
+    if (ret != OSD_OK)
+        return ret;
+
+repeat_dir:
+    ret = 0;
+    ret |= sqlite3_bind_int64(dbc->attr->dirdelall, 1, pid);
+    ret |= sqlite3_bind_int64(dbc->attr->dirdelall, 2, oid);
+    ret = db_exec_dms(dbc, dbc->attr->dirdelall, ret, __func__);
+    if (ret == OSD_REPEAT)
+        goto repeat_dir;
 
     return ret;
 }
 
 
+/*
+ * Set a list of attributes on the objects [oid, oid+numoid). Every row goes
+ * through the setattr statement prepared in attr_initialize; values are
+ * bound without copying since they are consumed by the step right after
+ * the bind. attrdir is touched once per run of entries on the same page.
+ * Entries with len == 0 delete the attribute. Caller is expected to
+ * wrap this in a transaction.
+ *
+ * returns:
+ * -EINVAL: invalid arg
+ * OSD_ERROR: some other error
+ * OSD_OK: success
+ */
+int attr_set_attr_list(void *ohandle, uint64_t pid, uint64_t oid,
+        uint16_t numoid, const struct list_entry *le, uint32_t sz)
+{
+    struct db_context *dbc = db_shard(ohandle, pid);
+    int ret = 0;
+    int indir = 0;
+    uint32_t i = 0;
+    uint64_t o = 0;
+    sqlite3_stmt *stmt = NULL;
+
+    assert(dbc && dbc->db && dbc->attr && dbc->attr->setattr);
+
+    for (o = oid; o < oid + numoid; o++) {
+        indir = 0;
+        for (i = 0; i < sz; i++) {
+            if (le[i].len == 0) {
+                ret = attr_delete_attr(ohandle, pid, o, le[i].page,
+                        le[i].number);
+                if (ret != OSD_OK)
+                    return ret;
+                indir = 0;
+                continue;
+            }
+
+repeat:
+            ret = 0;
+            stmt = dbc->attr->setattr;
+            ret |= sqlite3_bind_int64(stmt, 1, pid);
+            ret |= sqlite3_bind_int64(stmt, 2, o);
+            ret |= sqlite3_bind_int(stmt, 3, le[i].page);
+            ret |= sqlite3_bind_int(stmt, 4, le[i].number);
+            ret |= sqlite3_bind_blob(stmt, 5, le[i].cval, le[i].len,
+                    SQLITE_STATIC);
+            ret = db_exec_dms(dbc, stmt, ret, __func__);
+            if (ret == OSD_REPEAT)
+                goto repeat;
+            if (ret != OSD_OK)
+                return ret;
+
+            if (indir && le[i].page == le[i-1].page)
+                continue;
+
+repeat_dir:
+            ret = 0;
+            stmt = dbc->attr->dirins;
+            ret |= sqlite3_bind_int64(stmt, 1, pid);
+            ret |= sqlite3_bind_int64(stmt, 2, o);
+            ret |= sqlite3_bind_int(stmt, 3, le[i].page);
+            ret = db_exec_dms(dbc, stmt, ret, __func__);
+            if (ret == OSD_REPEAT)
+                goto repeat_dir;
+            if (ret != OSD_OK)
+                return ret;
+            indir = 1;
+        }
+    }
+
+    return OSD_OK;
+}
+
+
 /* 
  * Gather the results into list_entry format. Each row has page, number, len,
  * value. Look at queries in attr_get_attr attr_get_attr_page.  See page 163.
@@ -474,6 +724,12 @@ static int attr_gather_dir_page(sqlite3_stmt *stmt, uint32_t outlen,
     uint16_t len = sqlite3_column_bytes(stmt, 1);
     const void *val = sqlite3_column_blob(stmt, 1);
 
+    if (sqlite3_column_type(stmt, 1) == SQLITE_NULL) {
+        val = attr_virt_get(number, 0);
+        if (val == NULL)
+            val = unid_page;
+        len = ATTR_PAGE_ID_LEN;
+    }
     if (len != ATTR_PAGE_ID_LEN) 
         return -EINVAL;
 
@@ -489,23 +745,26 @@ static int attr_gather_dir_page(sqlite3_stmt *stmt, uint32_t outlen,
 
 
 /*
+ * With vc the virtual attributes it selects are merged into the rows,
+ * which come in (page, number) order.
+ *
  * returns:
  * -EINVAL: invalid arg or misaligned buffer
  * -ENOENT: empty result set
  * OSD_ERROR: some other error
  * OSD_OK: success, used_outlen modified
  */
-static int exec_attr_rtrvl_stmt(void *ohandle, sqlite3_stmt *stmt,
+static int exec_attr_rtrvl_stmt(struct db_context *dbc, sqlite3_stmt *stmt,
         int ret, const char *func, uint64_t oid, 
         uint64_t page, int rtrvl_type, uint64_t outlen,
         uint8_t *outdata, uint8_t listfmt,
-        uint32_t *used_outlen)
+        struct attr_virt_cursor *vc, uint32_t *used_outlen)
 {
     uint32_t len = 0;
+    uint32_t vlen = 0;
     uint8_t found = 0;
     uint8_t bound = (ret == SQLITE_OK);
     uint8_t inval = 0;
-    struct db_context *dbc = ((struct handle *)ohandle)->dbc;
 
     if (!bound) {
         error_sql(dbc->db, "%s: bind failed", func);
@@ -515,6 +774,23 @@ static int exec_attr_rtrvl_stmt(void *ohandle, sqlite3_stmt *stmt,
     *used_outlen = 0;
     while (1) {
         ret = sqlite3_step(stmt);
+        if (ret == SQLITE_ROW && vc) {
+            ret = attr_virt_merge(vc, sqlite3_column_int(stmt, 0),
+                    (rtrvl_type == GATHER_DIR_PAGE ? 0 :
+                     sqlite3_column_int(stmt, 1)), oid, outdata, outlen,
+                    listfmt, &vlen);
+            len += vlen;
+            outlen -= vlen;
+            outdata += vlen;
+            if (vlen > 0)
+                found = 1;
+            if (ret != OSD_OK) {
+                if (ret == -EINVAL)
+                    inval = 1;
+                break;
+            }
+            ret = SQLITE_ROW;
+        }
         if (ret == SQLITE_ROW) {
             if (rtrvl_type == GATHER_VAL) {
                 ret = attr_gather_val(stmt, outdata, outlen);
@@ -542,12 +818,21 @@ static int exec_attr_rtrvl_stmt(void *ohandle, sqlite3_stmt *stmt,
         } else if (ret == SQLITE_BUSY) {
             continue;
         } else {
+            if (ret == SQLITE_DONE && vc) {
+                ret = attr_virt_merge(vc, GETALLATTR_PG, ATTRNUM_GETALL,
+                        oid, outdata, outlen, listfmt, &vlen);
+                len += vlen;
+                if (vlen > 0)
+                    found = 1;
+                if (ret == -EINVAL)
+                    inval = 1;
+            }
             break;
         }
     }
 
 out_reset:
-    ret = db_reset_stmt(ohandle, stmt, bound, func);
+    ret = db_reset_stmt(dbc, stmt, bound, func);
     if (inval) {
         ret = -EINVAL;
     } else if (ret == OSD_OK) {
@@ -631,9 +916,9 @@ int attr_get_attr(struct osd_device *osd, uint64_t pid, uint64_t oid,
                 val = ll;
                 break;
             case UIAP_USERNAME:
-                return _attr_get_attr(osd->handle, pid, oid, USER_INFO_PG,
-                        UIAP_USERNAME, USER_INFO_PG, UIAP_USERNAME, 
-                        outlen, outdata, listfmt, used_outlen);
+                return osd->be->attr_get_conversion(osd->handle, pid, oid,
+                        USER_INFO_PG, UIAP_USERNAME, outlen, outdata,
+                        listfmt, used_outlen);
             default:
                 return OSD_ERROR;
         }
@@ -646,9 +931,9 @@ int attr_get_attr(struct osd_device *osd, uint64_t pid, uint64_t oid,
                 val = name;
                 break;
             case RIAP_OSD_SYSTEM_ID:
-                ret = _attr_get_attr(osd->handle, pid, oid, ROOT_INFO_PG,
-                        RIAP_OSD_SYSTEM_ID_LEN, ROOT_INFO_PG, RIAP_OSD_SYSTEM_ID_LEN,
-                        outlen, outdata, listfmt, used_outlen);
+                ret = osd->be->attr_get_conversion(osd->handle, pid, oid,
+                        ROOT_INFO_PG, RIAP_OSD_SYSTEM_ID_LEN, outlen, outdata,
+                        listfmt, used_outlen);
                 if (ret == -ENOENT) {
                     len = RIAP_OSD_SYSTEM_ID_LEN;
                     val = "\xf1\x81\x00\x0eOSC     OSDEMU\x00\x00";
@@ -702,9 +987,9 @@ int attr_get_attr(struct osd_device *osd, uint64_t pid, uint64_t oid,
                 val = ll;
                 break;
             case RIAP_OSD_NAME:
-                return _attr_get_attr(osd->handle, pid, oid, ROOT_INFO_PG,
-                        RIAP_OSD_NAME, ROOT_INFO_PG, RIAP_OSD_NAME, 
-                        outlen, outdata, listfmt, used_outlen);
+                return osd->be->attr_get_conversion(osd->handle, pid, oid,
+                        ROOT_INFO_PG, RIAP_OSD_NAME, outlen, outdata,
+                        listfmt, used_outlen);
             default:
                 return OSD_ERROR;
         }
@@ -745,7 +1030,7 @@ int _attr_get_attr(void *ohandle, uint64_t pid, uint64_t oid,
 {
     int ret = 0;
     sqlite3_stmt *stmt = NULL;
-    struct db_context *dbc = ((struct handle*)ohandle)->dbc;
+    struct db_context *dbc = db_shard(ohandle, pid);
 
     assert(dbc && dbc->db && dbc->attr && dbc->attr->getattr);
 
@@ -757,7 +1042,7 @@ repeat:
     ret |= sqlite3_bind_int(stmt, 3, page);
     ret |= sqlite3_bind_int(stmt, 4, number);
     ret = exec_attr_rtrvl_stmt(dbc, stmt, ret, __func__, oid, 0, 
-            GATHER_ATTR, outlen, outdata, listfmt,
+            GATHER_ATTR, outlen, outdata, listfmt, NULL,
             used_outlen); 
     if (ret == OSD_REPEAT) {
         goto repeat;
@@ -784,7 +1069,7 @@ int attr_get_val(void *ohandle, uint64_t pid, uint64_t oid,
 {
     int ret = 0;
     sqlite3_stmt *stmt = NULL;
-    struct db_context *dbc = ((struct handle*)ohandle)->dbc;
+    struct db_context *dbc = db_shard(ohandle, pid);
 
     assert(dbc && dbc->db && dbc->attr && dbc->attr->getval);
 
@@ -796,7 +1081,7 @@ repeat:
     ret |= sqlite3_bind_int(stmt, 3, page);
     ret |= sqlite3_bind_int(stmt, 4, number);
     ret = exec_attr_rtrvl_stmt(dbc, stmt, ret, __func__, oid, 0, 
-            GATHER_VAL, outlen, outdata, 0,
+            GATHER_VAL, outlen, outdata, 0, NULL,
             used_outlen); 
     if (ret == OSD_REPEAT) {
         goto repeat;
@@ -808,6 +1093,228 @@ repeat:
     return ret;
 }
 
+/*
+ * Compare and swap the 8 byte attribute (page, number): one conditional
+ * UPDATE swaps it when it matches cmp, the value is read back only when it
+ * does not. An absent attribute counts as 0 and is created, which is the
+ * lazy initialization of the atomics page.
+ *
+ * returns:
+ * -EINVAL: stored value is not 8 bytes
+ * OSD_ERROR: some other error
+ * OSD_OK: success, orig holds the value before the operation
+ */
+int attr_cas(void *ohandle, uint64_t pid, uint64_t oid, uint32_t page,
+        uint32_t number, uint64_t cmp, uint64_t swap, uint64_t *orig)
+{
+    int ret = 0;
+    uint32_t len = 0;
+    sqlite3_stmt *stmt = NULL;
+    struct db_context *dbc = db_shard(ohandle, pid);
+
+    assert(dbc && dbc->db && dbc->attr && dbc->attr->cas && orig);
+
+repeat:
+    ret = 0;
+    stmt = dbc->attr->cas;
+    ret |= sqlite3_bind_int64(stmt, 1, pid);
+    ret |= sqlite3_bind_int64(stmt, 2, oid);
+    ret |= sqlite3_bind_int(stmt, 3, page);
+    ret |= sqlite3_bind_int(stmt, 4, number);
+    ret |= sqlite3_bind_blob(stmt, 5, &cmp, sizeof(cmp), SQLITE_STATIC);
+    ret |= sqlite3_bind_blob(stmt, 6, &swap, sizeof(swap), SQLITE_STATIC);
+    ret = db_exec_dms(dbc, stmt, ret, __func__);
+    if (ret == OSD_REPEAT)
+        goto repeat;
+    if (ret != OSD_OK)
+        return ret;
+    if (sqlite3_changes(dbc->db) > 0) {
+        *orig = cmp;
+        return OSD_OK;
+    }
+
+    ret = attr_get_val(ohandle, pid, oid, page, number, sizeof(*orig), orig,
+            &len);
+    if (ret == OSD_OK)
+        return (len == sizeof(*orig) ? OSD_OK : -EINVAL);
+    if (ret != -ENOENT)
+        return ret;
+
+    *orig = 0;
+    return _attr_set_attr(ohandle, pid, oid, page, number,
+            (cmp == 0 ? &swap : orig), sizeof(*orig));
+}
+
+/*
+ * Fetch and add on the 8 byte attribute (page, number) with one UPDATE;
+ * osd_add64 hands back the value it replaced. An absent attribute counts
+ * as 0 and is created.
+ *
+ * returns:
+ * OSD_ERROR: stored value is not 8 bytes, or some other error
+ * OSD_OK: success, orig holds the value before the operation
+ */
+int attr_fa(void *ohandle, uint64_t pid, uint64_t oid, uint32_t page,
+        uint32_t number, int64_t add, uint64_t *orig)
+{
+    int ret = 0;
+    sqlite3_stmt *stmt = NULL;
+    struct db_context *dbc = db_shard(ohandle, pid);
+
+    assert(dbc && dbc->db && dbc->attr && dbc->attr->fa && orig);
+
+repeat:
+    ret = 0;
+    stmt = dbc->attr->fa;
+    ret |= sqlite3_bind_int64(stmt, 1, pid);
+    ret |= sqlite3_bind_int64(stmt, 2, oid);
+    ret |= sqlite3_bind_int(stmt, 3, page);
+    ret |= sqlite3_bind_int(stmt, 4, number);
+    ret |= sqlite3_bind_int64(stmt, 5, add);
+    ret |= sqlite3_bind_pointer(stmt, 6, orig, "osd_u64", NULL);
+    ret = db_exec_dms(dbc, stmt, ret, __func__);
+    if (ret == OSD_REPEAT)
+        goto repeat;
+    if (ret != OSD_OK)
+        return ret;
+    if (sqlite3_changes(dbc->db) > 0)
+        return OSD_OK;
+
+    *orig = 0;
+    return _attr_set_attr(ohandle, pid, oid, page, number, &add,
+            sizeof(add));
+}
+
+/*
+ * Step getval for (page, number), comparing the value to cmp in place in
+ * the row and copying what fits of it into buf.
+ *
+ * returns:
+ * -ENOENT: attribute not found
+ * -EOVERFLOW: value longer than buflen, len and match are set
+ * OSD_ERROR: some other error
+ * OSD_OK: success, len and match are set
+ */
+static int attr_cmp_val(struct db_context *dbc, uint64_t pid, uint64_t oid,
+        uint32_t page, uint32_t number, const void *cmp, uint16_t cmp_len,
+        void *buf, uint32_t buflen, uint16_t *len, int *match)
+{
+    int ret = 0;
+    int bound = 0;
+    int found = 0;
+    const void *val = NULL;
+    sqlite3_stmt *stmt = NULL;
+
+repeat:
+    ret = 0;
+    found = 0;
+    stmt = dbc->attr->getval;
+    ret |= sqlite3_bind_int64(stmt, 1, pid);
+    ret |= sqlite3_bind_int64(stmt, 2, oid);
+    ret |= sqlite3_bind_int(stmt, 3, page);
+    ret |= sqlite3_bind_int(stmt, 4, number);
+    bound = (ret == SQLITE_OK);
+    if (!bound) {
+        error_sql(dbc->db, "%s: bind failed", __func__);
+        goto out_reset;
+    }
+
+    do {
+        ret = sqlite3_step(stmt);
+    } while (ret == SQLITE_BUSY);
+    if (ret == SQLITE_ROW) {
+        found = 1;
+        val = sqlite3_column_blob(stmt, 0);
+        *len = sqlite3_column_bytes(stmt, 0);
+        *match = (*len == cmp_len &&
+                (cmp_len == 0 || memcmp(val, cmp, cmp_len) == 0));
+        memcpy(buf, val, min((uint32_t)*len, buflen));
+    }
+
+out_reset:
+    ret = db_reset_stmt(dbc, stmt, bound, __func__);
+    if (ret == OSD_REPEAT)
+        goto repeat;
+    if (ret != OSD_OK)
+        return ret;
+    if (!found)
+        return -ENOENT;
+    return (*len > buflen ? -EOVERFLOW : OSD_OK);
+}
+
+/*
+ * Compare and swap an attribute of any length: swap holds the new value,
+ * or with swap_len 0 the attribute is deleted if it matches cmp. An
+ * absent attribute is always set. The matching case is one conditional
+ * UPDATE; otherwise the stored value is compared where it lies in the row.
+ * orig receives the value before the operation without an intermediate
+ * copy.
+ *
+ * returns:
+ * -EOVERFLOW: operation done, but the value does not fit in orig_max
+ * OSD_ERROR: some other error
+ * OSD_OK: success, orig_len is 0 if the attribute was absent
+ */
+int attr_gen_cas(void *ohandle, uint64_t pid, uint64_t oid, uint32_t page,
+        uint32_t number, const void *cmp, uint16_t cmp_len,
+        const void *swap, uint16_t swap_len, void *orig,
+        uint32_t orig_max, uint16_t *orig_len)
+{
+    int ret = 0;
+    int err = 0;
+    int match = 0;
+    sqlite3_stmt *stmt = NULL;
+    struct db_context *dbc = db_shard(ohandle, pid);
+
+    assert(dbc && dbc->db && dbc->attr && dbc->attr->cas && orig &&
+            orig_len);
+
+    if (swap_len > 0) {
+repeat:
+        ret = 0;
+        stmt = dbc->attr->cas;
+        ret |= sqlite3_bind_int64(stmt, 1, pid);
+        ret |= sqlite3_bind_int64(stmt, 2, oid);
+        ret |= sqlite3_bind_int(stmt, 3, page);
+        ret |= sqlite3_bind_int(stmt, 4, number);
+        ret |= sqlite3_bind_blob(stmt, 5, (cmp_len ? cmp : ""), cmp_len,
+                SQLITE_STATIC);
+        ret |= sqlite3_bind_blob(stmt, 6, swap, swap_len, SQLITE_STATIC);
+        ret = db_exec_dms(dbc, stmt, ret, __func__);
+        if (ret == OSD_REPEAT)
+            goto repeat;
+        if (ret != OSD_OK)
+            return ret;
+        if (sqlite3_changes(dbc->db) > 0) {
+            *orig_len = cmp_len;
+            if (cmp_len > orig_max)
+                return -EOVERFLOW;
+            memcpy(orig, cmp, cmp_len);
+            return OSD_OK;
+        }
+    }
+
+    ret = attr_cmp_val(dbc, pid, oid, page, number, cmp, cmp_len, orig,
+            orig_max, orig_len, &match);
+    if (ret == -ENOENT) {
+        *orig_len = 0;
+        if (swap_len == 0)
+            return OSD_OK;
+        return _attr_set_attr(ohandle, pid, oid, page, number, swap,
+                swap_len);
+    }
+    if (ret != OSD_OK && ret != -EOVERFLOW)
+        return ret;
+
+    /* a swap that matched was done by the UPDATE */
+    if (swap_len == 0 && match) {
+        err = attr_delete_attr(ohandle, pid, oid, page, number);
+        if (err != OSD_OK)
+            return err;
+    }
+    return ret;
+}
+
 /*
  * get one page in list format
  *
@@ -825,7 +1332,8 @@ int attr_get_page_as_list(void *ohandle, uint64_t pid, uint64_t oid,
 {
     int ret = 0;
     sqlite3_stmt *stmt = NULL;
-    struct db_context *dbc = ((struct handle*)ohandle)->dbc;
+    struct attr_virt_cursor vc;
+    struct db_context *dbc = db_shard(ohandle, pid);
 
     assert(dbc && dbc->db && dbc->attr && dbc->attr->pgaslst);
 
@@ -835,8 +1343,9 @@ repeat:
     ret |= sqlite3_bind_int64(stmt, 1, pid);
     ret |= sqlite3_bind_int64(stmt, 2, oid);
     ret |= sqlite3_bind_int(stmt, 3, page);
+    attr_virt_open(&vc, page, ATTRNUM_GETALL);
     ret = exec_attr_rtrvl_stmt(dbc, stmt, ret, __func__, oid, 0, 
-            GATHER_ATTR, outlen, outdata, listfmt,
+            GATHER_ATTR, outlen, outdata, listfmt, &vc,
             used_outlen); 
     if (ret == OSD_REPEAT) {
         goto repeat;
@@ -866,7 +1375,8 @@ int attr_get_for_all_pages(void *ohandle, uint64_t pid, uint64_t oid,
 {
     int ret = 0;
     sqlite3_stmt *stmt = NULL;
-    struct db_context *dbc = ((struct handle*)ohandle)->dbc;
+    struct attr_virt_cursor vc;
+    struct db_context *dbc = db_shard(ohandle, pid);
 
     assert(dbc && dbc->db && dbc->attr && dbc->attr->forallpg);
 
@@ -876,8 +1386,9 @@ repeat:
     ret |= sqlite3_bind_int64(stmt, 1, pid);
     ret |= sqlite3_bind_int64(stmt, 2, oid);
     ret |= sqlite3_bind_int(stmt, 3, number);
+    attr_virt_open(&vc, GETALLATTR_PG, number);
     ret = exec_attr_rtrvl_stmt(dbc, stmt, ret, __func__, oid, 0,
-            GATHER_ATTR, outlen, outdata, listfmt,
+            GATHER_ATTR, outlen, outdata, listfmt, &vc,
             used_outlen);
     if (ret == OSD_REPEAT) {
         goto repeat;
@@ -908,7 +1419,8 @@ int attr_get_all_attrs(void *ohandle, uint64_t pid, uint64_t oid,
 {
     int ret = 0;
     sqlite3_stmt *stmt = NULL;
-    struct db_context *dbc = ((struct handle*)ohandle)->dbc;
+    struct attr_virt_cursor vc;
+    struct db_context *dbc = db_shard(ohandle, pid);
 
     assert(dbc && dbc->db && dbc->attr && dbc->attr->getall);
 
@@ -917,8 +1429,9 @@ repeat:
     stmt = dbc->attr->getall;
     ret |= sqlite3_bind_int64(stmt, 1, pid);
     ret |= sqlite3_bind_int64(stmt, 2, oid);
+    attr_virt_open(&vc, GETALLATTR_PG, ATTRNUM_GETALL);
     ret = exec_attr_rtrvl_stmt(dbc, stmt, ret, __func__, oid, 0,
-            GATHER_ATTR, outlen, outdata, listfmt,
+            GATHER_ATTR, outlen, outdata, listfmt, &vc,
             used_outlen);
     if (ret == OSD_REPEAT) {
         goto repeat;
@@ -946,7 +1459,8 @@ int attr_get_dir_page(void *ohandle, uint64_t pid, uint64_t oid,
 {
     int ret = 0;
     sqlite3_stmt *stmt = NULL;
-    struct db_context *dbc = ((struct handle*)ohandle)->dbc;
+    struct attr_virt_cursor vc;
+    struct db_context *dbc = db_shard(ohandle, pid);
 
     assert(dbc && dbc->db && dbc->attr && dbc->attr->dirpage);
 
@@ -956,12 +1470,11 @@ int attr_get_dir_page(void *ohandle, uint64_t pid, uint64_t oid,
 repeat:
     ret = 0;
     stmt = dbc->attr->dirpage;
-    ret |= sqlite3_bind_blob(stmt, 1, unid_page, sizeof(unid_page), 
-            SQLITE_TRANSIENT);
-    ret |= sqlite3_bind_int64(stmt, 2, pid);
-    ret |= sqlite3_bind_int64(stmt, 3, oid);
+    ret |= sqlite3_bind_int64(stmt, 1, pid);
+    ret |= sqlite3_bind_int64(stmt, 2, oid);
+    attr_virt_open_dir(&vc, page);
     ret = exec_attr_rtrvl_stmt(dbc, stmt, ret, __func__, oid, page,
-            GATHER_DIR_PAGE, outlen, outdata, listfmt,
+            GATHER_DIR_PAGE, outlen, outdata, listfmt, &vc,
             used_outlen);
     if (ret == OSD_REPEAT) {
         goto repeat;
@@ -972,6 +1485,156 @@ repeat:
     return ret;
 }
 
+/*
+ * Retrieve a list of attributes of the objects [oid, oid+numoid) in one
+ * pass. Entries flagged in indb are plain (page, number) lookups and are
+ * all fetched by a single query, ordered the same way the list is encoded:
+ * entry-major, then by oid. Slots without a row, and entries not flagged
+ * in indb, are handed to fill, so the output is produced in list order by
+ * one encoder pass.
+ *
+ * returns:
+ * -EINVAL: invalid arg
+ * -ENOMEM: out of memory
+ * OSD_ERROR: some other error
+ * >0: error returned by fill
+ * OSD_OK: success, used_outlen modified
+ */
+int attr_get_attr_list(void *ohandle, uint64_t pid, uint64_t oid,
+        uint16_t numoid, const struct getattr_list *ga, const uint8_t *indb,
+        attr_fill_t fill, void *arg, uint64_t outlen, void *outdata,
+        uint8_t listfmt, uint32_t *used_outlen)
+{
+    int ret = 0;
+    int row = 0;
+    int pos = 0;
+    uint32_t i = 0;
+    uint32_t ndb = 0;
+    uint32_t used = 0;
+    uint32_t ridx = 0;
+    uint64_t o = 0;
+    uint64_t roid = 0;
+    uint8_t *cp = outdata;
+    char *SQL = NULL;
+    char *sp = NULL;
+    sqlite3_stmt *stmt = NULL;
+    struct db_context *dbc = db_shard(ohandle, pid);
+
+    assert(dbc && dbc->db && dbc->attr && ga && indb && fill);
+
+    if (listfmt != RTRVD_SET_ATTR_LIST &&
+            listfmt != RTRVD_CREATE_MULTIOBJ_LIST)
+        return -EINVAL;
+
+    for (i = 0; i < ga->sz; i++)
+        if (indb[i])
+            ndb++;
+
+    if (ndb > 0) {
+        SQL = Malloc(MAXSQLEN + ndb * 32);
+        if (!SQL)
+            return -ENOMEM;
+
+        sp = SQL;
+        sp += sprintf(sp, "WITH q(idx, page, number) AS (VALUES ");
+        for (i = 0, pos = 0; i < ga->sz; i++) {
+            if (!indb[i])
+                continue;
+            sp += sprintf(sp, "%s(%u, ?, ?)", (pos++ ? ", " : ""), i);
+        }
+        sp += sprintf(sp, "), o(oid) AS (SELECT ? UNION ALL SELECT oid + 1 "
+                " FROM o WHERE oid < ?) SELECT q.idx, a.oid, a.value "
+                " FROM q, o, %s AS a WHERE a.pid = ? AND a.oid = o.oid AND "
+                " a.page = q.page AND a.number = q.number "
+                " ORDER BY q.idx, a.oid;", dbc->attr->name);
+
+        ret = sqlite3_prepare(dbc->db, SQL, -1, &stmt, NULL);
+        if (ret != SQLITE_OK) {
+            error_sql(dbc->db, "%s: prepare", __func__);
+            ret = OSD_ERROR;
+            goto out;
+        }
+
+        pos = 1;
+        ret = 0;
+        for (i = 0; i < ga->sz; i++) {
+            if (!indb[i])
+                continue;
+            ret |= sqlite3_bind_int(stmt, pos++, ga->le[i].page);
+            ret |= sqlite3_bind_int(stmt, pos++, ga->le[i].number);
+        }
+        ret |= sqlite3_bind_int64(stmt, pos++, oid);
+        ret |= sqlite3_bind_int64(stmt, pos++, oid + numoid - 1);
+        ret |= sqlite3_bind_int64(stmt, pos++, pid);
+        if (ret != SQLITE_OK) {
+            error_sql(dbc->db, "%s: bind", __func__);
+            ret = OSD_ERROR;
+            goto out_finalize;
+        }
+    }
+
+    row = 0;
+    if (stmt) {
+        while ((ret = sqlite3_step(stmt)) == SQLITE_BUSY);
+        if (ret == SQLITE_ROW) {
+            row = 1;
+            ridx = sqlite3_column_int(stmt, 0);
+            roid = sqlite3_column_int64(stmt, 1);
+        } else if (ret != SQLITE_DONE) {
+            goto out_step_err;
+        }
+    }
+
+    *used_outlen = 0;
+    for (i = 0; i < ga->sz; i++) {
+        for (o = oid; o < oid + numoid; o++) {
+            if (row && ridx == i && roid == o) {
+                uint16_t len = sqlite3_column_bytes(stmt, 2);
+                const void *val = sqlite3_column_blob(stmt, 2);
+
+                if (listfmt == RTRVD_SET_ATTR_LIST)
+                    ret = le_pack_attr(cp, outlen, ga->le[i].page,
+                            ga->le[i].number, len, val);
+                else
+                    ret = le_multiobj_pack_attr(cp, outlen, o,
+                            ga->le[i].page, ga->le[i].number, len, val);
+                if (ret == -EINVAL)
+                    goto out_finalize;
+                used = (ret > 0) ? ret : 0;
+
+                while ((ret = sqlite3_step(stmt)) == SQLITE_BUSY);
+                if (ret == SQLITE_ROW) {
+                    ridx = sqlite3_column_int(stmt, 0);
+                    roid = sqlite3_column_int64(stmt, 1);
+                } else if (ret == SQLITE_DONE) {
+                    row = 0;
+                } else {
+                    goto out_step_err;
+                }
+            } else {
+                ret = fill(arg, i, o, cp, outlen, &used);
+                if (ret != OSD_OK)
+                    goto out_finalize;
+            }
+            cp += used;
+            outlen -= used;
+            *used_outlen += used;
+        }
+    }
+    ret = OSD_OK;
+    goto out_finalize;
+
+out_step_err:
+    error_sql(dbc->db, "%s: step", __func__);
+    ret = OSD_ERROR;
+out_finalize:
+    if (stmt && sqlite3_finalize(stmt) != SQLITE_OK)
+        error_sql(dbc->db, "%s: finalize", __func__);
+out:
+    free(SQL);
+    return ret;
+}
+
 int attr_get_conversion(void *ohandle, uint64_t pid, uint64_t oid,
         uint32_t page, uint32_t number, uint64_t outlen,
         void *outdata, uint8_t listfmt, uint32_t *used_outlen)
@@ -992,3 +1655,192 @@ int attr_set_conversion(void *ohandle, uint64_t pid, uint64_t oid,
 
     return _attr_set_attr(ohandle, pid, oid, page, number, val, len);
 }
+
+/*
+ * Bring the value indexes on attr of one shard in line with the declared
+ * (page, number) pairs in at, see attr_sync_query_idx.
+ *
+ * returns:
+ * -ENOMEM: out of memory
+ * OSD_ERROR: some other error
+ * OSD_OK: success
+ */
+static int attr_sync_shard_idx(struct db_context *dbc,
+        const struct attr_types *at)
+{
+    int ret = 0;
+    int nf = 0;
+    uint32_t i = 0;
+    uint32_t page = 0;
+    uint32_t number = 0;
+    uint32_t type = 0;
+    char *SQL = NULL;
+    char *err = NULL;
+    sqlite3_stmt *stmt = NULL;
+
+    assert(dbc && dbc->db);
+
+    /* collect indexes no longer declared; they are dropped after the scan */
+    ret = sqlite3_prepare(dbc->db, "SELECT name FROM sqlite_master WHERE "
+            " type = 'index' AND tbl_name = 'attr' AND name LIKE 'qidx_%';",
+            -1, &stmt, NULL);
+    if (ret != SQLITE_OK) {
+        error_sql(dbc->db, "%s: prepare", __func__);
+        goto out_err;
+    }
+    SQL = sqlite3_mprintf("");
+    while (SQL && (ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+        const char *name = (const char *)sqlite3_column_text(stmt, 0);
+        char *p = NULL;
+
+        /* a typed index has the type in its name, a blob one has none */
+        type = ROOT_QUERY_BLOB;
+        nf = sscanf(name, "qidx_%u_%u_%u", &page, &number, &type);
+        for (i = 0; nf >= 2 && i < at->n; i++)
+            if (at->ent[i].page == page && at->ent[i].number == number)
+                break;
+        if (nf >= 2 && i < at->n && at->ent[i].type == type &&
+                (nf == 3) == (type != ROOT_QUERY_BLOB))
+            continue;
+        p = sqlite3_mprintf("%sDROP INDEX %s;", SQL, name);
+        sqlite3_free(SQL);
+        SQL = p;
+    }
+    if (!SQL) {
+        ret = -ENOMEM;
+        goto out;
+    }
+    if (ret != SQLITE_DONE) {
+        error_sql(dbc->db, "%s: step", __func__);
+        goto out_err;
+    }
+    sqlite3_finalize(stmt);
+    stmt = NULL;
+
+    /* page and number are stored through sqlite3_bind_int, hence %d */
+    for (i = 0; i < at->n; i++) {
+        char *p = NULL;
+
+        if (at->ent[i].type == ROOT_QUERY_BLOB)
+            p = sqlite3_mprintf("%sCREATE INDEX IF NOT EXISTS qidx_%u_%u "
+                    " ON attr (pid, value) WHERE page = %d AND number = %d;",
+                    SQL, at->ent[i].page, at->ent[i].number,
+                    (int32_t)at->ent[i].page, (int32_t)at->ent[i].number);
+        else
+            p = sqlite3_mprintf("%sCREATE INDEX IF NOT EXISTS qidx_%u_%u_%u "
+                    " ON attr (pid, osd_qkey(value, %u), value) WHERE "
+                    " page = %d AND number = %d;", SQL, at->ent[i].page,
+                    at->ent[i].number, at->ent[i].type, at->ent[i].type,
+                    (int32_t)at->ent[i].page, (int32_t)at->ent[i].number);
+        sqlite3_free(SQL);
+        SQL = p;
+        if (!SQL) {
+            ret = -ENOMEM;
+            goto out;
+        }
+    }
+
+    ret = sqlite3_exec(dbc->db, SQL, NULL, NULL, &err);
+    if (ret != SQLITE_OK) {
+        osd_error("%s: %s failed: %s", __func__, SQL, err);
+        sqlite3_free(err);
+        goto out_err;
+    }
+    ret = OSD_OK;
+    goto out;
+
+out_err:
+    ret = OSD_ERROR;
+out:
+    if (stmt)
+        sqlite3_finalize(stmt);
+    sqlite3_free(SQL);
+    return ret;
+}
+
+/*
+ * Bring the value indexes on attr in line with the (page, number) pairs
+ * declared in ROOT_QUERY_PG of the root object, and the types of the
+ * handle with their declared types. Each declared pair gets a partial
+ * index covering only its rows, which mtq_run_query picks up through its
+ * bound page and number terms: qidx_<page>_<number> on (pid, value) for
+ * a blob, qidx_<page>_<number>_<type> on (pid, osd_qkey(value, type),
+ * value) for a typed pair. The trailing value makes the typed index
+ * covering; the planner passes it over for the attr primary key
+ * otherwise. Indexes of pairs no longer declared, or declared with
+ * another type, are dropped, so attributes nobody queries carry no index
+ * maintenance on write. The root is in shard 0, the indexes are made in
+ * every shard; osd_open_backend calls this on every open, which redoes
+ * what a crash between the commits of the shards left undone, see
+ * osd_db_end_txn.
+ *
+ * returns:
+ * -ENOMEM: out of memory
+ * OSD_ERROR: some other error
+ * OSD_OK: success
+ */
+int attr_sync_query_idx(void *ohandle)
+{
+    int i = 0;
+    int ret = 0;
+    sqlite3_stmt *stmt = NULL;
+    struct attr_types *at = NULL;
+    struct handle *h = ohandle;
+    struct db_context *dbc = h->dbc;
+
+    assert(dbc && dbc->db);
+
+    at = Calloc(1, sizeof(*at));
+    if (!at)
+        return -ENOMEM;
+
+    ret = sqlite3_prepare(dbc->db, "SELECT value FROM attr WHERE pid = ? "
+            " AND oid = ? AND page = ? AND number != 0;", -1, &stmt, NULL);
+    if (ret != SQLITE_OK) {
+        error_sql(dbc->db, "%s: prepare", __func__);
+        attr_types_free(at);
+        return OSD_ERROR;
+    }
+    ret = 0;
+    ret |= sqlite3_bind_int64(stmt, 1, ROOT_PID);
+    ret |= sqlite3_bind_int64(stmt, 2, ROOT_OID);
+    ret |= sqlite3_bind_int(stmt, 3, ROOT_QUERY_PG);
+    if (ret != SQLITE_OK) {
+        error_sql(dbc->db, "%s: bind", __func__);
+        goto out_err;
+    }
+    while ((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+        /* anything but a declaration is skipped */
+        if (attr_types_add(at, sqlite3_column_blob(stmt, 0),
+                    sqlite3_column_bytes(stmt, 0)) == -ENOMEM) {
+            ret = -ENOMEM;
+            goto out;
+        }
+    }
+    if (ret != SQLITE_DONE) {
+        error_sql(dbc->db, "%s: step", __func__);
+        goto out_err;
+    }
+    sqlite3_finalize(stmt);
+    stmt = NULL;
+
+    for (i = 0; i < h->nshard; i++) {
+        ret = attr_sync_shard_idx(h->shard[i], at);
+        if (ret != OSD_OK)
+            goto out;
+    }
+
+    attr_types_free(h->qtypes);
+    h->qtypes = at;
+    at = NULL;
+    ret = OSD_OK;
+    goto out;
+
+out_err:
+    ret = OSD_ERROR;
+out:
+    if (stmt)
+        sqlite3_finalize(stmt);
+    attr_types_free(at);
+    return ret;
+}
@@ -24,6 +24,8 @@ int attr_initialize(void *dbc);
 
 int attr_finalize(void *dbc);
 
+int attr_create_functions(void *dbc);
+
 const char *attr_getname(void *o_handle);
 
 int attr_set_conversion(void* o_handle, uint64_t pid, uint64_t oid, 
@@ -40,6 +42,10 @@ int attr_delete_attr(void *o_handle, uint64_t pid, uint64_t oid,
 
 int attr_delete_all(void *o_handle, uint64_t pid, uint64_t oid);
 
+int attr_set_attr_list(void *o_handle, uint64_t pid, uint64_t oid,
+		       uint16_t numoid, const struct list_entry *le,
+		       uint32_t sz);
+
 int attr_get_conversion(void *o_handle, uint64_t pid, uint64_t oid, uint32_t page,
 		  uint32_t number, uint64_t outlen, void *outdata, uint8_t listfmt,
                   uint32_t *used_outlen);
@@ -57,6 +63,17 @@ int attr_get_val(void *o_handle, uint64_t pid, uint64_t oid,
 		 uint32_t page, uint32_t number, uint64_t outlen,
 		 void *outdata, uint32_t *used_outlen);
 
+int attr_cas(void *o_handle, uint64_t pid, uint64_t oid, uint32_t page,
+	     uint32_t number, uint64_t cmp, uint64_t swap, uint64_t *orig);
+
+int attr_fa(void *o_handle, uint64_t pid, uint64_t oid, uint32_t page,
+	    uint32_t number, int64_t add, uint64_t *orig);
+
+int attr_gen_cas(void *o_handle, uint64_t pid, uint64_t oid, uint32_t page,
+		 uint32_t number, const void *cmp, uint16_t cmp_len,
+		 const void *swap, uint16_t swap_len, void *orig,
+		 uint32_t orig_max, uint16_t *orig_len);
+
 int attr_get_page_as_list(void *o_handle, uint64_t pid, uint64_t oid,
 			  uint32_t page, uint64_t outlen, void *outdata,
 			  uint8_t listfmt, uint32_t *used_outlen);
@@ -69,8 +86,24 @@ int attr_get_all_attrs(void *o_handle, uint64_t pid, uint64_t oid,
 		       uint64_t outlen, void *outdata, uint8_t listfmt, 
 		       uint32_t *used_outlen);
 
+/*
+ * Called by attr_get_attr_list for list slots it cannot serve from the attr
+ * table. Packs entry idx of oid into buf and sets *used, returns OSD_OK or
+ * the error to abort with.
+ */
+typedef int (*attr_fill_t)(void *arg, uint32_t idx, uint64_t oid,
+			   uint8_t *buf, uint32_t buflen, uint32_t *used);
+
+int attr_get_attr_list(void *o_handle, uint64_t pid, uint64_t oid,
+		       uint16_t numoid, const struct getattr_list *ga,
+		       const uint8_t *indb, attr_fill_t fill, void *arg,
+		       uint64_t outlen, void *outdata, uint8_t listfmt,
+		       uint32_t *used_outlen);
+
 int attr_get_dir_page(void *o_handle, uint64_t pid, uint64_t oid, 
 		      uint32_t page, uint64_t outlen, void *outbuf,
 		      uint8_t listfmt, uint32_t *used_outlen);
 
+int attr_sync_query_idx(void *o_handle);
+
 #endif /* __ATTR_H */
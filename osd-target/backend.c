@@ -0,0 +1,136 @@
+/*
+ * Backend registry.
+ *
+ * Copyright (C) 2007 OSD Team <pvfs-osd@osc.edu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "osd.h"
+#include "osd-types.h"
+#include "osd-util/osd-util.h"
+#include "backend.h"
+
+/* backends linked into this build, the first one is the default */
+static const struct osd_backend *backends[] = {
+#ifdef __PANASAS_OSD__
+	&pan_backend,
+#else
+	&sqlite_backend,
+	&kv_backend,
+#endif
+};
+
+/*
+ * Find a backend by name. A NULL name picks the one named by the
+ * OSD_BACKEND environment variable, or the default if that is unset.
+ *
+ * returns:
+ * NULL: no such backend in this build
+ * otherwise the backend
+ */
+const struct osd_backend *osd_backend_lookup(const char *name)
+{
+	int i = 0;
+
+	if (name == NULL)
+		name = getenv("OSD_BACKEND");
+	if (name == NULL || name[0] == '\0')
+		return backends[0];
+
+	for (i = 0; i < ARRAY_SIZE(backends); i++)
+		if (strcmp(backends[i]->name, name) == 0)
+			return backends[i];
+
+	osd_error("%s: no backend named %s", __func__, name);
+	return NULL;
+}
+
+/*
+ * The backend that made the LUN at root is named in the file backendname
+ * there, since nothing else on disk tells the stores apart and one
+ * backend finds no metadata in the store of another. Checked before the
+ * backend opens root, recorded once it has.
+ *
+ * returns:
+ * -EINVAL: root was made by another backend
+ * -errno: the record could not be read
+ * OSD_OK: success, also for a root without a record
+ */
+int osd_backend_check(const char *root, const struct osd_backend *be)
+{
+	int ret = 0;
+	FILE *fp = NULL;
+	char path[MAXNAMELEN];
+	char name[64];
+
+	if (snprintf(path, sizeof(path), "%s/%s", root,
+		     backendname) >= (int)sizeof(path))
+		return -ENAMETOOLONG;
+	fp = fopen(path, "r");
+	if (!fp)
+		return errno == ENOENT ? OSD_OK : -errno;
+	if (!fgets(name, sizeof(name), fp))
+		name[0] = '\0';
+	fclose(fp);
+	name[strcspn(name, "\n")] = '\0';
+
+	if (strcmp(name, be->name) != 0) {
+		osd_error("%s: %s belongs to backend %s, not %s", __func__,
+			  root, name, be->name);
+		ret = -EINVAL;
+	}
+	return ret;
+}
+
+/*
+ * Name be in the record of root if there is none yet; written aside and
+ * renamed, so that a crash leaves no partial name.
+ *
+ * returns:
+ * -errno: the record could not be written
+ * OSD_OK: success
+ */
+int osd_backend_record(const char *root, const struct osd_backend *be)
+{
+	int ret = 0;
+	FILE *fp = NULL;
+	char path[MAXNAMELEN];
+	char tmp[MAXNAMELEN + 4];
+
+	if (snprintf(path, sizeof(path), "%s/%s", root,
+		     backendname) >= (int)sizeof(path))
+		return -ENAMETOOLONG;
+	if (access(path, F_OK) == 0)
+		return OSD_OK;
+
+	sprintf(tmp, "%s.new", path);
+	fp = fopen(tmp, "w");
+	if (!fp) {
+		ret = -errno;
+		osd_error("%s: open %s: %m", __func__, tmp);
+		return ret;
+	}
+	fprintf(fp, "%s\n", be->name);
+	if (fclose(fp) != 0 || rename(tmp, path) != 0) {
+		ret = -errno;
+		osd_error("%s: write %s: %m", __func__, path);
+		unlink(tmp);
+	}
+	return ret;
+}
@@ -0,0 +1,217 @@
+/*
+ * Metadata and data backends.
+ *
+ * Copyright (C) 2007 OSD Team <pvfs-osd@osc.edu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __BACKEND_H
+#define __BACKEND_H
+
+#include "osd-types.h"
+#include "attr.h"
+
+/*
+ * Operations a backend provides to the command layer in osd.c. A backend
+ * is bound to an osd_device by osd_open and every obj, attr, coll, mtq and
+ * data file access of the commands goes through osd->be. Members carry
+ * the names of the functions they stand for, with the same signatures,
+ * so a backend can fill the table with its existing functions.
+ */
+struct osd_backend {
+	const char *name;
+
+	/* lifecycle and transactions */
+	int (*open)(const char *root, struct osd_device *osd);
+	int (*close)(struct osd_device *osd);
+	int (*begin_txn)(struct osd_device *osd);
+	int (*end_txn)(struct osd_device *osd);
+	/* hand free metadata space back, see osd_vacuum */
+	int (*vacuum)(void *ohandle, int idle);
+	void (*vacuum_stats)(void *ohandle, struct vacuum_stats *vs);
+	void (*cache_stats)(void *ohandle, struct tune_stats *ts);
+
+	/* objects */
+	int (*obj_insert)(void *ohandle, uint64_t pid, uint64_t oid,
+			  uint32_t type);
+	int (*obj_insert_range)(void *ohandle, uint64_t pid, uint64_t oid,
+				uint16_t numoid, uint32_t type);
+	int (*obj_delete)(void *ohandle, uint64_t pid, uint64_t oid);
+	int (*obj_get_nextoid)(void *ohandle, uint64_t pid, uint64_t *oid);
+	int (*obj_get_nextpid)(void *ohandle, uint64_t *pid);
+	int (*obj_ispresent)(void *ohandle, char *root, uint64_t pid,
+			     uint64_t oid, int *present);
+	int (*obj_isempty_pid)(void *ohandle, char *root, uint64_t pid,
+			       int *isempty);
+	int (*obj_get_type)(void *ohandle, uint64_t pid, uint64_t oid,
+			    uint8_t *obj_type);
+	/*
+	 * The list functions here and below take in *add_len the length of
+	 * the list from initial_oid on when a continued LIST knows it, 0
+	 * otherwise. When it is known they stop at the first id that does
+	 * not fit instead of counting the rest, and hand it back.
+	 */
+	int (*obj_get_oids_in_pid)(void *ohandle, uint64_t pid,
+				   uint64_t initial_oid, uint64_t alloc_len,
+				   uint8_t *outdata, uint64_t *used_outlen,
+				   uint64_t *add_len, uint64_t *cont_id);
+	int (*obj_get_cids_in_pid)(void *ohandle, uint64_t pid,
+				   uint64_t initial_cid, uint64_t alloc_len,
+				   uint8_t *outdata, uint64_t *used_outlen,
+				   uint64_t *add_len, uint64_t *cont_id);
+	int (*obj_get_all_pids)(void *ohandle, uint64_t initial_oid,
+				uint64_t alloc_len, uint8_t *outdata,
+				uint64_t *used_outlen, uint64_t *add_len,
+				uint64_t *cont_id);
+
+	/* attributes */
+	int (*attr_set_attr)(struct osd_device *osd, uint64_t pid,
+			     uint64_t oid, uint32_t page, uint32_t number,
+			     const void *val, uint16_t len);
+	int (*_attr_set_attr)(void *ohandle, uint64_t pid, uint64_t oid,
+			      uint32_t page, uint32_t number, const void *val,
+			      uint16_t len);
+	int (*attr_set_conversion)(void *ohandle, uint64_t pid, uint64_t oid,
+				   uint32_t page, uint32_t number,
+				   const void *val, uint16_t len);
+	int (*attr_set_attr_list)(void *ohandle, uint64_t pid, uint64_t oid,
+				  uint16_t numoid, const struct list_entry *le,
+				  uint32_t sz);
+	int (*attr_delete_attr)(void *ohandle, uint64_t pid, uint64_t oid,
+				uint32_t page, uint32_t number);
+	int (*attr_delete_all)(void *ohandle, uint64_t pid, uint64_t oid);
+	int (*attr_get_attr)(struct osd_device *osd, uint64_t pid,
+			     uint64_t oid, uint32_t page, uint32_t number,
+			     uint64_t outlen, void *outdata, uint8_t listfmt,
+			     uint32_t *used_outlen);
+	int (*attr_get_conversion)(void *ohandle, uint64_t pid, uint64_t oid,
+				   uint32_t page, uint32_t number,
+				   uint64_t outlen, void *outdata,
+				   uint8_t listfmt, uint32_t *used_outlen);
+	int (*attr_get_val)(void *ohandle, uint64_t pid, uint64_t oid,
+			    uint32_t page, uint32_t number, uint64_t outlen,
+			    void *outdata, uint32_t *used_outlen);
+	int (*attr_cas)(void *ohandle, uint64_t pid, uint64_t oid,
+			uint32_t page, uint32_t number, uint64_t cmp,
+			uint64_t swap, uint64_t *orig);
+	int (*attr_fa)(void *ohandle, uint64_t pid, uint64_t oid,
+		       uint32_t page, uint32_t number, int64_t add,
+		       uint64_t *orig);
+	int (*attr_gen_cas)(void *ohandle, uint64_t pid, uint64_t oid,
+			    uint32_t page, uint32_t number, const void *cmp,
+			    uint16_t cmp_len, const void *swap,
+			    uint16_t swap_len, void *orig, uint32_t orig_max,
+			    uint16_t *orig_len);
+	int (*attr_get_page_as_list)(void *ohandle, uint64_t pid,
+				     uint64_t oid, uint32_t page,
+				     uint64_t outlen, void *outdata,
+				     uint8_t listfmt, uint32_t *used_outlen);
+	int (*attr_get_for_all_pages)(void *ohandle, uint64_t pid,
+				      uint64_t oid, uint32_t number,
+				      uint64_t outlen, void *outdata,
+				      uint8_t listfmt, uint32_t *used_outlen);
+	int (*attr_get_all_attrs)(void *ohandle, uint64_t pid, uint64_t oid,
+				  uint64_t outlen, void *outdata,
+				  uint8_t listfmt, uint32_t *used_outlen);
+	int (*attr_get_attr_list)(void *ohandle, uint64_t pid, uint64_t oid,
+				  uint16_t numoid,
+				  const struct getattr_list *ga,
+				  const uint8_t *indb, attr_fill_t fill,
+				  void *arg, uint64_t outlen, void *outdata,
+				  uint8_t listfmt, uint32_t *used_outlen);
+	int (*attr_get_dir_page)(void *ohandle, uint64_t pid, uint64_t oid,
+				 uint32_t page, uint64_t outlen, void *outbuf,
+				 uint8_t listfmt, uint32_t *used_outlen);
+	int (*attr_sync_query_idx)(void *ohandle);
+
+	/* collections */
+	int (*coll_insert)(void *ohandle, uint64_t pid, uint64_t cid,
+			   uint64_t oid, uint32_t number);
+	int (*coll_delete)(void *ohandle, uint64_t pid, uint64_t cid,
+			   uint64_t oid);
+	int (*coll_delete_cid)(void *ohandle, uint64_t pid, uint64_t cid);
+	int (*coll_delete_oid)(void *ohandle, uint64_t pid, uint64_t oid);
+	int (*coll_isempty_cid)(void *ohandle, uint64_t pid, uint64_t cid,
+				int *isempty);
+	int (*coll_get_cid)(void *ohandle, uint64_t pid, uint64_t oid,
+			    uint32_t number, uint64_t *cid);
+	int (*coll_get_oids_in_cid)(void *ohandle, uint64_t pid, uint64_t cid,
+				    uint64_t initial_oid, uint64_t alloc_len,
+				    uint8_t *outdata, uint64_t *used_outlen,
+				    uint64_t *add_len, uint64_t *cont_id);
+	int (*coll_copyoids)(void *ohandle, uint64_t pid, uint64_t dest_cid,
+			     uint64_t source_cid);
+
+	/* multi-table queries */
+	int (*mtq_run_query)(void *ohandle, uint64_t pid, uint64_t cid,
+			     struct query_criteria *qc, void *outdata,
+			     uint32_t alloc_len, uint64_t *used_outlen);
+	int (*mtq_list_oids_attr)(void *ohandle, uint64_t pid,
+				  uint64_t initial_oid,
+				  struct getattr_list *get_attr,
+				  uint64_t alloc_len, void *outdata,
+				  uint64_t *used_outlen, uint64_t *add_len,
+				  uint64_t *cont_id);
+	int (*mtq_list_members_attr)(void *ohandle, uint64_t pid,
+				     uint64_t cid, uint64_t initial_oid,
+				     struct getattr_list *get_attr,
+				     uint64_t alloc_len, void *outdata,
+				     uint64_t *used_outlen, uint64_t *add_len,
+				     uint64_t *cont_id);
+	int (*mtq_set_member_attrs)(void *ohandle, uint64_t pid, uint64_t cid,
+				    struct setattr_list *set_attr);
+	/* hands back the removed members in *oids, to be freed */
+	int (*mtq_remove_members)(void *ohandle, uint64_t pid, uint64_t cid,
+				  uint64_t **oids, size_t *noid);
+
+	/* data files */
+	int (*contig_read)(struct osd_device *osd, uint64_t pid, uint64_t oid,
+			   uint64_t len, uint64_t offset, uint8_t *outdata,
+			   uint64_t *used_outlen, uint8_t *sense);
+	int (*sgl_read)(struct osd_device *osd, uint64_t pid, uint64_t oid,
+			uint64_t len, uint64_t offset,
+			const struct sg_list *sglist, uint8_t *outdata,
+			uint64_t *used_outlen, uint8_t *sense);
+	int (*vec_read)(struct osd_device *osd, uint64_t pid, uint64_t oid,
+			uint64_t len, uint64_t offset, const uint8_t *indata,
+			uint8_t *outdata, uint64_t *used_outlen,
+			uint8_t *sense);
+	int (*contig_write)(struct osd_device *osd, uint64_t pid, uint64_t oid,
+			    uint64_t len, uint64_t offset,
+			    const uint8_t *dinbuf, uint8_t *sense);
+	int (*sgl_write)(struct osd_device *osd, uint64_t pid, uint64_t oid,
+			 uint64_t len, uint64_t offset, const uint8_t *dinbuf,
+			 const struct sg_list *sglist, uint8_t *sense);
+	int (*vec_write)(struct osd_device *osd, uint64_t pid, uint64_t oid,
+			 uint64_t len, uint64_t offset, const uint8_t *dinbuf,
+			 uint8_t *sense);
+	int (*osd_create_datafile)(struct osd_device *osd, uint64_t pid,
+				   uint64_t oid);
+	int (*format_osd)(struct osd_device *osd, uint64_t capacity,
+			  uint32_t cdb_cont_len, uint8_t *sense);
+};
+
+#ifdef __PANASAS_OSD__
+extern const struct osd_backend pan_backend;
+#else
+extern const struct osd_backend sqlite_backend;
+extern const struct osd_backend kv_backend;
+#endif
+
+const struct osd_backend *osd_backend_lookup(const char *name);
+
+int osd_backend_check(const char *root, const struct osd_backend *be);
+
+int osd_backend_record(const char *root, const struct osd_backend *be);
+
+#endif /* __BACKEND_H */
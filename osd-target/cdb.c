@@ -30,6 +30,7 @@
 #include "cdb.h"
 #include "osd-util/osd-util.h"
 #include "list-entry.h"
+#include "idle.h"
 
 #ifdef __DBUS_STATS__
 #include "dbus/server_stats.h"
@@ -180,203 +181,6 @@ out_invalid_param:
 	return sense_basic_build(cmd->sense, OSD_SSK_ILLEGAL_REQUEST,
 				 OSD_ASC_INVALID_FIELD_IN_CDB, pid, oid);
 }
-/*
- * TODO: proper return codes
- * returns:
- * ==0: success
- *  >0: failure, senselen is returned.
- */
-static int get_attr_list(struct command *cmd, uint64_t pid, uint64_t oid,
-			 uint8_t isembedded, uint16_t numoid, uint32_t cdb_cont_len)
-{
-	int ret = 0;
-	int err = 0;
-	int within_txn = 0;
-	uint64_t i = 0;
-	uint8_t list_type;
-	uint8_t listfmt = RTRVD_SET_ATTR_LIST;
-	uint32_t getattr_list_len = get_ntohl(&cmd->cdb[52]);
-	uint32_t list_in_len, list_len = 0;
-	uint64_t list_off = get_ntohoffset(&cmd->cdb[56]);
-	uint32_t list_alloc_len = get_ntohl(&cmd->cdb[60]);
-	const uint8_t *list_hdr = &cmd->indata[list_off];
-	uint8_t *outbuf;
-	uint8_t *cp = NULL;
-
-	if (getattr_list_len == 0)
-		return 0; /* nothing to retrieve, osd2r00 Sec 5.2.2.3 */
-
-	if (!cmd->outdata)
-		goto out_param_list_err;
-	outbuf = &cmd->outdata[cmd->retrieved_attr_off];
-
-	if (getattr_list_len != 0 && getattr_list_len < LIST_HDR_LEN)
-		goto out_param_list_err;
-
-	/* available bytes in getattr list, need at least a header */
-	list_in_len = cmd->inlen - list_off;
-	if (list_in_len < 8)
-		goto out_param_list_err;
-
-	if ((list_off & 0x7) || (list_alloc_len & 0x7))
-		goto out_param_list_err;
-
-	list_type = list_hdr[0] & 0xF;
-	if (list_type != RTRV_ATTR_LIST)
-		goto out_invalid_param_list;
-
-	list_len = getattr_list_len - 8;
-	if (list_len & 0x7) /* multiple of 8 */
-		goto out_param_list_err;
-	if (list_len + 8 < list_in_len)
-		goto out_param_list_err;
-
-	if (numoid > 1)
-		listfmt = RTRVD_CREATE_MULTIOBJ_LIST;
-	outbuf[0] = listfmt; /* fill list header */
-	outbuf[1] = outbuf[2] = outbuf[3] = 0;
-
-	err = osd_begin_txn(cmd->osd);
-	assert(err == 0);
-	within_txn = 1;
-
-	list_hdr += 8;
-	cp = outbuf + 8;
-	cmd->get_used_outlen = 8;
-	list_alloc_len -= 8;
-	while (list_len > 0) {
-		uint32_t page = get_ntohl(&list_hdr[0]);
-		uint32_t number = get_ntohl(&list_hdr[4]);
-
-		for (i = oid; i < oid+numoid; i++) {
-			uint32_t get_used_outlen;
-			ret = osd_getattr_list(cmd->osd, pid, i, page, number,
-					       cp, list_alloc_len, isembedded,
-					       listfmt, &get_used_outlen, cdb_cont_len,
-					       cmd->sense);
-			if (ret != 0) {
-				cmd->senselen = ret;
-				goto out_err;
-			}
-
-			list_alloc_len -= get_used_outlen;
-			cmd->get_used_outlen += get_used_outlen;
-			cp += get_used_outlen;
-		}
-
-		list_len -= 8;
-		list_hdr += 8;
-	}
-	set_htonl(&outbuf[4], cmd->get_used_outlen - 8);
-
-	err = osd_end_txn(cmd->osd);
-	assert(err == 0);
-
-	return OSD_OK; /* success */
-
-out_err:
-	if (within_txn) {
-		err = osd_end_txn(cmd->osd);
-		assert(err == 0);
-	}
-	return ret;
-
-out_param_list_err:
-	return sense_basic_build(cmd->sense, OSD_SSK_ILLEGAL_REQUEST,
-				 OSD_ASC_PARAMETER_LIST_LENGTH_ERROR, pid,
-				 oid);
-
-out_invalid_param_list:
-	return sense_basic_build(cmd->sense, OSD_SSK_ILLEGAL_REQUEST,
-				 OSD_ASC_INVALID_FIELD_IN_PARAM_LIST, pid,
-				 oid);
-}
-
-
-/*
- * TODO: proper return codes
- * returns:
- * ==0: success
- *  >0: failure, senselen is returned.
- */
-static int set_attr_list(struct command *cmd, uint64_t pid, uint64_t oid,
-			 uint8_t isembedded, uint16_t numoid, uint32_t cdb_cont_len)
-{
-	int ret = 0;
-	int err = 0;
-	int within_txn = 0;
-	uint64_t i = 0;
-	uint8_t list_type;
-	uint8_t *cdb = cmd->cdb;
-	uint32_t setattr_list_len = get_ntohl(&cdb[68]);
-	uint32_t list_len = 0;
-	uint32_t list_off = get_ntohoffset(&cdb[72]);
-	const uint8_t *list_hdr = &cmd->indata[list_off];
-
-	if (setattr_list_len == 0)
-		return 0; /* nothing to set, osd2r00 Sec 5.2.2.3 */
-
-	if (setattr_list_len != 0 && setattr_list_len < LIST_HDR_LEN)
-		goto out_param_list_err;
-
-	list_type = list_hdr[0] & 0xF;
-	if (list_type != RTRVD_SET_ATTR_LIST)
-		goto out_param_list_err;
-
-	list_len = setattr_list_len - 8;
-	if (list_len & 0x7) /* multiple of 8, values are padded */
-		goto out_param_list_err;
-
-	err = osd_begin_txn(cmd->osd);
-	assert(err == 0);
-	within_txn = 1;
-
-	list_hdr = &list_hdr[8]; /* XXX: osd errata */
-	while (list_len > 0) {
-		uint32_t page = get_ntohl(&list_hdr[LE_PAGE_OFF]);
-		uint32_t number = get_ntohl(&list_hdr[LE_NUMBER_OFF]);
-		uint32_t len = get_ntohs(&list_hdr[LE_LEN_OFF]);
-		uint32_t pad = 0;
-
-		/* set attr on multiple objects if that is the case */
-		for (i = oid; i < oid+numoid; i++) {
-			ret = osd_set_attributes(cmd->osd, pid, i, page,
-						 number, &list_hdr[LE_VAL_OFF], len,
-						 isembedded, cdb_cont_len, cmd->sense);
-			if (ret != 0) {
-				cmd->senselen = ret;
-				goto out_err;
-			}
-		}
-
-		pad = (0x8 - ((LE_VAL_OFF + len) & 0x7)) & 0x7;
-		list_hdr += LE_VAL_OFF + len + pad;
-		list_len -= LE_VAL_OFF + len + pad;
-	}
-
-	err = osd_end_txn(cmd->osd);
-	assert(err == 0);
-
-	return 0; /* success */
-
-out_err:
-	if (within_txn) {
-		err = osd_end_txn(cmd->osd);
-		assert(err == 0);
-	}
-	return ret;
-
-out_param_list_err:
-	if (within_txn) {
-		err = osd_end_txn(cmd->osd);
-		assert(err == 0);
-	}
-	cmd->senselen = sense_basic_build(cmd->sense, OSD_SSK_ILLEGAL_REQUEST,
-					  OSD_ASC_PARAMETER_LIST_LENGTH_ERROR,
-					  pid, oid);
-	return cmd->senselen;
-}
-
 static int parse_getattr_list(struct command *cmd, uint64_t pid, uint64_t oid)
 {
        int ret = 0;
@@ -500,6 +304,8 @@ static int parse_setattr_list(struct command *cmd, uint64_t pid, uint64_t oid)
 
 		pad = (0x8 - ((LE_VAL_OFF + cmd->set_attr.le[i].len) & 0x7)) &
 			0x7;
+		if ((uint32_t)(LE_VAL_OFF + cmd->set_attr.le[i].len + pad) > list_len)
+			goto out_param_list_err;
 		list_hdr += LE_VAL_OFF + cmd->set_attr.le[i].len + pad;
 		list_len -= LE_VAL_OFF + cmd->set_attr.le[i].len + pad;
 		++i;
@@ -518,6 +324,113 @@ out_hw_err:
 }
 
 
+/*
+ * The decoded list is retrieved for all numoid objects by one call to
+ * osd_get_attr_list, which fetches the stored attributes with one query.
+ *
+ * returns:
+ * ==0: success
+ *  >0: failure, senselen is returned.
+ */
+static int get_attr_list(struct command *cmd, uint64_t pid, uint64_t oid,
+			 uint8_t isembedded, uint16_t numoid, uint32_t cdb_cont_len)
+{
+	int ret = 0;
+	int err = 0;
+	uint8_t listfmt = RTRVD_SET_ATTR_LIST;
+	uint32_t list_alloc_len = get_ntohl(&cmd->cdb[60]);
+	uint32_t get_used_outlen = 0;
+	uint8_t *outbuf;
+
+	if (get_ntohl(&cmd->cdb[52]) == 0)
+		return 0; /* nothing to retrieve, osd2r00 Sec 5.2.2.3 */
+
+	if (!cmd->outdata || list_alloc_len < 8)
+		goto out_param_list_err;
+	outbuf = &cmd->outdata[cmd->retrieved_attr_off];
+
+	ret = parse_getattr_list(cmd, pid, oid);
+	if (ret != 0)
+		goto out;
+
+	if (numoid > 1)
+		listfmt = RTRVD_CREATE_MULTIOBJ_LIST;
+	outbuf[0] = listfmt; /* fill list header */
+	outbuf[1] = outbuf[2] = outbuf[3] = 0;
+
+	err = osd_begin_txn(cmd->osd);
+	assert(err == 0);
+
+	ret = osd_get_attr_list(cmd->osd, pid, oid, numoid, &cmd->get_attr,
+				outbuf + 8, list_alloc_len - 8, isembedded,
+				listfmt, &get_used_outlen, cdb_cont_len,
+				cmd->sense);
+
+	err = osd_end_txn(cmd->osd);
+	assert(err == 0);
+
+	if (ret != 0) {
+		cmd->senselen = ret;
+		goto out;
+	}
+
+	cmd->get_used_outlen = 8 + get_used_outlen;
+	set_htonl(&outbuf[4], get_used_outlen);
+
+out:
+	free(cmd->get_attr.le);
+	cmd->get_attr.le = NULL;
+	cmd->get_attr.sz = 0;
+	return ret;
+
+out_param_list_err:
+	return sense_basic_build(cmd->sense, OSD_SSK_ILLEGAL_REQUEST,
+				 OSD_ASC_PARAMETER_LIST_LENGTH_ERROR, pid,
+				 oid);
+}
+
+/*
+ * The whole list is decoded first and handed to osd_set_attr_list, which
+ * validates it once per object and writes all entries in one pass.
+ *
+ * returns:
+ * ==0: success
+ *  >0: failure, senselen is returned.
+ */
+static int set_attr_list(struct command *cmd, uint64_t pid, uint64_t oid,
+			 uint8_t isembedded, uint16_t numoid, uint32_t cdb_cont_len)
+{
+	int ret = 0;
+	int err = 0;
+
+	if (get_ntohl(&cmd->cdb[68]) == 0)
+		return 0; /* nothing to set, osd2r00 Sec 5.2.2.3 */
+
+	ret = parse_setattr_list(cmd, pid, oid);
+	if (ret != 0) {
+		cmd->senselen = ret;
+		goto out;
+	}
+
+	err = osd_begin_txn(cmd->osd);
+	assert(err == 0);
+
+	ret = osd_set_attr_list(cmd->osd, pid, oid, numoid, &cmd->set_attr,
+				isembedded, cdb_cont_len, cmd->sense);
+	if (ret != 0)
+		cmd->senselen = ret;
+
+	err = osd_end_txn(cmd->osd);
+	assert(err == 0);
+
+out:
+	free(cmd->set_attr.le);
+	cmd->set_attr.le = NULL;
+	cmd->set_attr.sz = 0;
+	return ret;
+}
+
+
 /*
  * returns:
  * ==0: success
@@ -981,6 +894,44 @@ out_cdb_err:
 	return ret;
 }
 
+/*
+ * GET MEMBER ATTRIBUTES takes its allocation length, initial oid and list
+ * identifier where LIST COLLECTION has them, and its attribute list as a
+ * get attributes list, then answers like LIST COLLECTION with attributes
+ * would.
+ */
+static int cdb_get_member_attributes(struct command *cmd,
+				     uint32_t cdb_cont_len)
+{
+	int ret = 0;
+	uint8_t *cdb = cmd->cdb;
+	uint64_t pid = get_ntohll(&cdb[16]);
+	uint64_t cid = get_ntohll(&cdb[24]);
+	uint64_t alloc_len = get_ntohll(&cdb[32]);
+	uint64_t initial_oid = get_ntohll(&cdb[40]);
+	uint32_t list_id = get_ntohl(&cdb[48]);
+
+	if (cmd->getset_cdbfmt == GETPAGE_SETVALUE)
+		goto out_cdb_err;
+
+	ret = parse_getattr_list(cmd, pid, cid);
+	if (ret)
+		return ret;
+
+	ret = osd_get_member_attributes(cmd->osd, pid, cid, alloc_len,
+					initial_oid, &cmd->get_attr, list_id,
+					cmd->outdata, &cmd->used_outlen,
+					cdb_cont_len, cmd->sense);
+	free(cmd->get_attr.le);
+	cmd->get_attr.le = NULL;
+	cmd->get_attr.sz = 0;
+	return ret;
+
+out_cdb_err:
+	return sense_basic_build(cmd->sense, OSD_SSK_ILLEGAL_REQUEST,
+				 OSD_ASC_INVALID_FIELD_IN_CDB, pid, cid);
+}
+
 static int cdb_set_member_attributes(struct command *cmd, uint32_t cdb_cont_len)
 {
 	int ret = 0;
@@ -1095,19 +1046,25 @@ out_cdb_err:
 	return ret;
 }
 
+/*
+ * The original value is returned straight into the outdata, as the value
+ * of the first entry of the retrieved attributes list that exec_getattr
+ * completes.
+ */
 static int exec_gen_cas(struct command *cmd, uint64_t pid, uint64_t oid,
 			const uint8_t **setattr_list, uint32_t *orig_page,
-			uint32_t *orig_number, uint8_t **orig,
-			uint16_t *orig_len, uint32_t *list_len,
-			uint8_t *cas_res)
+			uint32_t *orig_number, uint16_t *orig_len,
+			uint32_t *list_len, uint8_t *cas_res)
 {
 	int ret;
 	uint8_t pad, list_type;
 	uint32_t page, number;
 	const uint8_t *cmp, *swap;
 	uint16_t cmp_len, swap_len;
+	uint8_t *orig;
 	const uint8_t *list = *setattr_list;
 	uint32_t setattr_list_len = get_ntohl(&cmd->cdb[68]);
+	uint32_t alloc_len = get_ntohl(&cmd->cdb[60]);
 
 	if (setattr_list_len < LIST_HDR_LEN) /* need atleast cmp & swap */
 		goto out_param_list_err;
@@ -1148,16 +1105,23 @@ static int exec_gen_cas(struct command *cmd, uint64_t pid, uint64_t oid,
 	*list_len -= LE_VAL_OFF + swap_len + pad;
 	*setattr_list = list;
 
-	*orig = NULL;
+	if (!cmd->outdata || cmd->retrieved_attr_off == -1LLU ||
+	    alloc_len < LIST_HDR_LEN + LE_VAL_OFF)
+		goto out_cdb_err;
+	orig = &cmd->outdata[cmd->retrieved_attr_off + LIST_HDR_LEN +
+			     LE_VAL_OFF];
+
 	*cas_res = 0;
 	ret = osd_gen_cas(cmd->osd, pid, oid, page, number, cmp, cmp_len,
-			  swap, swap_len, orig, orig_len, cmd->sense);
+			  swap, swap_len, orig,
+			  alloc_len - LIST_HDR_LEN - LE_VAL_OFF, orig_len,
+			  cmd->sense);
 	if (ret != OSD_OK) {
 		cmd->senselen = ret;
 		goto out_err;
 	}
 
-	if (*orig_len == cmp_len && memcmp(cmp, *orig, cmp_len) == 0)
+	if (*orig_len == cmp_len && memcmp(cmp, orig, cmp_len) == 0)
 		*cas_res = 1;
 	*orig_page = page;
 	*orig_number = number;
@@ -1222,16 +1186,18 @@ out_err:
  * get_attributes function. Since get_attributes creates the whole list along
  * with header, we need a way to stuff original value in the front of the
  * list. To do this we tamper with the retrieved_attr_off so that
- * get_attributes creates its list at an offset. Then we stuff the original
- * value from CAS op after the list header making it the first entry.
+ * get_attributes creates its list at an offset. exec_gen_cas has left the
+ * original value from CAS op after the list header already, its entry is
+ * completed around it making it the first entry.
  */
 static int exec_getattr(struct command *cmd, uint64_t pid, uint64_t oid,
 			uint32_t orig_page, uint32_t orig_number,
-			uint8_t *orig, uint16_t orig_len, uint32_t cdb_cont_len)
+			uint16_t orig_len, uint32_t cdb_cont_len)
 {
 	int ret;
 	uint8_t *cp, *sp;
 	uint8_t *cdb = cmd->cdb;
+	uint8_t tail[LIST_HDR_LEN];
 	uint64_t old_retr_attr_off;
 	uint32_t alloc_len = get_ntohl(&cdb[60]);
 	uint32_t list_len, orig_le_len;
@@ -1243,6 +1209,7 @@ static int exec_getattr(struct command *cmd, uint64_t pid, uint64_t oid,
 		goto out_cdb_err;
 	cmd->retrieved_attr_off += orig_le_len;
 	cp = &cmd->outdata[cmd->retrieved_attr_off];
+	memcpy(tail, cp, LIST_HDR_LEN); /* end of the original value */
 	memset(cp, 0, LIST_HDR_LEN);
 	set_htonl(&cdb[60], alloc_len - orig_le_len);
 	ret = get_attributes(cmd, pid, oid, 1, cdb_cont_len);
@@ -1256,26 +1223,16 @@ static int exec_getattr(struct command *cmd, uint64_t pid, uint64_t oid,
 	cp = &cmd->outdata[old_retr_attr_off];
 	sp = &cmd->outdata[old_retr_attr_off + orig_le_len];
 	memcpy(cp, sp, LIST_HDR_LEN);
+	memcpy(sp, tail, LIST_HDR_LEN);
 	cp += LIST_HDR_LEN;
 
-	/* stuff original value from CAS operation */
-	if (orig != NULL && orig_len > 0) {
-		ret = le_pack_attr(cp, alloc_len - LIST_HDR_LEN, orig_page,
-				   orig_number, orig_len, orig);
-		free(orig);
-		orig = NULL;
-	} else {
-		ret = le_pack_attr(cp, alloc_len - LIST_HDR_LEN, orig_page,
-				   orig_number, 0, NULL);
-	}
-	if (ret <= 0) {
+	/* entry header and padding of the original value from CAS operation */
+	ret = le_pack_attr(cp, LE_VAL_OFF, orig_page, orig_number, orig_len,
+			   NULL);
+	if (ret <= 0)
 		goto out_cdb_err;
-	} else {
-		if (orig_le_len <= alloc_len - LIST_HDR_LEN)
-			assert((uint32_t)ret == orig_le_len);
-		else
-			assert((uint32_t)ret == alloc_len - LIST_HDR_LEN);
-	}
+	memset(&cp[LE_VAL_OFF + orig_len], 0,
+	       orig_le_len - LE_VAL_OFF - orig_len);
 
 	/* modify list len to reflect new entry */
 	cp -= LIST_HDR_LEN;
@@ -1310,8 +1267,7 @@ static int cdb_gen_cas(struct command *cmd, int osd_cmd, uint32_t cdb_cont_len)
 	uint32_t list_off = get_ntohoffset(&cmd->cdb[72]);
 	const uint8_t *list = &cmd->indata[list_off];
 	const uint8_t *list_pos;
-	uint8_t *orig;
-	uint16_t orig_len;
+	uint16_t orig_len = 0;
 	uint32_t orig_page = 0, orig_number = 0;
 	uint8_t cas_res = 0;
 
@@ -1320,7 +1276,7 @@ static int cdb_gen_cas(struct command *cmd, int osd_cmd, uint32_t cdb_cont_len)
 		goto out_cdb_err;
 
 	ret = exec_gen_cas(cmd, pid, oid, &list, &orig_page, &orig_number,
-			   &orig, &orig_len, &list_len, &cas_res);
+			   &orig_len, &list_len, &cas_res);
 	if (ret != OSD_OK)
 		goto out_err;
 
@@ -1335,20 +1291,16 @@ static int cdb_gen_cas(struct command *cmd, int osd_cmd, uint32_t cdb_cont_len)
 	if (ret != OSD_OK)
 		goto out_err;
 get_attr:
-	ret = exec_getattr(cmd, pid, oid, orig_page, orig_number, orig,
-			   orig_len, cdb_cont_len);
+	ret = exec_getattr(cmd, pid, oid, orig_page, orig_number, orig_len,
+			   cdb_cont_len);
 	TICK_TRACE(cdb_gen_cas);
 	if (ret == OSD_OK)
 		return ret;
 
 out_cdb_err:
-	if (orig)
-		free(orig);
 	return sense_basic_build(cmd->sense, OSD_SSK_ILLEGAL_REQUEST,
 				 OSD_ASC_INVALID_FIELD_IN_CDB, pid, oid);
 out_err:
-	if (orig)
-		free(orig);
 	return ret;
 }
 
@@ -1789,9 +1741,7 @@ static void exec_service_action(struct command *cmd)
 
 	}
 	case OSD_GET_MEMBER_ATTRIBUTES: {
-		uint64_t pid = get_ntohll(&cdb[16]);
-		uint64_t cid = get_ntohll(&cdb[24]);
-		ret = osd_get_member_attributes(osd, pid, cid, cdb_cont_len, sense);
+		ret = cdb_get_member_attributes(cmd, cdb_cont_len);
 		break;
 	}
 	case OSD_LIST: {
@@ -2181,7 +2131,9 @@ int osdemu_cmd_submit(struct osd_device *osd, char *ip, uint8_t *cdb,
 		}
 	}
 
+	idle_cmd_begin(osd);
 	exec_service_action(&cmd); /* run the command. */
+	idle_cmd_end(osd);
 
 
 	/*
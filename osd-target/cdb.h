@@ -24,6 +24,8 @@ struct osd_device;
 struct osd_device *osd_device_alloc(void);
 void osd_device_free(struct osd_device *osd);
 int osd_open(const char *root, struct osd_device *osd);
+int osd_open_backend(const char *root, const char *backend,
+		     struct osd_device *osd);
 int osd_close(struct osd_device *osd);
 int osdemu_cmd_submit(struct osd_device *osd, char* ip, uint8_t *cdb,
                       const uint8_t *data_in, uint64_t data_in_len,
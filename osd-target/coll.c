@@ -28,6 +28,7 @@
 #include "coll.h"
 #include "osd-util/osd-util.h"
 #include "list-entry.h"
+#include "collbm.h"
 
 /*
  * coll table stores many-to-many relationship between userobjects and
@@ -35,6 +36,25 @@
  * which an object belongs can be computed efficiently.
  */
 
+/*
+ * The members of the most recently used collections are also kept as
+ * bitmaps (see collbm.h), and saved to the collbm table when they leave
+ * the cache. coll stays the authority: the collbm row of a collection is
+ * deleted before coll changes under it, and a collection without a row
+ * is read back from coll when next used. Since a SQLITE_SCHEMA retry
+ * finalizes and rebuilds the cache, entries are looked up again after
+ * every statement rather than held across one.
+ */
+#define COLL_BM_CACHE (64)
+
+struct coll_bm {
+	uint64_t pid;
+	uint64_t cid;
+	uint64_t tick;          /* last use */
+	int dirty;              /* changed since read, has no collbm row */
+	struct collbm *bm;
+};
+
 static const char *coll_tab_name = "coll";
 struct coll_tab {
 	char *name;             /* name of the table */
@@ -46,6 +66,16 @@ struct coll_tab {
 	sqlite3_stmt *getcid;   /* get collection */
 	sqlite3_stmt *getoids;  /* get objects in a collection */
 	sqlite3_stmt *copyoids; /* copy oids from one collection to another */
+	sqlite3_stmt *getcids;  /* get collections of an object */
+	sqlite3_stmt *copylost; /* collections losing objects to copyoids */
+	sqlite3_stmt *memlost;  /* collections sharing members with one */
+	sqlite3_stmt *delmem;   /* delete members of one from another */
+	sqlite3_stmt *bmget;    /* get the saved bitmap of a collection */
+	sqlite3_stmt *bmput;    /* save the bitmap of a collection */
+	sqlite3_stmt *bmdel;    /* delete the saved bitmap of a collection */
+	struct coll_bm bm[COLL_BM_CACHE];
+	uint32_t nbm;
+	uint64_t tick;
 };
 
 
@@ -136,9 +166,77 @@ int coll_initialize(void *db)
 	if (ret != SQLITE_OK)
 		goto out_finalize_copyoids;
 
+	sprintf(SQL, "SELECT cid FROM %s WHERE pid = ? AND oid = ?;",
+		dbc->coll->name);
+	ret = sqlite3_prepare(dbc->db, SQL, -1, &dbc->coll->getcids, NULL);
+	if (ret != SQLITE_OK)
+		goto out_finalize_getcids;
+
+	sprintf(SQL, "SELECT DISTINCT cid FROM %s WHERE pid = ?1 AND "
+		" number = 0 AND cid != ?2 AND oid IN (SELECT oid FROM %s "
+		" WHERE pid = ?1 AND cid = ?3);", dbc->coll->name,
+		dbc->coll->name);
+	ret = sqlite3_prepare(dbc->db, SQL, -1, &dbc->coll->copylost, NULL);
+	if (ret != SQLITE_OK)
+		goto out_finalize_copylost;
+
+	sprintf(SQL, "SELECT DISTINCT cid FROM %s WHERE pid = ?1 AND "
+		" cid != ?2 AND oid IN (SELECT oid FROM %s WHERE pid = ?1 "
+		" AND cid = ?2);", dbc->coll->name, dbc->coll->name);
+	ret = sqlite3_prepare(dbc->db, SQL, -1, &dbc->coll->memlost, NULL);
+	if (ret != SQLITE_OK)
+		goto out_finalize_memlost;
+
+	sprintf(SQL, "DELETE FROM %s WHERE pid = ?1 AND cid = ?3 AND oid IN "
+		" (SELECT oid FROM %s WHERE pid = ?1 AND cid = ?2);",
+		dbc->coll->name, dbc->coll->name);
+	ret = sqlite3_prepare(dbc->db, SQL, -1, &dbc->coll->delmem, NULL);
+	if (ret != SQLITE_OK)
+		goto out_finalize_delmem;
+
+	/*
+	 * prepared with sqlite3_prepare_v2, which handles schema changes
+	 * itself, since bmput also runs from coll_finalize
+	 */
+	sprintf(SQL, "SELECT bitmap FROM collbm WHERE pid = ? AND cid = ?;");
+	ret = sqlite3_prepare_v2(dbc->db, SQL, -1, &dbc->coll->bmget, NULL);
+	if (ret != SQLITE_OK)
+		goto out_finalize_bmget;
+
+	sprintf(SQL, "INSERT OR REPLACE INTO collbm VALUES (?, ?, ?);");
+	ret = sqlite3_prepare_v2(dbc->db, SQL, -1, &dbc->coll->bmput, NULL);
+	if (ret != SQLITE_OK)
+		goto out_finalize_bmput;
+
+	sprintf(SQL, "DELETE FROM collbm WHERE pid = ? AND cid = ?;");
+	ret = sqlite3_prepare_v2(dbc->db, SQL, -1, &dbc->coll->bmdel, NULL);
+	if (ret != SQLITE_OK)
+		goto out_finalize_bmdel;
+
 	ret = OSD_OK; /* success */
 	goto out;
 
+out_finalize_bmdel:
+	db_sqfinalize(dbc->db, dbc->coll->bmdel, SQL);
+	SQL[0] = '\0';
+out_finalize_bmput:
+	db_sqfinalize(dbc->db, dbc->coll->bmput, SQL);
+	SQL[0] = '\0';
+out_finalize_bmget:
+	db_sqfinalize(dbc->db, dbc->coll->bmget, SQL);
+	SQL[0] = '\0';
+out_finalize_delmem:
+	db_sqfinalize(dbc->db, dbc->coll->delmem, SQL);
+	SQL[0] = '\0';
+out_finalize_memlost:
+	db_sqfinalize(dbc->db, dbc->coll->memlost, SQL);
+	SQL[0] = '\0';
+out_finalize_copylost:
+	db_sqfinalize(dbc->db, dbc->coll->copylost, SQL);
+	SQL[0] = '\0';
+out_finalize_getcids:
+	db_sqfinalize(dbc->db, dbc->coll->getcids, SQL);
+	SQL[0] = '\0';
 out_finalize_copyoids:
 	db_sqfinalize(dbc->db, dbc->coll->copyoids, SQL);
 	SQL[0] = '\0';
@@ -168,12 +266,250 @@ out:
 }
 
 
+/* cache entry of (pid, cid), NULL if it has none */
+static struct coll_bm *coll_bm_find(struct db_context *dbc, uint64_t pid,
+				    uint64_t cid)
+{
+	uint32_t i = 0;
+	struct coll_tab *ct = dbc->coll;
+
+	for (i = 0; i < ct->nbm; i++) {
+		if (ct->bm[i].pid == pid && ct->bm[i].cid == cid) {
+			ct->bm[i].tick = ++ct->tick;
+			return &ct->bm[i];
+		}
+	}
+	return NULL;
+}
+
+/* drop a cache entry without saving it; others may move */
+static void coll_bm_drop(struct db_context *dbc, struct coll_bm *b)
+{
+	struct coll_tab *ct = dbc->coll;
+
+	collbm_free(b->bm);
+	*b = ct->bm[--ct->nbm];
+}
+
+/*
+ * Delete the collbm row of (pid, cid). Done before coll changes under
+ * the collection, so that a row never describes a stale membership.
+ *
+ * returns:
+ * OSD_ERROR: some error
+ * OSD_OK: success
+ * OSD_REPEAT: the statements were rebuilt, start over
+ */
+static int coll_bm_unsave(struct db_context *dbc, uint64_t pid, uint64_t cid)
+{
+	int ret = 0;
+	sqlite3_stmt *stmt = dbc->coll->bmdel;
+
+	ret |= sqlite3_bind_int64(stmt, 1, pid);
+	ret |= sqlite3_bind_int64(stmt, 2, cid);
+	return db_exec_dms(dbc, stmt, ret, __func__);
+}
+
+/*
+ * About to change the members of (pid, cid): mark its cache entry dirty,
+ * deleting its collbm row unless it is dirty already.
+ *
+ * returns: that of coll_bm_unsave
+ */
+static int coll_bm_change(struct db_context *dbc, uint64_t pid, uint64_t cid)
+{
+	int ret = 0;
+	struct coll_bm *b = coll_bm_find(dbc, pid, cid);
+
+	if (b && b->dirty)
+		return OSD_OK;
+	ret = coll_bm_unsave(dbc, pid, cid);
+	if (ret != OSD_OK)
+		return ret;
+	b = coll_bm_find(dbc, pid, cid);
+	if (b)
+		b->dirty = 1;
+	return OSD_OK;
+}
+
+/*
+ * Write the bitmap of a dirty entry to its collbm row. An empty
+ * collection is left without one.
+ *
+ * returns:
+ * -ENOMEM: out of memory
+ * OSD_ERROR: some other error
+ * OSD_OK: success
+ */
+static int coll_bm_save(struct db_context *dbc, struct coll_bm *b)
+{
+	int ret = 0;
+	size_t len = 0;
+	void *buf = NULL;
+	sqlite3_stmt *stmt = dbc->coll->bmput;
+
+	if (!b->dirty || b->bm->card == 0)
+		goto out;
+	ret = collbm_encode(b->bm, &buf, &len);
+	if (ret != OSD_OK)
+		return ret;
+
+	/* not through db_exec_dms, which may end up back in coll_finalize */
+	ret |= sqlite3_bind_int64(stmt, 1, b->pid);
+	ret |= sqlite3_bind_int64(stmt, 2, b->cid);
+	ret |= sqlite3_bind_blob(stmt, 3, buf, len, SQLITE_STATIC);
+	if (ret == SQLITE_OK)
+		while ((ret = sqlite3_step(stmt)) == SQLITE_BUSY);
+	sqlite3_reset(stmt);
+	free(buf);
+	if (ret != SQLITE_DONE) {
+		error_sql(dbc->db, "%s: save failed", __func__);
+		return OSD_ERROR;
+	}
+out:
+	b->dirty = 0;
+	return OSD_OK;
+}
+
+/*
+ * Read the members of (pid, cid) from its collbm row, or from coll if it
+ * has none.
+ *
+ * returns:
+ * -ENOMEM: out of memory
+ * OSD_ERROR: some other error
+ * OSD_OK: success, *bm set; *dirty set if it came from coll
+ * OSD_REPEAT: the statements were rebuilt, start over
+ */
+static int coll_bm_read(struct db_context *dbc, uint64_t pid, uint64_t cid,
+			struct collbm **bm, int *dirty)
+{
+	int ret = 0;
+	int bound = 0;
+	sqlite3_stmt *stmt = dbc->coll->bmget;
+
+	*bm = NULL;
+	*dirty = 0;
+	ret |= sqlite3_bind_int64(stmt, 1, pid);
+	ret |= sqlite3_bind_int64(stmt, 2, cid);
+	bound = (ret == SQLITE_OK);
+	if (!bound) {
+		error_sql(dbc->db, "%s: bind failed", __func__);
+		goto out_reset;
+	}
+	while ((ret = sqlite3_step(stmt)) == SQLITE_BUSY);
+	if (ret == SQLITE_ROW)
+		*bm = collbm_decode(sqlite3_column_blob(stmt, 0),
+				    sqlite3_column_bytes(stmt, 0));
+out_reset:
+	ret = db_reset_stmt(dbc, stmt, bound, __func__);
+	if (ret != OSD_OK || *bm)
+		goto out;
+
+	/* no row, or not one collbm_decode understands */
+	*dirty = 1;
+	*bm = collbm_alloc();
+	if (!*bm)
+		return -ENOMEM;
+	stmt = dbc->coll->getoids;
+	ret = 0;
+	ret |= sqlite3_bind_int64(stmt, 1, pid);
+	ret |= sqlite3_bind_int64(stmt, 2, cid);
+	ret |= sqlite3_bind_int64(stmt, 3, 0);
+	bound = (ret == SQLITE_OK);
+	if (!bound) {
+		error_sql(dbc->db, "%s: bind failed", __func__);
+		goto out_reset_oids;
+	}
+	while ((ret = sqlite3_step(stmt)) == SQLITE_ROW || ret == SQLITE_BUSY) {
+		if (ret == SQLITE_ROW &&
+		    collbm_add(*bm, sqlite3_column_int64(stmt, 0)) < 0)
+			break;
+	}
+out_reset_oids:
+	if (ret == SQLITE_ROW) {
+		sqlite3_reset(stmt);
+		ret = -ENOMEM;
+	} else {
+		ret = db_reset_stmt(dbc, stmt, bound, __func__);
+	}
+out:
+	if (ret != OSD_OK) {
+		collbm_free(*bm);
+		*bm = NULL;
+	}
+	return ret;
+}
+
+/*
+ * The cache entry of (pid, cid), read in if it is not cached, in place of
+ * the least recently used one if the cache is full.
+ *
+ * returns:
+ * NULL: out of memory or some other error
+ * the entry otherwise, until the next call into coll
+ */
+static struct coll_bm *coll_bm_get(struct db_context *dbc, uint64_t pid,
+				   uint64_t cid)
+{
+	int ret = 0;
+	int dirty = 0;
+	uint32_t i = 0;
+	struct collbm *bm = NULL;
+	struct coll_tab *ct = NULL;
+	struct coll_bm *b = NULL;
+
+	do {
+		b = coll_bm_find(dbc, pid, cid);
+		if (b)
+			return b;
+		ret = coll_bm_read(dbc, pid, cid, &bm, &dirty);
+	} while (ret == OSD_REPEAT);
+	if (ret != OSD_OK)
+		return NULL;
+
+	ct = dbc->coll;
+	if (ct->nbm == COLL_BM_CACHE) {
+		b = &ct->bm[0];
+		for (i = 1; i < ct->nbm; i++)
+			if (ct->bm[i].tick < b->tick)
+				b = &ct->bm[i];
+		if (coll_bm_save(dbc, b) != OSD_OK)
+			osd_error("%s: bitmap of %llu not saved", __func__,
+				  llu(b->cid));
+		coll_bm_drop(dbc, b);
+	}
+	b = &ct->bm[ct->nbm++];
+	b->pid = pid;
+	b->cid = cid;
+	b->tick = ++ct->tick;
+	b->dirty = dirty;
+	b->bm = bm;
+	return b;
+}
+
 int coll_finalize(void *db)
 {
+	uint32_t i = 0;
+	int txn = 0;
   struct db_context *dbc = (struct db_context *)db;
 	if (!dbc || !dbc->coll)
 		return OSD_ERROR;
 
+	/* save the changed bitmaps, in one transaction if not in one */
+	if (sqlite3_get_autocommit(dbc->db))
+		txn = (sqlite3_exec(dbc->db, "BEGIN;", NULL, NULL, NULL) ==
+		       SQLITE_OK);
+	for (i = 0; i < dbc->coll->nbm; i++) {
+		if (coll_bm_save(dbc, &dbc->coll->bm[i]) != OSD_OK)
+			osd_error("%s: bitmap of %llu not saved", __func__,
+				  llu(dbc->coll->bm[i].cid));
+		collbm_free(dbc->coll->bm[i].bm);
+	}
+	if (txn && sqlite3_exec(dbc->db, "COMMIT;", NULL, NULL, NULL) !=
+	    SQLITE_OK)
+		error_sql(dbc->db, "%s: commit", __func__);
+
 	/* finalize statements; ignore return values */
 	sqlite3_finalize(dbc->coll->insert);
 	sqlite3_finalize(dbc->coll->delete);
@@ -183,6 +519,13 @@ int coll_finalize(void *db)
 	sqlite3_finalize(dbc->coll->getcid);
 	sqlite3_finalize(dbc->coll->getoids);
 	sqlite3_finalize(dbc->coll->copyoids);
+	sqlite3_finalize(dbc->coll->getcids);
+	sqlite3_finalize(dbc->coll->copylost);
+	sqlite3_finalize(dbc->coll->memlost);
+	sqlite3_finalize(dbc->coll->delmem);
+	sqlite3_finalize(dbc->coll->bmget);
+	sqlite3_finalize(dbc->coll->bmput);
+	sqlite3_finalize(dbc->coll->bmdel);
 	free(dbc->coll->name);
 	free(dbc->coll);
 	dbc->coll = NULL;
@@ -200,6 +543,106 @@ const char *coll_getname(void *ohandle)
 }
 
 
+/* a growing list of collection ids */
+struct cids {
+	uint64_t *cid;
+	uint32_t n;
+	uint32_t cap;
+};
+
+/*
+ * add cid to the list unless it is there already
+ *
+ * returns:
+ * -ENOMEM: out of memory
+ * OSD_OK: success
+ */
+static int cids_add(struct cids *l, uint64_t cid)
+{
+	uint32_t i = 0;
+	void *p = NULL;
+
+	for (i = 0; i < l->n; i++)
+		if (l->cid[i] == cid)
+			return OSD_OK;
+	if (l->n == l->cap) {
+		p = realloc(l->cid, (l->cap ? 2 * l->cap : 4) * sizeof(cid));
+		if (!p)
+			return -ENOMEM;
+		l->cid = p;
+		l->cap = l->cap ? 2 * l->cap : 4;
+	}
+	l->cid[l->n++] = cid;
+	return OSD_OK;
+}
+
+/*
+ * step stmt, whose bindings returned ret, adding the cid of each row to l
+ *
+ * returns:
+ * -ENOMEM: out of memory
+ * OSD_ERROR: some other error
+ * OSD_REPEAT: the statement was prepared again, rebind and retry
+ * OSD_OK: success
+ */
+static int coll_collect_cids(struct db_context *dbc, sqlite3_stmt *stmt,
+			     int ret, struct cids *l)
+{
+	int bound = (ret == SQLITE_OK);
+
+	if (!bound) {
+		error_sql(dbc->db, "%s: bind failed", __func__);
+		goto out_reset;
+	}
+	while ((ret = sqlite3_step(stmt)) == SQLITE_ROW || ret == SQLITE_BUSY)
+		if (ret == SQLITE_ROW &&
+		    cids_add(l, sqlite3_column_int64(stmt, 0)) != OSD_OK)
+			break;
+out_reset:
+	if (ret == SQLITE_ROW) {
+		sqlite3_reset(stmt);
+		return -ENOMEM;
+	}
+	return db_reset_stmt(dbc, stmt, bound, __func__);
+}
+
+/*
+ * the collection oid is a member of under number, if any
+ *
+ * returns:
+ * OSD_ERROR: in case of any error
+ * OSD_OK: success, *found set, and *cid if found
+ * OSD_REPEAT: the statements were rebuilt, start over
+ */
+static int coll_lookup_cid(struct db_context *dbc, uint64_t pid,
+			   uint64_t oid, uint32_t number, uint64_t *cid,
+			   int *found)
+{
+	int ret = 0;
+	int bound = 0;
+	sqlite3_stmt *stmt = dbc->coll->getcid;
+
+	*found = 0;
+	ret |= sqlite3_bind_int64(stmt, 1, pid);
+	ret |= sqlite3_bind_int64(stmt, 2, oid);
+	ret |= sqlite3_bind_int64(stmt, 3, number);
+	bound = (ret == SQLITE_OK);
+	if (!bound) {
+		error_sql(dbc->db, "%s: bind failed", __func__);
+		goto out_reset;
+	}
+
+	while ((ret = sqlite3_step(stmt)) == SQLITE_BUSY);
+	if (ret == SQLITE_ROW) {
+		*cid = sqlite3_column_int64(stmt, 0);
+		*found = 1;
+	}
+
+out_reset:
+	return db_reset_stmt(dbc, stmt, bound, __func__);
+}
+
+
 /* 
  * @pid: partition id 
  * @cid: collection id
@@ -214,12 +657,27 @@ const char *coll_getname(void *ohandle)
 int coll_insert(void *ohandle, uint64_t pid, uint64_t cid,
 		uint64_t oid, uint32_t number)
 {
-  struct db_context *dbc = ((struct handle*)ohandle)->dbc;
+  struct db_context *dbc = db_shard(ohandle, pid);
 	int ret = 0;
 
+	int found = 0;
+	uint64_t old = 0;
+	struct coll_bm *b = NULL;
+
 	assert(dbc && dbc->db && dbc->coll && dbc->coll->insert);
 
 repeat:
+	/* the row replaces the membership of oid under number, if any */
+	ret = coll_lookup_cid(dbc, pid, oid, number, &old, &found);
+	if (ret == OSD_OK && found && old != cid)
+		ret = coll_bm_change(dbc, pid, old);
+	if (ret == OSD_OK)
+		ret = coll_bm_change(dbc, pid, cid);
+	if (ret == OSD_REPEAT)
+		goto repeat;
+	if (ret != OSD_OK)
+		return ret;
+
 	ret = 0;
 	ret |= sqlite3_bind_int64(dbc->coll->insert, 1, pid);
 	ret |= sqlite3_bind_int64(dbc->coll->insert, 2, cid);
@@ -228,8 +686,15 @@ repeat:
 	ret = db_exec_dms(dbc, dbc->coll->insert, ret, __func__);
 	if (ret == OSD_REPEAT)
 		goto repeat;
-
-	return ret;
+	if (ret != OSD_OK)
+		return ret;
+
+	if (found && old != cid && (b = coll_bm_find(dbc, pid, old)))
+		collbm_remove(b->bm, oid);
+	b = coll_bm_find(dbc, pid, cid);
+	if (b && collbm_add(b->bm, oid) < 0)
+		coll_bm_drop(dbc, b);
+	return OSD_OK;
 }
 
 /* 
@@ -245,12 +710,53 @@ repeat:
 int coll_copyoids(void *ohandle, uint64_t pid, uint64_t dest_cid,
 		  uint64_t source_cid)
 {
-  struct db_context *dbc = ((struct handle*)ohandle)->dbc;
+  struct db_context *dbc = db_shard(ohandle, pid);
 	int ret = 0;
 
+	uint32_t i = 0;
+	uint64_t oid = 0;
+	struct coll_bm *b = NULL;
+	struct collbm *copy = NULL;
+	struct collbm_iter it;
+	struct cids losers = {NULL, 0, 0};
+
 	assert(dbc && dbc->db && dbc->coll && dbc->coll->copyoids);
 
 repeat:
+	collbm_free(copy);
+	copy = NULL;
+	losers.n = 0;
+	b = coll_bm_get(dbc, pid, source_cid);
+	if (b)
+		copy = collbm_clone(b->bm);
+	if (!copy) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	/* in the cache, so that the copy can become its bitmap below */
+	if (!coll_bm_get(dbc, pid, dest_cid)) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	/*
+	 * the copies are number 0, replacing the number 0 membership the
+	 * source objects have elsewhere
+	 */
+	ret = 0;
+	ret |= sqlite3_bind_int64(dbc->coll->copylost, 1, pid);
+	ret |= sqlite3_bind_int64(dbc->coll->copylost, 2, dest_cid);
+	ret |= sqlite3_bind_int64(dbc->coll->copylost, 3, source_cid);
+	ret = coll_collect_cids(dbc, dbc->coll->copylost, ret, &losers);
+	for (i = 0; ret == OSD_OK && i < losers.n; i++)
+		ret = coll_bm_change(dbc, pid, losers.cid[i]);
+	if (ret == OSD_OK)
+		ret = coll_bm_change(dbc, pid, dest_cid);
+	if (ret == OSD_REPEAT)
+		goto repeat;
+	if (ret != OSD_OK)
+		goto out;
+
 	ret = 0;
 	ret |= sqlite3_bind_int64(dbc->coll->copyoids, 1, pid);
 	ret |= sqlite3_bind_int64(dbc->coll->copyoids, 2, dest_cid);
@@ -259,7 +765,31 @@ repeat:
 	ret = db_exec_dms(dbc, dbc->coll->copyoids, ret, __func__);
 	if (ret == OSD_REPEAT)
 		goto repeat;
+	if (ret != OSD_OK)
+		goto out;
+
+	/* which of their objects the losers lost is not kept track of */
+	for (i = 0; i < losers.n; i++)
+		if ((b = coll_bm_find(dbc, pid, losers.cid[i])))
+			coll_bm_drop(dbc, b);
+	b = coll_bm_find(dbc, pid, dest_cid);
+	if (b && b->bm->card == 0) {
+		/* typically a new tracking collection */
+		collbm_free(b->bm);
+		b->bm = copy;
+		copy = NULL;
+	} else if (b) {
+		collbm_iter_seek(&it, copy, 0);
+		while (collbm_iter_next(&it, &oid))
+			if (collbm_add(b->bm, oid) < 0)
+				break;
+		if (collbm_iter_next(&it, &oid))
+			coll_bm_drop(dbc, b);
+	}
 
+out:
+	collbm_free(copy);
+	free(losers.cid);
 	return ret;
 }
 
@@ -273,12 +803,20 @@ repeat:
 int coll_delete(void *ohandle, uint64_t pid, uint64_t cid, 
 		uint64_t oid)
 {
-  struct db_context *dbc = ((struct handle*)ohandle)->dbc;
+  struct db_context *dbc = db_shard(ohandle, pid);
 	int ret = 0;
 
+	struct coll_bm *b = NULL;
+
 	assert(dbc && dbc->db && dbc->coll && dbc->coll->delete);
 
 repeat:
+	ret = coll_bm_change(dbc, pid, cid);
+	if (ret == OSD_REPEAT)
+		goto repeat;
+	if (ret != OSD_OK)
+		return ret;
+
 	ret = 0;
 	ret |= sqlite3_bind_int64(dbc->coll->delete, 1, pid);
 	ret |= sqlite3_bind_int64(dbc->coll->delete, 2, cid);
@@ -286,6 +824,8 @@ repeat:
 	ret = db_exec_dms(dbc, dbc->coll->delete, ret, __func__);
 	if (ret == OSD_REPEAT)
 		goto repeat;
+	if (ret == OSD_OK && (b = coll_bm_find(dbc, pid, cid)))
+		collbm_remove(b->bm, oid);
 
 	return ret;
 }
@@ -299,12 +839,23 @@ repeat:
  */
 int coll_delete_cid(void *ohandle, uint64_t pid, uint64_t cid)
 {
-  struct db_context *dbc = ((struct handle*)ohandle)->dbc;
+  struct db_context *dbc = db_shard(ohandle, pid);
 	int ret = 0;
 
+	struct coll_bm *b = NULL;
+
 	assert(dbc && dbc->db && dbc->coll && dbc->coll->delcid);
 
 repeat:
+	b = coll_bm_find(dbc, pid, cid);
+	if (b)
+		coll_bm_drop(dbc, b);
+	ret = coll_bm_unsave(dbc, pid, cid);
+	if (ret == OSD_REPEAT)
+		goto repeat;
+	if (ret != OSD_OK)
+		return ret;
+
 	ret = 0;
 	ret |= sqlite3_bind_int64(dbc->coll->delcid, 1, pid);
 	ret |= sqlite3_bind_int64(dbc->coll->delcid, 2, cid);
@@ -324,23 +875,106 @@ repeat:
  */
 int coll_delete_oid(void *ohandle, uint64_t pid, uint64_t oid)
 {
-  struct db_context *dbc = ((struct handle*)ohandle)->dbc;
+  struct db_context *dbc = db_shard(ohandle, pid);
 	int ret = 0;
 
+	uint32_t i = 0;
+	struct coll_bm *b = NULL;
+	struct cids in = {NULL, 0, 0};
+
 	assert(dbc && dbc->db && dbc->coll && dbc->coll->deloid);
 
 repeat:
+	/* the collections oid leaves */
+	in.n = 0;
+	ret = 0;
+	ret |= sqlite3_bind_int64(dbc->coll->getcids, 1, pid);
+	ret |= sqlite3_bind_int64(dbc->coll->getcids, 2, oid);
+	ret = coll_collect_cids(dbc, dbc->coll->getcids, ret, &in);
+	for (i = 0; ret == OSD_OK && i < in.n; i++)
+		ret = coll_bm_change(dbc, pid, in.cid[i]);
+	if (ret == OSD_REPEAT)
+		goto repeat;
+	if (ret != OSD_OK)
+		goto out;
+
 	ret = 0;
 	ret |= sqlite3_bind_int64(dbc->coll->deloid, 1, pid);
 	ret |= sqlite3_bind_int64(dbc->coll->deloid, 2, oid);
 	ret = db_exec_dms(dbc, dbc->coll->deloid, ret, __func__);
 	if (ret == OSD_REPEAT)
 		goto repeat;
+	for (i = 0; ret == OSD_OK && i < in.n; i++)
+		if ((b = coll_bm_find(dbc, pid, in.cid[i])))
+			collbm_remove(b->bm, oid);
 
+out:
+	free(in.cid);
 	return ret;
 }
 
 
+/*
+ * Delete every membership of the members of cid, in cid and in the other
+ * collections they belong to. Each collection loses its share with one
+ * statement that stays on the primary key; cid goes last, since it is
+ * where the statement finds the members.
+ *
+ * returns:
+ * -ENOMEM: out of memory
+ * OSD_ERROR: some other error
+ * OSD_OK: success
+ */
+int coll_delete_members(void *ohandle, uint64_t pid, uint64_t cid)
+{
+	struct db_context *dbc = db_shard(ohandle, pid);
+	int ret = 0;
+	uint32_t i = 0;
+	struct coll_bm *b = NULL;
+	struct cids losers = {NULL, 0, 0};
+
+	assert(dbc && dbc->db && dbc->coll && dbc->coll->delmem);
+
+repeat:
+	losers.n = 0;
+	ret = 0;
+	ret |= sqlite3_bind_int64(dbc->coll->memlost, 1, pid);
+	ret |= sqlite3_bind_int64(dbc->coll->memlost, 2, cid);
+	ret = coll_collect_cids(dbc, dbc->coll->memlost, ret, &losers);
+	for (i = 0; ret == OSD_OK && i < losers.n; i++)
+		ret = coll_bm_change(dbc, pid, losers.cid[i]);
+	if (ret == OSD_OK)
+		ret = coll_bm_change(dbc, pid, cid);
+	if (ret == OSD_REPEAT)
+		goto repeat;
+	if (ret != OSD_OK)
+		goto out;
+
+	for (i = 0; i <= losers.n; i++) {
+		ret = 0;
+		ret |= sqlite3_bind_int64(dbc->coll->delmem, 1, pid);
+		ret |= sqlite3_bind_int64(dbc->coll->delmem, 2, cid);
+		ret |= sqlite3_bind_int64(dbc->coll->delmem, 3,
+					  i < losers.n ? losers.cid[i] : cid);
+		ret = db_exec_dms(dbc, dbc->coll->delmem, ret, __func__);
+		if (ret == OSD_REPEAT)
+			goto repeat;
+		if (ret != OSD_OK)
+			goto out;
+	}
+
+	/* as in coll_copyoids, the losers are read again when next used */
+	for (i = 0; i < losers.n; i++)
+		if ((b = coll_bm_find(dbc, pid, losers.cid[i])))
+			coll_bm_drop(dbc, b);
+	if ((b = coll_bm_find(dbc, pid, cid)))
+		coll_bm_drop(dbc, b);
+
+out:
+	free(losers.cid);
+	return ret;
+}
+
 /*
  * tests whether collection is empty. 
  *
@@ -354,13 +988,20 @@ repeat:
 int coll_isempty_cid(void *ohandle, uint64_t pid, uint64_t cid,
 		     int *isempty)
 {
-  struct db_context *dbc = ((struct handle*)ohandle)->dbc;
+  struct db_context *dbc = db_shard(ohandle, pid);
 	int ret = 0;
 	int bound = 0;
+	struct coll_bm *b = NULL;
 	*isempty = 0;
 
 	assert(dbc && dbc->db && dbc->coll && dbc->coll->emptycid);
 
+	b = coll_bm_find(dbc, pid, cid);
+	if (b) {
+		*isempty = (b->bm->card == 0);
+		return OSD_OK;
+	}
+
 repeat:
 	ret = 0;
 	ret |= sqlite3_bind_int64(dbc->coll->emptycid, 1, pid);
@@ -393,32 +1034,16 @@ out:
 int coll_get_cid(void *ohandle, uint64_t pid, uint64_t oid, 
 		 uint32_t number, uint64_t *cid)
 {
-  struct db_context *dbc = ((struct handle*)ohandle)->dbc;
+  struct db_context *dbc = db_shard(ohandle, pid);
 	int ret = 0;
-	int bound = 0;
+	int found = 0;
 
 	assert(dbc && dbc->db && dbc->coll && dbc->coll->getcid);
 
-repeat:
-	ret = 0;
-	ret |= sqlite3_bind_int64(dbc->coll->getcid, 1, pid);
-	ret |= sqlite3_bind_int64(dbc->coll->getcid, 2, oid);
-	ret |= sqlite3_bind_int64(dbc->coll->getcid, 3, number);
-	bound = (ret == SQLITE_OK);
-	if (!bound) {
-		error_sql(dbc->db, "%s: bind failed", __func__);
-		goto out_reset;
-	}
-
-	while ((ret = sqlite3_step(dbc->coll->getcid)) == SQLITE_BUSY);
-	if (ret == SQLITE_ROW)
-		*cid = sqlite3_column_int64(dbc->coll->getcid, 0);
+	do {
+		ret = coll_lookup_cid(dbc, pid, oid, number, cid, &found);
+	} while (ret == OSD_REPEAT);
 
-out_reset:
-	ret = db_reset_stmt(dbc, dbc->coll->getcid, bound, __func__);
-	if (ret == OSD_REPEAT)
-		goto repeat;
-out:
 	return ret;
 }
 
@@ -434,13 +1059,21 @@ int coll_get_oids_in_cid(void *ohandle, uint64_t pid, uint64_t cid,
 		       uint8_t *outdata, uint64_t *used_outlen,
 		       uint64_t *add_len, uint64_t *cont_id)
 {
-  struct db_context *dbc = ((struct handle*)ohandle)->dbc;
+  struct db_context *dbc = db_shard(ohandle, pid);
 	int ret = 0;
-	uint64_t len = 0;
 	sqlite3_stmt *stmt = NULL;
+	struct coll_bm *b = NULL;
 
 	assert(dbc && dbc->db && dbc->coll && dbc->coll->getoids);
 
+	b = coll_bm_get(dbc, pid, cid);
+	if (!b)
+		goto repeat;
+
+	collbm_list(b->bm, initial_oid, alloc_len, outdata, used_outlen,
+		    add_len, cont_id);
+	return OSD_OK;
+
 repeat:
 	ret = 0;
 	stmt = dbc->coll->getoids;
@@ -455,6 +1088,25 @@ repeat:
 	return ret;
 }
 
+/*
+ * The members of collection cid, valid until the next call into coll.
+ *
+ * returns:
+ * NULL: out of memory or some other error
+ * the member bitmap otherwise
+ */
+const struct collbm *coll_get_members(void *ohandle, uint64_t pid,
+				      uint64_t cid)
+{
+	struct db_context *dbc = db_shard(ohandle, pid);
+	struct coll_bm *b = NULL;
+
+	assert(dbc && dbc->db && dbc->coll);
+
+	b = coll_bm_get(dbc, pid, cid);
+	return b ? b->bm : NULL;
+}
+
 /*
  * Collection Attributes Page (CAP) of a userobject stores its membership in 
  * collections osd2r01 Sec 7.1.2.19.
@@ -20,6 +20,7 @@
 
 #include "osd-types.h"
 
+struct collbm;
 
 int coll_initialize(void *ohandle);
 
@@ -37,6 +38,8 @@ int coll_delete_cid(void *ohandle, uint64_t pid, uint64_t cid);
 
 int coll_delete_oid(void *ohandle, uint64_t pid, uint64_t oid);
 
+int coll_delete_members(void *ohandle, uint64_t pid, uint64_t cid);
+
 int coll_isempty_cid(void *ohandle, uint64_t pid, uint64_t cid,
 		     int *isempty);
 
@@ -54,4 +57,7 @@ int coll_get_oids_in_cid(void *ohandle, uint64_t pid, uint64_t cid,
 int coll_copyoids(void *ohandle, uint64_t pid, uint64_t dest_cid,
 		  uint64_t source_cid);
 
+const struct collbm *coll_get_members(void *ohandle, uint64_t pid,
+				      uint64_t cid);
+
 #endif /* __COLL_H */
@@ -0,0 +1,656 @@
+/*
+ * Compressed bitmaps of object ids.
+ *
+ * Copyright (C) 2007 OSD Team <pvfs-osd@osc.edu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <assert.h>
+#include <endian.h>
+
+#include "osd-types.h"
+#include "osd-util/osd-util.h"
+#include "collbm.h"
+
+#define COLLBM_WORDS (65536 / 64)
+
+/* encodings of a container in collbm_encode */
+enum {
+	COLLBM_ENC_ARRAY = 0,
+	COLLBM_ENC_BITS = 1,
+	COLLBM_ENC_RUNS = 2,
+};
+
+struct collbm *collbm_alloc(void)
+{
+	return Calloc(1, sizeof(struct collbm));
+}
+
+static void collbm_cont_free(struct collbm_cont *c)
+{
+	free(c->arr);
+	free(c->bits);
+}
+
+void collbm_free(struct collbm *bm)
+{
+	uint32_t i = 0;
+
+	if (!bm)
+		return;
+	for (i = 0; i < bm->n; i++)
+		collbm_cont_free(&bm->c[i]);
+	free(bm->c);
+	free(bm);
+}
+
+/*
+ * returns 1 and the index of the container of key in *pos if there is
+ * one, 0 and the index it would be inserted at otherwise
+ */
+static int collbm_find(const struct collbm *bm, uint64_t key, uint32_t *pos)
+{
+	uint32_t lo = 0, hi = bm->n, mid = 0;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (bm->c[mid].key < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	*pos = lo;
+	return lo < bm->n && bm->c[lo].key == key;
+}
+
+/* the same for a low 16 bits value in an array container */
+static int collbm_arr_find(const struct collbm_cont *c, uint16_t low,
+			   uint32_t *pos)
+{
+	uint32_t lo = 0, hi = c->card, mid = 0;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (c->arr[mid] < low)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	*pos = lo;
+	return lo < c->card && c->arr[lo] == low;
+}
+
+static int collbm_to_bits(struct collbm_cont *c)
+{
+	uint32_t i = 0;
+
+	c->bits = Calloc(COLLBM_WORDS, sizeof(*c->bits));
+	if (!c->bits)
+		return -ENOMEM;
+	for (i = 0; i < c->card; i++)
+		c->bits[c->arr[i] >> 6] |= 1ULL << (c->arr[i] & 63);
+	free(c->arr);
+	c->arr = NULL;
+	c->cap = 0;
+	return OSD_OK;
+}
+
+static void collbm_to_arr(struct collbm_cont *c)
+{
+	uint32_t w = 0, n = 0;
+	uint64_t word = 0;
+	uint16_t *arr = Malloc(c->card * sizeof(*arr));
+
+	if (!arr)
+		return; /* stays a bitmap */
+	for (w = 0; w < COLLBM_WORDS; w++)
+		for (word = c->bits[w]; word; word &= word - 1)
+			arr[n++] = w * 64 + __builtin_ctzll(word);
+	free(c->bits);
+	c->bits = NULL;
+	c->arr = arr;
+	c->cap = c->card;
+}
+
+/*
+ * returns:
+ * -ENOMEM: out of memory
+ * 0: oid was in the set already
+ * 1: oid added
+ */
+int collbm_add(struct collbm *bm, uint64_t oid)
+{
+	uint32_t ci = 0, pos = 0, cap = 0;
+	uint16_t low = oid & 0xffff;
+	uint64_t bit = 1ULL << (low & 63);
+	struct collbm_cont *c = NULL;
+	void *p = NULL;
+
+	if (!collbm_find(bm, oid >> 16, &ci)) {
+		if (bm->n == bm->cap) {
+			cap = bm->cap ? 2 * bm->cap : 4;
+			p = realloc(bm->c, cap * sizeof(*bm->c));
+			if (!p)
+				return -ENOMEM;
+			bm->c = p;
+			bm->cap = cap;
+		}
+		memmove(&bm->c[ci + 1], &bm->c[ci],
+			(bm->n - ci) * sizeof(*bm->c));
+		memset(&bm->c[ci], 0, sizeof(*bm->c));
+		bm->c[ci].key = oid >> 16;
+		bm->n++;
+	}
+	c = &bm->c[ci];
+
+	if (c->bits) {
+		if (c->bits[low >> 6] & bit)
+			return 0;
+		c->bits[low >> 6] |= bit;
+		goto added;
+	}
+
+	if (collbm_arr_find(c, low, &pos))
+		return 0;
+	if (c->card == COLLBM_ARRAY_MAX) {
+		if (collbm_to_bits(c) != OSD_OK)
+			return -ENOMEM;
+		c->bits[low >> 6] |= bit;
+		goto added;
+	}
+	if (c->card == c->cap) {
+		cap = c->cap ? 2 * c->cap : 4;
+		p = realloc(c->arr, cap * sizeof(*c->arr));
+		if (!p) {
+			if (c->card == 0) {
+				/* drop the container just made */
+				memmove(c, c + 1,
+					(bm->n - ci - 1) * sizeof(*c));
+				bm->n--;
+			}
+			return -ENOMEM;
+		}
+		c->arr = p;
+		c->cap = cap;
+	}
+	memmove(&c->arr[pos + 1], &c->arr[pos],
+		(c->card - pos) * sizeof(*c->arr));
+	c->arr[pos] = low;
+
+added:
+	c->card++;
+	bm->card++;
+	return 1;
+}
+
+/*
+ * returns:
+ * 0: oid was not in the set
+ * 1: oid removed
+ */
+int collbm_remove(struct collbm *bm, uint64_t oid)
+{
+	uint32_t ci = 0, pos = 0;
+	uint16_t low = oid & 0xffff;
+	uint64_t bit = 1ULL << (low & 63);
+	struct collbm_cont *c = NULL;
+
+	if (!collbm_find(bm, oid >> 16, &ci))
+		return 0;
+	c = &bm->c[ci];
+
+	if (c->bits) {
+		if (!(c->bits[low >> 6] & bit))
+			return 0;
+		c->bits[low >> 6] &= ~bit;
+	} else {
+		if (!collbm_arr_find(c, low, &pos))
+			return 0;
+		memmove(&c->arr[pos], &c->arr[pos + 1],
+			(c->card - pos - 1) * sizeof(*c->arr));
+	}
+	c->card--;
+	bm->card--;
+
+	if (c->card == 0) {
+		collbm_cont_free(c);
+		memmove(c, c + 1, (bm->n - ci - 1) * sizeof(*c));
+		bm->n--;
+	} else if (c->bits && c->card <= COLLBM_ARRAY_MAX / 2) {
+		/* not at COLLBM_ARRAY_MAX, lest it flip on every update */
+		collbm_to_arr(c);
+	}
+	return 1;
+}
+
+int collbm_contains(const struct collbm *bm, uint64_t oid)
+{
+	uint32_t ci = 0, pos = 0;
+	uint16_t low = oid & 0xffff;
+	const struct collbm_cont *c = NULL;
+
+	if (!collbm_find(bm, oid >> 16, &ci))
+		return 0;
+	c = &bm->c[ci];
+	if (c->bits)
+		return (c->bits[low >> 6] >> (low & 63)) & 1;
+	return collbm_arr_find(c, low, &pos);
+}
+
+/*
+ * returns:
+ * NULL: out of memory
+ * a copy of bm otherwise
+ */
+struct collbm *collbm_clone(const struct collbm *bm)
+{
+	uint32_t i = 0;
+	struct collbm *cl = collbm_alloc();
+	struct collbm_cont *c = NULL;
+
+	if (!cl)
+		return NULL;
+	cl->c = Malloc((bm->n ? bm->n : 1) * sizeof(*cl->c));
+	if (!cl->c)
+		goto out_free;
+	cl->cap = bm->n;
+	cl->card = bm->card;
+	for (i = 0; i < bm->n; i++) {
+		c = &cl->c[i];
+		*c = bm->c[i];
+		if (c->bits) {
+			c->bits = Malloc(COLLBM_WORDS * sizeof(*c->bits));
+			if (c->bits)
+				memcpy(c->bits, bm->c[i].bits,
+				       COLLBM_WORDS * sizeof(*c->bits));
+		} else {
+			c->arr = Malloc(c->cap * sizeof(*c->arr));
+			if (c->arr)
+				memcpy(c->arr, bm->c[i].arr,
+				       c->card * sizeof(*c->arr));
+		}
+		cl->n++;
+		if (!c->bits && !c->arr)
+			goto out_free;
+	}
+	return cl;
+
+out_free:
+	collbm_free(cl);
+	return NULL;
+}
+
+/*
+ * start it at the first oid >= oid in bm; bm must not change while it is
+ * in use
+ */
+void collbm_iter_seek(struct collbm_iter *it, const struct collbm *bm,
+		      uint64_t oid)
+{
+	const struct collbm_cont *c = NULL;
+
+	it->bm = bm;
+	it->pos = 0;
+	if (!collbm_find(bm, oid >> 16, &it->ci))
+		return;
+	c = &bm->c[it->ci];
+	it->pos = oid & 0xffff;
+	if (!c->bits)
+		collbm_arr_find(c, oid & 0xffff, &it->pos);
+}
+
+/*
+ * returns:
+ * 0: no more oids
+ * 1: next oid in *oid
+ */
+int collbm_iter_next(struct collbm_iter *it, uint64_t *oid)
+{
+	uint32_t w = 0;
+	uint64_t word = 0;
+	const struct collbm_cont *c = NULL;
+
+	for (; it->ci < it->bm->n; it->ci++, it->pos = 0) {
+		c = &it->bm->c[it->ci];
+		if (!c->bits) {
+			if (it->pos >= c->card)
+				continue;
+			*oid = (c->key << 16) | c->arr[it->pos++];
+			return 1;
+		}
+		if (it->pos >= 65536)
+			continue;
+		w = it->pos >> 6;
+		word = c->bits[w] & (~0ULL << (it->pos & 63));
+		while (word == 0 && ++w < COLLBM_WORDS)
+			word = c->bits[w];
+		if (word == 0)
+			continue;
+		it->pos = w * 64 + __builtin_ctzll(word);
+		*oid = (c->key << 16) | it->pos;
+		it->pos++;
+		return 1;
+	}
+	return 0;
+}
+
+/* number of oids from where it stands on, without visiting them */
+static uint64_t collbm_iter_rest(const struct collbm_iter *it)
+{
+	uint32_t i = 0, w = 0;
+	uint64_t n = 0;
+	const struct collbm_cont *c = NULL;
+
+	if (it->ci >= it->bm->n)
+		return 0;
+	c = &it->bm->c[it->ci];
+	if (!c->bits) {
+		n = it->pos < c->card ? c->card - it->pos : 0;
+	} else if (it->pos < 65536) {
+		w = it->pos >> 6;
+		n = __builtin_popcountll(c->bits[w] & (~0ULL << (it->pos & 63)));
+		for (w++; w < COLLBM_WORDS; w++)
+			n += __builtin_popcountll(c->bits[w]);
+	}
+	for (i = it->ci + 1; i < it->bm->n; i++)
+		n += it->bm->c[i].card;
+	return n;
+}
+
+/*
+ * returns:
+ * 0: bm is empty
+ * 1: its largest oid in *oid
+ */
+int collbm_max(const struct collbm *bm, uint64_t *oid)
+{
+	uint32_t w = COLLBM_WORDS;
+	const struct collbm_cont *c = NULL;
+
+	if (bm->n == 0)
+		return 0;
+	c = &bm->c[bm->n - 1];
+	if (!c->bits) {
+		*oid = (c->key << 16) | c->arr[c->card - 1];
+		return 1;
+	}
+	while (c->bits[--w] == 0);
+	*oid = (c->key << 16) | (w * 64 + 63 - __builtin_clzll(c->bits[w]));
+	return 1;
+}
+
+/*
+ * Put the oids of bm from initial_oid on into outdata as the id list of
+ * LIST, the way db_exec_id_rtrvl_stmt does with rows: big-endian, as many
+ * as fit in alloc_len, the first one that does not in *cont_id, and all
+ * of them counted in *add_len unless the caller passed in a known
+ * length. The count comes from the cardinalities of the containers, so
+ * the oids past the page are never visited.
+ */
+void collbm_list(const struct collbm *bm, uint64_t initial_oid,
+		 uint64_t alloc_len, uint8_t *outdata, uint64_t *used_outlen,
+		 uint64_t *add_len, uint64_t *cont_id)
+{
+	uint32_t i = 0, k = 0;
+	uint64_t n = 0, room = alloc_len / 8, total = 0;
+	uint64_t oid = 0, base = 0, be = 0;
+	const struct collbm_cont *c = NULL;
+	struct collbm_iter it;
+
+	*cont_id = 0;
+	collbm_iter_seek(&it, bm, initial_oid);
+	while (n < room) {
+		c = it.ci < bm->n ? &bm->c[it.ci] : NULL;
+		if (c && !c->bits) {
+			/* straight off the array, one tight loop per container */
+			k = it.pos < c->card ? c->card - it.pos : 0;
+			if (k > room - n)
+				k = room - n;
+			base = c->key << 16;
+			for (i = 0; i < k; i++) {
+				be = htobe64(base | c->arr[it.pos + i]);
+				memcpy(outdata + 8 * (n + i), &be, 8);
+			}
+			n += k;
+			it.pos += k;
+			if (it.pos >= c->card) {
+				it.ci++;
+				it.pos = 0;
+			}
+			continue;
+		}
+		if (!collbm_iter_next(&it, &oid))
+			break;
+		set_htonll(outdata + 8 * n, oid);
+		n++;
+	}
+	*used_outlen = 8 * n;
+
+	total = n;
+	if (collbm_iter_next(&it, &oid)) {
+		*cont_id = oid;
+		total += 1 + (*add_len ? 0 : collbm_iter_rest(&it));
+	}
+	if (*add_len)
+		return;
+	/* handle overflow: osd2r01 Sec 6.14.2 */
+	*add_len = total <= (uint64_t) -1 / 8 ? 8 * total : (uint64_t) -1;
+}
+
+/* number of runs of consecutive values in a container */
+static uint32_t collbm_runs(const struct collbm_cont *c)
+{
+	uint32_t i = 0, w = 0, n = 0;
+	uint64_t word = 0, prev = 0;
+
+	if (!c->bits) {
+		for (i = 0; i < c->card; i++)
+			if (i == 0 || c->arr[i] != c->arr[i-1] + 1)
+				n++;
+		return n;
+	}
+	/* a run starts at every set bit whose predecessor is clear */
+	for (w = 0; w < COLLBM_WORDS; w++) {
+		word = c->bits[w];
+		n += __builtin_popcountll(word & ~((word << 1) | prev));
+		prev = word >> 63;
+	}
+	return n;
+}
+
+/*
+ * Serialize bm, each container in the smallest of three forms: sorted
+ * values, a bitmap, or runs of consecutive values, which is what the oids
+ * of objects created in sequence usually are. All fields big-endian:
+ *
+ *   u32 number of containers, then for each
+ *   u64 key, u8 form, then
+ *     array: u16 card-1, card x u16 value
+ *     bits:  8192 bytes, bit 7 of the first one is value 0
+ *     runs:  u16 nruns-1, nruns x (u16 start, u16 length-1)
+ *
+ * returns:
+ * -ENOMEM: out of memory
+ * OSD_OK: success, *buf to be freed by the caller
+ */
+int collbm_encode(const struct collbm *bm, void **buf, size_t *len)
+{
+	uint32_t i = 0, v = 0, start = 0, end = 0;
+	uint64_t oid = 0;
+	size_t sz = 4, arrsz = 0, runsz = 0;
+	uint8_t *p = NULL, *b = NULL;
+	uint8_t *form = NULL;
+	const struct collbm_cont *c = NULL;
+	struct collbm_iter it;
+
+	form = Malloc(bm->n ? bm->n : 1);
+	if (!form)
+		return -ENOMEM;
+	for (i = 0; i < bm->n; i++) {
+		c = &bm->c[i];
+		arrsz = 2 + 2 * (size_t)c->card;
+		runsz = 2 + 4 * (size_t)collbm_runs(c);
+		if (runsz <= arrsz && runsz <= 8192) {
+			form[i] = COLLBM_ENC_RUNS;
+			sz += 9 + runsz;
+		} else if (arrsz <= 8192) {
+			form[i] = COLLBM_ENC_ARRAY;
+			sz += 9 + arrsz;
+		} else {
+			form[i] = COLLBM_ENC_BITS;
+			sz += 9 + 8192;
+		}
+	}
+
+	b = p = Malloc(sz);
+	if (!b) {
+		free(form);
+		return -ENOMEM;
+	}
+	set_htonl(p, bm->n);
+	p += 4;
+	for (i = 0; i < bm->n; i++) {
+		c = &bm->c[i];
+		set_htonll(p, c->key);
+		p[8] = form[i];
+		p += 9;
+		if (form[i] == COLLBM_ENC_BITS) {
+			memset(p, 0, 8192);
+		} else {
+			set_htons(p, (form[i] == COLLBM_ENC_ARRAY ? c->card :
+				      collbm_runs(c)) - 1);
+			p += 2;
+		}
+		/* the values of this container, in order */
+		collbm_iter_seek(&it, bm, c->key << 16);
+		start = end = 0;
+		while (collbm_iter_next(&it, &oid) && (oid >> 16) == c->key) {
+			v = oid & 0xffff;
+			if (form[i] == COLLBM_ENC_BITS) {
+				p[v >> 3] |= 0x80 >> (v & 7);
+			} else if (form[i] == COLLBM_ENC_ARRAY) {
+				set_htons(p, v);
+				p += 2;
+			} else if (end == 0 || v != end) {
+				if (end != 0) {
+					set_htons(p, start);
+					set_htons(p + 2, end - start - 1);
+					p += 4;
+				}
+				start = v;
+				end = v + 1;
+			} else {
+				end++;
+			}
+		}
+		if (form[i] == COLLBM_ENC_BITS) {
+			p += 8192;
+		} else if (form[i] == COLLBM_ENC_RUNS) {
+			set_htons(p, start);
+			set_htons(p + 2, end - start - 1);
+			p += 4;
+		}
+	}
+	free(form);
+	assert(p == b + sz);
+
+	*buf = b;
+	*len = sz;
+	return OSD_OK;
+}
+
+/*
+ * returns:
+ * NULL: out of memory, or buf is not an encoded bitmap
+ * the bitmap otherwise
+ */
+struct collbm *collbm_decode(const void *buf, size_t len)
+{
+	uint32_t i = 0, k = 0, n = 0, cnt = 0, start = 0, rlen = 0, v = 0;
+	const uint8_t *p = buf, *end = p + len;
+	struct collbm *bm = NULL;
+	uint64_t key = 0, prev = 0;
+
+	if (len < 4)
+		return NULL;
+	n = get_ntohl(p);
+	p += 4;
+	bm = collbm_alloc();
+	if (!bm)
+		return NULL;
+
+	for (i = 0; i < n; i++) {
+		if (end - p < 9)
+			goto out_free;
+		key = get_ntohll(p);
+		if (key >> 48 || (i > 0 && key <= prev))
+			goto out_free;
+		prev = key;
+		key <<= 16;
+		switch (p[8]) {
+		case COLLBM_ENC_BITS:
+			p += 9;
+			if (end - p < 8192)
+				goto out_free;
+			for (v = 0; v < 65536; v++)
+				if ((p[v >> 3] << (v & 7)) & 0x80)
+					if (collbm_add(bm, key | v) < 0)
+						goto out_free;
+			p += 8192;
+			break;
+		case COLLBM_ENC_ARRAY:
+			p += 9;
+			if (end - p < 2)
+				goto out_free;
+			cnt = get_ntohs(p) + 1;
+			p += 2;
+			if (end - p < 2 * (ptrdiff_t)cnt)
+				goto out_free;
+			for (k = 0; k < cnt; k++, p += 2)
+				if (collbm_add(bm, key | get_ntohs(p)) < 0)
+					goto out_free;
+			break;
+		case COLLBM_ENC_RUNS:
+			p += 9;
+			if (end - p < 2)
+				goto out_free;
+			cnt = get_ntohs(p) + 1;
+			p += 2;
+			if (end - p < 4 * (ptrdiff_t)cnt)
+				goto out_free;
+			for (k = 0; k < cnt; k++, p += 4) {
+				start = get_ntohs(p);
+				rlen = get_ntohs(p + 2) + 1;
+				if (start + rlen > 65536)
+					goto out_free;
+				for (v = start; v < start + rlen; v++)
+					if (collbm_add(bm, key | v) < 0)
+						goto out_free;
+			}
+			break;
+		default:
+			goto out_free;
+		}
+	}
+	if (p != end)
+		goto out_free;
+	return bm;
+
+out_free:
+	collbm_free(bm);
+	return NULL;
+}
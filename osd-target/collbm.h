@@ -0,0 +1,80 @@
+/*
+ * Compressed bitmaps of object ids.
+ *
+ * Copyright (C) 2007 OSD Team <pvfs-osd@osc.edu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __COLLBM_H
+#define __COLLBM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * A set of oids split the roaring way: the high 48 bits of an oid pick a
+ * container, which holds the low 16 bits either as a sorted array, while
+ * it has at most COLLBM_ARRAY_MAX of them, or as a 65536 bit bitmap.
+ */
+#define COLLBM_ARRAY_MAX (4096)
+
+struct collbm_cont {
+	uint64_t key;		/* oid >> 16 */
+	uint32_t card;
+	uint32_t cap;		/* of arr */
+	uint16_t *arr;
+	uint64_t *bits;		/* set instead of arr past COLLBM_ARRAY_MAX */
+};
+
+struct collbm {
+	uint64_t card;
+	uint32_t n;
+	uint32_t cap;
+	struct collbm_cont *c;	/* ascending keys */
+};
+
+/* visits the oids of a bitmap in ascending order */
+struct collbm_iter {
+	const struct collbm *bm;
+	uint32_t ci;		/* container */
+	uint32_t pos;		/* next index into arr, or bit of bits */
+};
+
+struct collbm *collbm_alloc(void);
+
+void collbm_free(struct collbm *bm);
+
+int collbm_add(struct collbm *bm, uint64_t oid);
+
+int collbm_remove(struct collbm *bm, uint64_t oid);
+
+int collbm_contains(const struct collbm *bm, uint64_t oid);
+
+struct collbm *collbm_clone(const struct collbm *bm);
+
+void collbm_iter_seek(struct collbm_iter *it, const struct collbm *bm,
+		      uint64_t oid);
+
+int collbm_iter_next(struct collbm_iter *it, uint64_t *oid);
+
+int collbm_max(const struct collbm *bm, uint64_t *oid);
+
+void collbm_list(const struct collbm *bm, uint64_t initial_oid,
+		 uint64_t alloc_len, uint8_t *outdata, uint64_t *used_outlen,
+		 uint64_t *add_len, uint64_t *cont_id);
+
+int collbm_encode(const struct collbm *bm, void **buf, size_t *len);
+
+struct collbm *collbm_decode(const void *buf, size_t len);
+
+#endif /* __COLLBM_H */
@@ -30,6 +30,12 @@
 #include "coll.h"
 #include "osd-util/osd-util.h"
 #include "attr.h"
+#include "mtq.h"
+#include "io.h"
+#include "backend.h"
+#include "attr-type.h"
+#include "vacuum.h"
+#include "tune.h"
 
 extern const char osd_schema[];
 
@@ -57,7 +63,7 @@ static int db_check_tables(struct db_context *dbc)
 	int ret = 0;
 	char SQL[MAXSQLEN];
 	char *err = NULL;
-	const char *tables[] = {"attr", "obj", "coll"};
+	const char *tables[] = {"attr", "attrdir", "obj", "coll", "collbm"};
 	struct array arr = {ARRAY_SIZE(tables), tables};
 
 	sprintf(SQL, "SELECT name FROM sqlite_master WHERE type='table' "
@@ -73,25 +79,236 @@ static int db_check_tables(struct db_context *dbc)
 }
 
 
+static int count_rows(void *arg, int count, char **val, char **colname)
+{
+	(*(int *)arg)++;
+	return 0;
+}
+
+/*
+ * Databases created before attrdir was introduced lack the table. Create
+ * it and fill it from the pages already present in attr.
+ *
+ * returns:
+ * OSD_ERROR: in case of any error
+ * OSD_OK: attrdir exists
+ */
+static int db_check_attrdir(struct db_context *dbc)
+{
+	int ret = 0;
+	int found = 0;
+	char *err = NULL;
+
+	ret = sqlite3_exec(dbc->db, "SELECT name FROM sqlite_master WHERE "
+			   " type = 'table' AND name = 'attrdir';", count_rows,
+			   &found, &err);
+	if (ret != SQLITE_OK)
+		goto out_err;
+	if (found)
+		return OSD_OK;
+
+	osd_info("%s: building attrdir from attr", __func__);
+	ret = sqlite3_exec(dbc->db,
+			   "BEGIN TRANSACTION;"
+			   "CREATE TABLE attrdir ("
+			   "  pid INTEGER NOT NULL,"
+			   "  oid INTEGER NOT NULL,"
+			   "  page INTEGER NOT NULL,"
+			   "  PRIMARY KEY (pid, oid, page)) WITHOUT ROWID;"
+			   "INSERT INTO attrdir SELECT DISTINCT pid, oid, page "
+			   "  FROM attr;"
+			   "END TRANSACTION;", NULL, NULL, &err);
+	if (ret != SQLITE_OK) {
+		sqlite3_exec(dbc->db, "ROLLBACK;", NULL, NULL, NULL);
+		goto out_err;
+	}
+	return OSD_OK;
+
+out_err:
+	osd_error("%s: failed: %s", __func__, err);
+	sqlite3_free(err);
+	return OSD_ERROR;
+}
+
+
 /*
+ * Rebuild a rowid table as a WITHOUT ROWID table with the same definition.
+ * Indexes on the table are dropped along with the old copy, so their
+ * definitions are saved beforehand and replayed on the new table.
+ *
+ * returns:
+ * OSD_ERROR: in case of any error
+ * OSD_OK: table is clustered on its primary key
+ */
+static int db_rebuild_table(struct db_context *dbc, const char *name)
+{
+	int ret = 0;
+	char *SQL = NULL;
+	char *idx = NULL;
+	char *err = NULL;
+	sqlite3_stmt *stmt = NULL;
+
+	ret = sqlite3_prepare(dbc->db, "SELECT type, sql FROM sqlite_master "
+			      " WHERE tbl_name = ? AND sql IS NOT NULL "
+			      " ORDER BY type DESC;", -1, &stmt, NULL);
+	if (ret != SQLITE_OK) {
+		error_sql(dbc->db, "%s: sqlite3_prepare", __func__);
+		return OSD_ERROR;
+	}
+	ret = sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+	if (ret != SQLITE_OK) {
+		error_sql(dbc->db, "%s: bind name", __func__);
+		goto out_finalize;
+	}
+
+	/* 'table' sorts before 'index' descending, so it comes first */
+	idx = sqlite3_mprintf("");
+	while ((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+		const char *type = (const char *)sqlite3_column_text(stmt, 0);
+		const char *sql = (const char *)sqlite3_column_text(stmt, 1);
+
+		if (strcmp(type, "table") == 0) {
+			if (strstr(sql, "WITHOUT ROWID"))
+				break;
+			SQL = sqlite3_mprintf("ALTER TABLE %s RENAME TO %s_old;"
+					      "%s WITHOUT ROWID;"
+					      "INSERT INTO %s SELECT * FROM %s_old;"
+					      "DROP TABLE %s_old;", name, name,
+					      sql, name, name, name);
+		} else if (strcmp(type, "index") == 0) {
+			char *p = sqlite3_mprintf("%s%s;", idx, sql);
+			sqlite3_free(idx);
+			idx = p;
+		}
+	}
+	if (ret != SQLITE_ROW && ret != SQLITE_DONE) {
+		error_sql(dbc->db, "%s: sqlite3_step", __func__);
+		goto out_finalize;
+	}
+	sqlite3_finalize(stmt);
+	stmt = NULL;
+
+	ret = OSD_OK;
+	if (SQL == NULL || idx == NULL)
+		goto out;
+
+	osd_info("%s: rebuilding %s WITHOUT ROWID", __func__, name);
+	ret = sqlite3_exec(dbc->db, SQL, NULL, NULL, &err);
+	if (ret == SQLITE_OK)
+		ret = sqlite3_exec(dbc->db, idx, NULL, NULL, &err);
+	if (ret != SQLITE_OK) {
+		osd_error("%s: rebuild of %s failed: %s", __func__, name, err);
+		sqlite3_free(err);
+		ret = OSD_ERROR;
+	}
+	goto out;
+
+out_finalize:
+	sqlite3_finalize(stmt);
+	ret = OSD_ERROR;
+out:
+	sqlite3_free(SQL);
+	sqlite3_free(idx);
+	return ret;
+}
+
+
+static int get_version(void *arg, int count, char **val, char **colname)
+{
+	*(int *)arg = atoi(val[0]);
+	return 0;
+}
+
+/*
+ * Upgrade a database created from an older osd.schema. Version 0 used
+ * rowid tables; version 1 clusters every table on its primary key;
+ * version 2 drops the global val_ind in favour of declared query indexes;
+ * version 3 adds collbm, empty, so every bitmap is first read from coll.
+ *
+ * returns:
+ * OSD_ERROR: in case of any error
+ * OSD_OK: schema is at DB_SCHEMA_VERSION
+ */
+static int db_check_schema(struct db_context *dbc)
+{
+	int i = 0;
+	int ret = 0;
+	int version = 0;
+	char *err = NULL;
+	char SQL[MAXSQLEN];
+	const char *tables[] = {"attr", "attrdir", "obj", "coll"};
+
+	ret = sqlite3_exec(dbc->db, "PRAGMA user_version;", get_version,
+			   &version, &err);
+	if (ret != SQLITE_OK)
+		goto out_err;
+	if (version >= DB_SCHEMA_VERSION)
+		return OSD_OK;
+
+	ret = sqlite3_exec(dbc->db, "BEGIN TRANSACTION;", NULL, NULL, &err);
+	if (ret != SQLITE_OK)
+		goto out_err;
+	for (i = 0; version < 1 && i < ARRAY_SIZE(tables); i++) {
+		ret = db_rebuild_table(dbc, tables[i]);
+		if (ret != OSD_OK)
+			goto out_rollback;
+	}
+	if (version < 2) {
+		ret = sqlite3_exec(dbc->db, "DROP INDEX IF EXISTS val_ind;",
+				   NULL, NULL, &err);
+		if (ret != SQLITE_OK)
+			goto out_err;
+	}
+	if (version < 3) {
+		ret = sqlite3_exec(dbc->db, "CREATE TABLE IF NOT EXISTS collbm ("
+				   "  pid INTEGER NOT NULL,"
+				   "  cid INTEGER NOT NULL,"
+				   "  bitmap BLOB NOT NULL,"
+				   "  PRIMARY KEY (pid, cid)) WITHOUT ROWID;",
+				   NULL, NULL, &err);
+		if (ret != SQLITE_OK)
+			goto out_err;
+	}
+	sprintf(SQL, "PRAGMA user_version = %d; END TRANSACTION;",
+		DB_SCHEMA_VERSION);
+	ret = sqlite3_exec(dbc->db, SQL, NULL, NULL, &err);
+	if (ret != SQLITE_OK)
+		goto out_err;
+	return OSD_OK;
+
+out_rollback:
+	sqlite3_exec(dbc->db, "ROLLBACK;", NULL, NULL, NULL);
+	return OSD_ERROR;
+out_err:
+	osd_error("%s: failed: %s", __func__, err);
+	sqlite3_free(err);
+	sqlite3_exec(dbc->db, "ROLLBACK;", NULL, NULL, NULL);
+	return OSD_ERROR;
+}
+
+
+/*
+ * Open the database file of one shard into *pdbc.
+ *
  *  <0: error
  * ==0: success
- * ==1: new db opened, caller must initialize tables
+ * ==1: new db opened, tables created from the schema
  */
-int osd_db_open(const char *path, struct osd_device *osd)
+static int db_open_shard(const char *path, const struct tune *t,
+			 struct db_context **pdbc)
 {
 	int ret;
 	struct stat sb;
-	char SQL[MAXSQLEN];
 	char *err = NULL;
 	int is_new_db = 0;
+	struct db_context *dbc = NULL;
 
 	ret = stat(path, &sb);
 	if (ret == 0) {
 		if (!S_ISREG(sb.st_mode)) {
 			osd_error("%s: path %s not a regular file %d", 
 				  __func__, path, sb.st_mode);
-			ret = 1;
+			ret = OSD_ERROR;
 			goto out;
 		}
 	} else {
@@ -104,13 +321,13 @@ int osd_db_open(const char *path, struct osd_device *osd)
 		is_new_db = 1;
 	}
 
-	osd->handle->dbc = Calloc(1, sizeof(*osd->handle->dbc));
-	if (!osd->handle->dbc) {
+	dbc = Calloc(1, sizeof(*dbc));
+	if (!dbc) {
 		ret = -ENOMEM;
 		goto out;
 	}
 
-	ret = sqlite3_open(path, &(osd->handle->dbc->db));
+	ret = sqlite3_open(path, &dbc->db);
 	if (ret != SQLITE_OK) {
 		osd_error("%s: open db %s", __func__, path);
 		ret = OSD_ERROR;
@@ -118,8 +335,15 @@ int osd_db_open(const char *path, struct osd_device *osd)
 	}
 
 	if (is_new_db) {
-		/* build tables from schema file */
-		ret = sqlite3_exec(osd->handle->dbc->db, osd_schema, NULL, NULL, &err);
+		/* build tables from schema file; see vacuum.c for the pragma */
+		ret = tune_new_shard(dbc, t);
+		if (ret != OSD_OK)
+			goto out_close_db;
+		ret = sqlite3_exec(dbc->db, "PRAGMA auto_vacuum = INCREMENTAL;",
+				   NULL, NULL, &err);
+		if (ret == SQLITE_OK)
+			ret = sqlite3_exec(dbc->db, osd_schema, NULL, NULL,
+					   &err);
 		if (ret != SQLITE_OK) {
 			sqlite3_free(err);
 			ret = OSD_ERROR;
@@ -127,47 +351,244 @@ int osd_db_open(const char *path, struct osd_device *osd)
 		}
 	} else {
 		/* existing db, check for tables */
-		ret = db_check_tables(osd->handle->dbc);
+		ret = db_check_attrdir(dbc);
+		if (ret != OSD_OK)
+			goto out_close_db;
+		ret = db_check_schema(dbc);
+		if (ret != OSD_OK)
+			goto out_close_db;
+		ret = db_check_tables(dbc);
 		if (ret != OSD_OK)
 			goto out_close_db;
 	}
 
+	ret = attr_create_functions(dbc);
+	if (ret != OSD_OK) {
+		ret = OSD_ERROR;
+		goto out_close_db;
+	}
+
 	/* initialize dbc fields */
-	ret = db_initialize(osd->handle->dbc);
+	ret = db_initialize(dbc);
 	if (ret != OSD_OK) {
 		ret = OSD_ERROR;
 		goto out_close_db;
 	}
 
+	*pdbc = dbc;
 	if (is_new_db) 
 		ret = 1;
 	goto out;
 
 out_close_db:
-	sqlite3_close(osd->handle->dbc->db);
+	sqlite3_close(dbc->db);
 out_free_dbc:
-	free(osd->handle->dbc);
-	osd->handle->dbc = NULL;
+	free(dbc);
 out:
 	return ret;
 }
 
 
-int osd_db_close(struct osd_device *osd)
+static void db_close_shard(struct db_context *dbc)
+{
+	db_finalize(dbc);
+	sqlite3_close(dbc->db);
+	free(dbc);
+}
+
+
+/*
+ * The shard count of an osd is kept in the application_id of osd.db, a
+ * header field that, unlike a table, changes no schema under the
+ * prepared statements. Read with a connection of its own, since it
+ * decides how many shards there are to open; 0 if it was never set.
+ */
+static int db_get_nshard(const char *path, int *nshard)
 {
 	int ret = 0;
+	sqlite3 *db = NULL;
+	sqlite3_stmt *stmt = NULL;
+
+	ret = sqlite3_open_v2(path, &db, SQLITE_OPEN_READONLY, NULL);
+	if (ret == SQLITE_OK)
+		ret = sqlite3_prepare_v2(db, "PRAGMA application_id;", -1,
+					 &stmt, NULL);
+	if (ret == SQLITE_OK) {
+		while ((ret = sqlite3_step(stmt)) == SQLITE_BUSY);
+		if (ret == SQLITE_ROW) {
+			*nshard = sqlite3_column_int(stmt, 0);
+			ret = SQLITE_OK;
+		}
+	}
+	if (ret != SQLITE_OK)
+		error_sql(db, "%s: %s", __func__, path);
+	sqlite3_finalize(stmt);
+	sqlite3_close(db);
+	return ret == SQLITE_OK ? OSD_OK : OSD_ERROR;
+}
 
-	assert(osd && osd->handle->dbc && osd->handle->dbc->db);
+/*
+ * Open the shards of the osd at root, see db_shard. osd.db is opened last
+ * so that it exists only with all of its shards, and is told their count
+ * once they are open. An osd from before the count was kept has
+ * osd.db.1 on to the first missing one, and gets its count recorded. A
+ * shard missing from the count fails the open: with fewer shards pid %
+ * nshard would place partitions in the wrong files. The tunables of
+ * TUNE_FILE under root are applied to every shard.
+ *
+ *  <0: error
+ * ==0: success
+ * ==1: new db opened, caller must initialize tables
+ */
+int osd_db_open(const char *root, struct osd_device *osd)
+{
+	int i = 0;
+	int ret = 0;
+	int nshard = 0;
+	int known = 0;
+	struct stat sb;
+	char path[MAXNAMELEN];
+	char SQL[MAXSQLEN];
+	struct handle *h = osd->handle;
 
-	db_finalize(osd->handle->dbc);
-	sqlite3_close(osd->handle->dbc->db);
-	free(osd->handle->dbc);
-	osd->handle->dbc = NULL;
+	get_dbname(path, root);
+	if (stat(path, &sb) != 0) {
+		nshard = DB_NSHARD;
+	} else {
+		ret = db_get_nshard(path, &nshard);
+		if (ret != OSD_OK)
+			return ret;
+		known = (nshard > 0);
+		if (!known) {
+			for (nshard = 1;; nshard++) {
+				get_shard_dbname(path, root, nshard);
+				if (stat(path, &sb) != 0)
+					break;
+			}
+		}
+		for (i = 1; i < nshard; i++) {
+			get_shard_dbname(path, root, i);
+			if (stat(path, &sb) != 0) {
+				osd_error("%s: shard %s of %d is missing",
+					  __func__, path, nshard);
+				return -ENOENT;
+			}
+		}
+	}
+
+	ret = tune_load(root, &h->tune);
+	if (ret != OSD_OK)
+		return ret;
+
+	h->shard = Calloc(nshard, sizeof(*h->shard));
+	if (!h->shard) {
+		ret = -ENOMEM;
+		goto out_tune;
+	}
+
+	for (i = nshard - 1; i >= 0; i--) {
+		get_shard_dbname(path, root, i);
+		ret = db_open_shard(path, h->tune, &h->shard[i]);
+		if (ret < 0)
+			goto out_close;
+	}
+	h->nshard = nshard;
+	h->dbc = h->shard[0];
+	if (!known) {
+		sprintf(SQL, "PRAGMA application_id = %d;", nshard);
+		if (sqlite3_exec(h->dbc->db, SQL, NULL, NULL, NULL) !=
+		    SQLITE_OK) {
+			error_sql(h->dbc->db, "%s: %s", __func__, SQL);
+			osd_db_close(osd);
+			return OSD_ERROR;
+		}
+	}
+	if (tune_apply(h) != OSD_OK) {
+		osd_db_close(osd);
+		return OSD_ERROR;
+	}
+	return ret;
+
+out_close:
+	for (i++; i < nshard; i++)
+		db_close_shard(h->shard[i]);
+	free(h->shard);
+	h->shard = NULL;
+	h->nshard = 0;
+out_tune:
+	tune_release(h);
+	return ret;
+}
+
+
+int osd_db_close(struct osd_device *osd)
+{
+	int i = 0;
+	struct handle *h = osd->handle;
+
+	assert(osd && h->dbc && h->dbc->db);
+
+	tune_release(h);
+	for (i = 0; i < h->nshard; i++)
+		db_close_shard(h->shard[i]);
+	free(h->shard);
+	h->shard = NULL;
+	h->nshard = 0;
+	h->dbc = NULL;
+	attr_types_free(h->qtypes);
+	h->qtypes = NULL;
 
 	return OSD_OK;
 }
 
 
+/*
+ * A command transaction spans every shard. BEGIN is deferred, so a
+ * shard the command does not touch takes no lock.
+ */
+int osd_db_begin_txn(struct osd_device *osd)
+{
+	int i = 0;
+	int ret = 0;
+	struct handle *h = osd->handle;
+
+	for (i = 0; i < h->nshard; i++) {
+		ret = db_begin_txn(h->shard[i]);
+		if (ret != OSD_OK)
+			break;
+	}
+	if (ret == OSD_OK)
+		return OSD_OK;
+
+	while (--i >= 0)
+		sqlite3_exec(h->shard[i]->db, "ROLLBACK;", NULL, NULL, NULL);
+	return ret;
+}
+
+
+/*
+ * Commit the shards one by one. That is not atomic across shards. A
+ * command works on one partition, and the rows of a partition, its own
+ * object included, are all in one shard. The one exception is a change
+ * to ROOT_QUERY_PG, whose query indexes attr_sync_query_idx makes in
+ * every shard: a crash between the commits can leave some shards with
+ * the indexes of the old declarations. Indexes only speed queries up,
+ * and the next open runs attr_sync_query_idx again, which brings every
+ * shard in line with the declarations in shard 0.
+ */
+int osd_db_end_txn(struct osd_device *osd)
+{
+	int i = 0;
+	int ret = OSD_OK;
+	struct handle *h = osd->handle;
+
+	for (i = 0; i < h->nshard; i++)
+		if (db_end_txn(h->shard[i]) != OSD_OK)
+			ret = OSD_ERROR;
+	return ret;
+}
+
+
 int db_initialize(struct db_context *dbc)
 {
 	int ret = 0;
@@ -186,10 +607,20 @@ int db_initialize(struct db_context *dbc)
 	ret = attr_initialize(dbc);
 	if (ret != OSD_OK)
 		goto finalize_attr;
+	ret = mtq_initialize(dbc);
+	if (ret != OSD_OK)
+		goto finalize_mtq;
+	ret = vacuum_initialize(dbc);
+	if (ret != OSD_OK)
+		goto finalize_vacuum;
 
 	ret = OSD_OK;
 	goto out;
 
+finalize_vacuum:
+	vacuum_finalize(dbc);
+finalize_mtq:
+	mtq_finalize(dbc);
 finalize_attr:
 	attr_finalize(dbc);
 finalize_obj:
@@ -212,6 +643,8 @@ int db_finalize(struct db_context *dbc)
 	ret |= coll_finalize(dbc);
 	ret |= obj_finalize(dbc);
 	ret |= attr_finalize(dbc);
+	ret |= mtq_finalize(dbc);
+	ret |= vacuum_finalize(dbc);
 	if (ret == OSD_OK)
 		return OSD_OK;
 
@@ -266,9 +699,7 @@ int db_exec_pragma(struct db_context *dbc)
 
 	sprintf(SQL,
 		"PRAGMA synchronous = OFF; " /* sync off */
-		"PRAGMA auto_vacuum = 1; "   /* reduce db size on delete */
 		"PRAGMA count_changes = 0; " /* ignore count changes */
-		"PRAGMA temp_store = 0; "    /* memory as scratchpad */
 	       );
 	ret = sqlite3_exec(dbc->db, SQL, NULL, NULL, &err);
 	if (ret != SQLITE_OK) {
@@ -299,7 +730,9 @@ int db_print_pragma(struct db_context *dbc)
 	sprintf(SQL,
 		" PRAGMA synchronous;"
 		" PRAGMA auto_vacuum;"
-		" PRAGMA auto_vacuum;"
+		" PRAGMA page_size;"
+		" PRAGMA cache_size;"
+		" PRAGMA mmap_size;"
 		" PRAGMA temp_store;"
 	       );
 	ret = sqlite3_exec(dbc->db, SQL, callback, NULL, &err);
@@ -368,6 +801,10 @@ out_reset:
  * this function executes id retrieval statement. Only the functions
  * retireiving a list of oids, cids or pids may use this function
  *
+ * add_len is the length of the list from the first row on when it is
+ * known from an earlier page, 0 otherwise; when known, the rows past the
+ * first one that does not fit are not read.
+ *
  * returns:
  * OSD_ERROR: in case of any error
  * OSD_OK: on success
@@ -380,6 +817,7 @@ int db_exec_id_rtrvl_stmt(struct db_context *dbc, sqlite3_stmt *stmt,
 			  uint64_t *add_len, uint64_t *cont_id)
 {
 	uint64_t len = 0;
+	uint64_t known = *add_len;
 	int bound = (ret == SQLITE_OK);
 
 	if (!bound) {
@@ -401,6 +839,8 @@ int db_exec_id_rtrvl_stmt(struct db_context *dbc, sqlite3_stmt *stmt,
 				len += 8;
 			} else if (*cont_id == 0) {
 				*cont_id = sqlite3_column_int64(stmt, 0);
+				if (known)
+					break;
 			}
 			/* handle overflow: osd2r01 Sec 6.14.2 */
 			if (*add_len + 8 > *add_len) {
@@ -422,6 +862,76 @@ out_reset:
 	ret = db_reset_stmt(dbc, stmt, bound, func);
 	if (ret == OSD_OK)
 		*used_outlen = len;
+	if (known)
+		*add_len = known;
 	return ret;
 }
 
+
+/* the SQLite metadata backend, data in files under dfiles */
+const struct osd_backend sqlite_backend = {
+	.name = "sqlite",
+
+	.open = setup_root_paths,
+	.close = io_close,
+	.begin_txn = io_begin_txn,
+	.end_txn = io_end_txn,
+	.vacuum = vacuum_run,
+	.vacuum_stats = vacuum_get_stats,
+	.cache_stats = tune_get_stats,
+
+	.obj_insert = obj_insert,
+	.obj_insert_range = obj_insert_range,
+	.obj_delete = obj_delete,
+	.obj_get_nextoid = obj_get_nextoid,
+	.obj_get_nextpid = obj_get_nextpid,
+	.obj_ispresent = obj_ispresent,
+	.obj_isempty_pid = obj_isempty_pid,
+	.obj_get_type = obj_get_type,
+	.obj_get_oids_in_pid = obj_get_oids_in_pid,
+	.obj_get_cids_in_pid = obj_get_cids_in_pid,
+	.obj_get_all_pids = obj_get_all_pids,
+
+	.attr_set_attr = attr_set_attr,
+	._attr_set_attr = _attr_set_attr,
+	.attr_set_conversion = attr_set_conversion,
+	.attr_set_attr_list = attr_set_attr_list,
+	.attr_delete_attr = attr_delete_attr,
+	.attr_delete_all = attr_delete_all,
+	.attr_get_attr = attr_get_attr,
+	.attr_get_conversion = attr_get_conversion,
+	.attr_get_val = attr_get_val,
+	.attr_cas = attr_cas,
+	.attr_fa = attr_fa,
+	.attr_gen_cas = attr_gen_cas,
+	.attr_get_page_as_list = attr_get_page_as_list,
+	.attr_get_for_all_pages = attr_get_for_all_pages,
+	.attr_get_all_attrs = attr_get_all_attrs,
+	.attr_get_attr_list = attr_get_attr_list,
+	.attr_get_dir_page = attr_get_dir_page,
+	.attr_sync_query_idx = attr_sync_query_idx,
+
+	.coll_insert = coll_insert,
+	.coll_delete = coll_delete,
+	.coll_delete_cid = coll_delete_cid,
+	.coll_delete_oid = coll_delete_oid,
+	.coll_isempty_cid = coll_isempty_cid,
+	.coll_get_cid = coll_get_cid,
+	.coll_get_oids_in_cid = coll_get_oids_in_cid,
+	.coll_copyoids = coll_copyoids,
+
+	.mtq_run_query = mtq_run_query,
+	.mtq_list_oids_attr = mtq_list_oids_attr,
+	.mtq_list_members_attr = mtq_list_members_attr,
+	.mtq_set_member_attrs = mtq_set_member_attrs,
+	.mtq_remove_members = mtq_remove_members,
+
+	.contig_read = contig_read,
+	.sgl_read = sgl_read,
+	.vec_read = vec_read,
+	.contig_write = contig_write,
+	.sgl_write = sgl_write,
+	.vec_write = vec_write,
+	.osd_create_datafile = osd_create_datafile,
+	.format_osd = format_osd,
+};
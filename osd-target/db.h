@@ -21,6 +21,9 @@
 #include <sqlite3.h>
 #include "osd-types.h"
 
+/* must match the user_version set at the end of osd.schema */
+#define DB_SCHEMA_VERSION (3)
+
 /*
  * Encapsulate all db structs in db context. each db context is handled by an
  * independent thread.
@@ -30,12 +33,39 @@ struct db_context {
   struct coll_tab *coll;
   struct obj_tab *obj;
   struct attr_tab *attr;
+  struct mtq_tab *mtq;
+  struct vacuum_tab *vac;
+  /* vacuum counters, kept when a schema change renews vac */
+  uint64_t vac_slices;
+  uint64_t vac_reclaimed;
+  uint64_t vac_usec;
 };
 
-int osd_db_open(const char *path, struct osd_device *osd);
+/*
+ * The metadata is split over shards, each a database file with its own
+ * connection and statements, so that writes to one partition do not
+ * hold the lock of the others. Every row carries the pid of its
+ * partition, and partition pid lives in shard pid % nshard: the root
+ * and partition zero in shard 0, osd.db. A LUN gets DB_NSHARD shards
+ * when it is created; one made before shards has just osd.db.
+ */
+#define DB_NSHARD (4)
+
+static inline struct db_context *db_shard(void *ohandle, uint64_t pid)
+{
+	struct handle *h = ohandle;
+
+	return h->shard[pid % h->nshard];
+}
+
+int osd_db_open(const char *root, struct osd_device *osd);
 
 int osd_db_close(struct osd_device *osd);
 
+int osd_db_begin_txn(struct osd_device *osd);
+
+int osd_db_end_txn(struct osd_device *osd);
+
 int db_initialize(struct db_context *dbc);
 
 int db_finalize(struct db_context *dbc);
@@ -0,0 +1,184 @@
+/*
+ * Background work between commands.
+ *
+ * Copyright (C) 2007 OSD Team <pvfs-osd@osc.edu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "osd.h"
+#include "osd-util/osd-util.h"
+#include "idle.h"
+
+/*
+ * Metadata vacuum runs on a thread of its own, never inside a command.
+ * osdemu_cmd_submit holds cmd for the whole of a command, so the thread
+ * takes it with trylock, every IDLE_TICK_MS, and only finds it free
+ * between commands. If no command began since the last tick the
+ * transport is idle, and the thread vacuums with idle set, slice after
+ * slice while osd_vacuum has more and no command comes in; otherwise it
+ * runs the one slice osd_vacuum does for a store with much free space.
+ *
+ * The thread starts with the first command through osdemu_cmd_submit:
+ * callers of the osd_* functions without it hold no cmd, and would race
+ * with the thread on the metadata store. It lasts until the osd_close
+ * outside of a command; FORMAT closes and reopens the osd within one,
+ * and keeps it.
+ */
+struct idle {
+	uint64_t cmds;		/* commands begun, under cmd */
+	int in_cmd;		/* set by the command thread only */
+	int stop;
+	pthread_t thread;
+	pthread_mutex_t cmd;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+/*
+ * wait for the next tick; returns 1 if the thread is asked to stop
+ */
+static int idle_wait(struct idle *i)
+{
+	int stop = 0;
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_nsec += IDLE_TICK_MS * 1000000L;
+	while (ts.tv_nsec >= 1000000000L) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
+	}
+	pthread_mutex_lock(&i->lock);
+	if (!i->stop)
+		pthread_cond_timedwait(&i->cond, &i->lock, &ts);
+	stop = i->stop;
+	pthread_mutex_unlock(&i->lock);
+	return stop;
+}
+
+static int idle_stopping(struct idle *i)
+{
+	int stop = 0;
+
+	pthread_mutex_lock(&i->lock);
+	stop = i->stop;
+	pthread_mutex_unlock(&i->lock);
+	return stop;
+}
+
+static void *idle_thread(void *arg)
+{
+	struct osd_device *osd = arg;
+	struct idle *i = osd->idle;
+	uint64_t seen = 0;
+	int idle = 0;
+	int more = 0;
+
+	while (!idle_wait(i)) {
+		do {
+			if (pthread_mutex_trylock(&i->cmd) != 0)
+				break;
+			idle = (i->cmds == seen);
+			seen = i->cmds;
+			more = osd_vacuum(osd, idle);
+			pthread_mutex_unlock(&i->cmd);
+		} while (idle && more && !idle_stopping(i));
+	}
+	return NULL;
+}
+
+static int idle_start(struct osd_device *osd)
+{
+	int ret = 0;
+	struct idle *i = NULL;
+
+	i = Calloc(1, sizeof(*i));
+	if (!i)
+		return -ENOMEM;
+	pthread_mutex_init(&i->cmd, NULL);
+	pthread_mutex_init(&i->lock, NULL);
+	pthread_cond_init(&i->cond, NULL);
+	osd->idle = i;
+
+	ret = pthread_create(&i->thread, NULL, idle_thread, osd);
+	if (ret != 0) {
+		osd_error("%s: pthread_create: %d", __func__, ret);
+		pthread_cond_destroy(&i->cond);
+		pthread_mutex_destroy(&i->lock);
+		pthread_mutex_destroy(&i->cmd);
+		free(i);
+		osd->idle = NULL;
+		return -ret;
+	}
+	return OSD_OK;
+}
+
+/*
+ * Called by osdemu_cmd_submit before a command, which then runs with the
+ * idle thread kept off the osd. Without a thread, which could not be
+ * started, commands run as they would without vacuum.
+ */
+void idle_cmd_begin(struct osd_device *osd)
+{
+	struct idle *i = osd->idle;
+
+	if (!i) {
+		if (idle_start(osd) != OSD_OK)
+			return;
+		i = osd->idle;
+	}
+	pthread_mutex_lock(&i->cmd);
+	i->cmds++;
+	i->in_cmd = 1;
+}
+
+/* called by osdemu_cmd_submit once the command has run */
+void idle_cmd_end(struct osd_device *osd)
+{
+	struct idle *i = osd->idle;
+
+	if (!i || !i->in_cmd)
+		return;
+	i->in_cmd = 0;
+	pthread_mutex_unlock(&i->cmd);
+}
+
+/*
+ * Stop the idle thread of osd, unless called from within a command, see
+ * struct idle.
+ */
+void idle_stop(struct osd_device *osd)
+{
+	struct idle *i = osd->idle;
+
+	if (!i || i->in_cmd)
+		return;
+	pthread_mutex_lock(&i->lock);
+	i->stop = 1;
+	pthread_cond_signal(&i->cond);
+	pthread_mutex_unlock(&i->lock);
+	pthread_join(i->thread, NULL);
+
+	pthread_cond_destroy(&i->cond);
+	pthread_mutex_destroy(&i->lock);
+	pthread_mutex_destroy(&i->cmd);
+	free(i);
+	osd->idle = NULL;
+}
@@ -0,0 +1,32 @@
+/*
+ * Background work between commands.
+ *
+ * Copyright (C) 2007 OSD Team <pvfs-osd@osc.edu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __IDLE_H
+#define __IDLE_H
+
+#include "osd-types.h"
+
+/* the idle thread looks for a pause in the commands every IDLE_TICK_MS */
+#define IDLE_TICK_MS (200)
+
+void idle_cmd_begin(struct osd_device *osd);
+
+void idle_cmd_end(struct osd_device *osd);
+
+void idle_stop(struct osd_device *osd);
+
+#endif /* __IDLE_H */
@@ -4,14 +4,17 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <dirent.h>
 #include <sys/stat.h>
 
 
 #include "io.h"
+#include "backend.h"
 #include "db.h"
 #include "osd.h"
 #include "osd-sense.h"
 #include "osd-types.h"
+#include "reaper.h"
 #include "target-sense.h"
 #include "osd-util/osd-util.h"
 
@@ -275,7 +278,7 @@ int contig_write(struct osd_device *osd, uint64_t pid, uint64_t oid,
     osd_debug("%s: pid %llu oid %llu len %llu offset %llu data %p",
             __func__, llu(pid), llu(oid), llu(len), llu(offset), dinbuf);
 
-    assert(osd && osd->root && osd->handle->dbc && dinbuf && sense);
+    assert(osd && osd->root && osd->handle && dinbuf && sense);
 
     if (!(pid >= USEROBJECT_PID_LB && oid >= USEROBJECT_OID_LB))
         goto out_cdb_err;
@@ -321,7 +324,7 @@ int sgl_write(struct osd_device *osd, uint64_t pid, uint64_t oid,
     osd_info("%s: pid %llu oid %llu len %llu offset %llu data %p",
             __func__, llu(pid), llu(oid), llu(len), llu(offset), dinbuf);
 
-    assert(osd && osd->root && osd->handle->dbc && dinbuf && sense);
+    assert(osd && osd->root && osd->handle && dinbuf && sense);
 
     pairs = sglist->num_entries;
     assert(pairs != 0);
@@ -390,7 +393,7 @@ int vec_write(struct osd_device *osd, uint64_t pid, uint64_t oid,
     osd_debug("%s: pid %llu oid %llu len %llu offset %llu data %p",
             __func__, llu(pid), llu(oid), llu(len), llu(offset), dinbuf);
 
-    assert(osd && osd->root && osd->handle->dbc && dinbuf && sense);
+    assert(osd && osd->root && osd->handle && dinbuf && sense);
 
     stride = get_ntohll(dinbuf);
     hdr_offset = sizeof(uint64_t);
@@ -446,16 +449,106 @@ out_cdb_err:
     return ret;
 }
 
-int
-setup_root_paths (const char* root, struct osd_device *osd) {                              
+/*
+ * Finish a FORMAT that was cut short. format_osd puts formatting in root
+ * before it strands md and takes it away once dfiles has followed, so
+ * with it there either may still be in place.
+ *
+ * returns:
+ * -errno: md or dfiles could not be stranded, or the mark not removed
+ * OSD_OK: success
+ */
+static int format_resume(const char *root)
+{
+    int ret = 0;
+    char path[MAXNAMELEN];
 
-    int i = 0;
+    sprintf(path, "%s/%s", root, formatting);
+    if (access(path, F_OK) != 0)
+        return errno == ENOENT ? OSD_OK : -errno;
+
+    osd_info("%s: finishing an interrupted format of %s", __func__, root);
+    ret = reaper_strand_dir(root, md);
+    if (ret == OSD_OK || ret == -ENOENT)
+        ret = reaper_strand_dir(root, dfiles);
+    if (ret != OSD_OK && ret != -ENOENT)
+        return ret;
+    if (unlink(path) != 0)
+        return -errno;
+    return OSD_OK;
+}
+
+/* 1 if there is a file anywhere under dirname, else 0 or -errno */
+static int dir_has_files(const char *dirname)
+{
     int ret = 0;
     char path[MAXNAMELEN];
-    char *argv[] = { strdup("osd-target"), NULL };
+    DIR *dir = NULL;
+    struct dirent *ent = NULL;
+    struct stat sb;
+
+    dir = opendir(dirname);
+    if (!dir)
+        return errno == ENOENT ? 0 : -errno;
+    while (ret == 0 && (ent = readdir(dir)) != NULL) {
+        if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, ".."))
+            continue;
+        if (snprintf(path, sizeof(path), "%s/%s", dirname,
+                    ent->d_name) >= (int)sizeof(path)) {
+            ret = -ENAMETOOLONG;
+            break;
+        }
+        if (ent->d_type == DT_DIR ||
+            (ent->d_type == DT_UNKNOWN && lstat(path, &sb) == 0 &&
+             S_ISDIR(sb.st_mode)))
+            ret = dir_has_files(path);
+        else
+            ret = 1;
+    }
+    closedir(dir);
+    return ret;
+}
+
+/*
+ * Called by a backend before it creates its metadata store under root.
+ * Data files already in dfiles would then belong to no object: the store
+ * was lost, or root belongs to another backend. The open fails rather
+ * than hand their oids out again.
+ *
+ * returns:
+ * -ENOTEMPTY: dfiles holds data files
+ * -errno: dfiles could not be read
+ * OSD_OK: success
+ */
+int check_dfiles_empty(const char *root)
+{
+    int ret = 0;
+    char path[MAXNAMELEN];
+
+    sprintf(path, "%s/%s", root, dfiles);
+    ret = dir_has_files(path);
+    if (ret == 1) {
+        osd_error("%s: %s holds data files but there is no metadata",
+                __func__, path);
+        ret = -ENOTEMPTY;
+    }
+    return ret;
+}
+
+/*
+ * Reset osd and create the directories of an OSD under root. Shared by the
+ * backends that keep data in files under dfiles.
+ */
+int setup_root_dirs(const char *root, struct osd_device *osd)
+{
+    int ret = 0;
+    char path[MAXNAMELEN];
+    static char progname[] = "osd-target";
+    char *argv[] = { progname, NULL };
+    const struct osd_backend *be = NULL;
+    uint64_t start = osd_now_us();
 
     osd_set_progname(1, argv);  /* for debug messages from libosdutil */
-    mhz = get_mhz(); /* XXX: find a better way of profiling */
 
     if (strlen(root) > MAXROOTLEN) {
         osd_error("strlen(%s) > MAXROOTLEN", root);
@@ -463,7 +556,10 @@ setup_root_paths (const char* root, struct osd_device *osd) {
         goto out;
     }
 
+    /* keep the backend osd_open_backend bound */
+    be = osd->be;
     memset(osd, 0, sizeof(*osd));
+    osd->be = be;
 
     /* test if root exists and is a directory */
     ret = create_dir(root);
@@ -472,6 +568,12 @@ setup_root_paths (const char* root, struct osd_device *osd) {
         goto out;
     }
 
+    ret = format_resume(root);
+    if (ret != 0) {
+        osd_error("!format_resume(%s)", root);
+        goto out;
+    }
+
     /* test create 'data/dfiles' sub-directory */
     sprintf(path, "%s/%s/", root, dfiles);
     ret = create_dir(path);
@@ -480,15 +582,7 @@ setup_root_paths (const char* root, struct osd_device *osd) {
         goto out;
     }
 
-    /* to prevent fan-out create 256 subdirs under dfiles */
-    for (i = 0; i < 256; i++) {
-        sprintf(path, "%s/%s/%02x/", root, dfiles, i);
-        ret = create_dir(path);
-        if (ret != 0) {
-            osd_error("!create_dir_256(%s)", path);
-            goto out;
-        }
-    }
+    /* the 256 fan-out subdirs are made by osd_create_datafile */
 
     /* create 'stranded-files' sub-directory */
     sprintf(path, "%s/%s/", root, stranded);
@@ -513,13 +607,36 @@ setup_root_paths (const char* root, struct osd_device *osd) {
         goto out;
     }
 
-    osd->handle = malloc(sizeof(*osd->handle));
+    osd->handle = calloc(1, sizeof(*osd->handle));
+    if (!osd->handle)
+        ret = -ENOMEM;
+    osd->open_us.dirs = osd_now_us() - start;
+
+out:
+    return ret;
+}
+
+int
+setup_root_paths (const char* root, struct osd_device *osd) {                              
+
+    int i = 0;
+    int ret = 0;
+    char path[MAXNAMELEN];
+
+    ret = setup_root_dirs(root, osd);
+    if (ret != 0)
+        goto out;
 
     /* auto-creates db if necessary, and sets osd->handle */
     get_dbname(path, root);
-    ret = osd_db_open(path, osd);
+    if (access(path, F_OK) != 0) {
+        ret = check_dfiles_empty(root);
+        if (ret != 0)
+            goto out;
+    }
+    ret = osd_db_open(root, osd);
     if (ret != 0 && ret != 1) {
-        osd_error("!osd_db_open(%s)", path);
+        osd_error("!osd_db_open(%s)", root);
         goto out;
     }
     if (ret == 1) {
@@ -529,7 +646,8 @@ setup_root_paths (const char* root, struct osd_device *osd) {
             goto out;
         }
     }
-    ret = db_exec_pragma(osd->handle->dbc);
+    for (i = 0; ret == 0 && i < osd->handle->nshard; i++)
+        ret = db_exec_pragma(osd->handle->shard[i]);
 
 out:
     return ret;
@@ -559,9 +677,22 @@ int osd_create_datafile(struct osd_device *osd, uint64_t pid,
         *smoog = '/';
 #endif
         ret = creat(path, 0666);
-        osd_debug("%s: path %s creat failed ret %d!", __func__, path, ret);
-        if (ret <= 0)
+#ifndef __PANASAS_OSDSIM__
+        if (ret < 0 && errno == ENOENT) {
+            /* first file of its fan-out subdir under dfiles */
+            char *slash = strrchr(path, '/');
+            *slash = '\0';
+            if (mkdir(path, 0777) != 0 && errno != EEXIST)
+                return -errno;
+            *slash = '/';
+            ret = creat(path, 0666);
+        }
+#endif
+        if (ret < 0) {
+            ret = -errno;
+            osd_debug("%s: path %s creat failed ret %d", __func__, path, ret);
             return ret;
+        }
         close(ret);
     } else {
         return ret;
@@ -574,6 +705,7 @@ int osd_create_datafile(struct osd_device *osd, uint64_t pid,
 int format_osd(struct osd_device *osd, uint64_t capacity, uint32_t cdb_cont_len, uint8_t *sense)
 {
     int ret;
+    int fd = -1;
     char *root = NULL;
     char path[MAXNAMELEN];
     struct stat sb;
@@ -584,41 +716,52 @@ int format_osd(struct osd_device *osd, uint64_t capacity, uint32_t cdb_cont_len,
 
     root = strdup(osd->root);
 
-    get_dbname(path, root);
+    sprintf(path, "%s/%s/", root, md);
     if (stat(path, &sb) != 0) {
-        osd_error_errno("%s: DB %s does not exist, creating it",
+        osd_error_errno("%s: metadata %s does not exist, creating it",
                 __func__, path);
         goto create;
     }
 
-    sprintf(path, "%s/%s/", root, md);
-    ret = empty_dir(path);
+    /* close first, a backend may still write to md on close */
+    ret = osd_close(osd);
     if (ret) {
-        osd_error("%s: empty_dir %s failed", __func__, path);
+        osd_error("%s: osd close failed, ret %d", __func__, ret);
         goto out_sense;
     }
 
-    sprintf(path, "%s/%s", root, stranded);
-    ret = empty_dir(path);
-    if (ret) {
-        osd_error("%s: empty_dir %s failed", __func__, path);
-        goto out_sense;
+    /*
+     * Move the old tree aside rather than emptying it, which takes as long
+     * as there are objects; the reaper removes it once reopened. md goes
+     * first: once it is gone the osd is formatted. formatting marks the
+     * root until dfiles has followed, so that an open after a crash in
+     * between finishes the job, see format_resume.
+     */
+    sprintf(path, "%s/%s", root, formatting);
+    fd = creat(path, 0666);
+    if (fd < 0) {
+        osd_error_errno("%s: creat %s", __func__, path);
+        goto out_reopen;
     }
+    close(fd);
 
-    sprintf(path, "%s/%s", root, dfiles);
-    ret = empty_dir(path);
+    ret = reaper_strand_dir(root, md);
     if (ret) {
-        osd_error("%s: empty_dir %s failed", __func__, path);
-        goto out_sense;
+        osd_error("%s: reaper_strand_dir %s failed", __func__, md);
+        unlink(path); /* nothing has changed */
+        goto out_reopen;
     }
 
-    ret = osd_close(osd);
+    ret = reaper_strand_dir(root, dfiles);
     if (ret) {
-        osd_error("%s: osd close failed, ret %d", __func__, ret);
-        goto out_sense;
+        osd_error("%s: reaper_strand_dir %s failed", __func__, dfiles);
+        goto out_reopen; /* left marked, the open tries again */
     }
+    unlink(path); /* if it stays, the open takes it */
+
 create:
-    ret = osd_open(root, osd); /* will create files/dirs under root */
+    /* will create files/dirs under root */
+    ret = osd_open_backend(root, osd->be->name, osd);
     if (ret != 0) {
         osd_error("%s: osd_open %s failed", __func__, root);
         goto out_sense;
@@ -627,31 +770,37 @@ create:
     ret = OSD_OK;
     goto out;
 
+out_reopen:
+    /* do not leave the osd closed for the commands that follow */
+    if (osd_open_backend(root, osd->be->name, osd) != 0)
+        osd_error("%s: osd_open %s failed", __func__, root);
+
 out_sense:
     ret = sense_build_sdd(sense, OSD_SSK_HARDWARE_ERROR,
             OSD_ASC_SYSTEM_RESOURCE_FAILURE, 0, 0);
 
 out:
+    free(root);
     return ret;
 }
 
 
-int osd_begin_txn(struct osd_device *osd)
+int io_begin_txn(struct osd_device *osd)
 {
     int ret = 0;
-    ret = db_begin_txn(osd->handle->dbc);
+    ret = osd_db_begin_txn(osd);
     return ret;
 }
 
-int osd_end_txn(struct osd_device *osd)
+int io_end_txn(struct osd_device *osd)
 {
     int ret = 0;
-    ret = db_end_txn(osd->handle->dbc);
+    ret = osd_db_end_txn(osd);
     return ret;
 
 }
 
-int osd_close(struct osd_device *osd)
+int io_close(struct osd_device *osd)
 {
     int ret = 0;
 
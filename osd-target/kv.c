@@ -0,0 +1,1212 @@
+/*
+ * Log-structured key/value store for OSD metadata.
+ *
+ * Copyright (C) 2007 OSD Team <pvfs-osd@osc.edu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "osd-types.h"
+#include "kv.h"
+#include "osd-util/osd-util.h"
+
+/*
+ * On disk a store directory holds:
+ *
+ *   wal           log of the puts and deletes not yet in a segment
+ *   seg-NNNNNN    immutable sorted segments, NNNNNN increasing with age
+ *
+ * Log records and segment records share one layout, all lengths in native
+ * byte order: klen (4), vlen (4), key, value. A vlen of KV_TOMBSTONE marks
+ * a deleted key and has no value bytes.
+ *
+ * A segment is its records in key order, padding to 8 bytes, an array of
+ * the record offsets, a bloom filter over the keys and a fixed footer.
+ * Compaction merges segments base..id into one that replaces seg-id, then
+ * unlinks the others; base in the footer lets kv_open finish a compaction
+ * that was interrupted before the unlinks.
+ */
+
+#define KV_TOMBSTONE (0xFFFFFFFFU)
+#define KV_MAXLEVEL (16)
+#define KV_BLOOM_BITS (10)	/* bloom filter bits per key */
+#define KV_BLOOM_K (7)		/* hashes per key, about 1% false positives */
+#define KV_WALBUF (64U << 10)	/* log bytes buffered within a txn */
+
+static const char kv_seg_magic[8] = "OSDKVSG1";
+
+struct kv_seg_footer {
+	uint64_t idx_off;
+	uint64_t nrec;
+	uint64_t bloom_off;
+	uint32_t nbits;
+	uint32_t k;
+	uint32_t base;
+	uint32_t pad;
+	char magic[8];
+};
+
+struct kv_node {
+	uint8_t *val;
+	uint32_t klen;
+	uint32_t vlen;
+	int height;
+	struct kv_node *next[];	/* height pointers, then the key */
+};
+
+struct kv_mem {
+	struct kv_node *head;
+	int level;
+	uint32_t rnd;
+	uint64_t nrec;
+	size_t bytes;
+};
+
+struct kv_seg {
+	uint32_t id;
+	uint32_t base;
+	uint8_t *map;
+	size_t size;
+	const uint64_t *idx;
+	uint64_t nrec;
+	const uint8_t *bloom;
+	uint32_t nbits;
+	uint32_t k;
+};
+
+struct kv_db {
+	char *dir;
+	struct kv_mem mem;
+	int wal_fd;
+	uint8_t *walbuf;
+	size_t wallen;
+	int in_txn;
+	struct kv_seg **seg;	/* oldest first */
+	int nseg;
+	uint32_t next_id;
+
+	/* compaction, everything below is under lock */
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int stop;
+	int cwork;		/* cin is waiting for the thread */
+	int cbusy;		/* a compaction is out, until kv_install */
+	int cdone;		/* thread is done, cout is the result */
+	struct kv_seg **cin;
+	int ncin;
+	struct kv_seg *cout;
+};
+
+/* one sorted input of a merge: the memtable or a segment */
+struct kv_src {
+	struct kv_node *node;
+	const struct kv_seg *seg;
+	uint64_t pos;
+};
+
+struct kv_iter {
+	struct kv_db *kv;
+	uint8_t *prefix;
+	uint32_t plen;
+	int raw;		/* return tombstones too */
+	int nsrc;		/* newest first */
+	struct kv_src src[];
+};
+
+static inline uint8_t *kv_node_key(struct kv_node *n)
+{
+	return (uint8_t *)&n->next[n->height];
+}
+
+static int kv_cmp(const uint8_t *a, uint32_t alen, const uint8_t *b,
+		  uint32_t blen)
+{
+	int c = memcmp(a, b, alen < blen ? alen : blen);
+
+	if (c != 0)
+		return c;
+	return (alen > blen) - (alen < blen);
+}
+
+static uint64_t kv_hash(const uint8_t *key, uint32_t klen)
+{
+	uint32_t i = 0;
+	uint64_t h = 0xcbf29ce484222325ULL;
+
+	for (i = 0; i < klen; i++) {
+		h ^= key[i];
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+static void kv_seg_path(char *path, const char *dir, uint32_t id)
+{
+	sprintf(path, "%s/seg-%06u", dir, id);
+}
+
+/*
+ * memtable, a skiplist of the latest value of each key written since the
+ * last flush
+ */
+static int kv_mem_init(struct kv_mem *m)
+{
+	memset(m, 0, sizeof(*m));
+	m->head = Calloc(1, sizeof(*m->head) +
+			 KV_MAXLEVEL * sizeof(m->head->next[0]));
+	if (!m->head)
+		return -ENOMEM;
+	m->head->height = KV_MAXLEVEL;
+	m->level = 1;
+	m->rnd = 0x9e3779b9;
+	return OSD_OK;
+}
+
+static void kv_mem_clear(struct kv_mem *m)
+{
+	struct kv_node *n = NULL, *next = NULL;
+	int i = 0;
+
+	for (n = m->head->next[0]; n; n = next) {
+		next = n->next[0];
+		free(n->val);
+		free(n);
+	}
+	for (i = 0; i < KV_MAXLEVEL; i++)
+		m->head->next[i] = NULL;
+	m->level = 1;
+	m->nrec = 0;
+	m->bytes = 0;
+}
+
+static int kv_mem_height(struct kv_mem *m)
+{
+	int h = 1;
+
+	/* xorshift32, a quarter of the nodes go up a level */
+	m->rnd ^= m->rnd << 13;
+	m->rnd ^= m->rnd >> 17;
+	m->rnd ^= m->rnd << 5;
+	while (h < KV_MAXLEVEL && ((m->rnd >> (2*h)) & 3) == 0)
+		h++;
+	return h;
+}
+
+/* fill update[] with the last node before key on each level */
+static struct kv_node *kv_mem_find(struct kv_mem *m, const uint8_t *key,
+				   uint32_t klen, struct kv_node **update)
+{
+	struct kv_node *x = m->head;
+	struct kv_node *n = NULL;
+	int i = 0;
+
+	for (i = m->level - 1; i >= 0; i--) {
+		while ((n = x->next[i]) &&
+		       kv_cmp(kv_node_key(n), n->klen, key, klen) < 0)
+			x = n;
+		if (update)
+			update[i] = x;
+	}
+	return x->next[0];
+}
+
+static int kv_mem_put(struct kv_mem *m, const uint8_t *key, uint32_t klen,
+		      const void *val, uint32_t vlen)
+{
+	struct kv_node *update[KV_MAXLEVEL];
+	struct kv_node *n = NULL;
+	uint8_t *v = NULL;
+	int h = 0;
+	int i = 0;
+
+	if (vlen != KV_TOMBSTONE && vlen > 0) {
+		v = Malloc(vlen);
+		if (!v)
+			return -ENOMEM;
+		memcpy(v, val, vlen);
+	}
+
+	n = kv_mem_find(m, key, klen, update);
+	if (n && kv_cmp(kv_node_key(n), n->klen, key, klen) == 0) {
+		if (n->vlen != KV_TOMBSTONE)
+			m->bytes -= n->vlen;
+		free(n->val);
+		n->val = v;
+		n->vlen = vlen;
+		if (vlen != KV_TOMBSTONE)
+			m->bytes += vlen;
+		return OSD_OK;
+	}
+
+	h = kv_mem_height(m);
+	n = Malloc(sizeof(*n) + h * sizeof(n->next[0]) + klen);
+	if (!n) {
+		free(v);
+		return -ENOMEM;
+	}
+	n->val = v;
+	n->klen = klen;
+	n->vlen = vlen;
+	n->height = h;
+	memcpy(kv_node_key(n), key, klen);
+	for (i = m->level; i < h; i++)
+		update[i] = m->head;
+	if (h > m->level)
+		m->level = h;
+	for (i = 0; i < h; i++) {
+		n->next[i] = update[i]->next[i];
+		update[i]->next[i] = n;
+	}
+	m->nrec++;
+	m->bytes += sizeof(*n) + h * sizeof(n->next[0]) + klen;
+	if (vlen != KV_TOMBSTONE)
+		m->bytes += vlen;
+	return OSD_OK;
+}
+
+/*
+ * segments
+ */
+static void kv_seg_rec(const struct kv_seg *s, uint64_t i,
+		       const uint8_t **key, uint32_t *klen,
+		       const uint8_t **val, uint32_t *vlen)
+{
+	const uint8_t *p = s->map + s->idx[i];
+
+	memcpy(klen, p, 4);
+	memcpy(vlen, p + 4, 4);
+	*key = p + 8;
+	*val = p + 8 + *klen;
+}
+
+/* index of the first record with a key >= key */
+static uint64_t kv_seg_lower(const struct kv_seg *s, const uint8_t *key,
+			     uint32_t klen)
+{
+	uint64_t lo = 0, hi = s->nrec;
+	const uint8_t *k = NULL, *v = NULL;
+	uint32_t kl = 0, vl = 0;
+
+	while (lo < hi) {
+		uint64_t mid = lo + (hi - lo) / 2;
+
+		kv_seg_rec(s, mid, &k, &kl, &v, &vl);
+		if (kv_cmp(k, kl, key, klen) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static int kv_bloom_test(const struct kv_seg *s, const uint8_t *key,
+			 uint32_t klen)
+{
+	uint64_t h = kv_hash(key, klen);
+	uint64_t h2 = (h >> 33) | (h << 31) | 1;
+	uint32_t i = 0;
+
+	for (i = 0; i < s->k; i++) {
+		uint64_t bit = (h + i * h2) % s->nbits;
+
+		if (!(s->bloom[bit >> 3] & (1 << (bit & 7))))
+			return 0;
+	}
+	return 1;
+}
+
+static struct kv_seg *kv_seg_open(const char *dir, uint32_t id)
+{
+	int fd = -1;
+	char path[MAXNAMELEN];
+	struct stat sb;
+	struct kv_seg *s = NULL;
+	struct kv_seg_footer f;
+
+	kv_seg_path(path, dir, id);
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		osd_error_errno("%s: open %s", __func__, path);
+		return NULL;
+	}
+	if (fstat(fd, &sb) != 0 || (size_t)sb.st_size < sizeof(f) +
+	    sizeof(kv_seg_magic)) {
+		osd_error("%s: %s too short", __func__, path);
+		goto out_close;
+	}
+
+	s = Calloc(1, sizeof(*s));
+	if (!s)
+		goto out_close;
+	s->id = id;
+	s->size = sb.st_size;
+	s->map = mmap(NULL, s->size, PROT_READ, MAP_SHARED, fd, 0);
+	if (s->map == MAP_FAILED) {
+		osd_error_errno("%s: mmap %s", __func__, path);
+		goto out_free;
+	}
+
+	memcpy(&f, s->map + s->size - sizeof(f), sizeof(f));
+	if (memcmp(f.magic, kv_seg_magic, sizeof(f.magic)) != 0 ||
+	    memcmp(s->map, kv_seg_magic, sizeof(kv_seg_magic)) != 0 ||
+	    f.idx_off % 8 != 0 || f.idx_off + f.nrec * 8 > f.bloom_off ||
+	    f.bloom_off + f.nbits / 8 > s->size - sizeof(f) ||
+	    f.nbits == 0 || f.base > id) {
+		osd_error("%s: %s is not a segment", __func__, path);
+		goto out_unmap;
+	}
+	s->idx = (const uint64_t *)(s->map + f.idx_off);
+	s->nrec = f.nrec;
+	s->bloom = s->map + f.bloom_off;
+	s->nbits = f.nbits;
+	s->k = f.k;
+	s->base = f.base;
+	close(fd);
+	return s;
+
+out_unmap:
+	munmap(s->map, s->size);
+out_free:
+	free(s);
+	s = NULL;
+out_close:
+	close(fd);
+	return NULL;
+}
+
+static void kv_seg_close(struct kv_seg *s)
+{
+	if (!s)
+		return;
+	munmap(s->map, s->size);
+	free(s);
+}
+
+/*
+ * merge iterator over the memtable and any number of segments. On equal
+ * keys the newest source wins and the others are skipped.
+ */
+static struct kv_iter *kv_iter_alloc(int nsrc)
+{
+	return Calloc(1, sizeof(struct kv_iter) +
+		      nsrc * sizeof(struct kv_src));
+}
+
+static int kv_src_get(const struct kv_src *src, const uint8_t **key,
+		      uint32_t *klen, const uint8_t **val, uint32_t *vlen)
+{
+	if (src->seg) {
+		if (src->pos >= src->seg->nrec)
+			return 0;
+		kv_seg_rec(src->seg, src->pos, key, klen, val, vlen);
+		return 1;
+	}
+	if (!src->node)
+		return 0;
+	*key = kv_node_key(src->node);
+	*klen = src->node->klen;
+	*val = src->node->val;
+	*vlen = src->node->vlen;
+	return 1;
+}
+
+static void kv_src_next(struct kv_src *src)
+{
+	if (src->seg)
+		src->pos++;
+	else if (src->node)
+		src->node = src->node->next[0];
+}
+
+void kv_iter_seek(struct kv_iter *it, const void *key, uint32_t klen)
+{
+	int i = 0;
+
+	for (i = 0; i < it->nsrc; i++) {
+		struct kv_src *src = &it->src[i];
+
+		if (src->seg)
+			src->pos = kv_seg_lower(src->seg, key, klen);
+		else
+			src->node = kv_mem_find(&it->kv->mem, key, klen, NULL);
+	}
+}
+
+/*
+ * returns:
+ * 1: a row, key and val set
+ * 0: no more rows with the prefix of the iterator
+ */
+int kv_iter_next(struct kv_iter *it, const void **key, uint32_t *klen,
+		 const void **val, uint32_t *vlen)
+{
+	int i = 0;
+	int best = -1;
+	const uint8_t *k = NULL, *v = NULL, *bk = NULL, *bv = NULL;
+	uint32_t kl = 0, vl = 0, bkl = 0, bvl = 0;
+
+	while (1) {
+		best = -1;
+		for (i = 0; i < it->nsrc; i++) {
+			if (!kv_src_get(&it->src[i], &k, &kl, &v, &vl))
+				continue;
+			if (best < 0 || kv_cmp(k, kl, bk, bkl) < 0) {
+				best = i;
+				bk = k, bkl = kl, bv = v, bvl = vl;
+			}
+		}
+		if (best < 0)
+			return 0;
+
+		for (i = 0; i < it->nsrc; i++) {
+			if (i != best && kv_src_get(&it->src[i], &k, &kl,
+						    &v, &vl) &&
+			    kv_cmp(k, kl, bk, bkl) == 0)
+				kv_src_next(&it->src[i]);
+		}
+		kv_src_next(&it->src[best]);
+
+		if (it->plen && (bkl < it->plen ||
+				 memcmp(bk, it->prefix, it->plen) != 0)) {
+			/* sorted, so nothing with the prefix follows */
+			for (i = 0; i < it->nsrc; i++) {
+				if (it->src[i].seg)
+					it->src[i].pos = it->src[i].seg->nrec;
+				else
+					it->src[i].node = NULL;
+			}
+			return 0;
+		}
+		if (bvl == KV_TOMBSTONE && !it->raw)
+			continue;
+
+		*key = bk;
+		*klen = bkl;
+		*val = bv;
+		*vlen = bvl;
+		return 1;
+	}
+}
+
+/*
+ * Iterate over the keys starting with prefix, in key order.
+ *
+ * returns:
+ * -ENOMEM: out of memory
+ * OSD_OK: success, *itp set
+ */
+int kv_iter_open(struct kv_db *kv, const void *prefix, uint32_t plen,
+		 struct kv_iter **itp)
+{
+	int i = 0;
+	struct kv_iter *it = kv_iter_alloc(kv->nseg + 1);
+
+	if (!it)
+		return -ENOMEM;
+	it->prefix = Malloc(plen ? plen : 1);
+	if (!it->prefix) {
+		free(it);
+		return -ENOMEM;
+	}
+	memcpy(it->prefix, prefix, plen);
+	it->plen = plen;
+	it->kv = kv;
+	it->nsrc = kv->nseg + 1;
+	for (i = 0; i < kv->nseg; i++)
+		it->src[i + 1].seg = kv->seg[kv->nseg - 1 - i];
+	kv_iter_seek(it, prefix, plen);
+	*itp = it;
+	return OSD_OK;
+}
+
+void kv_iter_close(struct kv_iter *it)
+{
+	if (!it)
+		return;
+	free(it->prefix);
+	free(it);
+}
+
+/*
+ * Write the rows of it to a new segment dir/seg-id, through a temporary
+ * file so a crash never leaves a partial segment under that name. nrec is
+ * an upper bound of the number of rows, used to size the bloom filter.
+ */
+static struct kv_seg *kv_seg_write(const char *dir, struct kv_iter *it,
+				   uint64_t nrec, uint32_t id, uint32_t base)
+{
+	FILE *fp = NULL;
+	char tmp[MAXNAMELEN + 8];
+	char path[MAXNAMELEN];
+	const void *k = NULL, *v = NULL;
+	uint32_t kl = 0, vl = 0;
+	uint64_t off = 0;
+	uint64_t n = 0;
+	uint64_t *idx = NULL;
+	uint8_t *bloom = NULL;
+	struct kv_seg_footer f;
+	static const uint8_t zero[8];
+
+	memset(&f, 0, sizeof(f));
+	f.nbits = (nrec * KV_BLOOM_BITS + 63) & ~63ULL;
+	if (f.nbits == 0)
+		f.nbits = 64;
+	f.k = KV_BLOOM_K;
+	f.base = base;
+	memcpy(f.magic, kv_seg_magic, sizeof(f.magic));
+
+	idx = Malloc((nrec ? nrec : 1) * sizeof(*idx));
+	bloom = Calloc(1, f.nbits / 8);
+	if (!idx || !bloom)
+		goto out_free;
+
+	kv_seg_path(path, dir, id);
+	sprintf(tmp, "%s.tmp", path);
+	fp = fopen(tmp, "w");
+	if (!fp) {
+		osd_error_errno("%s: fopen %s", __func__, tmp);
+		goto out_free;
+	}
+
+	if (fwrite(kv_seg_magic, sizeof(kv_seg_magic), 1, fp) != 1)
+		goto out_err;
+	off = sizeof(kv_seg_magic);
+	while (kv_iter_next(it, &k, &kl, &v, &vl)) {
+		uint64_t h = kv_hash(k, kl);
+		uint64_t h2 = (h >> 33) | (h << 31) | 1;
+		uint32_t i = 0;
+
+		assert(n < nrec);
+		for (i = 0; i < f.k; i++) {
+			uint64_t bit = (h + i * h2) % f.nbits;
+
+			bloom[bit >> 3] |= 1 << (bit & 7);
+		}
+		idx[n++] = off;
+		if (fwrite(&kl, 4, 1, fp) != 1 || fwrite(&vl, 4, 1, fp) != 1 ||
+		    fwrite(k, kl, 1, fp) != 1)
+			goto out_err;
+		off += 8 + kl;
+		if (vl != KV_TOMBSTONE && vl > 0) {
+			if (fwrite(v, vl, 1, fp) != 1)
+				goto out_err;
+			off += vl;
+		}
+	}
+	if (off % 8 && fwrite(zero, 8 - off % 8, 1, fp) != 1)
+		goto out_err;
+	f.idx_off = roundup8(off);
+	f.nrec = n;
+	f.bloom_off = f.idx_off + n * 8;
+	if ((n && fwrite(idx, n * 8, 1, fp) != 1) ||
+	    fwrite(bloom, f.nbits / 8, 1, fp) != 1 ||
+	    fwrite(&f, sizeof(f), 1, fp) != 1)
+		goto out_err;
+	if (fclose(fp) != 0) {
+		fp = NULL;
+		goto out_err;
+	}
+	fp = NULL;
+
+	if (rename(tmp, path) != 0) {
+		osd_error_errno("%s: rename %s", __func__, tmp);
+		goto out_unlink;
+	}
+	free(idx);
+	free(bloom);
+	return kv_seg_open(dir, id);
+
+out_err:
+	osd_error_errno("%s: write %s", __func__, tmp);
+	if (fp)
+		fclose(fp);
+out_unlink:
+	unlink(tmp);
+out_free:
+	free(idx);
+	free(bloom);
+	return NULL;
+}
+
+/*
+ * compaction
+ */
+static void *kv_compact_thread(void *arg)
+{
+	struct kv_db *kv = arg;
+	struct kv_iter *it = NULL;
+	struct kv_seg *out = NULL;
+	char path[MAXNAMELEN];
+	uint64_t nrec = 0;
+	int i = 0;
+
+	pthread_mutex_lock(&kv->lock);
+	while (1) {
+		while (!kv->stop && !kv->cwork)
+			pthread_cond_wait(&kv->cond, &kv->lock);
+		if (kv->stop && !kv->cwork)
+			break;
+		kv->cwork = 0;
+		pthread_mutex_unlock(&kv->lock);
+
+		/*
+		 * The inputs are the oldest segments, so no older value is
+		 * left for a tombstone to hide and they are dropped.
+		 */
+		out = NULL;
+		nrec = 0;
+		it = kv_iter_alloc(kv->ncin);
+		if (it) {
+			it->nsrc = kv->ncin;
+			for (i = 0; i < kv->ncin; i++) {
+				it->src[i].seg = kv->cin[kv->ncin - 1 - i];
+				nrec += kv->cin[i]->nrec;
+			}
+			out = kv_seg_write(kv->dir, it, nrec,
+					   kv->cin[kv->ncin - 1]->id,
+					   kv->cin[0]->base);
+			free(it);
+		}
+		if (out) {
+			for (i = 0; i < kv->ncin - 1; i++) {
+				kv_seg_path(path, kv->dir, kv->cin[i]->id);
+				unlink(path);
+			}
+		}
+
+		pthread_mutex_lock(&kv->lock);
+		kv->cout = out;
+		kv->cdone = 1;
+	}
+	pthread_mutex_unlock(&kv->lock);
+	return NULL;
+}
+
+/* hand the segments to the compaction thread if there are enough */
+static void kv_compact(struct kv_db *kv)
+{
+	pthread_mutex_lock(&kv->lock);
+	if (!kv->cbusy && kv->nseg >= KV_COMPACT_SEGS) {
+		kv->cin = Malloc(kv->nseg * sizeof(*kv->cin));
+		if (kv->cin) {
+			memcpy(kv->cin, kv->seg, kv->nseg * sizeof(*kv->cin));
+			kv->ncin = kv->nseg;
+			kv->cbusy = 1;
+			kv->cwork = 1;
+			pthread_cond_signal(&kv->cond);
+		}
+	}
+	pthread_mutex_unlock(&kv->lock);
+}
+
+/*
+ * Swap in the result of a finished compaction. The inputs are the first
+ * ncin segments, since only flushes add segments meanwhile and they
+ * append.
+ */
+static void kv_install(struct kv_db *kv)
+{
+	int i = 0;
+
+	pthread_mutex_lock(&kv->lock);
+	if (!kv->cdone) {
+		pthread_mutex_unlock(&kv->lock);
+		return;
+	}
+	if (kv->cout) {
+		for (i = 0; i < kv->ncin; i++) {
+			assert(kv->seg[i] == kv->cin[i]);
+			kv_seg_close(kv->seg[i]);
+		}
+		kv->seg[0] = kv->cout;
+		memmove(&kv->seg[1], &kv->seg[kv->ncin],
+			(kv->nseg - kv->ncin) * sizeof(*kv->seg));
+		kv->nseg -= kv->ncin - 1;
+	} else {
+		osd_error("%s: compaction of %d segments failed", __func__,
+			  kv->ncin);
+	}
+	free(kv->cin);
+	kv->cin = NULL;
+	kv->ncin = 0;
+	kv->cout = NULL;
+	kv->cdone = 0;
+	kv->cbusy = 0;
+	pthread_mutex_unlock(&kv->lock);
+}
+
+/*
+ * log
+ */
+static int kv_wal_sync(struct kv_db *kv)
+{
+	size_t off = 0;
+	ssize_t w = 0;
+
+	while (off < kv->wallen) {
+		w = write(kv->wal_fd, kv->walbuf + off, kv->wallen - off);
+		if (w < 0) {
+			if (errno == EINTR)
+				continue;
+			osd_error_errno("%s: write", __func__);
+			return OSD_ERROR;
+		}
+		off += w;
+	}
+	kv->wallen = 0;
+	return OSD_OK;
+}
+
+static int kv_wal_append(struct kv_db *kv, const void *key, uint32_t klen,
+			 const void *val, uint32_t vlen)
+{
+	int ret = 0;
+	uint32_t dlen = (vlen == KV_TOMBSTONE ? 0 : vlen);
+	size_t len = 8 + klen + dlen;
+	uint8_t *p = NULL;
+
+	if (kv->wallen + len > KV_WALBUF) {
+		ret = kv_wal_sync(kv);
+		if (ret != OSD_OK)
+			return ret;
+	}
+	if (len > KV_WALBUF) {
+		/* larger than the buffer, write it in pieces */
+		uint8_t hdr[8];
+
+		memcpy(hdr, &klen, 4);
+		memcpy(hdr + 4, &vlen, 4);
+		if (write(kv->wal_fd, hdr, 8) != 8 ||
+		    write(kv->wal_fd, key, klen) != (ssize_t)klen ||
+		    write(kv->wal_fd, val, dlen) != (ssize_t)dlen) {
+			osd_error_errno("%s: write", __func__);
+			return OSD_ERROR;
+		}
+		return OSD_OK;
+	}
+
+	p = kv->walbuf + kv->wallen;
+	memcpy(p, &klen, 4);
+	memcpy(p + 4, &vlen, 4);
+	memcpy(p + 8, key, klen);
+	if (dlen > 0)
+		memcpy(p + 8 + klen, val, dlen);
+	kv->wallen += len;
+	return OSD_OK;
+}
+
+/* apply the log left by the previous run to the memtable */
+static int kv_wal_replay(struct kv_db *kv)
+{
+	int ret = 0;
+	struct stat sb;
+	uint8_t *buf = NULL;
+	size_t off = 0;
+	ssize_t r = 0;
+
+	if (fstat(kv->wal_fd, &sb) != 0)
+		return OSD_ERROR;
+	if (sb.st_size == 0)
+		return OSD_OK;
+
+	buf = Malloc(sb.st_size);
+	if (!buf)
+		return -ENOMEM;
+	while (off < (size_t)sb.st_size) {
+		r = pread(kv->wal_fd, buf + off, sb.st_size - off, off);
+		if (r <= 0) {
+			ret = OSD_ERROR;
+			goto out;
+		}
+		off += r;
+	}
+
+	off = 0;
+	while (off + 8 <= (size_t)sb.st_size) {
+		uint32_t klen = 0, vlen = 0;
+		size_t len = 0;
+
+		memcpy(&klen, buf + off, 4);
+		memcpy(&vlen, buf + off + 4, 4);
+		len = 8 + (size_t)klen + (vlen == KV_TOMBSTONE ? 0 : vlen);
+		if (off + len > (size_t)sb.st_size)
+			break;
+		ret = kv_mem_put(&kv->mem, buf + off + 8, klen,
+				 buf + off + 8 + klen, vlen);
+		if (ret != OSD_OK)
+			goto out;
+		off += len;
+	}
+	/* drop a record torn by a crash */
+	if (off < (size_t)sb.st_size) {
+		osd_error("%s: truncating log at %zu of %llu", __func__, off,
+			  llu(sb.st_size));
+		if (ftruncate(kv->wal_fd, off) != 0) {
+			ret = OSD_ERROR;
+			goto out;
+		}
+	}
+	ret = OSD_OK;
+
+out:
+	free(buf);
+	return ret;
+}
+
+/* write the memtable out as the newest segment and empty the log */
+static int kv_flush(struct kv_db *kv)
+{
+	int ret = 0;
+	struct kv_iter *it = NULL;
+	struct kv_seg *s = NULL;
+	struct kv_seg **seg = NULL;
+
+	ret = kv_wal_sync(kv);
+	if (ret != OSD_OK || kv->mem.nrec == 0)
+		return ret;
+
+	seg = realloc(kv->seg, (kv->nseg + 1) * sizeof(*seg));
+	if (!seg)
+		return -ENOMEM;
+	kv->seg = seg;
+
+	it = kv_iter_alloc(1);
+	if (!it)
+		return -ENOMEM;
+	it->kv = kv;
+	it->raw = 1;
+	it->nsrc = 1;
+	it->src[0].node = kv->mem.head->next[0];
+	s = kv_seg_write(kv->dir, it, kv->mem.nrec, kv->next_id,
+			 kv->next_id);
+	free(it);
+	if (!s)
+		return OSD_ERROR;
+
+	pthread_mutex_lock(&kv->lock);
+	kv->seg[kv->nseg++] = s;
+	pthread_mutex_unlock(&kv->lock);
+	kv->next_id++;
+	kv_mem_clear(&kv->mem);
+	if (ftruncate(kv->wal_fd, 0) != 0) {
+		osd_error_errno("%s: ftruncate", __func__);
+		return OSD_ERROR;
+	}
+
+	kv_compact(kv);
+	return OSD_OK;
+}
+
+static int kv_seg_idcmp(const void *a, const void *b)
+{
+	const struct kv_seg *sa = *(struct kv_seg * const *)a;
+	const struct kv_seg *sb = *(struct kv_seg * const *)b;
+
+	return (sa->id > sb->id) - (sa->id < sb->id);
+}
+
+/*
+ * Load the segments of dir. Temporary files of an interrupted write are
+ * removed, so are segments covered by a newer one whose compaction did
+ * not get to unlink them.
+ */
+static int kv_load_segs(struct kv_db *kv)
+{
+	DIR *d = NULL;
+	struct dirent *de = NULL;
+	char path[MAXNAMELEN + sizeof(de->d_name)];
+	unsigned int id = 0;
+	char c = 0;
+	int i = 0, j = 0, n = 0;
+
+	d = opendir(kv->dir);
+	if (!d)
+		return OSD_ERROR;
+	while ((de = readdir(d)) != NULL) {
+		struct kv_seg *s = NULL;
+		struct kv_seg **seg = NULL;
+
+		if (strncmp(de->d_name, "seg-", 4) != 0)
+			continue;
+		if (strstr(de->d_name, ".tmp")) {
+			sprintf(path, "%s/%s", kv->dir, de->d_name);
+			unlink(path);
+			continue;
+		}
+		if (sscanf(de->d_name, "seg-%u%c", &id, &c) != 1)
+			continue;
+		s = kv_seg_open(kv->dir, id);
+		if (!s)
+			goto out_err;
+		seg = realloc(kv->seg, (kv->nseg + 1) * sizeof(*seg));
+		if (!seg) {
+			kv_seg_close(s);
+			goto out_err;
+		}
+		kv->seg = seg;
+		kv->seg[kv->nseg++] = s;
+	}
+	closedir(d);
+
+	qsort(kv->seg, kv->nseg, sizeof(*kv->seg), kv_seg_idcmp);
+	for (i = 0, n = 0; i < kv->nseg; i++) {
+		struct kv_seg *s = kv->seg[i];
+
+		for (j = i + 1; j < kv->nseg; j++)
+			if (kv->seg[j]->base <= s->id)
+				break;
+		if (j < kv->nseg) {
+			kv_seg_path(path, kv->dir, s->id);
+			unlink(path);
+			kv_seg_close(s);
+			continue;
+		}
+		kv->seg[n++] = s;
+	}
+	kv->nseg = n;
+	kv->next_id = n ? kv->seg[n - 1]->id + 1 : 1;
+	return OSD_OK;
+
+out_err:
+	closedir(d);
+	return OSD_ERROR;
+}
+
+/*
+ * Open the store in directory dir, creating it if needed.
+ *
+ * returns:
+ * -ENOMEM: out of memory
+ * OSD_ERROR: some other error
+ * OSD_OK: success, *kvp set
+ * 1: success, the store is new and empty
+ */
+int kv_open(const char *dir, struct kv_db **kvp)
+{
+	int ret = 0;
+	char path[MAXNAMELEN];
+	struct stat sb;
+	struct kv_db *kv = NULL;
+
+	if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+		osd_error_errno("%s: mkdir %s", __func__, dir);
+		return OSD_ERROR;
+	}
+
+	kv = Calloc(1, sizeof(*kv));
+	if (!kv)
+		return -ENOMEM;
+	kv->wal_fd = -1;
+	pthread_mutex_init(&kv->lock, NULL);
+	pthread_cond_init(&kv->cond, NULL);
+	kv->dir = strdup(dir);
+	kv->walbuf = Malloc(KV_WALBUF);
+	if (!kv->dir || !kv->walbuf) {
+		ret = -ENOMEM;
+		goto out_free;
+	}
+	ret = kv_mem_init(&kv->mem);
+	if (ret != OSD_OK)
+		goto out_free;
+
+	ret = kv_load_segs(kv);
+	if (ret != OSD_OK)
+		goto out_free;
+
+	sprintf(path, "%s/wal", dir);
+	kv->wal_fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0666);
+	if (kv->wal_fd < 0) {
+		osd_error_errno("%s: open %s", __func__, path);
+		ret = OSD_ERROR;
+		goto out_free;
+	}
+	ret = kv_wal_replay(kv);
+	if (ret != OSD_OK)
+		goto out_free;
+
+	ret = pthread_create(&kv->thread, NULL, kv_compact_thread, kv);
+	if (ret != 0) {
+		ret = OSD_ERROR;
+		goto out_free;
+	}
+	kv_compact(kv);
+
+	*kvp = kv;
+	if (kv->nseg == 0 && kv->mem.nrec == 0 && fstat(kv->wal_fd, &sb) == 0
+	    && sb.st_size == 0)
+		return 1;
+	return OSD_OK;
+
+out_free:
+	if (kv->wal_fd >= 0)
+		close(kv->wal_fd);
+	while (kv->nseg > 0)
+		kv_seg_close(kv->seg[--kv->nseg]);
+	free(kv->seg);
+	if (kv->mem.head) {
+		kv_mem_clear(&kv->mem);
+		free(kv->mem.head);
+	}
+	free(kv->walbuf);
+	free(kv->dir);
+	free(kv);
+	return ret;
+}
+
+/*
+ * Wait for a running compaction and write the memtable out, so the next
+ * open starts with an empty log.
+ */
+int kv_close(struct kv_db *kv)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&kv->lock);
+	kv->stop = 1;
+	pthread_cond_signal(&kv->cond);
+	pthread_mutex_unlock(&kv->lock);
+	pthread_join(kv->thread, NULL);
+	kv_install(kv);
+
+	/* the thread is gone, so kv_flush may not hand it more work */
+	kv->cbusy = 1;
+	ret = kv_flush(kv);
+
+	close(kv->wal_fd);
+	while (kv->nseg > 0)
+		kv_seg_close(kv->seg[--kv->nseg]);
+	free(kv->seg);
+	kv_mem_clear(&kv->mem);
+	free(kv->mem.head);
+	pthread_mutex_destroy(&kv->lock);
+	pthread_cond_destroy(&kv->cond);
+	free(kv->walbuf);
+	free(kv->dir);
+	free(kv);
+	return ret;
+}
+
+/*
+ * Within a transaction log records are buffered and written together by
+ * kv_end_txn. There is no rollback: like the SQLite backend running with
+ * synchronous=OFF, a transaction only batches the writes.
+ */
+int kv_begin_txn(struct kv_db *kv)
+{
+	kv->in_txn = 1;
+	return OSD_OK;
+}
+
+int kv_end_txn(struct kv_db *kv)
+{
+	kv->in_txn = 0;
+	kv_install(kv);
+	return kv_wal_sync(kv);
+}
+
+static int kv_write(struct kv_db *kv, const void *key, uint32_t klen,
+		    const void *val, uint32_t vlen)
+{
+	int ret = 0;
+
+	kv_install(kv);
+
+	ret = kv_wal_append(kv, key, klen, val, vlen);
+	if (ret != OSD_OK)
+		return ret;
+	ret = kv_mem_put(&kv->mem, key, klen, val, vlen);
+	if (ret != OSD_OK)
+		return ret;
+
+	if (kv->mem.bytes >= KV_MEMTABLE_SZ)
+		return kv_flush(kv);
+	if (!kv->in_txn)
+		return kv_wal_sync(kv);
+	return OSD_OK;
+}
+
+/*
+ * returns:
+ * -ENOMEM: out of memory
+ * OSD_ERROR: some other error
+ * OSD_OK: success
+ */
+int kv_put(struct kv_db *kv, const void *key, uint32_t klen,
+	   const void *val, uint32_t vlen)
+{
+	assert(kv && key && vlen != KV_TOMBSTONE);
+	return kv_write(kv, key, klen, val, vlen);
+}
+
+int kv_del(struct kv_db *kv, const void *key, uint32_t klen)
+{
+	assert(kv && key);
+	return kv_write(kv, key, klen, NULL, KV_TOMBSTONE);
+}
+
+/*
+ * returns:
+ * -ENOENT: key not found
+ * OSD_OK: success, val and vlen set
+ */
+int kv_get(struct kv_db *kv, const void *key, uint32_t klen,
+	   const void **val, uint32_t *vlen)
+{
+	int i = 0;
+	uint64_t pos = 0;
+	const uint8_t *k = NULL, *v = NULL;
+	uint32_t kl = 0, vl = 0;
+	struct kv_node *n = NULL;
+
+	assert(kv && key && val && vlen);
+
+	n = kv_mem_find(&kv->mem, key, klen, NULL);
+	if (n && kv_cmp(kv_node_key(n), n->klen, key, klen) == 0) {
+		if (n->vlen == KV_TOMBSTONE)
+			return -ENOENT;
+		*val = n->val;
+		*vlen = n->vlen;
+		return OSD_OK;
+	}
+
+	for (i = kv->nseg - 1; i >= 0; i--) {
+		const struct kv_seg *s = kv->seg[i];
+
+		if (!kv_bloom_test(s, key, klen))
+			continue;
+		pos = kv_seg_lower(s, key, klen);
+		if (pos >= s->nrec)
+			continue;
+		kv_seg_rec(s, pos, &k, &kl, &v, &vl);
+		if (kv_cmp(k, kl, key, klen) != 0)
+			continue;
+		if (vl == KV_TOMBSTONE)
+			return -ENOENT;
+		*val = v;
+		*vlen = vl;
+		return OSD_OK;
+	}
+	return -ENOENT;
+}
@@ -0,0 +1,70 @@
+/*
+ * Log-structured key/value store for OSD metadata.
+ *
+ * Copyright (C) 2007 OSD Team <pvfs-osd@osc.edu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __KV_H
+#define __KV_H
+
+#include <stdint.h>
+
+/*
+ * Keys are byte strings ordered by memcmp, shorter first on a tie. Writes
+ * go to a sorted in-memory table and are appended to a write-ahead log in
+ * the store directory; the log is written out at the end of each
+ * transaction, or right away outside of one. A full memtable is written
+ * to an immutable sorted segment file with a bloom filter, and a
+ * background thread merges segments once there are KV_COMPACT_SEGS of
+ * them.
+ *
+ * A store is used by one thread. Values returned by kv_get and rows
+ * returned by an iterator point into the store and stay valid only until
+ * the next kv_put, kv_del or kv_end_txn; iterators must be closed before
+ * writing.
+ */
+
+#define KV_MEMTABLE_SZ (4U << 20)  /* memtable bytes before a flush */
+#define KV_COMPACT_SEGS (4)        /* segments that trigger a compaction */
+
+struct kv_db;
+struct kv_iter;
+
+int kv_open(const char *dir, struct kv_db **kvp);
+
+int kv_close(struct kv_db *kv);
+
+int kv_begin_txn(struct kv_db *kv);
+
+int kv_end_txn(struct kv_db *kv);
+
+int kv_put(struct kv_db *kv, const void *key, uint32_t klen,
+	   const void *val, uint32_t vlen);
+
+int kv_del(struct kv_db *kv, const void *key, uint32_t klen);
+
+int kv_get(struct kv_db *kv, const void *key, uint32_t klen,
+	   const void **val, uint32_t *vlen);
+
+int kv_iter_open(struct kv_db *kv, const void *prefix, uint32_t plen,
+		 struct kv_iter **itp);
+
+void kv_iter_seek(struct kv_iter *it, const void *key, uint32_t klen);
+
+int kv_iter_next(struct kv_iter *it, const void **key, uint32_t *klen,
+		 const void **val, uint32_t *vlen);
+
+void kv_iter_close(struct kv_iter *it);
+
+#endif /* __KV_H */
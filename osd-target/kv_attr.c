@@ -0,0 +1,699 @@
+/*
+ * Attributes in the key/value store.
+ *
+ * Copyright (C) 2007 OSD Team <pvfs-osd@osc.edu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <assert.h>
+
+#include "osd.h"
+#include "osd-types.h"
+#include "osd-util/osd-util.h"
+#include "list-entry.h"
+#include "kv_md.h"
+#include "attr-virt.h"
+#include "attr-type.h"
+
+/* 40 bytes including terminating NUL */
+static const char unid_page[ATTR_PAGE_ID_LEN] =
+"        unidentified attributes page   ";
+
+/*
+ * returns:
+ * -EINVAL: invalid arg
+ * OSD_ERROR: some other error
+ * OSD_OK: success
+ */
+int kv_attr_set_attr(void *ohandle, uint64_t pid, uint64_t oid,
+        uint32_t page, uint32_t number, const void *val, uint16_t len)
+{
+    uint8_t key[KV_ATTR_KEYLEN];
+
+    assert(kv_handle(ohandle));
+
+    kv_key_attr(key, pid, oid, page, number);
+    return kv_put(kv_handle(ohandle), key, sizeof(key), val, len);
+}
+
+int kv_attr_set_conversion(void *ohandle, uint64_t pid, uint64_t oid,
+        uint32_t page, uint32_t number, const void *val, uint16_t len)
+{
+    osd_debug("%s: attr (%llu %llu %u %u)!", __func__,
+            llu(pid), llu(oid), page, number);
+
+    return kv_attr_set_attr(ohandle, pid, oid, page, number, val, len);
+}
+
+/*
+ * returns:
+ * -EINVAL: invalid arg
+ * OSD_ERROR: some other error
+ * OSD_OK: success
+ */
+int kv_attr_delete_attr(void *ohandle, uint64_t pid, uint64_t oid,
+        uint32_t page, uint32_t number)
+{
+    uint8_t key[KV_ATTR_KEYLEN];
+
+    assert(kv_handle(ohandle));
+
+    kv_key_attr(key, pid, oid, page, number);
+    return kv_del(kv_handle(ohandle), key, sizeof(key));
+}
+
+/*
+ * The keys are collected first since an iterator does not survive a
+ * write to the store.
+ *
+ * returns:
+ * -ENOMEM: out of memory
+ * OSD_ERROR: some other error
+ * OSD_OK: success
+ */
+int kv_attr_delete_all(void *ohandle, uint64_t pid, uint64_t oid)
+{
+    int ret = 0;
+    size_t i = 0;
+    size_t n = 0;
+    uint8_t *keys = NULL;
+    uint8_t *p = NULL;
+    uint8_t prefix[KV_ATTR_KEYLEN];
+    const void *k = NULL, *v = NULL;
+    uint32_t kl = 0, vl = 0;
+    struct kv_db *kv = kv_handle(ohandle);
+    struct kv_iter *it = NULL;
+
+    assert(kv);
+
+    kv_key_attr(prefix, pid, oid, 0, 0);
+    ret = kv_iter_open(kv, prefix, 17, &it);
+    if (ret != OSD_OK)
+        return ret;
+    while (kv_iter_next(it, &k, &kl, &v, &vl)) {
+        if ((n & 63) == 0) {
+            p = realloc(keys, (n + 64) * KV_ATTR_KEYLEN);
+            if (!p) {
+                kv_iter_close(it);
+                ret = -ENOMEM;
+                goto out;
+            }
+            keys = p;
+        }
+        memcpy(keys + n * KV_ATTR_KEYLEN, k, KV_ATTR_KEYLEN);
+        n++;
+    }
+    kv_iter_close(it);
+
+    for (i = 0; i < n; i++) {
+        ret = kv_del(kv, keys + i * KV_ATTR_KEYLEN, KV_ATTR_KEYLEN);
+        if (ret != OSD_OK)
+            goto out;
+    }
+    ret = OSD_OK;
+
+out:
+    free(keys);
+    return ret;
+}
+
+/*
+ * Set a list of attributes on the objects [oid, oid+numoid). Entries with
+ * len == 0 delete the attribute. Caller is expected to wrap this in a
+ * transaction, which has the log written once.
+ *
+ * returns:
+ * -EINVAL: invalid arg
+ * OSD_ERROR: some other error
+ * OSD_OK: success
+ */
+int kv_attr_set_attr_list(void *ohandle, uint64_t pid, uint64_t oid,
+        uint16_t numoid, const struct list_entry *le, uint32_t sz)
+{
+    int ret = 0;
+    uint32_t i = 0;
+    uint64_t o = 0;
+
+    for (o = oid; o < oid + numoid; o++) {
+        for (i = 0; i < sz; i++) {
+            if (le[i].len == 0)
+                ret = kv_attr_delete_attr(ohandle, pid, o, le[i].page,
+                        le[i].number);
+            else
+                ret = kv_attr_set_attr(ohandle, pid, o, le[i].page,
+                        le[i].number, le[i].cval, le[i].len);
+            if (ret != OSD_OK)
+                return ret;
+        }
+    }
+
+    return OSD_OK;
+}
+
+static int kv_attr_pack(void *buf, uint32_t buflen, uint64_t oid,
+        uint32_t page, uint32_t number, uint16_t len, const void *val,
+        uint8_t listfmt)
+{
+    if (listfmt == RTRVD_SET_ATTR_LIST) {
+        return le_pack_attr(buf, buflen, page, number, len, val);
+    } else if (listfmt == RTRVD_CREATE_MULTIOBJ_LIST) {
+        return le_multiobj_pack_attr(buf, buflen, oid, page, number,
+                len, val);
+    } else {
+        return -EINVAL;
+    }
+}
+
+/*
+ * Pack the attributes under prefix in list format, stopping at the first
+ * one that does not fit. With number != NULL only attributes of that
+ * number are packed, and the virtual attributes vc selects are merged in
+ * key order. Results match exec_attr_rtrvl_stmt of the SQLite backend.
+ *
+ * returns:
+ * -EINVAL: invalid arg, ignore used_len
+ * -ENOENT: error, attribute not found
+ * -ENOMEM: out of memory
+ * OSD_OK: success, used_outlen modified
+ */
+static int kv_attr_gather(struct kv_db *kv, const uint8_t *prefix,
+        uint32_t plen, const uint32_t *number, uint64_t oid,
+        uint64_t outlen, uint8_t *outdata, uint8_t listfmt,
+        struct attr_virt_cursor *vc, uint32_t *used_outlen)
+{
+    int ret = 0;
+    int found = 0;
+    int inval = 0;
+    uint32_t len = 0;
+    uint32_t vlen = 0;
+    uint32_t page = 0;
+    uint32_t num = 0;
+    const void *k = NULL, *v = NULL;
+    uint32_t kl = 0, vl = 0;
+    struct kv_iter *it = NULL;
+
+    assert(kv);
+
+    ret = kv_iter_open(kv, prefix, plen, &it);
+    if (ret != OSD_OK)
+        return ret;
+
+    *used_outlen = 0;
+    while (kv_iter_next(it, &k, &kl, &v, &vl)) {
+        page = get_ntohl((const uint8_t *)k + 17);
+        num = get_ntohl((const uint8_t *)k + 21);
+        if (number && num != *number)
+            continue;
+        ret = attr_virt_merge(vc, page, num, oid, outdata, outlen, listfmt,
+                &vlen);
+        len += vlen;
+        outlen -= vlen;
+        outdata += vlen;
+        if (vlen > 0)
+            found = 1;
+        if (ret == OSD_OK)
+            ret = kv_attr_pack(outdata, outlen, oid, page, num, vl, v,
+                    listfmt);
+        if (ret > 0) {
+            len += ret;
+            outlen -= ret;
+            outdata += ret;
+            found = 1;
+        } else {
+            if (ret == -EINVAL)
+                inval = 1;
+            break;
+        }
+    }
+    kv_iter_close(it);
+    if (ret >= 0) {
+        ret = attr_virt_merge(vc, GETALLATTR_PG, ATTRNUM_GETALL, oid,
+                outdata, outlen, listfmt, &vlen);
+        len += vlen;
+        if (vlen > 0)
+            found = 1;
+        if (ret == -EINVAL)
+            inval = 1;
+    }
+
+    if (inval)
+        return -EINVAL;
+    *used_outlen = len;
+    return found ? OSD_OK : -ENOENT;
+}
+
+/*
+ * get one attribute in list format.
+ *
+ * -EINVAL: invalid arg, ignore used_len
+ * -ENOENT: error, attribute not found
+ * OSD_OK: success, used_outlen modified
+ */
+int kv_attr_get_conversion(void *ohandle, uint64_t pid, uint64_t oid,
+        uint32_t page, uint32_t number, uint64_t outlen,
+        void *outdata, uint8_t listfmt, uint32_t *used_outlen)
+{
+    int ret = 0;
+    uint8_t key[KV_ATTR_KEYLEN];
+    const void *val = NULL;
+    uint32_t len = 0;
+
+    assert(kv_handle(ohandle));
+
+    kv_key_attr(key, pid, oid, page, number);
+    ret = kv_get(kv_handle(ohandle), key, sizeof(key), &val, &len);
+    if (ret == -ENOENT) {
+        osd_debug("%s: attr (%llu %llu %u %u) not found!", __func__,
+                llu(pid), llu(oid), page, number);
+        return ret;
+    }
+
+    ret = kv_attr_pack(outdata, outlen, oid, page, number, len, val,
+            listfmt);
+    if (ret == -EINVAL)
+        return ret;
+    if (ret == -EOVERFLOW)
+        return -ENOENT; /* nothing fit, as exec_attr_rtrvl_stmt */
+    *used_outlen = ret;
+    return OSD_OK;
+}
+
+/*
+ * get one attribute value.
+ *
+ * -EINVAL: invalid arg, ignore used_len
+ * -ENOENT: error, attribute not found
+ * OSD_OK: success, used_outlen modified
+ */
+int kv_attr_get_val(void *ohandle, uint64_t pid, uint64_t oid,
+        uint32_t page, uint32_t number, uint64_t outlen,
+        void *outdata, uint32_t *used_outlen)
+{
+    int ret = 0;
+    uint8_t key[KV_ATTR_KEYLEN];
+    const void *val = NULL;
+    uint32_t len = 0;
+
+    assert(kv_handle(ohandle));
+
+    *used_outlen = 0;
+    kv_key_attr(key, pid, oid, page, number);
+    ret = kv_get(kv_handle(ohandle), key, sizeof(key), &val, &len);
+    if (ret == -ENOENT) {
+        osd_debug("%s: attr (%llu %llu %u %u) not found!", __func__,
+                llu(pid), llu(oid), page, number);
+        return ret;
+    }
+    if (outlen < len)
+        return -EINVAL;
+
+    memcpy(outdata, val, len);
+    *used_outlen = len;
+    return OSD_OK;
+}
+
+/*
+ * Compare and swap the 8 byte attribute (page, number). An absent
+ * attribute counts as 0 and is created.
+ *
+ * returns:
+ * -EINVAL: stored value is not 8 bytes
+ * OSD_ERROR: some other error
+ * OSD_OK: success, orig holds the value before the operation
+ */
+int kv_attr_cas(void *ohandle, uint64_t pid, uint64_t oid, uint32_t page,
+        uint32_t number, uint64_t cmp, uint64_t swap, uint64_t *orig)
+{
+    uint8_t key[KV_ATTR_KEYLEN];
+    const void *val = NULL;
+    uint32_t len = 0;
+    struct kv_db *kv = kv_handle(ohandle);
+
+    assert(kv && orig);
+
+    *orig = 0;
+    kv_key_attr(key, pid, oid, page, number);
+    if (kv_get(kv, key, sizeof(key), &val, &len) == OSD_OK) {
+        if (len != sizeof(*orig))
+            return -EINVAL;
+        memcpy(orig, val, len);
+    } else if (cmp != 0) {
+        return kv_put(kv, key, sizeof(key), orig, sizeof(*orig));
+    }
+
+    if (*orig != cmp)
+        return OSD_OK;
+    return kv_put(kv, key, sizeof(key), &swap, sizeof(swap));
+}
+
+/*
+ * Fetch and add on the 8 byte attribute (page, number). An absent
+ * attribute counts as 0 and is created.
+ *
+ * returns:
+ * OSD_ERROR: stored value is not 8 bytes, or some other error
+ * OSD_OK: success, orig holds the value before the operation
+ */
+int kv_attr_fa(void *ohandle, uint64_t pid, uint64_t oid, uint32_t page,
+        uint32_t number, int64_t add, uint64_t *orig)
+{
+    uint8_t key[KV_ATTR_KEYLEN];
+    const void *val = NULL;
+    uint32_t len = 0;
+    uint64_t sum = 0;
+    struct kv_db *kv = kv_handle(ohandle);
+
+    assert(kv && orig);
+
+    *orig = 0;
+    kv_key_attr(key, pid, oid, page, number);
+    if (kv_get(kv, key, sizeof(key), &val, &len) == OSD_OK) {
+        if (len != sizeof(*orig))
+            return OSD_ERROR;
+        memcpy(orig, val, len);
+    }
+
+    sum = *orig + (uint64_t)add;
+    return kv_put(kv, key, sizeof(key), &sum, sizeof(sum));
+}
+
+/*
+ * Compare and swap an attribute of any length, see attr_gen_cas. The
+ * stored value is compared where the store holds it and copied into orig
+ * before it is replaced.
+ *
+ * returns:
+ * -EOVERFLOW: operation done, but the value does not fit in orig_max
+ * OSD_ERROR: some other error
+ * OSD_OK: success, orig_len is 0 if the attribute was absent
+ */
+int kv_attr_gen_cas(void *ohandle, uint64_t pid, uint64_t oid, uint32_t page,
+        uint32_t number, const void *cmp, uint16_t cmp_len,
+        const void *swap, uint16_t swap_len, void *orig,
+        uint32_t orig_max, uint16_t *orig_len)
+{
+    int ret = OSD_OK;
+    int match = 0;
+    uint8_t key[KV_ATTR_KEYLEN];
+    const void *val = NULL;
+    uint32_t len = 0;
+    struct kv_db *kv = kv_handle(ohandle);
+
+    assert(kv && orig && orig_len);
+
+    *orig_len = 0;
+    kv_key_attr(key, pid, oid, page, number);
+    if (kv_get(kv, key, sizeof(key), &val, &len) != OSD_OK) {
+        if (swap_len == 0)
+            return OSD_OK;
+        return kv_put(kv, key, sizeof(key), swap, swap_len);
+    }
+
+    *orig_len = len;
+    match = (len == cmp_len && (len == 0 || memcmp(val, cmp, len) == 0));
+    if (len > orig_max) {
+        ret = -EOVERFLOW;
+        len = orig_max;
+    }
+    memcpy(orig, val, len);  /* val does not survive the put below */
+    if (!match)
+        return ret;
+
+    if (swap_len > 0)
+        return (kv_put(kv, key, sizeof(key), swap, swap_len) == OSD_OK ?
+                ret : OSD_ERROR);
+    return (kv_del(kv, key, sizeof(key)) == OSD_OK ? ret : OSD_ERROR);
+}
+
+/*
+ * get one page in list format
+ *
+ * -EINVAL: invalid arg, ignore used_len
+ * -ENOENT: error, attribute not found
+ * OSD_OK: success, used_outlen modified
+ */
+int kv_attr_get_page_as_list(void *ohandle, uint64_t pid, uint64_t oid,
+        uint32_t page, uint64_t outlen, void *outdata,
+        uint8_t listfmt, uint32_t *used_outlen)
+{
+    uint8_t prefix[KV_ATTR_KEYLEN];
+    struct attr_virt_cursor vc;
+
+    kv_key_attr(prefix, pid, oid, page, 0);
+    attr_virt_open(&vc, page, ATTRNUM_GETALL);
+    return kv_attr_gather(kv_handle(ohandle), prefix, 21, NULL, oid,
+            outlen, outdata, listfmt, &vc, used_outlen);
+}
+
+/*
+ * for each defined page of an object get attribute with specified number
+ *
+ * -EINVAL: invalid arg, ignore used_len
+ * -ENOENT: error, attribute not found
+ * OSD_OK: success, used_outlen modified
+ */
+int kv_attr_get_for_all_pages(void *ohandle, uint64_t pid, uint64_t oid,
+        uint32_t number, uint64_t outlen, void *outdata,
+        uint8_t listfmt, uint32_t *used_outlen)
+{
+    uint8_t prefix[KV_ATTR_KEYLEN];
+    struct attr_virt_cursor vc;
+
+    kv_key_attr(prefix, pid, oid, 0, 0);
+    attr_virt_open(&vc, GETALLATTR_PG, number);
+    return kv_attr_gather(kv_handle(ohandle), prefix, 17, &number, oid,
+            outlen, outdata, listfmt, &vc, used_outlen);
+}
+
+/*
+ * get all attributes for an object in a list format
+ *
+ * -EINVAL: invalid arg, ignore used_len
+ * -ENOENT: error, attribute not found
+ * OSD_OK: success, used_outlen modified
+ */
+int kv_attr_get_all_attrs(void *ohandle, uint64_t pid, uint64_t oid,
+        uint64_t outlen, void *outdata, uint8_t listfmt,
+        uint32_t *used_outlen)
+{
+    uint8_t prefix[KV_ATTR_KEYLEN];
+    struct attr_virt_cursor vc;
+
+    kv_key_attr(prefix, pid, oid, 0, 0);
+    attr_virt_open(&vc, GETALLATTR_PG, ATTRNUM_GETALL);
+    return kv_attr_gather(kv_handle(ohandle), prefix, 17, NULL, oid,
+            outlen, outdata, listfmt, &vc, used_outlen);
+}
+
+/*
+ * get the directory page of the object. The defined pages are visited by
+ * seeking from each page to the first attribute of the next one, so the
+ * cost is O(pages). A page name, number 0, sorts first in its page.
+ *
+ * returns:
+ * -EINVAL: invalid arg, ignore used_len
+ * -ENOENT: error, attribute not found
+ * -ENOMEM: out of memory
+ * OSD_OK: success, used_outlen modified
+ */
+int kv_attr_get_dir_page(void *ohandle, uint64_t pid, uint64_t oid,
+        uint32_t page, uint64_t outlen, void *outdata,
+        uint8_t listfmt, uint32_t *used_outlen)
+{
+    int ret = 0;
+    int found = 0;
+    uint32_t len = 0;
+    uint32_t vlen = 0;
+    uint32_t pg = 0;
+    uint8_t *cp = outdata;
+    struct attr_virt_cursor vc;
+    uint8_t key[KV_ATTR_KEYLEN];
+    const void *k = NULL, *v = NULL;
+    uint32_t kl = 0, vl = 0;
+    struct kv_iter *it = NULL;
+
+    assert(kv_handle(ohandle));
+
+    if (page != USEROBJECT_DIR_PG && page != COLLECTION_DIR_PG &&
+            page != PARTITION_DIR_PG && page != ROOT_DIR_PG)
+        return -EINVAL;
+
+    kv_key_attr(key, pid, oid, 0, 0);
+    ret = kv_iter_open(kv_handle(ohandle), key, 17, &it);
+    if (ret != OSD_OK)
+        return ret;
+
+    *used_outlen = 0;
+    attr_virt_open_dir(&vc, page);
+    while (kv_iter_next(it, &k, &kl, &v, &vl)) {
+        pg = get_ntohl((const uint8_t *)k + 17);
+        if (get_ntohl((const uint8_t *)k + 21) != 0) {
+            v = attr_virt_get(pg, 0);
+            if (v == NULL)
+                v = unid_page;
+            vl = ATTR_PAGE_ID_LEN;
+        }
+        if (vl != ATTR_PAGE_ID_LEN) {
+            ret = -EINVAL;
+            goto out;
+        }
+        ret = attr_virt_merge(&vc, pg, 0, oid, cp, outlen, listfmt, &vlen);
+        len += vlen;
+        outlen -= vlen;
+        cp += vlen;
+        if (vlen > 0)
+            found = 1;
+        if (ret == OSD_OK)
+            ret = kv_attr_pack(cp, outlen, oid, page, pg, vl, v, listfmt);
+        if (ret <= 0)
+            break;
+        len += ret;
+        outlen -= ret;
+        cp += ret;
+        found = 1;
+
+        if (pg == (uint32_t) -1)
+            break;
+        kv_key_attr(key, pid, oid, pg + 1, 0);
+        kv_iter_seek(it, key, sizeof(key));
+    }
+    if (ret >= 0) {
+        ret = attr_virt_merge(&vc, GETALLATTR_PG, ATTRNUM_GETALL, oid, cp,
+                outlen, listfmt, &vlen);
+        len += vlen;
+        if (vlen > 0)
+            found = 1;
+    }
+    if (ret == -EINVAL)
+        goto out;
+
+    *used_outlen = len;
+    ret = found ? OSD_OK : -ENOENT;
+    if (!found)
+        osd_debug("%s: dir page not found!", __func__);
+
+out:
+    kv_iter_close(it);
+    return ret;
+}
+
+/*
+ * Retrieve a list of attributes of the objects [oid, oid+numoid), in the
+ * order attr_get_attr_list of the SQLite backend produces: entry-major,
+ * then by oid. Entries flagged in indb are point lookups, the others and
+ * missing attributes are handed to fill.
+ *
+ * returns:
+ * -EINVAL: invalid arg
+ * >0: error returned by fill
+ * OSD_OK: success, used_outlen modified
+ */
+int kv_attr_get_attr_list(void *ohandle, uint64_t pid, uint64_t oid,
+        uint16_t numoid, const struct getattr_list *ga, const uint8_t *indb,
+        attr_fill_t fill, void *arg, uint64_t outlen, void *outdata,
+        uint8_t listfmt, uint32_t *used_outlen)
+{
+    int ret = 0;
+    uint32_t i = 0;
+    uint32_t used = 0;
+    uint64_t o = 0;
+    uint8_t *cp = outdata;
+    uint8_t key[KV_ATTR_KEYLEN];
+    const void *val = NULL;
+    uint32_t len = 0;
+    struct kv_db *kv = kv_handle(ohandle);
+
+    assert(kv && ga && indb && fill);
+
+    if (listfmt != RTRVD_SET_ATTR_LIST &&
+            listfmt != RTRVD_CREATE_MULTIOBJ_LIST)
+        return -EINVAL;
+
+    *used_outlen = 0;
+    for (i = 0; i < ga->sz; i++) {
+        for (o = oid; o < oid + numoid; o++) {
+            kv_key_attr(key, pid, o, ga->le[i].page, ga->le[i].number);
+            if (indb[i] && kv_get(kv, key, sizeof(key), &val,
+                        &len) == OSD_OK) {
+                ret = kv_attr_pack(cp, outlen, o, ga->le[i].page,
+                        ga->le[i].number, len, val, listfmt);
+                if (ret == -EINVAL)
+                    return ret;
+                used = (ret > 0) ? ret : 0;
+            } else {
+                ret = fill(arg, i, o, cp, outlen, &used);
+                if (ret != OSD_OK)
+                    return ret;
+            }
+            cp += used;
+            outlen -= used;
+            *used_outlen += used;
+        }
+    }
+
+    return OSD_OK;
+}
+
+/*
+ * The store keeps no value indexes: OSD_QUERY looks up the attributes of
+ * each collection member, see kv_mtq_run_query. Only the declared types
+ * are loaded into the handle, for it to compare by.
+ *
+ * returns:
+ * -ENOMEM: out of memory
+ * OSD_ERROR: some other error
+ * OSD_OK: success
+ */
+int kv_attr_sync_query_idx(void *ohandle)
+{
+    int ret = 0;
+    uint8_t prefix[KV_ATTR_KEYLEN];
+    const void *k = NULL, *v = NULL;
+    uint32_t kl = 0, vl = 0;
+    struct handle *h = ohandle;
+    struct attr_types *at = NULL;
+    struct kv_iter *it = NULL;
+
+    at = Calloc(1, sizeof(*at));
+    if (!at)
+        return -ENOMEM;
+
+    kv_key_attr(prefix, ROOT_PID, ROOT_OID, ROOT_QUERY_PG, 0);
+    ret = kv_iter_open(kv_handle(ohandle), prefix, 21, &it);
+    if (ret != OSD_OK)
+        goto out;
+    while (kv_iter_next(it, &k, &kl, &v, &vl)) {
+        if (get_ntohl((const uint8_t *)k + 21) == 0)
+            continue;
+        /* anything but a declaration is skipped */
+        if (attr_types_add(at, v, vl) == -ENOMEM) {
+            ret = -ENOMEM;
+            break;
+        }
+    }
+    kv_iter_close(it);
+    if (ret != OSD_OK)
+        goto out;
+
+    attr_types_free(h->qtypes);
+    h->qtypes = at;
+    at = NULL;
+
+out:
+    attr_types_free(at);
+    return ret;
+}
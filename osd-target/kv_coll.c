@@ -0,0 +1,328 @@
+/*
+ * Collections in the key/value store.
+ *
+ * Copyright (C) 2007 OSD Team <pvfs-osd@osc.edu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <assert.h>
+
+#include "osd.h"
+#include "osd-util/osd-util.h"
+#include "kv_md.h"
+
+/*
+ * Membership is kept twice, as 'c' pid cid oid -> number and as 'm' pid
+ * oid number -> cid; both are written and deleted together.
+ */
+
+static int kv_coll_unlink(struct kv_db *kv, uint64_t pid, uint64_t cid,
+			  uint64_t oid, uint32_t number)
+{
+	int ret = 0;
+	uint8_t key[KV_COLL_KEYLEN];
+
+	kv_key_coll(key, pid, cid, oid);
+	ret = kv_del(kv, key, KV_COLL_KEYLEN);
+	if (ret != OSD_OK)
+		return ret;
+	kv_key_memb(key, pid, oid, number);
+	return kv_del(kv, key, KV_MEMB_KEYLEN);
+}
+
+/*
+ * Like the UNIQUE (pid, oid, number) ON CONFLICT REPLACE constraint of the
+ * coll table, a membership under the same number in another collection is
+ * replaced.
+ *
+ * returns:
+ * OSD_ERROR: oid is in cid already, or some other error
+ * OSD_OK: success
+ */
+int kv_coll_insert(void *ohandle, uint64_t pid, uint64_t cid, uint64_t oid,
+		   uint32_t number)
+{
+	int ret = 0;
+	uint8_t key[KV_COLL_KEYLEN];
+	uint8_t val[8];
+	const void *v = NULL;
+	uint32_t vl = 0;
+	struct kv_db *kv = kv_handle(ohandle);
+
+	assert(kv);
+
+	kv_key_coll(key, pid, cid, oid);
+	if (kv_get(kv, key, KV_COLL_KEYLEN, &v, &vl) == OSD_OK) {
+		osd_error("%s: (%llu %llu) already in collection %llu",
+			  __func__, llu(pid), llu(oid), llu(cid));
+		return OSD_ERROR;
+	}
+
+	kv_key_memb(key, pid, oid, number);
+	if (kv_get(kv, key, KV_MEMB_KEYLEN, &v, &vl) == OSD_OK && vl == 8) {
+		ret = kv_coll_unlink(kv, pid, get_ntohll(v), oid, number);
+		if (ret != OSD_OK)
+			return ret;
+	}
+
+	kv_key_coll(key, pid, cid, oid);
+	set_htonl(val, number);
+	ret = kv_put(kv, key, KV_COLL_KEYLEN, val, 4);
+	if (ret != OSD_OK)
+		return ret;
+	kv_key_memb(key, pid, oid, number);
+	set_htonll(val, cid);
+	return kv_put(kv, key, KV_MEMB_KEYLEN, val, 8);
+}
+
+/*
+ * returns:
+ * OSD_ERROR: some error
+ * OSD_OK: success
+ */
+int kv_coll_delete(void *ohandle, uint64_t pid, uint64_t cid, uint64_t oid)
+{
+	uint8_t key[KV_COLL_KEYLEN];
+	const void *v = NULL;
+	uint32_t vl = 0;
+	struct kv_db *kv = kv_handle(ohandle);
+
+	assert(kv);
+
+	kv_key_coll(key, pid, cid, oid);
+	if (kv_get(kv, key, KV_COLL_KEYLEN, &v, &vl) != OSD_OK || vl != 4)
+		return OSD_OK;
+	return kv_coll_unlink(kv, pid, cid, oid, get_ntohl(v));
+}
+
+/*
+ * Collect the 16 byte tail of every key under prefix: oid and number of
+ * the members of a collection, or number and cid of the memberships of
+ * an object.
+ */
+static int kv_coll_collect(struct kv_db *kv, const uint8_t *prefix,
+			   uint32_t plen, uint8_t **out, size_t *n)
+{
+	int ret = 0;
+	uint8_t *p = NULL;
+	const void *k = NULL, *v = NULL;
+	uint32_t kl = 0, vl = 0;
+	struct kv_iter *it = NULL;
+
+	*out = NULL;
+	*n = 0;
+	ret = kv_iter_open(kv, prefix, plen, &it);
+	if (ret != OSD_OK)
+		return ret;
+	while (kv_iter_next(it, &k, &kl, &v, &vl)) {
+		if ((*n & 63) == 0) {
+			p = realloc(*out, (*n + 64) * 16);
+			if (!p) {
+				ret = -ENOMEM;
+				break;
+			}
+			*out = p;
+		}
+		assert(kl - plen + vl <= 16);
+		memcpy(*out + *n * 16, (const uint8_t *)k + plen, kl - plen);
+		memcpy(*out + *n * 16 + kl - plen, v, vl);
+		(*n)++;
+	}
+	kv_iter_close(it);
+	if (ret != OSD_OK) {
+		free(*out);
+		*out = NULL;
+	}
+	return ret;
+}
+
+/*
+ * returns:
+ * -ENOMEM: out of memory
+ * OSD_ERROR: some other error
+ * OSD_OK: success
+ */
+int kv_coll_delete_cid(void *ohandle, uint64_t pid, uint64_t cid)
+{
+	int ret = 0;
+	size_t i = 0;
+	size_t n = 0;
+	uint8_t *m = NULL;
+	uint8_t prefix[KV_COLL_KEYLEN];
+	struct kv_db *kv = kv_handle(ohandle);
+
+	kv_key_coll(prefix, pid, cid, 0);
+	ret = kv_coll_collect(kv, prefix, 17, &m, &n);
+	for (i = 0; ret == OSD_OK && i < n; i++)
+		ret = kv_coll_unlink(kv, pid, cid, get_ntohll(m + i * 16),
+				     get_ntohl(m + i * 16 + 8));
+	free(m);
+	return ret;
+}
+
+int kv_coll_delete_oid(void *ohandle, uint64_t pid, uint64_t oid)
+{
+	int ret = 0;
+	size_t i = 0;
+	size_t n = 0;
+	uint8_t *m = NULL;
+	uint8_t prefix[KV_MEMB_KEYLEN];
+	struct kv_db *kv = kv_handle(ohandle);
+
+	kv_key_memb(prefix, pid, oid, 0);
+	ret = kv_coll_collect(kv, prefix, 17, &m, &n);
+	for (i = 0; ret == OSD_OK && i < n; i++)
+		ret = kv_coll_unlink(kv, pid, get_ntohll(m + i * 16 + 4),
+				     oid, get_ntohl(m + i * 16));
+	free(m);
+	return ret;
+}
+
+/*
+ * returns:
+ * -ENOMEM: out of memory
+ * OSD_OK: success, isempty is set to:
+ * 	==1: if collection is empty or absent
+ * 	==0: if not empty
+ */
+int kv_coll_isempty_cid(void *ohandle, uint64_t pid, uint64_t cid,
+			int *isempty)
+{
+	int ret = 0;
+	uint8_t prefix[KV_COLL_KEYLEN];
+	const void *k = NULL, *v = NULL;
+	uint32_t kl = 0, vl = 0;
+	struct kv_iter *it = NULL;
+
+	kv_key_coll(prefix, pid, cid, 0);
+	ret = kv_iter_open(kv_handle(ohandle), prefix, 17, &it);
+	if (ret != OSD_OK)
+		return ret;
+	*isempty = !kv_iter_next(it, &k, &kl, &v, &vl);
+	kv_iter_close(it);
+	return OSD_OK;
+}
+
+/*
+ * returns:
+ * OSD_OK: success, cid is set to proper collection id if there is one
+ */
+int kv_coll_get_cid(void *ohandle, uint64_t pid, uint64_t oid,
+		    uint32_t number, uint64_t *cid)
+{
+	uint8_t key[KV_MEMB_KEYLEN];
+	const void *v = NULL;
+	uint32_t vl = 0;
+
+	assert(kv_handle(ohandle));
+
+	kv_key_memb(key, pid, oid, number);
+	if (kv_get(kv_handle(ohandle), key, sizeof(key), &v, &vl) == OSD_OK &&
+	    vl == 8)
+		*cid = get_ntohll(v);
+	return OSD_OK;
+}
+
+/*
+ * returns:
+ * -ENOMEM: out of memory
+ * OSD_OK: success, oids copied into outbuf, cont_id set if necessary
+ */
+int kv_coll_get_oids_in_cid(void *ohandle, uint64_t pid, uint64_t cid,
+			    uint64_t initial_oid, uint64_t alloc_len,
+			    uint8_t *outdata, uint64_t *used_outlen,
+			    uint64_t *add_len, uint64_t *cont_id)
+{
+	int ret = 0;
+	uint64_t len = 0;
+	uint8_t key[KV_COLL_KEYLEN];
+	const void *k = NULL, *v = NULL;
+	uint32_t kl = 0, vl = 0;
+	uint64_t known = *add_len;
+	struct kv_iter *it = NULL;
+
+	*add_len = 0;
+	*cont_id = 0;
+	*used_outlen = 0;
+
+	kv_key_coll(key, pid, cid, initial_oid);
+	ret = kv_iter_open(kv_handle(ohandle), key, 17, &it);
+	if (ret != OSD_OK)
+		return ret;
+	kv_iter_seek(it, key, sizeof(key));
+	while (kv_iter_next(it, &k, &kl, &v, &vl))
+		if (kv_emit_id(get_ntohll((const uint8_t *)k + 17), alloc_len,
+			       outdata, &len, add_len, cont_id, known))
+			break;
+	kv_iter_close(it);
+	*used_outlen = len;
+	if (known)
+		*add_len = known;
+	return OSD_OK;
+}
+
+/*
+ * Member oids of a collection in ascending order, in a malloc'ed array
+ * the caller frees.
+ *
+ * returns:
+ * -ENOMEM: out of memory
+ * OSD_OK: success
+ */
+int kv_coll_get_members(void *ohandle, uint64_t pid, uint64_t cid,
+			uint64_t **oids, size_t *noid)
+{
+	int ret = 0;
+	size_t i = 0;
+	uint8_t *m = NULL;
+	uint8_t prefix[KV_COLL_KEYLEN];
+
+	kv_key_coll(prefix, pid, cid, 0);
+	ret = kv_coll_collect(kv_handle(ohandle), prefix, 17, &m, noid);
+	if (ret != OSD_OK)
+		return ret;
+
+	/* reuse the buffer, each 16 byte entry becomes one oid */
+	*oids = (uint64_t *)m;
+	for (i = 0; i < *noid; i++)
+		(*oids)[i] = get_ntohll(m + i * 16);
+	return OSD_OK;
+}
+
+/*
+ * Add the members of source_cid to dest_cid under number 0, the same as
+ * the INSERT ... SELECT of the SQLite backend.
+ *
+ * returns:
+ * -ENOMEM: out of memory
+ * OSD_ERROR: some other error
+ * OSD_OK: success
+ */
+int kv_coll_copyoids(void *ohandle, uint64_t pid, uint64_t dest_cid,
+		     uint64_t source_cid)
+{
+	int ret = 0;
+	size_t i = 0;
+	size_t n = 0;
+	uint64_t *oids = NULL;
+
+	ret = kv_coll_get_members(ohandle, pid, source_cid, &oids, &n);
+	for (i = 0; ret == OSD_OK && i < n; i++)
+		ret = kv_coll_insert(ohandle, pid, dest_cid, oids[i], 0);
+	free(oids);
+	return ret;
+}
@@ -0,0 +1,177 @@
+/*
+ * The key/value metadata backend.
+ *
+ * Copyright (C) 2007 OSD Team <pvfs-osd@osc.edu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "io.h"
+#include "backend.h"
+#include "osd.h"
+#include "osd-types.h"
+#include "osd-util/osd-util.h"
+#include "kv_md.h"
+#include "attr-type.h"
+
+/*
+ * Metadata lives in the store under md/kv, data in files under dfiles as
+ * with the SQLite backend, whose data path is shared.
+ */
+static int kv_io_open(const char *root, struct osd_device *osd)
+{
+    int ret = 0;
+    char path[MAXNAMELEN];
+
+    ret = setup_root_dirs(root, osd);
+    if (ret != 0)
+        goto out;
+
+    sprintf(path, "%s/%s/kv", root, md);
+    if (access(path, F_OK) != 0) {
+        ret = check_dfiles_empty(root);
+        if (ret != 0)
+            goto out;
+    }
+    ret = kv_open(path, &osd->handle->kv);
+    if (ret != 0 && ret != 1) {
+        osd_error("!kv_open(%s)", path);
+        goto out;
+    }
+    if (ret == 1) {
+        ret = osd_initialize_db(osd);
+        if (ret != 0) {
+            osd_error("!osd_initialize_db");
+            goto out;
+        }
+    }
+
+out:
+    return ret;
+}
+
+static int kv_io_close(struct osd_device *osd)
+{
+    int ret = 0;
+
+    ret = kv_close(osd->handle->kv);
+    if (ret != 0)
+        osd_error("%s: kv_close", __func__);
+    osd->handle->kv = NULL;
+    attr_types_free(osd->handle->qtypes);
+    osd->handle->qtypes = NULL;
+    free(osd->root);
+    osd->root = NULL;
+    return ret;
+}
+
+static int kv_io_begin_txn(struct osd_device *osd)
+{
+    return kv_begin_txn(osd->handle->kv);
+}
+
+static int kv_io_end_txn(struct osd_device *osd)
+{
+    return kv_end_txn(osd->handle->kv);
+}
+
+/* the store frees space as its compaction thread merges segments */
+static int kv_io_vacuum(void *ohandle, int idle)
+{
+    return 0;
+}
+
+static void kv_io_vacuum_stats(void *ohandle, struct vacuum_stats *vs)
+{
+    memset(vs, 0, sizeof(*vs));
+}
+
+static void kv_io_cache_stats(void *ohandle, struct tune_stats *ts)
+{
+    memset(ts, 0, sizeof(*ts));
+}
+
+/*
+ * attr_set_attr and attr_get_attr implement the INCITS information pages
+ * on top of the backend and are shared with the SQLite backend.
+ */
+const struct osd_backend kv_backend = {
+    .name = "kv",
+
+    .open = kv_io_open,
+    .close = kv_io_close,
+    .begin_txn = kv_io_begin_txn,
+    .end_txn = kv_io_end_txn,
+    .vacuum = kv_io_vacuum,
+    .vacuum_stats = kv_io_vacuum_stats,
+    .cache_stats = kv_io_cache_stats,
+
+    .obj_insert = kv_obj_insert,
+    .obj_insert_range = kv_obj_insert_range,
+    .obj_delete = kv_obj_delete,
+    .obj_get_nextoid = kv_obj_get_nextoid,
+    .obj_get_nextpid = kv_obj_get_nextpid,
+    .obj_ispresent = kv_obj_ispresent,
+    .obj_isempty_pid = kv_obj_isempty_pid,
+    .obj_get_type = kv_obj_get_type,
+    .obj_get_oids_in_pid = kv_obj_get_oids_in_pid,
+    .obj_get_cids_in_pid = kv_obj_get_cids_in_pid,
+    .obj_get_all_pids = kv_obj_get_all_pids,
+
+    .attr_set_attr = attr_set_attr,
+    ._attr_set_attr = kv_attr_set_attr,
+    .attr_set_conversion = kv_attr_set_conversion,
+    .attr_set_attr_list = kv_attr_set_attr_list,
+    .attr_delete_attr = kv_attr_delete_attr,
+    .attr_delete_all = kv_attr_delete_all,
+    .attr_get_attr = attr_get_attr,
+    .attr_get_conversion = kv_attr_get_conversion,
+    .attr_get_val = kv_attr_get_val,
+    .attr_cas = kv_attr_cas,
+    .attr_fa = kv_attr_fa,
+    .attr_gen_cas = kv_attr_gen_cas,
+    .attr_get_page_as_list = kv_attr_get_page_as_list,
+    .attr_get_for_all_pages = kv_attr_get_for_all_pages,
+    .attr_get_all_attrs = kv_attr_get_all_attrs,
+    .attr_get_attr_list = kv_attr_get_attr_list,
+    .attr_get_dir_page = kv_attr_get_dir_page,
+    .attr_sync_query_idx = kv_attr_sync_query_idx,
+
+    .coll_insert = kv_coll_insert,
+    .coll_delete = kv_coll_delete,
+    .coll_delete_cid = kv_coll_delete_cid,
+    .coll_delete_oid = kv_coll_delete_oid,
+    .coll_isempty_cid = kv_coll_isempty_cid,
+    .coll_get_cid = kv_coll_get_cid,
+    .coll_get_oids_in_cid = kv_coll_get_oids_in_cid,
+    .coll_copyoids = kv_coll_copyoids,
+
+    .mtq_run_query = kv_mtq_run_query,
+    .mtq_list_oids_attr = kv_mtq_list_oids_attr,
+    .mtq_list_members_attr = kv_mtq_list_members_attr,
+    .mtq_set_member_attrs = kv_mtq_set_member_attrs,
+    .mtq_remove_members = kv_mtq_remove_members,
+
+    .contig_read = contig_read,
+    .sgl_read = sgl_read,
+    .vec_read = vec_read,
+    .contig_write = contig_write,
+    .sgl_write = sgl_write,
+    .vec_write = vec_write,
+    .osd_create_datafile = osd_create_datafile,
+    .format_osd = format_osd,
+};
@@ -0,0 +1,241 @@
+/*
+ * OSD metadata in the key/value store.
+ *
+ * Copyright (C) 2007 OSD Team <pvfs-osd@osc.edu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __KV_MD_H
+#define __KV_MD_H
+
+#include "osd-types.h"
+#include "attr.h"
+#include "kv.h"
+#include "osd-util/osd-util.h"
+
+/*
+ * The obj, attr and coll tables of the SQLite schema map to four key
+ * spaces. Ids are big-endian so keys sort like the primary keys of the
+ * tables:
+ *
+ *   'o' pid oid               -> type (1 byte)
+ *   'a' pid oid page number   -> value
+ *   'c' pid cid oid           -> number (4 bytes)
+ *   'm' pid oid number        -> cid (8 bytes)
+ *
+ * 'm' is the reverse of 'c' and plays the part of the UNIQUE (pid, oid,
+ * number) constraint of the coll table. There is no attrdir: the pages of
+ * an object are found by seeking from one page to the next in 'a'.
+ */
+#define KV_OBJ_KEYLEN (17)
+#define KV_ATTR_KEYLEN (25)
+#define KV_COLL_KEYLEN (25)
+#define KV_MEMB_KEYLEN (21)
+
+static inline struct kv_db *kv_handle(void *ohandle)
+{
+	return ((struct handle *)ohandle)->kv;
+}
+
+static inline uint32_t kv_key_obj(uint8_t *k, uint64_t pid, uint64_t oid)
+{
+	k[0] = 'o';
+	set_htonll(&k[1], pid);
+	set_htonll(&k[9], oid);
+	return KV_OBJ_KEYLEN;
+}
+
+static inline uint32_t kv_key_attr(uint8_t *k, uint64_t pid, uint64_t oid,
+				   uint32_t page, uint32_t number)
+{
+	k[0] = 'a';
+	set_htonll(&k[1], pid);
+	set_htonll(&k[9], oid);
+	set_htonl(&k[17], page);
+	set_htonl(&k[21], number);
+	return KV_ATTR_KEYLEN;
+}
+
+static inline uint32_t kv_key_coll(uint8_t *k, uint64_t pid, uint64_t cid,
+				   uint64_t oid)
+{
+	k[0] = 'c';
+	set_htonll(&k[1], pid);
+	set_htonll(&k[9], cid);
+	set_htonll(&k[17], oid);
+	return KV_COLL_KEYLEN;
+}
+
+static inline uint32_t kv_key_memb(uint8_t *k, uint64_t pid, uint64_t oid,
+				   uint32_t number)
+{
+	k[0] = 'm';
+	set_htonll(&k[1], pid);
+	set_htonll(&k[9], oid);
+	set_htonl(&k[17], number);
+	return KV_MEMB_KEYLEN;
+}
+
+/* kv_obj.c */
+int kv_emit_id(uint64_t id, uint64_t alloc_len, uint8_t *outdata,
+	       uint64_t *len, uint64_t *add_len, uint64_t *cont_id,
+	       uint64_t known);
+
+int kv_obj_insert(void *ohandle, uint64_t pid, uint64_t oid, uint32_t type);
+
+int kv_obj_insert_range(void *ohandle, uint64_t pid, uint64_t oid,
+			uint16_t numoid, uint32_t type);
+
+int kv_obj_delete(void *ohandle, uint64_t pid, uint64_t oid);
+
+int kv_obj_get_nextoid(void *ohandle, uint64_t pid, uint64_t *oid);
+
+int kv_obj_get_nextpid(void *ohandle, uint64_t *pid);
+
+int kv_obj_ispresent(void *ohandle, char *root, uint64_t pid, uint64_t oid,
+		     int *present);
+
+int kv_obj_isempty_pid(void *ohandle, char *root, uint64_t pid,
+		       int *isempty);
+
+int kv_obj_get_type(void *ohandle, uint64_t pid, uint64_t oid,
+		    uint8_t *obj_type);
+
+int kv_obj_get_oids_in_pid(void *ohandle, uint64_t pid, uint64_t initial_oid,
+			   uint64_t alloc_len, uint8_t *outdata,
+			   uint64_t *used_outlen, uint64_t *add_len,
+			   uint64_t *cont_id);
+
+int kv_obj_get_cids_in_pid(void *ohandle, uint64_t pid, uint64_t initial_cid,
+			   uint64_t alloc_len, uint8_t *outdata,
+			   uint64_t *used_outlen, uint64_t *add_len,
+			   uint64_t *cont_id);
+
+int kv_obj_get_all_pids(void *ohandle, uint64_t initial_pid,
+			uint64_t alloc_len, uint8_t *outdata,
+			uint64_t *used_outlen, uint64_t *add_len,
+			uint64_t *cont_id);
+
+/* kv_attr.c */
+int kv_attr_set_attr(void *ohandle, uint64_t pid, uint64_t oid,
+		     uint32_t page, uint32_t number, const void *val,
+		     uint16_t len);
+
+int kv_attr_set_conversion(void *ohandle, uint64_t pid, uint64_t oid,
+			   uint32_t page, uint32_t number, const void *val,
+			   uint16_t len);
+
+int kv_attr_set_attr_list(void *ohandle, uint64_t pid, uint64_t oid,
+			  uint16_t numoid, const struct list_entry *le,
+			  uint32_t sz);
+
+int kv_attr_delete_attr(void *ohandle, uint64_t pid, uint64_t oid,
+			uint32_t page, uint32_t number);
+
+int kv_attr_delete_all(void *ohandle, uint64_t pid, uint64_t oid);
+
+int kv_attr_get_conversion(void *ohandle, uint64_t pid, uint64_t oid,
+			   uint32_t page, uint32_t number, uint64_t outlen,
+			   void *outdata, uint8_t listfmt,
+			   uint32_t *used_outlen);
+
+int kv_attr_get_val(void *ohandle, uint64_t pid, uint64_t oid,
+		    uint32_t page, uint32_t number, uint64_t outlen,
+		    void *outdata, uint32_t *used_outlen);
+
+int kv_attr_cas(void *ohandle, uint64_t pid, uint64_t oid, uint32_t page,
+		uint32_t number, uint64_t cmp, uint64_t swap, uint64_t *orig);
+
+int kv_attr_fa(void *ohandle, uint64_t pid, uint64_t oid, uint32_t page,
+	       uint32_t number, int64_t add, uint64_t *orig);
+
+int kv_attr_gen_cas(void *ohandle, uint64_t pid, uint64_t oid, uint32_t page,
+		    uint32_t number, const void *cmp, uint16_t cmp_len,
+		    const void *swap, uint16_t swap_len, void *orig,
+		    uint32_t orig_max, uint16_t *orig_len);
+
+int kv_attr_get_page_as_list(void *ohandle, uint64_t pid, uint64_t oid,
+			     uint32_t page, uint64_t outlen, void *outdata,
+			     uint8_t listfmt, uint32_t *used_outlen);
+
+int kv_attr_get_for_all_pages(void *ohandle, uint64_t pid, uint64_t oid,
+			      uint32_t number, uint64_t outlen, void *outdata,
+			      uint8_t listfmt, uint32_t *used_outlen);
+
+int kv_attr_get_all_attrs(void *ohandle, uint64_t pid, uint64_t oid,
+			  uint64_t outlen, void *outdata, uint8_t listfmt,
+			  uint32_t *used_outlen);
+
+int kv_attr_get_attr_list(void *ohandle, uint64_t pid, uint64_t oid,
+			  uint16_t numoid, const struct getattr_list *ga,
+			  const uint8_t *indb, attr_fill_t fill, void *arg,
+			  uint64_t outlen, void *outdata, uint8_t listfmt,
+			  uint32_t *used_outlen);
+
+int kv_attr_get_dir_page(void *ohandle, uint64_t pid, uint64_t oid,
+			 uint32_t page, uint64_t outlen, void *outbuf,
+			 uint8_t listfmt, uint32_t *used_outlen);
+
+int kv_attr_sync_query_idx(void *ohandle);
+
+/* kv_coll.c */
+int kv_coll_insert(void *ohandle, uint64_t pid, uint64_t cid, uint64_t oid,
+		   uint32_t number);
+
+int kv_coll_delete(void *ohandle, uint64_t pid, uint64_t cid, uint64_t oid);
+
+int kv_coll_delete_cid(void *ohandle, uint64_t pid, uint64_t cid);
+
+int kv_coll_delete_oid(void *ohandle, uint64_t pid, uint64_t oid);
+
+int kv_coll_isempty_cid(void *ohandle, uint64_t pid, uint64_t cid,
+			int *isempty);
+
+int kv_coll_get_cid(void *ohandle, uint64_t pid, uint64_t oid,
+		    uint32_t number, uint64_t *cid);
+
+int kv_coll_get_oids_in_cid(void *ohandle, uint64_t pid, uint64_t cid,
+			    uint64_t initial_oid, uint64_t alloc_len,
+			    uint8_t *outdata, uint64_t *used_outlen,
+			    uint64_t *add_len, uint64_t *cont_id);
+
+int kv_coll_copyoids(void *ohandle, uint64_t pid, uint64_t dest_cid,
+		     uint64_t source_cid);
+
+int kv_coll_get_members(void *ohandle, uint64_t pid, uint64_t cid,
+			uint64_t **oids, size_t *noid);
+
+/* kv_mtq.c */
+int kv_mtq_run_query(void *ohandle, uint64_t pid, uint64_t cid,
+		     struct query_criteria *qc, void *outdata,
+		     uint32_t alloc_len, uint64_t *used_outlen);
+
+int kv_mtq_list_oids_attr(void *ohandle, uint64_t pid, uint64_t initial_oid,
+			  struct getattr_list *get_attr, uint64_t alloc_len,
+			  void *outdata, uint64_t *used_outlen,
+			  uint64_t *add_len, uint64_t *cont_id);
+
+int kv_mtq_list_members_attr(void *ohandle, uint64_t pid, uint64_t cid,
+			     uint64_t initial_oid,
+			     struct getattr_list *get_attr,
+			     uint64_t alloc_len, void *outdata,
+			     uint64_t *used_outlen, uint64_t *add_len,
+			     uint64_t *cont_id);
+
+int kv_mtq_set_member_attrs(void *ohandle, uint64_t pid, uint64_t cid,
+			    struct setattr_list *set_attr);
+
+int kv_mtq_remove_members(void *ohandle, uint64_t pid, uint64_t cid,
+			  uint64_t **oids, size_t *noid);
+
+#endif /* __KV_MD_H */
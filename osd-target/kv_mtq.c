@@ -0,0 +1,319 @@
+/*
+ * Multi-table queries in the key/value store.
+ *
+ * Copyright (C) 2007 OSD Team <pvfs-osd@osc.edu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <assert.h>
+
+#include "osd-types.h"
+#include "osd-util/osd-util.h"
+#include "list-entry.h"
+#include "kv_md.h"
+#include "attr-type.h"
+
+/* the bounds of a criterion decoded under its declared type */
+struct kv_mtq_crit {
+	struct attr_key min;
+	struct attr_key max;
+};
+
+/*
+ * Does oid meet the query criteria: any of them for a union query, all
+ * of them for an intersection. Without criteria every member matches.
+ * Values compare under the declared type of their attribute; one that
+ * is not of the type meets no criterion with a bound.
+ */
+static int kv_mtq_match(struct kv_db *kv, uint64_t pid, uint64_t oid,
+			const struct query_criteria *qc,
+			const struct kv_mtq_crit *crit)
+{
+	uint32_t i = 0;
+	uint8_t key[KV_ATTR_KEYLEN];
+	const void *val = NULL;
+	uint32_t len = 0;
+	struct attr_key v;
+	int ok = 0;
+
+	for (i = 0; i < qc->qc_cnt; i++) {
+		kv_key_attr(key, pid, oid, qc->page[i], qc->number[i]);
+		ok = (kv_get(kv, key, sizeof(key), &val, &len) == OSD_OK);
+		if (ok && (qc->min_len[i] > 0 || qc->max_len[i] > 0))
+			ok = (attr_key_decode(crit[i].min.type, val, len, &v) ==
+			      OSD_OK);
+		if (ok && qc->min_len[i] > 0)
+			ok = attr_key_cmp(&crit[i].min, &v) <= 0;
+		if (ok && qc->max_len[i] > 0)
+			ok = attr_key_cmp(&v, &crit[i].max) <= 0;
+		if (ok && qc->query_type == 0)
+			return 1;
+		if (!ok && qc->query_type == 1)
+			return 0;
+	}
+	return qc->qc_cnt == 0 || qc->query_type == 1;
+}
+
+/*
+ * Members of the collection are visited in oid order and their criteria
+ * attributes looked up by key; the output is that of mtq_run_query.
+ *
+ * return values:
+ * -EINVAL: invalid argument
+ * -ENOMEM: out of memory
+ * OSD_OK: success
+ */
+int kv_mtq_run_query(void *ohandle, uint64_t pid, uint64_t cid,
+		     struct query_criteria *qc, void *outdata,
+		     uint32_t alloc_len, uint64_t *used_outlen)
+{
+	int ret = 0;
+	size_t i = 0;
+	size_t noid = 0;
+	uint8_t *p = NULL;
+	uint64_t len = 0;
+	uint64_t *oids = NULL;
+	uint8_t type = 0;
+	struct kv_mtq_crit *crit = NULL;
+	struct kv_db *kv = kv_handle(ohandle);
+	const struct attr_types *at = ((struct handle *)ohandle)->qtypes;
+
+	assert(kv && qc && outdata && used_outlen);
+
+	if (qc->query_type != 0 && qc->query_type != 1)
+		return -EINVAL;
+
+	/* a bound that is not of the declared type is invalid */
+	crit = Calloc(qc->qc_cnt + 1, sizeof(*crit));
+	if (!crit)
+		return -ENOMEM;
+	for (i = 0; i < qc->qc_cnt; i++) {
+		type = attr_types_get(at, qc->page[i], qc->number[i]);
+		crit[i].min.type = crit[i].max.type = type;
+		if (qc->min_len[i] > 0)
+			ret |= attr_key_decode(type, qc->min_val[i],
+					       qc->min_len[i], &crit[i].min);
+		if (qc->max_len[i] > 0)
+			ret |= attr_key_decode(type, qc->max_val[i],
+					       qc->max_len[i], &crit[i].max);
+	}
+	if (ret != OSD_OK) {
+		free(crit);
+		return -EINVAL;
+	}
+
+	ret = kv_coll_get_members(ohandle, pid, cid, &oids, &noid);
+	if (ret != OSD_OK) {
+		free(crit);
+		return ret;
+	}
+
+	p = outdata;
+	p += ML_ODL_OFF;
+	len = ML_ODL_OFF - 8; /* subtract len of addition_len */
+	*used_outlen = ML_ODL_OFF;
+	for (i = 0; i < noid; i++) {
+		if (!kv_mtq_match(kv, pid, oids[i], qc, crit))
+			continue;
+		if ((alloc_len - len) > 8) {
+			set_htonll(p, oids[i]);
+			*used_outlen += 8;
+		}
+		p += 8;
+		/* handle overflow: osd2r01 Sec 6.18.3 */
+		if (len != (uint64_t) -1 && (len + 8) > len) {
+			len += 8;
+		} else {
+			len = (uint64_t) -1;
+		}
+	}
+	set_htonll(outdata, len);
+
+	free(crit);
+	free(oids);
+	return OSD_OK;
+}
+
+/*
+ * returns list of objects along with requested attributes: the user
+ * objects of pid if cid is 0, else the members of collection cid, read
+ * off the obj or coll keys. Objects are visited in oid order and produce
+ * the rows the UNION ALL of mtq_list_oids_attr would: the
+ * (USER_TMSTMP_PG, 0) row every object has, then each requested attribute
+ * it has.
+ *
+ * return values:
+ * -EINVAL: invalid argument
+ * -ENOMEM: out of memory
+ * OSD_OK: success
+ */
+static int kv_mtq_list_attr(void *ohandle, uint64_t pid, uint64_t cid,
+			    uint64_t initial_oid,
+			    struct getattr_list *get_attr, uint64_t alloc_len,
+			    void *outdata, uint64_t *used_outlen,
+			    uint64_t *add_len, uint64_t *cont_id)
+{
+	int ret = 0;
+	uint32_t i = 0;
+	uint64_t oid = 0;
+	uint8_t key[KV_ATTR_KEYLEN];
+	const void *k = NULL, *v = NULL, *val = NULL;
+	uint32_t kl = 0, vl = 0, len = 0;
+	struct kv_db *kv = kv_handle(ohandle);
+	uint64_t known = *add_len;
+	struct kv_iter *it = NULL;
+	struct le_odl l;
+
+	assert(kv && get_attr && outdata && used_outlen && add_len);
+
+	if (get_attr->sz == 0)
+		return -EINVAL;
+
+	le_odl_init(&l, outdata, alloc_len, used_outlen, add_len, cont_id);
+	*add_len = 0;
+
+	if (cid) {
+		kv_key_coll(key, pid, cid, initial_oid);
+		ret = kv_iter_open(kv, key, 17, &it);
+		if (ret != OSD_OK)
+			return ret;
+		kv_iter_seek(it, key, KV_COLL_KEYLEN);
+	} else {
+		kv_key_obj(key, pid, initial_oid);
+		ret = kv_iter_open(kv, key, 9, &it);
+		if (ret != OSD_OK)
+			return ret;
+		kv_iter_seek(it, key, KV_OBJ_KEYLEN);
+	}
+	/* the rest is not needed if its length is known */
+	while (ret == 0 && !(known && *cont_id) &&
+	       kv_iter_next(it, &k, &kl, &v, &vl)) {
+		if (cid) {
+			oid = get_ntohll((const uint8_t *)k + 17);
+		} else {
+			if (vl != 1 || *(const uint8_t *)v != USEROBJECT)
+				continue;
+			oid = get_ntohll((const uint8_t *)k + 9);
+		}
+
+		ret = le_odl_row(&l, oid, USER_TMSTMP_PG, 0, 0, NULL);
+
+		for (i = 0; ret == 0 && i < get_attr->sz; i++) {
+			kv_key_attr(key, pid, oid, get_attr->le[i].page,
+				    get_attr->le[i].number);
+			if (kv_get(kv, key, sizeof(key), &val, &len) != OSD_OK)
+				continue;
+			ret = le_odl_row(&l, oid, get_attr->le[i].page,
+					 get_attr->le[i].number, len, val);
+		}
+	}
+	kv_iter_close(it);
+	if (ret < 0)
+		return ret;
+
+	le_odl_end(&l);
+	if (known)
+		*add_len = known;
+
+	return OSD_OK;
+}
+
+int kv_mtq_list_oids_attr(void *ohandle, uint64_t pid, uint64_t initial_oid,
+			  struct getattr_list *get_attr, uint64_t alloc_len,
+			  void *outdata, uint64_t *used_outlen,
+			  uint64_t *add_len, uint64_t *cont_id)
+{
+	return kv_mtq_list_attr(ohandle, pid, 0, initial_oid, get_attr,
+				alloc_len, outdata, used_outlen, add_len,
+				cont_id);
+}
+
+int kv_mtq_list_members_attr(void *ohandle, uint64_t pid, uint64_t cid,
+			     uint64_t initial_oid,
+			     struct getattr_list *get_attr,
+			     uint64_t alloc_len, void *outdata,
+			     uint64_t *used_outlen, uint64_t *add_len,
+			     uint64_t *cont_id)
+{
+	return kv_mtq_list_attr(ohandle, pid, cid, initial_oid, get_attr,
+				alloc_len, outdata, used_outlen, add_len,
+				cont_id);
+}
+
+/*
+ * set attributes on members of the give collection
+ *
+ * return values:
+ * -ENOMEM: out of memory
+ * OSD_ERROR: some other error
+ * OSD_OK: success
+ */
+int kv_mtq_set_member_attrs(void *ohandle, uint64_t pid, uint64_t cid,
+			    struct setattr_list *set_attr)
+{
+	int ret = 0;
+	size_t i = 0;
+	size_t noid = 0;
+	uint64_t *oids = NULL;
+
+	assert(kv_handle(ohandle) && set_attr);
+
+	if (set_attr->sz == 0)
+		return OSD_OK;
+
+	/* in list order, entries with len == 0 deleting */
+	ret = kv_coll_get_members(ohandle, pid, cid, &oids, &noid);
+	for (i = 0; ret == OSD_OK && i < noid; i++)
+		ret = kv_attr_set_attr_list(ohandle, pid, oids[i], 1,
+					    set_attr->le, set_attr->sz);
+	free(oids);
+	return ret;
+}
+
+/*
+ * remove the user objects that are members of the given collection, with
+ * their attributes and memberships; their ids are handed back in *oids,
+ * to be freed by the caller
+ *
+ * return values:
+ * -ENOMEM: out of memory
+ * OSD_ERROR: some other error
+ * OSD_OK: success
+ */
+int kv_mtq_remove_members(void *ohandle, uint64_t pid, uint64_t cid,
+			  uint64_t **oids, size_t *noid)
+{
+	int ret = 0;
+	size_t i = 0;
+
+	assert(kv_handle(ohandle) && oids && noid);
+
+	ret = kv_coll_get_members(ohandle, pid, cid, oids, noid);
+	for (i = 0; ret == OSD_OK && i < *noid; i++) {
+		ret = kv_attr_delete_all(ohandle, pid, (*oids)[i]);
+		if (ret == OSD_OK)
+			ret = kv_coll_delete_oid(ohandle, pid, (*oids)[i]);
+		if (ret == OSD_OK)
+			ret = kv_obj_delete(ohandle, pid, (*oids)[i]);
+	}
+	if (ret != OSD_OK) {
+		free(*oids);
+		*oids = NULL;
+		*noid = 0;
+	}
+	return ret;
+}
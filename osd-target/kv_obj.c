@@ -0,0 +1,388 @@
+/*
+ * Objects in the key/value store.
+ *
+ * Copyright (C) 2007 OSD Team <pvfs-osd@osc.edu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <assert.h>
+
+#include "osd.h"
+#include "osd-util/osd-util.h"
+#include "kv_md.h"
+
+/*
+ * Append id to an id list, the way db_exec_id_rtrvl_stmt does for the
+ * SQLite backend. *len is the number of bytes used in outdata; known is
+ * the add_len the caller passed in, nonzero when the list length is known
+ * from an earlier page and the ids past the first one not fitting are
+ * not needed.
+ *
+ * returns:
+ * 0: go on
+ * 1: add_len overflowed or the page is full with the length known, stop
+ */
+int kv_emit_id(uint64_t id, uint64_t alloc_len, uint8_t *outdata,
+	       uint64_t *len, uint64_t *add_len, uint64_t *cont_id,
+	       uint64_t known)
+{
+	if ((alloc_len - *len) >= 8) {
+		set_htonll(outdata + *len, id);
+		*len += 8;
+	} else if (*cont_id == 0) {
+		*cont_id = id;
+		if (known)
+			return 1;
+	}
+	/* handle overflow: osd2r01 Sec 6.14.2 */
+	if (*add_len + 8 > *add_len) {
+		*add_len += 8;
+		return 0;
+	}
+	*add_len = (uint64_t) -1;
+	return 1;
+}
+
+/*
+ * Find the largest id stored right after the plen bytes of prefix in key,
+ * by seeking instead of scanning: every seek at least halves the range
+ * the maximum can be in, so it takes at most 64 of them.
+ *
+ * returns:
+ * -ENOMEM: out of memory
+ * OSD_OK: success, *found set, and *max if found
+ */
+static int kv_max_id(struct kv_db *kv, uint8_t *key, uint32_t plen,
+		     int *found, uint64_t *max)
+{
+	int ret = 0;
+	uint64_t lo = 0, hi = (uint64_t) -1, mid = 0;
+	const void *k = NULL, *v = NULL;
+	uint32_t kl = 0, vl = 0;
+	struct kv_iter *it = NULL;
+
+	ret = kv_iter_open(kv, key, plen, &it);
+	if (ret != OSD_OK)
+		return ret;
+
+	*found = 0;
+	while (lo <= hi) {
+		mid = *found ? lo + (hi - lo) / 2 : lo;
+		set_htonll(key + plen, mid);
+		kv_iter_seek(it, key, plen + 8);
+		if (kv_iter_next(it, &k, &kl, &v, &vl) && kl >= plen + 8) {
+			*found = 1;
+			*max = get_ntohll((const uint8_t *)k + plen);
+			if (*max == (uint64_t) -1)
+				break;
+			lo = *max + 1;
+		} else {
+			if (!*found || mid == 0)
+				break;
+			hi = mid - 1;
+		}
+	}
+
+	kv_iter_close(it);
+	return OSD_OK;
+}
+
+/*
+ * returns:
+ * -EINVAL: invalid arg
+ * OSD_ERROR: object exists already, or some other error
+ * OSD_OK: success
+ */
+int kv_obj_insert(void *ohandle, uint64_t pid, uint64_t oid, uint32_t type)
+{
+	struct kv_db *kv = kv_handle(ohandle);
+	uint8_t key[KV_OBJ_KEYLEN];
+	uint8_t t = type;
+	const void *v = NULL;
+	uint32_t vl = 0;
+
+	assert(kv);
+
+	kv_key_obj(key, pid, oid);
+	if (kv_get(kv, key, sizeof(key), &v, &vl) == OSD_OK) {
+		osd_error("%s: object (%llu %llu) exists", __func__,
+			  llu(pid), llu(oid));
+		return OSD_ERROR;
+	}
+	return kv_put(kv, key, sizeof(key), &t, sizeof(t));
+}
+
+/*
+ * returns:
+ * OSD_ERROR: an object of the range exists already, or some other error
+ * OSD_OK: success
+ */
+int kv_obj_insert_range(void *ohandle, uint64_t pid, uint64_t oid,
+			uint16_t numoid, uint32_t type)
+{
+	int ret = 0;
+	uint64_t o = 0;
+
+	for (o = oid; o < oid + numoid; o++) {
+		ret = kv_obj_insert(ohandle, pid, o, type);
+		if (ret != OSD_OK)
+			return ret;
+	}
+	return OSD_OK;
+}
+
+int kv_obj_delete(void *ohandle, uint64_t pid, uint64_t oid)
+{
+	uint8_t key[KV_OBJ_KEYLEN];
+
+	assert(kv_handle(ohandle));
+
+	kv_key_obj(key, pid, oid);
+	return kv_del(kv_handle(ohandle), key, sizeof(key));
+}
+
+/*
+ * returns:
+ * OSD_ERROR: some other error
+ * OSD_OK: success
+ * 	oid = next oid if pid has some oids
+ * 	oid = 1 if pid was empty or absent. caller must assign correct oid.
+ */
+int kv_obj_get_nextoid(void *ohandle, uint64_t pid, uint64_t *oid)
+{
+	int ret = 0;
+	int found = 0;
+	uint64_t max = 0;
+	uint8_t key[KV_OBJ_KEYLEN];
+
+	kv_key_obj(key, pid, 0);
+	ret = kv_max_id(kv_handle(ohandle), key, 9, &found, &max);
+	if (ret != OSD_OK)
+		return ret;
+	*oid = found ? max + 1 : 1;
+	return OSD_OK;
+}
+
+/*
+ * returns:
+ * OSD_ERROR: some other error
+ * OSD_OK: success
+ * 	pid = next pid if OSD has some pids
+ * 	pid = 1 if pid not in db. caller must assign correct pid.
+ */
+int kv_obj_get_nextpid(void *ohandle, uint64_t *pid)
+{
+	int ret = 0;
+	int found = 0;
+	uint64_t max = 0;
+	uint8_t key[KV_OBJ_KEYLEN];
+
+	kv_key_obj(key, 0, 0);
+	ret = kv_max_id(kv_handle(ohandle), key, 1, &found, &max);
+	if (ret != OSD_OK)
+		return ret;
+	*pid = found ? max + 1 : 1;
+	return OSD_OK;
+}
+
+/*
+ * returns:
+ * OSD_OK: success, *present set to the following:
+ * 	0: object is absent
+ * 	1: object is present
+ */
+int kv_obj_ispresent(void *ohandle, char *root, uint64_t pid, uint64_t oid,
+		     int *present)
+{
+	uint8_t key[KV_OBJ_KEYLEN];
+	const void *v = NULL;
+	uint32_t vl = 0;
+
+	assert(kv_handle(ohandle));
+
+	kv_key_obj(key, pid, oid);
+	*present = (kv_get(kv_handle(ohandle), key, sizeof(key), &v,
+			   &vl) == OSD_OK);
+	return OSD_OK;
+}
+
+/*
+ * returns:
+ * -ENOMEM: out of memory
+ * OSD_OK: success, *isempty set to:
+ * 	==1: if partition is empty or absent
+ * 	==0: if partition is not empty
+ */
+int kv_obj_isempty_pid(void *ohandle, char *root, uint64_t pid,
+		       int *isempty)
+{
+	int ret = 0;
+	uint8_t key[KV_OBJ_KEYLEN];
+	const void *k = NULL, *v = NULL;
+	uint32_t kl = 0, vl = 0;
+	struct kv_iter *it = NULL;
+
+	kv_key_obj(key, pid, 1);
+	ret = kv_iter_open(kv_handle(ohandle), key, 9, &it);
+	if (ret != OSD_OK)
+		return ret;
+	kv_iter_seek(it, key, sizeof(key));
+	*isempty = !kv_iter_next(it, &k, &kl, &v, &vl);
+	kv_iter_close(it);
+	return OSD_OK;
+}
+
+/*
+ * returns:
+ * OSD_OK: success in determining the type, either valid or invalid.
+ * 	obj_types set to the determined type.
+ */
+int kv_obj_get_type(void *ohandle, uint64_t pid, uint64_t oid,
+		    uint8_t *obj_type)
+{
+	uint8_t key[KV_OBJ_KEYLEN];
+	const void *v = NULL;
+	uint32_t vl = 0;
+
+	assert(kv_handle(ohandle));
+
+	*obj_type = ILLEGAL_OBJ;
+	kv_key_obj(key, pid, oid);
+	if (kv_get(kv_handle(ohandle), key, sizeof(key), &v, &vl) == OSD_OK &&
+	    vl == 1)
+		*obj_type = *(const uint8_t *)v;
+	else
+		osd_debug("%s: object (%llu %llu) doesn't exist", __func__,
+			  llu(pid), llu(oid));
+	return OSD_OK;
+}
+
+/* ids of the objects of type in pid, starting at initial_oid */
+static int kv_obj_get_ids(void *ohandle, uint64_t pid, uint8_t type,
+			  uint64_t initial_oid, uint64_t alloc_len,
+			  uint8_t *outdata, uint64_t *used_outlen,
+			  uint64_t *add_len, uint64_t *cont_id)
+{
+	int ret = 0;
+	uint64_t len = 0;
+	uint8_t key[KV_OBJ_KEYLEN];
+	const void *k = NULL, *v = NULL;
+	uint32_t kl = 0, vl = 0;
+	uint64_t known = *add_len;
+	struct kv_iter *it = NULL;
+
+	*add_len = 0;
+	*cont_id = 0;
+	*used_outlen = 0;
+
+	kv_key_obj(key, pid, initial_oid);
+	ret = kv_iter_open(kv_handle(ohandle), key, 9, &it);
+	if (ret != OSD_OK)
+		return ret;
+	kv_iter_seek(it, key, sizeof(key));
+	while (kv_iter_next(it, &k, &kl, &v, &vl)) {
+		if (vl != 1 || *(const uint8_t *)v != type)
+			continue;
+		if (kv_emit_id(get_ntohll((const uint8_t *)k + 9), alloc_len,
+			       outdata, &len, add_len, cont_id, known))
+			break;
+	}
+	kv_iter_close(it);
+	*used_outlen = len;
+	if (known)
+		*add_len = known;
+	return OSD_OK;
+}
+
+/*
+ * returns:
+ * -ENOMEM: out of memory
+ * OSD_OK: success. oids copied into outdata, contid, used_outlen and
+ * 	add_len are set accordingly
+ */
+int kv_obj_get_oids_in_pid(void *ohandle, uint64_t pid, uint64_t initial_oid,
+			   uint64_t alloc_len, uint8_t *outdata,
+			   uint64_t *used_outlen, uint64_t *add_len,
+			   uint64_t *cont_id)
+{
+	return kv_obj_get_ids(ohandle, pid, USEROBJECT, initial_oid,
+			      alloc_len, outdata, used_outlen, add_len,
+			      cont_id);
+}
+
+int kv_obj_get_cids_in_pid(void *ohandle, uint64_t pid, uint64_t initial_cid,
+			   uint64_t alloc_len, uint8_t *outdata,
+			   uint64_t *used_outlen, uint64_t *add_len,
+			   uint64_t *cont_id)
+{
+	return kv_obj_get_ids(ohandle, pid, COLLECTION, initial_cid,
+			      alloc_len, outdata, used_outlen, add_len,
+			      cont_id);
+}
+
+/*
+ * Partition objects are (pid, PARTITION_OID), so after looking at the
+ * first object of a pid the scan seeks straight to the next pid.
+ *
+ * returns:
+ * -ENOMEM: out of memory
+ * OSD_OK: success. pids copied into outdata, contid, used_outlen and
+ * 	add_len are set accordingly
+ */
+int kv_obj_get_all_pids(void *ohandle, uint64_t initial_pid,
+			uint64_t alloc_len, uint8_t *outdata,
+			uint64_t *used_outlen, uint64_t *add_len,
+			uint64_t *cont_id)
+{
+	int ret = 0;
+	uint64_t len = 0;
+	uint64_t pid = initial_pid;
+	uint8_t key[KV_OBJ_KEYLEN];
+	const void *k = NULL, *v = NULL;
+	uint32_t kl = 0, vl = 0;
+	uint64_t known = *add_len;
+	struct kv_iter *it = NULL;
+
+	*add_len = 0;
+	*cont_id = 0;
+	*used_outlen = 0;
+
+	kv_key_obj(key, pid, PARTITION_OID);
+	ret = kv_iter_open(kv_handle(ohandle), key, 1, &it);
+	if (ret != OSD_OK)
+		return ret;
+	while (1) {
+		kv_key_obj(key, pid, PARTITION_OID);
+		kv_iter_seek(it, key, sizeof(key));
+		if (!kv_iter_next(it, &k, &kl, &v, &vl))
+			break;
+		pid = get_ntohll((const uint8_t *)k + 1);
+		if (get_ntohll((const uint8_t *)k + 9) == PARTITION_OID &&
+		    vl == 1 && *(const uint8_t *)v == PARTITION &&
+		    kv_emit_id(pid, alloc_len, outdata, &len, add_len,
+			       cont_id, known))
+			break;
+		if (pid == (uint64_t) -1)
+			break;
+		pid++;
+	}
+	kv_iter_close(it);
+	*used_outlen = len;
+	if (known)
+		*add_len = known;
+	return OSD_OK;
+}
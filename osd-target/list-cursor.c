@@ -0,0 +1,113 @@
+/*
+ * Cursors of LIST and LIST COLLECTION continued by list identifier.
+ *
+ * Copyright (C) 2007 OSD Team <pvfs-osd@osc.edu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+#include <time.h>
+
+#include "list-cursor.h"
+
+/*
+ * A list that does not fit in the allocation length gets a list
+ * identifier and a cursor: the id it continues at and the length of the
+ * list from there on, as counted by its first page. A continuation seeks
+ * straight to that id and reads one page, instead of counting the rest
+ * of the list again, so paging through a list is linear in its length.
+ *
+ * The cursor is a position, not an open statement, so objects created or
+ * removed between pages are seen as a fresh scan from there would see
+ * them; only the length reported goes stale. There are LIST_CURSORS of
+ * them per OSD: an unused one expires after LIST_CURSOR_TTL seconds, and
+ * a new list takes the slot of the one used least recently when all are
+ * taken.
+ */
+
+void list_cursors_reset(struct list_cursors *lcs)
+{
+	memset(lcs, 0, sizeof(*lcs));
+}
+
+/*
+ * returns the cursor of list list_id, NULL if there is none of that kind,
+ * pid and cid or it expired
+ */
+struct list_cursor *list_cursor_find(struct list_cursors *lcs,
+				     uint32_t list_id, uint8_t kind,
+				     uint64_t pid, uint64_t cid)
+{
+	uint32_t i = 0;
+	struct list_cursor *c = NULL;
+
+	if (list_id == 0)
+		return NULL;
+	for (i = 0; i < LIST_CURSORS; i++) {
+		c = &lcs->c[i];
+		if (c->list_id != list_id)
+			continue;
+		if (c->expires < time(NULL)) {
+			c->list_id = 0;
+			return NULL;
+		}
+		if (c->kind != kind || c->pid != pid || c->cid != cid)
+			return NULL;
+		return c;
+	}
+	return NULL;
+}
+
+/*
+ * Keep a list that stopped at next, with add_len bytes of it left, in
+ * its cursor c, or in a new one when c is NULL. A list that ended
+ * (next == 0) frees its cursor.
+ *
+ * returns the list identifier to report, 0 for a list that ended in one
+ * page
+ */
+uint32_t list_cursor_keep(struct list_cursors *lcs, struct list_cursor *c,
+			  uint8_t kind, uint64_t pid, uint64_t cid,
+			  uint64_t next, uint64_t add_len)
+{
+	uint32_t i = 0;
+	uint32_t list_id = 0;
+
+	if (c && next == 0) {
+		list_id = c->list_id;
+		c->list_id = 0;
+		return list_id;
+	}
+	if (next == 0)
+		return 0;
+
+	if (!c) {
+		/* a free slot, else the one expiring first */
+		c = &lcs->c[0];
+		for (i = 0; i < LIST_CURSORS && c->list_id != 0; i++)
+			if (lcs->c[i].list_id == 0 ||
+			    lcs->c[i].expires < c->expires)
+				c = &lcs->c[i];
+		do {
+			lcs->last_id++;
+		} while (lcs->last_id == 0);
+		c->list_id = lcs->last_id;
+		c->kind = kind;
+		c->pid = pid;
+		c->cid = cid;
+	}
+	c->next = next;
+	c->add_len = add_len;
+	c->expires = time(NULL) + LIST_CURSOR_TTL;
+	return c->list_id;
+}
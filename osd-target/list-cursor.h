@@ -0,0 +1,45 @@
+/*
+ * Cursors of LIST and LIST COLLECTION continued by list identifier.
+ *
+ * Copyright (C) 2007 OSD Team <pvfs-osd@osc.edu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __LIST_CURSOR_H
+#define __LIST_CURSOR_H
+
+#include <stdint.h>
+#include "osd-types.h"
+
+/* what a cursor lists; a list is only continued as the kind it started */
+enum {
+	LIST_CURSOR_IDS = 1,	/* pids of the OSD, or oids of a partition */
+	LIST_CURSOR_ATTR,	/* oids of a partition with attributes */
+	LIST_CURSOR_COLL,	/* cids of a partition, or oids of a collection */
+	LIST_CURSOR_MEMBERS,	/* oids of a collection with attributes */
+};
+
+/* seconds an unused cursor is kept */
+#define LIST_CURSOR_TTL (300)
+
+void list_cursors_reset(struct list_cursors *lcs);
+
+struct list_cursor *list_cursor_find(struct list_cursors *lcs,
+				     uint32_t list_id, uint8_t kind,
+				     uint64_t pid, uint64_t cid);
+
+uint32_t list_cursor_keep(struct list_cursors *lcs, struct list_cursor *c,
+			  uint8_t kind, uint64_t pid, uint64_t cid,
+			  uint64_t next, uint64_t add_len);
+
+#endif /* __LIST_CURSOR_H */
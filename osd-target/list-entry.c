@@ -110,3 +110,111 @@ int le_multiobj_pack_attr(void *buf, uint32_t buflen, uint64_t oid,
 	return ret;
 }
 
+/* start an empty object descriptor list in outdata */
+void le_odl_init(struct le_odl *l, void *outdata, uint64_t alloc_len,
+		 uint64_t *used_outlen, uint64_t *add_len, uint64_t *cont_id)
+{
+	l->head = l->tail = outdata;
+	l->alloc_len = alloc_len;
+	l->attr_list_len = 0;
+	l->used_outlen = used_outlen;
+	l->add_len = add_len;
+	l->cont_id = cont_id;
+}
+
+/*
+ * Add one row to the object descriptor list of a LIST with attributes;
+ * the (USER_TMSTMP_PG, 0) row of an object starts its descriptor. See
+ * mtq_list_oids_attr for how the list departs from the spec.
+ *
+ * returns:
+ * 0: go on
+ * 1: add_len overflowed, stop
+ * <0: error
+ */
+int le_odl_row(struct le_odl *l, uint64_t oid, uint32_t page,
+	       uint32_t number, uint16_t len, const void *val)
+{
+	int ret = 0;
+
+	if (page == USER_TMSTMP_PG && number == 0) {
+		/* look ahead in the buf to see if there is space */
+		if (l->alloc_len >= 16) {
+			/* start attr list of 'this' ODE */
+			set_htonll(l->tail, oid);
+			memset(l->tail + 8, 0, 4);  /* reserved */
+			if (l->head != l->tail) {
+				/* fill attr_list_len of prev ODE */
+				set_htonl(l->head, l->attr_list_len);
+				l->head = l->tail;
+				l->attr_list_len = 0;
+			}
+			l->alloc_len -= 16;
+			l->tail += 16;
+			l->head += 12;  /* points to attr-list-len */
+			*l->used_outlen += 16;
+		} else {
+			if (l->head != l->tail) {
+				/* fill attr_list_len of prev ODE */
+				set_htonl(l->head, l->attr_list_len);
+				l->head = l->tail;
+				l->attr_list_len = 0;
+			}
+			if (*l->cont_id == 0)
+				*l->cont_id = oid;
+		}
+		/* handle overflow: osd2r01 Sec 6.14.2 */
+		if (*l->add_len + 16 > *l->add_len) {
+			*l->add_len += 16;
+			return 0;
+		}
+		/* terminate since add_len overflew */
+		*l->add_len = (uint64_t) -1;
+		return 1;
+	}
+
+	if (l->alloc_len >= 16) {
+		ret = le_pack_attr(l->tail, l->alloc_len, page, number, len, val);
+		assert (ret != -EOVERFLOW);
+		if (ret <= 0)
+			return ret;
+		l->alloc_len -= ret;
+		l->tail += ret;
+		l->attr_list_len += ret;
+		*l->used_outlen += ret;
+		if (l->alloc_len < 16){
+			set_htonl(l->head, l->attr_list_len);
+			l->head = l->tail;
+			l->attr_list_len = 0;
+			if (*l->cont_id == 0)
+				*l->cont_id = oid;
+		}
+	} else {
+		if (l->head != l->tail) {
+			/* fill attr_list_len of this ODE */
+			set_htonl(l->head, l->attr_list_len);
+			l->head = l->tail;
+			l->attr_list_len = 0;
+			if (*l->cont_id == 0)
+				*l->cont_id = oid;
+		}
+	}
+	/* handle overflow: osd2r01 Sec 6.14.2 */
+	if ((*l->add_len + roundup8(4+4+2+len)) > *l->add_len) {
+		*l->add_len += roundup8(4+4+2+len);
+		return 0;
+	}
+	/* terminate since add_len overflew */
+	*l->add_len = (uint64_t) -1;
+	return 1;
+}
+
+/* fill in the attribute list length of the last descriptor */
+void le_odl_end(struct le_odl *l)
+{
+	if (l->head != l->tail) {
+		set_htonl(l->head, l->attr_list_len);
+		l->head += (4 + l->attr_list_len);
+		assert(l->head == l->tail);
+	}
+}
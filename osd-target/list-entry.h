@@ -20,6 +20,17 @@
 
 #include <stdint.h>
 
+/* an object descriptor list being built, see le_odl_row */
+struct le_odl {
+	uint8_t *head;
+	uint8_t *tail;
+	uint64_t alloc_len;
+	uint32_t attr_list_len;
+	uint64_t *used_outlen;
+	uint64_t *add_len;
+	uint64_t *cont_id;
+};
+
 int le_pack_attr(void *buf, uint32_t buflen, uint32_t page, uint32_t number,
 		 uint16_t valen, const void *val);
 
@@ -27,4 +38,12 @@ int le_multiobj_pack_attr(void *buf, uint32_t buflen, uint64_t oid,
 			  uint32_t page, uint32_t number, uint16_t valen,
 			  const void *val);
 
+void le_odl_init(struct le_odl *l, void *outdata, uint64_t alloc_len,
+		 uint64_t *used_outlen, uint64_t *add_len, uint64_t *cont_id);
+
+int le_odl_row(struct le_odl *l, uint64_t oid, uint32_t page,
+	       uint32_t number, uint16_t len, const void *val);
+
+void le_odl_end(struct le_odl *l);
+
 #endif /* __LIST_ENTRY_H */
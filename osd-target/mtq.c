@@ -29,8 +29,10 @@
 #include "attr.h"
 #include "coll.h" 
 #include "mtq.h"
+#include "attr-type.h"
 #include "osd-util/osd-util.h"
 #include "list-entry.h"
+#include "collbm.h"
 
 /*
  * mtq: multitable query, all queries dealing with >=2 tables are implemented
@@ -38,13 +40,306 @@
  */
 
 /*
+ * The statements are built per query shape, with every value bound, and
+ * kept prepared in a small LRU cache in the db context. A repeated QUERY,
+ * LIST or SET MEMBER ATTRIBUTES of the same shape is neither parsed nor
+ * planned again.
+ *
+ * They are prepared with sqlite3_prepare_v2: the planner then looks at
+ * the bound page and number to pick the partial value index of a declared
+ * pair (see attr_sync_query_idx), at the price of a re-plan whenever they
+ * are rebound. Page and number are therefore only rebound when they differ
+ * from the last execution of the statement.
+ */
+#define MTQ_CACHE_SZ (16)
+
+/* attributes of a LIST left joined to obj, the rest are subqueries */
+#define MTQ_LIST_JOINS (48)
+
+enum {
+	MTQ_QUERY = 1,
+	MTQ_LIST_ATTR,
+	MTQ_LIST_MEMBER_ATTR,
+	MTQ_SET_MEMBER,
+	MTQ_SET_MEMBER_DIR,
+	MTQ_DEL_MEMBER,
+	MTQ_DEL_MEMBER_DIR,
+	MTQ_REMOVE_ATTR,
+	MTQ_REMOVE_DIR,
+	MTQ_REMOVE_OBJ,
+	MTQ_CRITERION,
+	MTQ_CRITERION_IDX,
+	MTQ_PROBE,
+};
+
+/*
+ * per criterion shape of a query: the bounds it has, and the declared
+ * type of its attribute above them
+ */
+enum {
+	MTQ_MIN = 0x1,
+	MTQ_MAX = 0x2,
+	MTQ_TYPE_SHIFT = 2,
+};
+
+struct mtq_stmt {
+	sqlite3_stmt *stmt;
+	uint8_t kind;
+	uint8_t type;		/* query_type of MTQ_QUERY */
+	uint8_t bound;		/* pn holds the bound page, number pairs */
+	uint32_t cnt;		/* number of criteria or attributes */
+	uint8_t *shape;		/* mtq_shape of each criterion */
+	int32_t *pn;
+	uint64_t tick;
+};
+
+struct mtq_tab {
+	struct mtq_stmt ent[MTQ_CACHE_SZ];
+	uint64_t tick;
+	uint64_t hits;
+	uint64_t misses;
+};
+
+int mtq_initialize(void *db)
+{
+	struct db_context *dbc = (struct db_context *)db;
+
+	if (dbc == NULL || dbc->db == NULL)
+		return -EINVAL;
+
+	if (dbc->mtq != NULL)
+		mtq_finalize(dbc);
+
+	dbc->mtq = Calloc(1, sizeof(*dbc->mtq));
+	if (!dbc->mtq)
+		return -ENOMEM;
+
+	return OSD_OK;
+}
+
+static void mtq_evict(struct mtq_stmt *e)
+{
+	sqlite3_finalize(e->stmt); /* ignore return value */
+	free(e->shape);
+	free(e->pn);
+	memset(e, 0, sizeof(*e));
+}
+
+int mtq_finalize(void *db)
+{
+	int i = 0;
+	struct db_context *dbc = (struct db_context *)db;
+
+	if (!dbc || !dbc->mtq)
+		return OSD_ERROR;
+
+	osd_debug("%s: statement cache hits %llu misses %llu", __func__,
+		  llu(dbc->mtq->hits), llu(dbc->mtq->misses));
+	for (i = 0; i < MTQ_CACHE_SZ; i++)
+		mtq_evict(&dbc->mtq->ent[i]);
+	free(dbc->mtq);
+	dbc->mtq = NULL;
+
+	return OSD_OK;
+}
+
+/*
+ * hit and miss counts of the statement caches of all shards since the db
+ * was opened
+ */
+void mtq_cache_stats(void *ohandle, uint64_t *hits, uint64_t *misses)
+{
+	struct handle *h = ohandle;
+	int i = 0;
+
+	assert(h && h->nshard > 0 && hits && misses);
+
+	*hits = *misses = 0;
+	for (i = 0; i < h->nshard; i++) {
+		*hits += h->shard[i]->mtq->hits;
+		*misses += h->shard[i]->mtq->misses;
+	}
+}
+
+static inline uint8_t mtq_shape(const struct attr_types *at,
+				const struct query_criteria *qc, uint32_t i)
+{
+	return (qc->min_len[i] > 0 ? MTQ_MIN : 0) |
+		(qc->max_len[i] > 0 ? MTQ_MAX : 0) |
+		attr_types_get(at, qc->page[i], qc->number[i]) <<
+		MTQ_TYPE_SHIFT;
+}
+
+/*
+ * write to buf the value a criterion of the shape compares, in the form
+ * of the typed index of its attribute if it has one
+ */
+static void mtq_value(char *buf, uint8_t shape, const char *col)
+{
+	uint8_t type = shape >> MTQ_TYPE_SHIFT;
+
+	if (type == ROOT_QUERY_BLOB)
+		sprintf(buf, "%s", col);
+	else
+		sprintf(buf, "osd_qkey(%s, %u)", col, type);
+}
+
+/*
+ * The bounds of the criteria must be of the declared types of their
+ * attributes.
+ *
+ * returns:
+ * -EINVAL: a bound is not
+ * OSD_OK: they are
+ */
+static int mtq_check_bounds(const struct attr_types *at,
+			    const struct query_criteria *qc)
+{
+	uint32_t i = 0;
+	uint8_t type = 0;
+	struct attr_key k;
+
+	for (i = 0; i < qc->qc_cnt; i++) {
+		type = attr_types_get(at, qc->page[i], qc->number[i]);
+		if (qc->min_len[i] > 0 && attr_key_decode(type,
+				qc->min_val[i], qc->min_len[i], &k) != OSD_OK)
+			return -EINVAL;
+		if (qc->max_len[i] > 0 && attr_key_decode(type,
+				qc->max_val[i], qc->max_len[i], &k) != OSD_OK)
+			return -EINVAL;
+	}
+	return OSD_OK;
+}
+
+/*
+ * bind a bound checked by mtq_check_bounds, decoded as osd_qkey would
+ */
+static int mtq_bind_bound(sqlite3_stmt *stmt, int pos, uint8_t shape,
+			  const void *val, uint32_t len)
+{
+	struct attr_key k;
+
+	attr_key_decode(shape >> MTQ_TYPE_SHIFT, val, len, &k);
+	if (k.type == ROOT_QUERY_U64 || k.type == ROOT_QUERY_I64)
+		return sqlite3_bind_int64(stmt, pos, k.num);
+	return sqlite3_bind_blob(stmt, pos, k.val, k.len, SQLITE_TRANSIENT);
+}
+
+/*
+ * Find the statement of a shape; qc, and the types at of its attributes,
+ * are only given for MTQ_QUERY. On a miss the least recently used entry
+ * is taken over and returned with stmt == NULL for the caller to prepare.
+ *
+ * returns:
+ * NULL: out of memory
+ * entry of the shape otherwise
+ */
+static struct mtq_stmt *mtq_lookup(struct db_context *dbc, uint8_t kind,
+				   uint8_t type, uint32_t cnt,
+				   const struct attr_types *at,
+				   const struct query_criteria *qc)
+{
+	uint32_t i = 0, j = 0;
+	struct mtq_tab *mt = dbc->mtq;
+	struct mtq_stmt *e = NULL, *lru = &mt->ent[0];
+
+	for (i = 0; i < MTQ_CACHE_SZ; i++) {
+		e = &mt->ent[i];
+		if (e->stmt == NULL || e->kind != kind || e->type != type ||
+		    e->cnt != cnt) {
+			if (e->tick < lru->tick)
+				lru = e;
+			continue;
+		}
+		for (j = 0; qc && j < cnt; j++)
+			if (e->shape[j] != mtq_shape(at, qc, j))
+				break;
+		if (j == cnt || !qc) {
+			e->tick = ++mt->tick;
+			mt->hits++;
+			return e;
+		}
+		if (e->tick < lru->tick)
+			lru = e;
+	}
+
+	mt->misses++;
+	e = lru;
+	mtq_evict(e);
+	e->pn = Malloc(2 * cnt * sizeof(*e->pn));
+	if (qc)
+		e->shape = Malloc(cnt);
+	if (!e->pn || (qc && !e->shape)) {
+		mtq_evict(e);
+		return NULL;
+	}
+	for (j = 0; qc && j < cnt; j++)
+		e->shape[j] = mtq_shape(at, qc, j);
+	e->kind = kind;
+	e->type = type;
+	e->cnt = cnt;
+	e->tick = ++mt->tick;
+	return e;
+}
+
+static int mtq_prepare(struct db_context *dbc, struct mtq_stmt *e,
+		       const char *SQL, const char *func)
+{
+	int ret = sqlite3_prepare_v2(dbc->db, SQL, -1, &e->stmt, NULL);
+
+	if (ret != SQLITE_OK) {
+		error_sql(dbc->db, "%s: sqlite3_prepare", func);
+		mtq_evict(e);
+		return -EIO;
+	}
+	e->bound = 0;
+	return OSD_OK;
+}
+
+/*
+ * bind page and number of the i'th criterion at pos and pos+1 in the
+ * signed form they are stored in, unless they already are
+ */
+static int mtq_bind_pn(struct mtq_stmt *e, uint32_t i, int pos,
+		       uint32_t page, uint32_t number)
+{
+	int ret = SQLITE_OK;
+
+	if (e->bound && e->pn[2*i] == (int32_t)page &&
+	    e->pn[2*i+1] == (int32_t)number)
+		return SQLITE_OK;
+
+	ret |= sqlite3_bind_int(e->stmt, pos, (int32_t)page);
+	ret |= sqlite3_bind_int(e->stmt, pos+1, (int32_t)number);
+	e->pn[2*i] = page;
+	e->pn[2*i+1] = number;
+	return ret;
+}
+
+/*
+ * reset the statement for its next use; one that failed is dropped
+ */
+static void mtq_release(struct mtq_stmt *e, int failed)
+{
+	sqlite3_reset(e->stmt);
+	if (failed)
+		mtq_evict(e);
+	else
+		e->bound = 1;
+}
+
+/*
+ * QUERY as a single compound SELECT, leaving set algebra and sorting to
+ * SQLite. mtq_run_query uses it for a query without criteria; it is kept
+ * to check the native executor against.
+ *
  * return values:
  * -EINVAL: invalid argument
  * -EIO: prepare or some other sqlite function failed
  * OSD_ERROR: some other error
  * OSD_OK: success
  */
-int mtq_run_query(void *ohandle, uint64_t pid, uint64_t cid, 
+int mtq_run_query_sql(void *ohandle, uint64_t pid, uint64_t cid, 
 		  struct query_criteria *qc, void *outdata, 
 		  uint32_t alloc_len, uint64_t *used_outlen)
 {
@@ -58,14 +353,16 @@ int mtq_run_query(void *ohandle, uint64_t pid, uint64_t cid,
 	uint32_t factor = 2; /* this query fills space quickly */
 	uint64_t len = 0;
 	const char *op = NULL;
-	sqlite3_stmt *stmt = NULL;
+	struct mtq_stmt *e = NULL;
 	char select_stmt[MAXSQLEN];
-        struct db_context *dbc = ((struct handle *)ohandle)->dbc;
-	const char *coll = coll_getname(dbc);
-	const char *attr = attr_getname(dbc);
+	char value[64];
+        struct db_context *dbc = db_shard(ohandle, pid);
+	const struct attr_types *at = ((struct handle *)ohandle)->qtypes;
+	const char *coll = coll_getname(ohandle);
+	const char *attr = attr_getname(ohandle);
 
-	assert(dbc && dbc->db && qc && outdata && used_outlen && coll 
-	       && attr);
+	assert(dbc && dbc->db && dbc->mtq && qc && outdata && used_outlen
+	       && coll && attr);
 
 	if (qc->query_type == 0) {
 		op = " UNION ";
@@ -75,6 +372,17 @@ int mtq_run_query(void *ohandle, uint64_t pid, uint64_t cid,
 		ret = -EINVAL;
 		goto out;
 	}
+	ret = mtq_check_bounds(at, qc);
+	if (ret != OSD_OK)
+		goto out;
+
+	e = mtq_lookup(dbc, MTQ_QUERY, qc->query_type, qc->qc_cnt, at, qc);
+	if (!e) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	if (e->stmt)
+		goto bind;
 
 	SQL = Malloc(MAXSQLEN*factor);
 	if (SQL == NULL) {
@@ -90,32 +398,38 @@ int mtq_run_query(void *ohandle, uint64_t pid, uint64_t cid,
 	 * boundaries, i.e. use '<=' for comparison.
 	 */
 
-	/* build the SQL statment */
+	/*
+	 * build the SQL statment: pid is ?1, cid ?2, then page, number and
+	 * the min and max values present of each criterion in turn
+	 */
 	sprintf(select_stmt, "SELECT attr.oid FROM %s as coll, %s as attr "
-		" WHERE coll.pid = coll.pid AND coll.oid = attr.oid AND "
-		" coll.pid = %llu AND coll.cid = %llu ", coll, attr,
-		llu(pid), llu(cid));
+		" WHERE coll.pid = attr.pid AND coll.oid = attr.oid AND "
+		" coll.pid = ?1 AND coll.cid = ?2 ", coll, attr);
 	sprintf(cp, select_stmt);
 	sqlen += strlen(cp);
 	cp += sqlen;
+	pos = 3;
 	for (i = 0; i < qc->qc_cnt; i++) {
-		sprintf(cp, " AND attr.page = %u AND attr.number = %u ",
-			qc->page[i], qc->number[i]);
+		cp += sprintf(cp, " AND attr.page = ?%d AND attr.number = ?%d ",
+			      pos, pos+1);
+		pos += 2;
+		mtq_value(value, e->shape[i], "attr.value");
 		if (qc->min_len[i] > 0)
-			cp = strcat(cp, " AND ? <= attr.value ");
+			cp += sprintf(cp, " AND ?%d <= %s ", pos++, value);
 		if (qc->max_len[i] > 0)
-			cp = strcat(cp, " AND attr.value <= ? ");
+			cp += sprintf(cp, " AND %s <= ?%d ", value, pos++);
 
 		if ((i+1) < qc->qc_cnt) {
 			cp = strcat(cp, op);
 			cp = strcat(cp, select_stmt);
 		}
-		sqlen += strlen(cp);
+		sqlen = strlen(SQL);
 
 		if (sqlen >= (MAXSQLEN*factor - 400)) {
 			factor *= 2;
 			SQL = realloc(SQL, MAXSQLEN*factor);
 			if (!SQL) {
+				mtq_evict(e);
 				ret = -ENOMEM;
 				goto out;
 			}
@@ -124,55 +438,48 @@ int mtq_run_query(void *ohandle, uint64_t pid, uint64_t cid,
 	}
 	cp = strcat(cp, " GROUP BY attr.oid ORDER BY 1;");
 
-	ret = sqlite3_prepare(dbc->db, SQL, strlen(SQL)+1, &stmt, NULL);
-	if (ret != SQLITE_OK) {
-		error_sql(dbc->db, "%s: sqlite3_prepare", __func__);
-		ret = -EIO;
+	ret = mtq_prepare(dbc, e, SQL, __func__);
+	if (ret != OSD_OK)
 		goto out;
-	}
 
+bind:
 	/* bind the values */
-	pos = 1;
-	for (i = 0; i < qc->qc_cnt; i++) {
+	ret = sqlite3_bind_int64(e->stmt, 1, pid);
+	ret |= sqlite3_bind_int64(e->stmt, 2, cid);
+	pos = 3;
+	for (i = 0; ret == SQLITE_OK && i < qc->qc_cnt; i++) {
+		ret = mtq_bind_pn(e, i, pos, qc->page[i], qc->number[i]);
+		pos += 2;
 		if (qc->min_len[i] > 0) {
-			ret = sqlite3_bind_blob(stmt, pos, qc->min_val[i],
-						qc->min_len[i],
-						SQLITE_TRANSIENT);
-			if (ret != SQLITE_OK) {
-				ret = -EIO;
-				error_sql(dbc->db, "%s: bind min_val @ %d",
-					  __func__, pos);
-				goto out_finalize;
-			}
+			ret |= mtq_bind_bound(e->stmt, pos, e->shape[i],
+					      qc->min_val[i], qc->min_len[i]);
 			pos++;
 		}
 		if (qc->max_len[i] > 0) {
-			ret = sqlite3_bind_blob(stmt, pos, qc->max_val[i],
-						qc->max_len[i],
-						SQLITE_TRANSIENT);
-			if (ret != SQLITE_OK) {
-				ret = -EIO;
-				error_sql(dbc->db, "%s: bind max_val @ %d",
-					  __func__, pos);
-				goto out_finalize;
-			}
+			ret |= mtq_bind_bound(e->stmt, pos, e->shape[i],
+					      qc->max_val[i], qc->max_len[i]);
 			pos++;
 		}
 	}
+	if (ret != SQLITE_OK) {
+		error_sql(dbc->db, "%s: bind @ %d", __func__, pos);
+		ret = -EIO;
+		goto out_release;
+	}
 
 	/* execute the query */
 	p = outdata;
 	p += ML_ODL_OFF; 
 	len = ML_ODL_OFF - 8; /* subtract len of addition_len */
 	*used_outlen = ML_ODL_OFF;
-	while ((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+	while ((ret = sqlite3_step(e->stmt)) == SQLITE_ROW) {
 		if ((alloc_len - len) > 8) {
 			/* 
 			 * TODO: query is a multi-object command, so delete
 			 * the objects from the collection, once they are
 			 * selected
 			 */
-			set_htonll(p, sqlite3_column_int64(stmt, 0));
+			set_htonll(p, sqlite3_column_int64(e->stmt, 0));
 			*used_outlen += 8;
 		}
 		p += 8; 
@@ -186,14 +493,13 @@ int mtq_run_query(void *ohandle, uint64_t pid, uint64_t cid,
 	if (ret != SQLITE_DONE) {
 		error_sql(dbc->db, "%s: sqlite3_step", __func__);
 		ret = -EIO;
-		goto out_finalize;
+		goto out_release;
 	}
 	set_htonll(outdata, len);
 	ret = OSD_OK;
 
-out_finalize:
-	if (sqlite3_finalize(stmt) != SQLITE_OK)
-		error_sql(dbc->db, "%s: finalize", __func__);
+out_release:
+	mtq_release(e, ret != OSD_OK);
 
 out:
 	free(SQL);
@@ -201,8 +507,421 @@ out:
 }
 
 
+/* ascending oids of a criterion or of the result so far */
+struct mtq_oids {
+	uint64_t *oid;
+	size_t n;
+	size_t cap;
+};
+
+static int mtq_oid_cmp(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ * The members of cid meeting criterion i of qc, in ascending oid order.
+ * Each criterion slot and shape has its own cached statement, so a
+ * repeated QUERY keeps its page and number bound.
+ *
+ * A declared attribute is looked up in its value index alone and the
+ * oids found are checked against the member bitmap of cid; any other is
+ * read from attr for each member, joined to coll.
+ *
+ * returns:
+ * -ENOMEM: out of memory
+ * -EIO: prepare or some other sqlite function failed
+ * OSD_OK: success
+ */
+static int mtq_crit_oids(void *ohandle, uint64_t pid, uint64_t cid,
+			 const struct query_criteria *qc, uint32_t i,
+			 struct mtq_oids *s)
+{
+	int ret = 0;
+	int indexed = 0;
+	char SQL[MAXSQLEN];
+	char value[64];
+	uint64_t o = 0;
+	uint64_t *oid = NULL;
+	const struct attr_types *at = ((struct handle *)ohandle)->qtypes;
+	uint8_t shape = mtq_shape(at, qc, i);
+	const struct collbm *members = NULL;
+	struct mtq_stmt *e = NULL;
+	struct db_context *dbc = db_shard(ohandle, pid);
+
+	/* first, as reading them in may rebuild the statement cache */
+	indexed = attr_types_declared(at, qc->page[i], qc->number[i]);
+	if (indexed) {
+		members = coll_get_members(ohandle, pid, cid);
+		if (!members)
+			return -ENOMEM;
+	}
+	e = mtq_lookup(dbc, indexed ? MTQ_CRITERION_IDX : MTQ_CRITERION,
+		       shape, i + 1, NULL, NULL);
+	if (!e)
+		return -ENOMEM;
+	if (e->stmt)
+		goto bind;
+
+	/* pid is ?1, cid ?2, page ?3, number ?4, min ?5 and max ?6 */
+	if (indexed) {
+		mtq_value(value, shape, "value");
+		sprintf(SQL, "SELECT oid FROM %s WHERE pid = ?1 AND "
+			" page = ?3 AND number = ?4 %s%s %s%s;",
+			attr_getname(ohandle),
+			(shape & MTQ_MIN) ? " AND ?5 <= " : "",
+			(shape & MTQ_MIN) ? value : "",
+			(shape & MTQ_MAX) ? " AND ?6 >= " : "",
+			(shape & MTQ_MAX) ? value : "");
+	} else {
+		mtq_value(value, shape, "attr.value");
+		sprintf(SQL, "SELECT attr.oid FROM %s as coll, %s as attr "
+			" WHERE coll.pid = attr.pid AND coll.oid = attr.oid "
+			" AND coll.pid = ?1 AND coll.cid = ?2 AND "
+			" attr.page = ?3 AND attr.number = ?4 %s%s %s%s "
+			" ORDER BY attr.oid;",
+			coll_getname(ohandle), attr_getname(ohandle),
+			(shape & MTQ_MIN) ? " AND ?5 <= " : "",
+			(shape & MTQ_MIN) ? value : "",
+			(shape & MTQ_MAX) ? " AND ?6 >= " : "",
+			(shape & MTQ_MAX) ? value : "");
+	}
+	ret = mtq_prepare(dbc, e, SQL, __func__);
+	if (ret != OSD_OK)
+		return ret;
+
+bind:
+	ret = sqlite3_bind_int64(e->stmt, 1, pid);
+	if (!indexed)
+		ret |= sqlite3_bind_int64(e->stmt, 2, cid);
+	ret |= mtq_bind_pn(e, 0, 3, qc->page[i], qc->number[i]);
+	if (shape & MTQ_MIN)
+		ret |= mtq_bind_bound(e->stmt, 5, shape, qc->min_val[i],
+				      qc->min_len[i]);
+	if (shape & MTQ_MAX)
+		ret |= mtq_bind_bound(e->stmt, 6, shape, qc->max_val[i],
+				      qc->max_len[i]);
+	if (ret != SQLITE_OK) {
+		error_sql(dbc->db, "%s: bind", __func__);
+		ret = -EIO;
+		goto out_release;
+	}
+
+	s->n = 0;
+	while ((ret = sqlite3_step(e->stmt)) == SQLITE_ROW) {
+		o = sqlite3_column_int64(e->stmt, 0);
+		if (indexed && !collbm_contains(members, o))
+			continue;
+		if (s->n == s->cap) {
+			s->cap = s->cap ? 2 * s->cap : 256;
+			oid = realloc(s->oid, s->cap * sizeof(*oid));
+			if (!oid) {
+				ret = -ENOMEM;
+				goto out_release;
+			}
+			s->oid = oid;
+		}
+		s->oid[s->n++] = o;
+	}
+	if (ret != SQLITE_DONE) {
+		error_sql(dbc->db, "%s: sqlite3_step", __func__);
+		ret = -EIO;
+		goto out_release;
+	}
+	/* the index is in value order */
+	if (indexed)
+		qsort(s->oid, s->n, sizeof(*s->oid), mtq_oid_cmp);
+	ret = OSD_OK;
+
+out_release:
+	mtq_release(e, ret != OSD_OK);
+	return ret;
+}
+
+/*
+ * Keep the oids of s that meet criterion i of qc, looking each of them up
+ * by the attr primary key. The oids are members already.
+ *
+ * returns:
+ * -ENOMEM: out of memory
+ * -EIO: prepare or some other sqlite function failed
+ * OSD_OK: success
+ */
+static int mtq_crit_probe(void *ohandle, uint64_t pid,
+			  const struct query_criteria *qc, uint32_t i,
+			  struct mtq_oids *s)
+{
+	int ret = 0;
+	size_t k = 0, n = 0;
+	char SQL[MAXSQLEN];
+	char value[64];
+	uint8_t shape = mtq_shape(((struct handle *)ohandle)->qtypes, qc, i);
+	struct mtq_stmt *e = NULL;
+	struct db_context *dbc = db_shard(ohandle, pid);
+
+	e = mtq_lookup(dbc, MTQ_PROBE, shape, i + 1, NULL, NULL);
+	if (!e)
+		return -ENOMEM;
+	if (e->stmt)
+		goto bind;
+
+	/* pid is ?1, oid ?2, page ?3, number ?4, min ?5 and max ?6 */
+	mtq_value(value, shape, "value");
+	sprintf(SQL, "SELECT 1 FROM %s WHERE pid = ?1 AND oid = ?2 AND "
+		" page = ?3 AND number = ?4 %s%s %s%s;", attr_getname(ohandle),
+		(shape & MTQ_MIN) ? " AND ?5 <= " : "",
+		(shape & MTQ_MIN) ? value : "",
+		(shape & MTQ_MAX) ? " AND ?6 >= " : "",
+		(shape & MTQ_MAX) ? value : "");
+	ret = mtq_prepare(dbc, e, SQL, __func__);
+	if (ret != OSD_OK)
+		return ret;
+
+bind:
+	ret = sqlite3_bind_int64(e->stmt, 1, pid);
+	ret |= mtq_bind_pn(e, 0, 3, qc->page[i], qc->number[i]);
+	if (shape & MTQ_MIN)
+		ret |= mtq_bind_bound(e->stmt, 5, shape, qc->min_val[i],
+				      qc->min_len[i]);
+	if (shape & MTQ_MAX)
+		ret |= mtq_bind_bound(e->stmt, 6, shape, qc->max_val[i],
+				      qc->max_len[i]);
+	if (ret != SQLITE_OK) {
+		error_sql(dbc->db, "%s: bind", __func__);
+		ret = -EIO;
+		goto out_release;
+	}
+
+	for (k = 0; k < s->n; k++) {
+		ret = sqlite3_bind_int64(e->stmt, 2, s->oid[k]);
+		if (ret == SQLITE_OK)
+			ret = sqlite3_step(e->stmt);
+		if (ret == SQLITE_ROW)
+			s->oid[n++] = s->oid[k];
+		else if (ret != SQLITE_DONE)
+			break;
+		ret = sqlite3_reset(e->stmt);
+		if (ret != SQLITE_OK)
+			break;
+	}
+	s->n = n;
+	if (ret != SQLITE_OK) {
+		error_sql(dbc->db, "%s: sqlite3_step", __func__);
+		ret = -EIO;
+		goto out_release;
+	}
+	ret = OSD_OK;
+
+out_release:
+	mtq_release(e, ret != OSD_OK);
+	return ret;
+}
+
+/*
+ * Keep the oids of a that are also in b. a is the shorter one; b is
+ * galloped through, so the cost is O(na log(nb/na)) rather than
+ * O(na + nb).
+ */
+static void mtq_oids_isect(struct mtq_oids *a, const struct mtq_oids *b)
+{
+	size_t i = 0, j = 0, n = 0;
+	size_t lo = 0, hi = 0, mid = 0, step = 0;
+	uint64_t x = 0;
+
+	for (i = 0; i < a->n && j < b->n; i++) {
+		x = a->oid[i];
+		/* gallop until b[hi] >= x, then search (lo, hi] */
+		lo = hi = j;
+		step = 1;
+		while (hi < b->n && b->oid[hi] < x) {
+			lo = hi + 1;
+			hi += step;
+			step <<= 1;
+		}
+		if (hi > b->n)
+			hi = b->n;
+		while (lo < hi) {
+			mid = lo + (hi - lo) / 2;
+			if (b->oid[mid] < x)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		j = lo;
+		if (j < b->n && b->oid[j] == x)
+			a->oid[n++] = x;
+	}
+	a->n = n;
+}
+
+/*
+ * Merge the oids of b into a.
+ *
+ * returns:
+ * -ENOMEM: out of memory
+ * OSD_OK: success
+ */
+static int mtq_oids_union(struct mtq_oids *a, const struct mtq_oids *b)
+{
+	size_t i = 0, j = 0, n = 0;
+	size_t cap = a->n + b->n;
+	uint64_t *m = NULL;
+
+	if (b->n == 0)
+		return OSD_OK;
+
+	m = Malloc(cap * sizeof(*m));
+	if (!m)
+		return -ENOMEM;
+	while (i < a->n && j < b->n) {
+		if (a->oid[i] < b->oid[j]) {
+			m[n++] = a->oid[i++];
+		} else if (b->oid[j] < a->oid[i]) {
+			m[n++] = b->oid[j++];
+		} else {
+			m[n++] = a->oid[i++];
+			j++;
+		}
+	}
+	while (i < a->n)
+		m[n++] = a->oid[i++];
+	while (j < b->n)
+		m[n++] = b->oid[j++];
+
+	free(a->oid);
+	a->oid = m;
+	a->n = n;
+	a->cap = cap;
+	return OSD_OK;
+}
+
+/*
+ * an intersection narrowed down to this many oids looks the rest of the
+ * criteria up per oid instead of scanning for them
+ */
+#define MTQ_PROBE_MAX (128)
+
+/*
+ * Each criterion is evaluated into a sorted oid array through its value
+ * index or the attr primary key, and the arrays are intersected or
+ * merged here. An intersection stops at the first empty result, and once
+ * down to MTQ_PROBE_MAX oids checks them against the remaining criteria
+ * one by one. Output is that of mtq_run_query_sql.
+ *
+ * return values:
+ * -EINVAL: invalid argument
+ * -ENOMEM: out of memory
+ * -EIO: prepare or some other sqlite function failed
+ * OSD_OK: success
+ */
+int mtq_run_query(void *ohandle, uint64_t pid, uint64_t cid,
+		  struct query_criteria *qc, void *outdata,
+		  uint32_t alloc_len, uint64_t *used_outlen)
+{
+	int ret = 0;
+	int txn = 0;
+	size_t k = 0;
+	uint32_t i = 0;
+	uint8_t *p = NULL;
+	uint64_t len = 0;
+	struct mtq_oids res = {NULL, 0, 0}, s = {NULL, 0, 0}, t;
+	struct db_context *dbc = db_shard(ohandle, pid);
+
+	assert(dbc && dbc->db && dbc->mtq && qc && outdata && used_outlen);
+
+	if (qc->query_type != 0 && qc->query_type != 1)
+		return -EINVAL;
+	if (mtq_check_bounds(((struct handle *)ohandle)->qtypes, qc) != OSD_OK)
+		return -EINVAL;
+	if (qc->qc_cnt == 0)
+		return mtq_run_query_sql(ohandle, pid, cid, qc, outdata,
+					 alloc_len, used_outlen);
+
+	/*
+	 * the criteria are read in one transaction, so they see the same
+	 * state and the read lock is not taken per statement
+	 */
+	if (sqlite3_get_autocommit(dbc->db))
+		txn = (sqlite3_exec(dbc->db, "BEGIN;", NULL, NULL, NULL) ==
+		       SQLITE_OK);
+
+	for (i = 0; i < qc->qc_cnt; i++) {
+		if (i > 0 && qc->query_type == 1 && res.n <= MTQ_PROBE_MAX) {
+			ret = mtq_crit_probe(ohandle, pid, qc, i, &res);
+			if (ret != OSD_OK)
+				goto out;
+			if (res.n == 0)
+				break;
+			continue;
+		}
+		ret = mtq_crit_oids(ohandle, pid, cid, qc, i, (i == 0 ? &res : &s));
+		if (ret != OSD_OK)
+			goto out;
+		if (i == 0)
+			continue;
+		if (qc->query_type == 1) {
+			if (s.n < res.n) {
+				t = res;
+				res = s;
+				s = t;
+			}
+			mtq_oids_isect(&res, &s);
+			if (res.n == 0)
+				break;
+		} else {
+			ret = mtq_oids_union(&res, &s);
+			if (ret != OSD_OK)
+				goto out;
+		}
+	}
+
+	p = outdata;
+	p += ML_ODL_OFF;
+	len = ML_ODL_OFF - 8; /* subtract len of addition_len */
+	*used_outlen = ML_ODL_OFF;
+	for (k = 0; k < res.n; k++) {
+		if ((alloc_len - len) > 8) {
+			set_htonll(p, res.oid[k]);
+			*used_outlen += 8;
+		}
+		p += 8;
+		/* handle overflow: osd2r01 Sec 6.18.3 */
+		if (len != (uint64_t) -1 && (len + 8) > len) {
+			len += 8;
+		} else {
+			len = (uint64_t) -1;
+		}
+	}
+	set_htonll(outdata, len);
+	ret = OSD_OK;
+
+out:
+	if (txn && sqlite3_exec(dbc->db, "COMMIT;", NULL, NULL, NULL) !=
+	    SQLITE_OK)
+		error_sql(dbc->db, "%s: commit", __func__);
+	free(res.oid);
+	free(s.oid);
+	return ret;
+}
+
+
 /*
- * returns list of objects along with requested attributes
+ * returns list of objects along with requested attributes: the user
+ * objects of pid if cid is 0, else the members of collection cid
+ *
+ * A single statement walks obj, or the coll rows of cid, in primary key
+ * order and left joins each requested attribute to it on the attr primary
+ * key, so the rows come out in oid order without a sort and each
+ * descriptor is built as its row arrives. Once the list length is
+ * known, from an earlier page, stepping stops when the page is full.
+ *
+ * XXX:SD The spec is inconsistent in applying padding and alignment
+ * rules. Here we make changes to the spec. In our case object descriptor
+ * format header (table 79) is 16B instead of 12B, and attributes list
+ * length field is 4B instead of 2B as defined in spec, and starts at byte
+ * 12 in the header (not 10). ODE is object descriptor entry.
  *
  * return values:
  * -EINVAL: invalid argument
@@ -210,223 +929,267 @@ out:
  * OSD_ERROR: some other error
  * OSD_OK: success
  */
-int mtq_list_oids_attr(void *ohandle, uint64_t pid,
-		       uint64_t initial_oid, struct getattr_list *get_attr,
-		       uint64_t alloc_len, void *outdata, 
-		       uint64_t *used_outlen, uint64_t *add_len, 
-		       uint64_t *cont_id)
+static int mtq_list_attr(void *ohandle, uint64_t pid, uint64_t cid,
+			 uint64_t initial_oid, struct getattr_list *get_attr,
+			 uint64_t alloc_len, void *outdata,
+			 uint64_t *used_outlen, uint64_t *add_len,
+			 uint64_t *cont_id)
 {
 	int ret = 0;
+	int stop = 0;
 	char *cp = NULL;
 	char *SQL = NULL;
 	uint32_t i = 0;
-	uint32_t factor = 2; /* this query uses space fast */
-	uint32_t attr_list_len = 0; /*XXX:SD see below */
 	uint32_t sqlen = 0;
 	uint64_t oid = 0;
-	uint32_t page;
-	uint32_t number;
-	uint16_t len;
-	const void *val = NULL;
+	uint64_t known = *add_len;
 	sqlite3_stmt *stmt = NULL;
-	uint8_t *head = NULL, *tail = NULL;
-	const char *select_stmt = NULL;
-  struct db_context *dbc = ((struct handle *)ohandle)->dbc;
-	const char *obj = obj_getname(dbc);
-	const char *attr = attr_getname(dbc);
+	struct mtq_stmt *e = NULL;
+	struct le_odl l;
+  struct db_context *dbc = db_shard(ohandle, pid);
+	uint8_t kind = (cid ? MTQ_LIST_MEMBER_ATTR : MTQ_LIST_ATTR);
+	const char *obj = obj_getname(ohandle);
+	const char *attr = attr_getname(ohandle);
+	const char *coll = coll_getname(ohandle);
 
-	assert(dbc && dbc->db && get_attr && outdata && used_outlen 
-	       && add_len && obj && attr);
+	assert(dbc && dbc->db && dbc->mtq && get_attr && outdata
+	       && used_outlen && add_len && obj && attr && coll);
 
 	if (get_attr->sz == 0) {
 		ret = -EINVAL;
 		goto out;
 	}
 
-	SQL = Malloc(MAXSQLEN*factor);
+	e = mtq_lookup(dbc, kind, 0, get_attr->sz, NULL, NULL);
+	if (!e) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	if (e->stmt)
+		goto bind;
+
+	/* no piece of it is longer than 200 */
+	SQL = Malloc(MAXSQLEN + 200 * (get_attr->sz + 1));
 	if (!SQL) {
+		mtq_evict(e);
 		ret = -ENOMEM;
 		goto out;
 	}
 
-	/* 
-	 * For each attribute requested, create a select statement,
-	 * which will try to index into the attr table with a full key rather
-	 * than just (pid, oid) prefix key. Analogous to loop unrolling, we
-	 * unroll each requested attribute into its own select statement.
+	/*
+	 * pid is ?1, initial_oid ?2, then page and number of each
+	 * attribute, and cid last. A missing attribute comes out as NULL;
+	 * attr never holds a NULL value, an empty one is deleted instead.
+	 * Past the join limit of SQLite attributes are scalar subqueries,
+	 * which do the same lookup somewhat slower. Members are walked as
+	 * the coll rows of cid, under the alias obj so the rest reads the
+	 * same.
 	 */
-	select_stmt = "SELECT obj.oid as myoid, attr.page, "
-		" attr.number, attr.value FROM %s as obj, %s as attr "
-		" WHERE obj.pid = attr.pid AND obj.oid = attr.oid AND "
-		" obj.pid = %llu AND obj.type = %u AND "
-		" attr.page = %u AND attr.number = %u AND obj.oid >= %llu ";
-
 	cp = SQL;
 	sqlen = 0;
-	sprintf(SQL, select_stmt, obj, attr, llu(pid), USEROBJECT,
-		USER_TMSTMP_PG, 0, llu(initial_oid));
-	SQL = strcat(SQL, " UNION ALL ");
-	sqlen += strlen(SQL);
-	cp += sqlen;
-	for (i = 0; i < get_attr->sz; i++) {
-		sprintf(cp, select_stmt, obj, attr, llu(pid), USEROBJECT,
-			get_attr->le[i].page, get_attr->le[i].number,
-			llu(initial_oid));
-		if (i < (get_attr->sz - 1))
-			cp = strcat(cp, " UNION ALL ");
-
+	for (i = 0; i <= get_attr->sz; i++) {
+		if (i == 0)
+			sprintf(cp, "SELECT obj.oid");
+		else if (i <= MTQ_LIST_JOINS)
+			sprintf(cp, ", a%u.value", i);
+		else
+			sprintf(cp, ", (SELECT value FROM %s WHERE "
+				" pid = obj.pid AND oid = obj.oid AND "
+				" page = ?%u AND number = ?%u)", attr,
+				1+2*i, 2+2*i);
+		sqlen += strlen(cp);
+		cp = SQL + sqlen;
+	}
+	sprintf(cp, " FROM %s as obj ", cid ? coll : obj);
+	sqlen += strlen(cp);
+	cp = SQL + sqlen;
+	for (i = 1; i <= get_attr->sz && i <= MTQ_LIST_JOINS; i++) {
+		sprintf(cp, " LEFT JOIN %s as a%u ON a%u.pid = obj.pid AND "
+			" a%u.oid = obj.oid AND a%u.page = ?%u AND "
+			" a%u.number = ?%u", attr, i, i, i, i, 1+2*i, i,
+			2+2*i);
 		sqlen += strlen(cp);
-		if (sqlen > (MAXSQLEN*factor - 400)) {
-			factor *= 2;
-			SQL = realloc(SQL, MAXSQLEN*factor);
-			if (!SQL) {
-				ret = -ENOMEM;
-				goto out;
-			}
-		}
-
 		cp = SQL + sqlen;
 	}
-	sprintf(cp, " ORDER BY myoid; "); 
+	if (cid)
+		sprintf(cp, " WHERE obj.pid = ?1 AND obj.cid = ?%u AND "
+			" obj.oid >= ?2 ORDER BY obj.oid;",
+			3+2*get_attr->sz);
+	else
+		sprintf(cp, " WHERE obj.pid = ?1 AND obj.type = %u AND "
+			" obj.oid >= ?2 ORDER BY obj.oid;", USEROBJECT);
 
-	ret = sqlite3_prepare(dbc->db, SQL, strlen(SQL)+1, &stmt, NULL);
-	if (ret != SQLITE_OK) {
-		error_sql(dbc->db, "%s: sqlite3_prepare", __func__);
+	ret = mtq_prepare(dbc, e, SQL, __func__);
+	if (ret != OSD_OK)
 		goto out;
+
+bind:
+	stmt = e->stmt;
+	ret = sqlite3_bind_int64(stmt, 1, pid);
+	ret |= sqlite3_bind_int64(stmt, 2, initial_oid);
+	if (cid)
+		ret |= sqlite3_bind_int64(stmt, 3+2*get_attr->sz, cid);
+	for (i = 0; ret == SQLITE_OK && i < get_attr->sz; i++)
+		ret = mtq_bind_pn(e, i, 3+2*i, get_attr->le[i].page,
+				  get_attr->le[i].number);
+	if (ret != SQLITE_OK) {
+		error_sql(dbc->db, "%s: bind", __func__);
+		ret = -EIO;
+		goto out_release;
 	}
 
 	/* execute the statement */
-	head = tail = outdata;
-	attr_list_len = 0;
-	while(1) {
+	*add_len = 0;
+	le_odl_init(&l, outdata, alloc_len, used_outlen, add_len, cont_id);
+	while (1) {
+		/* the rest is not needed if its length is known */
+		if (known && *cont_id) {
+			ret = SQLITE_DONE;
+			break;
+		}
 		ret = sqlite3_step(stmt);
-		if (ret == SQLITE_BUSY) {
+		if (ret == SQLITE_BUSY)
 			continue;
-		} else if (ret != SQLITE_ROW) {
+		else if (ret != SQLITE_ROW)
 			break;
-		} 
-		/* for the rest of loop body ret == SQLITE_ROW */
-
-		/*
-		 * XXX:SD The spec is inconsistent in applying padding and
-		 * alignment rules. Here we make changes to the spec. In our
-		 * case object descriptor format header (table 79) is 16B
-		 * instead of 12B, and attributes list length field is 4B
-		 * instead of 2B as defined in spec, and starts at byte 12
-		 * in the header (not 10).  ODE is object descriptor entry.
-		 */
+
+		/* every user object starts its descriptor with this row */
 		oid = sqlite3_column_int64(stmt, 0);
-		page = sqlite3_column_int64(stmt, 1);
-		number = sqlite3_column_int64(stmt, 2);
-		len = sqlite3_column_bytes(stmt, 3);
-
-		if (page == USER_TMSTMP_PG && number == 0) {
-			/* look ahead in the buf to see if there is space */
-			if (alloc_len >= 16) {
-				/* start attr list of 'this' ODE */
-				set_htonll(tail, oid);
-				memset(tail + 8, 0, 4);  /* reserved */
-				if (head != tail) {
-					/* fill attr_list_len of prev ODE */
-					set_htonl(head, attr_list_len);
-					head = tail;
-					attr_list_len = 0;
-				}
-				alloc_len -= 16;
-				tail += 16;
-				head += 12;  /* points to attr-list-len */
-				*used_outlen += 16;
-			} else {
-				if (head != tail) {
-					/* fill attr_list_len of prev ODE */
-					set_htonl(head, attr_list_len);
-					head = tail;
-					attr_list_len = 0;
-				}
-				if (*cont_id == 0)
-					*cont_id = oid;
-			}
-			/* handle overflow: osd2r01 Sec 6.14.2 */
-			if (*add_len + 16 > *add_len) {
-				*add_len += 16;
-			} else {
-				/* terminate since add_len overflew */
-				*add_len = (uint64_t) -1;
-				ret = SQLITE_DONE; 
-				break;
-			}
-			continue;
-		} 
-		if (alloc_len >= 16) {
-			/* osd_debug("%s: oid %llu, page %u, number %u, len %u",
-				  __func__, llu(oid), page, number, len); */
-			val = sqlite3_column_blob(stmt, 3);
-			ret = le_pack_attr(tail, alloc_len, page, number, len, 
-					   val);
-			assert (ret != -EOVERFLOW);
-			if (ret > 0) {
-				alloc_len -= ret;
-				tail += ret;
-				attr_list_len += ret;
-				*used_outlen += ret;
-				if (alloc_len < 16){
-					set_htonl(head, attr_list_len);
-					head = tail;
-					attr_list_len = 0;
-					if (*cont_id == 0)
-						*cont_id = oid;
-				}
-			} else {
-				goto out_finalize;
-			}
-		} else {
-			if (head != tail) {
-				/* fill attr_list_len of this ODE */
-				set_htonl(head, attr_list_len);
-				head = tail;
-				attr_list_len = 0;
-				if (*cont_id == 0)
-					*cont_id = oid;
-			}
+		stop = le_odl_row(&l, oid, USER_TMSTMP_PG, 0, 0, NULL);
+		for (i = 0; stop == 0 && i < get_attr->sz; i++) {
+			if (sqlite3_column_type(stmt, 1+i) == SQLITE_NULL)
+				continue;
+			stop = le_odl_row(&l, oid, get_attr->le[i].page,
+					  get_attr->le[i].number,
+					  sqlite3_column_bytes(stmt, 1+i),
+					  sqlite3_column_blob(stmt, 1+i));
 		}
-		/* handle overflow: osd2r01 Sec 6.14.2 */
-		if ((*add_len + roundup8(4+4+2+len)) > *add_len) {
-			*add_len += roundup8(4+4+2+len);
-		} else {
+		if (stop < 0) {
+			ret = stop;
+			goto out_release;
+		}
+		if (stop) {
 			/* terminate since add_len overflew */
-			*add_len = (uint64_t) -1; 
-			ret = SQLITE_DONE; 
+			ret = SQLITE_DONE;
 			break;
 		}
 	}
 	if (ret != SQLITE_DONE) {
 		error_sql(dbc->db, "%s: query execution failed. SQL %s, "
-			  " add_len %llu attr_list_len %u", __func__, SQL, 
-			  llu(*add_len), attr_list_len);
-		goto out_finalize;
-	}
-	if (head != tail) {
-		set_htonl(head, attr_list_len);
-		head += (4 + attr_list_len);
-		assert(head == tail);
+			  " add_len %llu", __func__, sqlite3_sql(stmt),
+			  llu(*add_len));
+		ret = -EIO;
+		goto out_release;
 	}
+	le_odl_end(&l);
+	if (known)
+		*add_len = known;
 
 	ret = OSD_OK; /* success */
 
-out_finalize:
-	if (sqlite3_finalize(stmt) != SQLITE_OK) {
-		ret = -EIO;
-		error_sql(dbc->db, "%s: finalize", __func__);
-	}
+out_release:
+	mtq_release(e, ret != OSD_OK);
 
 out:
 	free(SQL);
 	return ret;
 }
 
+int mtq_list_oids_attr(void *ohandle, uint64_t pid,
+		       uint64_t initial_oid, struct getattr_list *get_attr,
+		       uint64_t alloc_len, void *outdata, 
+		       uint64_t *used_outlen, uint64_t *add_len, 
+		       uint64_t *cont_id)
+{
+	return mtq_list_attr(ohandle, pid, 0, initial_oid, get_attr,
+			     alloc_len, outdata, used_outlen, add_len,
+			     cont_id);
+}
+
+/*
+ * returns the members of collection cid along with requested attributes,
+ * in the format of mtq_list_oids_attr
+ */
+int mtq_list_members_attr(void *ohandle, uint64_t pid, uint64_t cid,
+			  uint64_t initial_oid, struct getattr_list *get_attr,
+			  uint64_t alloc_len, void *outdata,
+			  uint64_t *used_outlen, uint64_t *add_len,
+			  uint64_t *cont_id)
+{
+	return mtq_list_attr(ohandle, pid, cid, initial_oid, get_attr,
+			     alloc_len, outdata, used_outlen, add_len,
+			     cont_id);
+}
+
+
+/*
+ * delete attribute (page, number) from the members of collection cid, and
+ * page from their attrdir where that was its last attribute
+ */
+static int mtq_delete_member_attr(struct db_context *dbc, uint64_t pid,
+				  uint64_t cid, uint32_t page, uint32_t number,
+				  const char *attr, const char *coll)
+{
+	static const uint8_t del[] = { MTQ_DEL_MEMBER, MTQ_DEL_MEMBER_DIR };
+	int ret = 0;
+	size_t i = 0;
+	char SQL[MAXSQLEN];
+	struct mtq_stmt *e = NULL;
+
+	for (i = 0; i < ARRAY_SIZE(del); i++) {
+		e = mtq_lookup(dbc, del[i], 0, 1, NULL, NULL);
+		if (!e)
+			return -ENOMEM;
+		if (!e->stmt) {
+			if (del[i] == MTQ_DEL_MEMBER)
+				sprintf(SQL, "DELETE FROM %s WHERE pid = ?1 AND "
+					"page = ?3 AND number = ?4 AND oid IN "
+					"(SELECT oid FROM %s WHERE pid = ?1 AND "
+					"cid = ?2);", attr, coll);
+			else
+				sprintf(SQL, "DELETE FROM attrdir WHERE "
+					"pid = ?1 AND page = ?3 AND oid IN "
+					"(SELECT oid FROM %s WHERE pid = ?1 AND "
+					"cid = ?2) AND NOT EXISTS (SELECT 1 FROM "
+					"%s AS a WHERE a.pid = ?1 AND a.oid = "
+					"attrdir.oid AND a.page = ?3);", coll,
+					attr);
+			ret = mtq_prepare(dbc, e, SQL, __func__);
+			if (ret != OSD_OK)
+				return ret;
+		}
+		ret = sqlite3_bind_int64(e->stmt, 1, pid);
+		ret |= sqlite3_bind_int64(e->stmt, 2, cid);
+		ret |= sqlite3_bind_int(e->stmt, 3, (int32_t)page);
+		if (del[i] == MTQ_DEL_MEMBER)
+			ret |= sqlite3_bind_int(e->stmt, 4, (int32_t)number);
+		if (ret == SQLITE_OK)
+			while ((ret = sqlite3_step(e->stmt)) == SQLITE_BUSY);
+		if (ret != SQLITE_DONE) {
+			error_sql(dbc->db, "%s: delete", __func__);
+			mtq_release(e, 1);
+			return -EIO;
+		}
+		mtq_release(e, 0);
+	}
+	return OSD_OK;
+}
+
+/* whether entry i of sa is deleted again by a later entry */
+static int mtq_deleted_later(const struct setattr_list *sa, uint32_t i)
+{
+	uint32_t j = 0;
+
+	for (j = i + 1; j < sa->sz; j++)
+		if (sa->le[j].len == 0 && sa->le[j].page == sa->le[i].page &&
+		    sa->le[j].number == sa->le[i].number)
+			return 1;
+	return 0;
+}
 
 /*
- * set attributes on members of the give collection
+ * set attributes on members of the give collection; entries with len == 0
+ * delete the attribute, as in attr_set_attr_list
  *
  * return values:
  * -EINVAL: invalid argument
@@ -440,44 +1203,90 @@ int mtq_set_member_attrs(void *ohandle, uint64_t pid, uint64_t cid,
 	int ret = 0;
 	int factor = 1;
 	uint32_t i = 0;
+	uint32_t n = 0;
 	char *cp = NULL;
 	char *SQL = NULL;
 	size_t sqlen = 0;
-	sqlite3_stmt *stmt = NULL;
-  struct db_context *dbc = ((struct handle *)ohandle)->dbc;
-	const char *coll = coll_getname(dbc);
-	const char *attr = attr_getname(dbc);
+	struct mtq_stmt *e = NULL;
+	struct list_entry *le = set_attr->le;
+	struct db_context *dbc = db_shard(ohandle, pid);
+	const char *coll = coll_getname(ohandle);
+	const char *attr = attr_getname(ohandle);
 
-	assert(dbc && dbc->db && set_attr && coll && attr);
+	assert(dbc && dbc->db && dbc->mtq && set_attr && coll && attr);
 
 	if (set_attr->sz == 0) {
 		ret = 0;
 		goto out;
 	}
 
+	/*
+	 * deletes go first, so a set they would have undone is dropped and
+	 * the outcome is that of applying the list in order
+	 */
+	for (i = 0; i < set_attr->sz; i++) {
+		if (set_attr->le[i].len != 0) {
+			if (!mtq_deleted_later(set_attr, i))
+				n++;
+			continue;
+		}
+		ret = mtq_delete_member_attr(dbc, pid, cid,
+					     set_attr->le[i].page,
+					     set_attr->le[i].number, attr, coll);
+		if (ret != OSD_OK)
+			goto out;
+	}
+	if (n == 0) {
+		ret = OSD_OK;
+		goto out;
+	}
+	if (n < set_attr->sz) {
+		/* the entries that set, in the order given */
+		le = Malloc(n * sizeof(*le));
+		if (!le) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		for (i = 0, n = 0; i < set_attr->sz; i++)
+			if (set_attr->le[i].len != 0 &&
+			    !mtq_deleted_later(set_attr, i))
+				le[n++] = set_attr->le[i];
+	}
+
+	e = mtq_lookup(dbc, MTQ_SET_MEMBER, 0, n, NULL, NULL);
+	if (!e) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	if (e->stmt)
+		goto bind;
+
 	SQL = Malloc(MAXSQLEN*factor);
 	if (!SQL) {
+		mtq_evict(e);
 		ret = -ENOMEM;
 		goto out;
 	}
 
+	/* pid is ?1, cid ?2, then page, number and value of each attr */
 	cp = SQL;
 	sqlen = 0;
 	sprintf(SQL, "INSERT OR REPLACE INTO %s ", attr);
 	sqlen += strlen(SQL);
 	cp += sqlen;
 
-	for (i = 0; i < set_attr->sz; i++) {
-		sprintf(cp, " SELECT %llu, oid, %u, %u, ? FROM %s "
-			" WHERE cid = %llu ", llu(pid), set_attr->le[i].page,
-			set_attr->le[i].number, coll, llu(cid));
-		if (i < (set_attr->sz - 1))
+	for (i = 0; i < n; i++) {
+		sprintf(cp, " SELECT ?1, oid, ?%u, ?%u, ?%u FROM %s "
+			" WHERE pid = ?1 AND cid = ?2 ", 3+3*i, 4+3*i, 5+3*i,
+			coll);
+		if (i < (n - 1))
 			cp = strcat(cp, " UNION ALL ");
 		sqlen += strlen(cp);
 		if (sqlen > (MAXSQLEN*factor - 200)) {
 			factor *= 2;
 			SQL = realloc(SQL, MAXSQLEN*factor);
 			if (!SQL) {
+				mtq_evict(e);
 				ret = -ENOMEM;
 				goto out;
 			}
@@ -486,41 +1295,224 @@ int mtq_set_member_attrs(void *ohandle, uint64_t pid, uint64_t cid,
 	}
 	cp = strcat(cp, " ;");
 
-	ret = sqlite3_prepare(dbc->db, SQL, strlen(SQL)+1, &stmt, NULL);
+	ret = mtq_prepare(dbc, e, SQL, __func__);
+	if (ret != OSD_OK)
+		goto out;
+
+bind:
+	/* bind values */
+	ret = sqlite3_bind_int64(e->stmt, 1, pid);
+	ret |= sqlite3_bind_int64(e->stmt, 2, cid);
+	for (i = 0; ret == SQLITE_OK && i < n; i++) {
+		ret = sqlite3_bind_int(e->stmt, 3+3*i,
+				       (int32_t)le[i].page);
+		ret |= sqlite3_bind_int(e->stmt, 4+3*i,
+					(int32_t)le[i].number);
+		ret |= sqlite3_bind_blob(e->stmt, 5+3*i, le[i].cval,
+					 le[i].len,
+					 SQLITE_TRANSIENT);
+	}
 	if (ret != SQLITE_OK) {
 		ret = -EIO;
-		error_sql(dbc->db, "%s: sqlite3_prepare", __func__);
+		error_sql(dbc->db, "%s: bind @ %u", __func__, i);
+		goto out_release;
+	}
+
+	/* execute the statement */
+	while ((ret = sqlite3_step(e->stmt)) == SQLITE_BUSY);
+	if (ret != SQLITE_DONE) {
+		error_sql(dbc->db, "%s: sqlite3_step", __func__);
+		ret = -EIO;
+		goto out_release;
+	}
+	mtq_release(e, 0);
+
+	/* members may have gained new pages, add them to attrdir */
+	e = mtq_lookup(dbc, MTQ_SET_MEMBER_DIR, 0, n, NULL, NULL);
+	if (!e) {
+		ret = -ENOMEM;
 		goto out;
 	}
+	if (e->stmt)
+		goto bind_dir;
 
-	/* bind values */
-	for (i = 0; i < set_attr->sz; i++) {
-		ret = sqlite3_bind_blob(stmt, i+1, set_attr->le[i].cval, 
-					set_attr->le[i].len,
-					SQLITE_TRANSIENT);
-		if (ret != SQLITE_OK) {
-			ret = -EIO;
-			error_sql(dbc->db, "%s: blob @ %u", __func__, i+1);
-			goto out_finalize;
+	if (!SQL) {
+		SQL = Malloc(MAXSQLEN*factor);
+		if (!SQL) {
+			mtq_evict(e);
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+	cp = SQL;
+	sqlen = 0;
+	sprintf(SQL, "INSERT OR IGNORE INTO attrdir ");
+	sqlen += strlen(SQL);
+	cp += sqlen;
+	for (i = 0; i < n; i++) {
+		sprintf(cp, " SELECT ?1, oid, ?%u FROM %s WHERE pid = ?1 AND "
+			" cid = ?2 ", 3+i, coll);
+		if (i < (n - 1))
+			cp = strcat(cp, " UNION ");
+		sqlen += strlen(cp);
+		if (sqlen > (MAXSQLEN*factor - 200)) {
+			factor *= 2;
+			SQL = realloc(SQL, MAXSQLEN*factor);
+			if (!SQL) {
+				mtq_evict(e);
+				ret = -ENOMEM;
+				goto out;
+			}
 		}
+		cp = SQL + sqlen;
 	}
+	cp = strcat(cp, " ;");
 
-	/* execute the statement */
-	while ((ret = sqlite3_step(stmt)) == SQLITE_BUSY);
+	ret = mtq_prepare(dbc, e, SQL, __func__);
+	if (ret != OSD_OK)
+		goto out;
+
+bind_dir:
+	ret = sqlite3_bind_int64(e->stmt, 1, pid);
+	ret |= sqlite3_bind_int64(e->stmt, 2, cid);
+	for (i = 0; ret == SQLITE_OK && i < n; i++)
+		ret = sqlite3_bind_int(e->stmt, 3+i,
+				       (int32_t)le[i].page);
+	if (ret == SQLITE_OK)
+		while ((ret = sqlite3_step(e->stmt)) == SQLITE_BUSY);
 	if (ret != SQLITE_DONE) {
-		error_sql(dbc->db, "%s: sqlite3_step", __func__);
+		error_sql(dbc->db, "%s: attrdir", __func__);
 		ret = -EIO;
-		goto out_finalize;
+		goto out_release;
 	}
 	ret = OSD_OK;
 
-out_finalize:
-	if (sqlite3_finalize(stmt) != SQLITE_OK)
-		error_sql(dbc->db, "%s: finalize", __func__);
+out_release:
+	mtq_release(e, ret != OSD_OK);
 
 out:
+	if (le != set_attr->le)
+		free(le);
 	free(SQL);
 	return ret;
 }
 
 
+/*
+ * Remove the user objects that are members of collection cid: their
+ * attributes and obj rows, one statement per table over the member set,
+ * and their memberships in every collection. Nothing is removed unless
+ * all of it is. The members are handed back in *oids, to be freed
+ * by the caller, so that it can remove their data files.
+ *
+ * return values:
+ * -ENOMEM: out of memory
+ * -EIO: prepare or some other sqlite function failed
+ * OSD_ERROR: some other error
+ * OSD_OK: success
+ */
+int mtq_remove_members(void *ohandle, uint64_t pid, uint64_t cid,
+		       uint64_t **oids, size_t *noid)
+{
+	static const uint8_t del[] = {
+		MTQ_REMOVE_ATTR, MTQ_REMOVE_DIR, MTQ_REMOVE_OBJ
+	};
+	int ret = 0;
+	size_t i = 0;
+	size_t n = 0;
+	char SQL[MAXSQLEN];
+	const struct collbm *bm = NULL;
+	struct collbm_iter it;
+	struct mtq_stmt *e = NULL;
+	struct db_context *dbc = db_shard(ohandle, pid);
+	const char *obj = obj_getname(ohandle);
+	const char *attr = attr_getname(ohandle);
+	const char *coll = coll_getname(ohandle);
+
+	assert(dbc && dbc->db && dbc->mtq && oids && noid && obj && attr &&
+	       coll);
+
+	*oids = NULL;
+	*noid = 0;
+
+	/* the member set, resolved once */
+	bm = coll_get_members(ohandle, pid, cid);
+	if (!bm)
+		return -ENOMEM;
+	if (bm->card == 0)
+		return OSD_OK;
+	*oids = Malloc(bm->card * sizeof(**oids));
+	if (!*oids)
+		return -ENOMEM;
+	collbm_iter_seek(&it, bm, 0);
+	while (collbm_iter_next(&it, &(*oids)[n]))
+		n++;
+
+	if (sqlite3_exec(dbc->db, "SAVEPOINT rmmembers;", NULL, NULL,
+			 NULL) != SQLITE_OK) {
+		error_sql(dbc->db, "%s: savepoint", __func__);
+		ret = -EIO;
+		goto out_free;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(del); i++) {
+		e = mtq_lookup(dbc, del[i], 0, 1, NULL, NULL);
+		if (!e) {
+			ret = -ENOMEM;
+			goto out_rollback;
+		}
+		if (!e->stmt) {
+			if (del[i] == MTQ_REMOVE_ATTR)
+				sprintf(SQL, "DELETE FROM %s WHERE pid = ?1 AND "
+					"oid IN (SELECT oid FROM %s WHERE "
+					"pid = ?1 AND cid = ?2);", attr, coll);
+			else if (del[i] == MTQ_REMOVE_DIR)
+				sprintf(SQL, "DELETE FROM attrdir WHERE "
+					"pid = ?1 AND oid IN (SELECT oid FROM "
+					"%s WHERE pid = ?1 AND cid = ?2);", coll);
+			else
+				sprintf(SQL, "DELETE FROM %s WHERE pid = ?1 AND "
+					"type = %u AND oid IN (SELECT oid FROM "
+					"%s WHERE pid = ?1 AND cid = ?2);", obj,
+					USEROBJECT, coll);
+			ret = mtq_prepare(dbc, e, SQL, __func__);
+			if (ret != OSD_OK)
+				goto out_rollback;
+		}
+		ret = sqlite3_bind_int64(e->stmt, 1, pid);
+		ret |= sqlite3_bind_int64(e->stmt, 2, cid);
+		if (ret == SQLITE_OK)
+			while ((ret = sqlite3_step(e->stmt)) == SQLITE_BUSY);
+		if (ret != SQLITE_DONE) {
+			error_sql(dbc->db, "%s: delete", __func__);
+			mtq_release(e, 1);
+			ret = -EIO;
+			goto out_rollback;
+		}
+		mtq_release(e, 0);
+	}
+
+	/* last, since the statements above select the members from coll */
+	ret = coll_delete_members(ohandle, pid, cid);
+	if (ret != OSD_OK)
+		goto out_rollback;
+
+	if (sqlite3_exec(dbc->db, "RELEASE rmmembers;", NULL, NULL,
+			 NULL) != SQLITE_OK) {
+		error_sql(dbc->db, "%s: release", __func__);
+		ret = -EIO;
+		goto out_rollback;
+	}
+	for (i = 0; i < n; i++)
+		obj_forget(ohandle, pid, (*oids)[i]);
+	*noid = n;
+	return OSD_OK;
+
+out_rollback:
+	sqlite3_exec(dbc->db, "ROLLBACK TO rmmembers; RELEASE rmmembers;",
+		     NULL, NULL, NULL);
+out_free:
+	free(*oids);
+	*oids = NULL;
+	return ret;
+}
@@ -20,17 +20,36 @@
 
 #include "osd-types.h"
 
+int mtq_initialize(void *db);
+
+int mtq_finalize(void *db);
+
+void mtq_cache_stats(void *handle, uint64_t *hits, uint64_t *misses);
+
 int mtq_run_query(void *handle, uint64_t pid, uint64_t cid, 
 		  struct query_criteria *qc, void *outdata, 
 		  uint32_t alloc_len, uint64_t *used_outlen);
 
+int mtq_run_query_sql(void *handle, uint64_t pid, uint64_t cid,
+		      struct query_criteria *qc, void *outdata,
+		      uint32_t alloc_len, uint64_t *used_outlen);
+
 int mtq_list_oids_attr(void *handle, uint64_t pid,
 		       uint64_t initial_oid, struct getattr_list *get_attr,
 		       uint64_t alloc_len, void *outdata, 
 		       uint64_t *used_outlen, uint64_t *add_len, 
 		       uint64_t *cont_id);
 
+int mtq_list_members_attr(void *handle, uint64_t pid, uint64_t cid,
+			  uint64_t initial_oid, struct getattr_list *get_attr,
+			  uint64_t alloc_len, void *outdata,
+			  uint64_t *used_outlen, uint64_t *add_len,
+			  uint64_t *cont_id);
+
 int mtq_set_member_attrs(void *handle, uint64_t pid, uint64_t cid, 
 			 struct setattr_list *set_attr);
 
+int mtq_remove_members(void *handle, uint64_t pid, uint64_t cid,
+		       uint64_t **oids, size_t *noid);
+
 #endif /* __MTQ_H */
@@ -26,13 +26,34 @@
 #include "osd-util/osd-util.h"
 #include "obj.h"
 #include "db.h"
+#include "collbm.h"
 
 /* obj table tracks the presence of objects in the OSD */
 
+/*
+ * The user object and collection ids of the most recently used
+ * partitions are also kept in memory as bitmaps (see collbm.h), read
+ * from obj on first use and changed along with it after every insert and
+ * delete; so are the ids of all partitions. LIST and the next free id
+ * are answered from them. None of it is saved: obj stays the authority,
+ * and an entry that cannot be kept up is dropped and read again later.
+ * A SQLITE_SCHEMA retry frees it all along with the statements, so no
+ * pointer into it outlives a statement.
+ */
+#define OBJ_IDX_CACHE (16)
+
+struct obj_idx {
+	uint64_t pid;
+	uint64_t tick;          /* last use */
+	struct collbm *oids;    /* USEROBJECT ids */
+	struct collbm *cids;    /* COLLECTION ids */
+};
+
 static const char *obj_tab_name = "obj";
 struct obj_tab {
 	char *name;             /* name of the table */
 	sqlite3_stmt *insert;   /* insert a row */
+	sqlite3_stmt *insrange; /* insert rows for a range of oids */
 	sqlite3_stmt *delete;   /* delete a row */
 	sqlite3_stmt *delpid;   /* delete all rows for pid */
 	sqlite3_stmt *nextoid;  /* get next oid */
@@ -43,6 +64,11 @@ struct obj_tab {
 	sqlite3_stmt *getoids;  /* get oids in a pid */
 	sqlite3_stmt *getcids;  /* get cids in pid */
 	sqlite3_stmt *getpids;  /* get pids in db */
+	sqlite3_stmt *getids;   /* get oids and types in a pid */
+	struct obj_idx idx[OBJ_IDX_CACHE];
+	uint32_t nidx;
+	uint64_t tick;
+	struct collbm *pids;    /* PARTITION ids, NULL until read */
 };
 
 
@@ -91,6 +117,13 @@ int obj_initialize(void *db)
 	if (ret != SQLITE_OK)
 		goto out_finalize_insert;
 
+	sprintf(SQL, "WITH RECURSIVE r(oid) AS (SELECT ?2 UNION ALL "
+		" SELECT oid + 1 FROM r WHERE oid < ?3) "
+		" INSERT INTO %s SELECT ?1, oid, ?4 FROM r;", dbc->obj->name);
+	ret = sqlite3_prepare(dbc->db, SQL, -1, &dbc->obj->insrange, NULL);
+	if (ret != SQLITE_OK)
+		goto out_finalize_insrange;
+
 	sprintf(SQL, "DELETE FROM %s WHERE pid = ? AND oid = ?;", 
 		dbc->obj->name);
 	ret = sqlite3_prepare(dbc->db, SQL, -1, &dbc->obj->delete, NULL);
@@ -149,9 +182,18 @@ int obj_initialize(void *db)
 	if (ret != SQLITE_OK)
 		goto out_finalize_getpids;
 
+	sprintf(SQL, "SELECT oid, type FROM %s WHERE pid = ?;",
+		dbc->obj->name);
+	ret = sqlite3_prepare(dbc->db, SQL, -1, &dbc->obj->getids, NULL);
+	if (ret != SQLITE_OK)
+		goto out_finalize_getids;
+
 	ret = OSD_OK; /* success */
 	goto out;
 
+out_finalize_getids:
+	db_sqfinalize(dbc->db, dbc->obj->getids, SQL);
+	SQL[0] = '\0';
 out_finalize_getpids:
 	db_sqfinalize(dbc->db, dbc->obj->getpids, SQL);
 	SQL[0] = '\0';
@@ -182,6 +224,9 @@ out_finalize_delpid:
 out_finalize_delete:
 	db_sqfinalize(dbc->db, dbc->obj->delete, SQL);
 	SQL[0] = '\0';
+out_finalize_insrange:
+	db_sqfinalize(dbc->db, dbc->obj->insrange, SQL);
+	SQL[0] = '\0';
 out_finalize_insert:
 	db_sqfinalize(dbc->db, dbc->obj->insert, SQL);
 	ret = -EIO;
@@ -192,12 +237,20 @@ out:
 
 int obj_finalize(void *db)
 {
+	uint32_t i = 0;
 	struct db_context *dbc = (struct db_context*)db;
 	if (!dbc || !dbc->obj)
 		return OSD_ERROR;
 
+	for (i = 0; i < dbc->obj->nidx; i++) {
+		collbm_free(dbc->obj->idx[i].oids);
+		collbm_free(dbc->obj->idx[i].cids);
+	}
+	collbm_free(dbc->obj->pids);
+
 	/* finalize statements; ignore return values */
 	sqlite3_finalize(dbc->obj->insert);
+	sqlite3_finalize(dbc->obj->insrange);
 	sqlite3_finalize(dbc->obj->delete);
 	sqlite3_finalize(dbc->obj->delpid);
 	sqlite3_finalize(dbc->obj->nextoid);
@@ -208,6 +261,7 @@ int obj_finalize(void *db)
 	sqlite3_finalize(dbc->obj->getoids);
 	sqlite3_finalize(dbc->obj->getcids);
 	sqlite3_finalize(dbc->obj->getpids);
+	sqlite3_finalize(dbc->obj->getids);
 	free(dbc->obj->name);
 	free(dbc->obj);
 	dbc->obj = NULL;
@@ -225,6 +279,229 @@ const char *obj_getname(void *ohandle)
 }
 
 
+/* cache entry of pid, NULL if it has none */
+static struct obj_idx *obj_idx_find(struct db_context *dbc, uint64_t pid)
+{
+	uint32_t i = 0;
+	struct obj_tab *ot = dbc->obj;
+
+	for (i = 0; i < ot->nidx; i++) {
+		if (ot->idx[i].pid == pid) {
+			ot->idx[i].tick = ++ot->tick;
+			return &ot->idx[i];
+		}
+	}
+	return NULL;
+}
+
+/* drop a cache entry; others may move */
+static void obj_idx_drop(struct db_context *dbc, struct obj_idx *e)
+{
+	struct obj_tab *ot = dbc->obj;
+
+	collbm_free(e->oids);
+	collbm_free(e->cids);
+	*e = ot->idx[--ot->nidx];
+}
+
+/*
+ * Read the user object and collection ids of pid from obj.
+ *
+ * returns:
+ * -ENOMEM: out of memory
+ * OSD_ERROR: some other error
+ * OSD_OK: success, *oids and *cids set
+ * OSD_REPEAT: the statements were rebuilt, start over
+ */
+static int obj_idx_read(struct db_context *dbc, uint64_t pid,
+			struct collbm **oids, struct collbm **cids)
+{
+	int ret = 0;
+	int bound = 0;
+	int type = 0;
+	struct collbm *bm = NULL;
+	sqlite3_stmt *stmt = dbc->obj->getids;
+
+	*oids = collbm_alloc();
+	*cids = collbm_alloc();
+	if (!*oids || !*cids) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	ret = sqlite3_bind_int64(stmt, 1, pid);
+	bound = (ret == SQLITE_OK);
+	if (!bound) {
+		error_sql(dbc->db, "%s: bind failed", __func__);
+		goto out_reset;
+	}
+	while ((ret = sqlite3_step(stmt)) == SQLITE_ROW || ret == SQLITE_BUSY) {
+		if (ret == SQLITE_BUSY)
+			continue;
+		type = sqlite3_column_int(stmt, 1);
+		bm = (type == USEROBJECT ? *oids :
+		      type == COLLECTION ? *cids : NULL);
+		if (bm && collbm_add(bm, sqlite3_column_int64(stmt, 0)) < 0)
+			break;
+	}
+
+out_reset:
+	if (ret == SQLITE_ROW) {
+		sqlite3_reset(stmt);
+		ret = -ENOMEM;
+	} else {
+		ret = db_reset_stmt(dbc, stmt, bound, __func__);
+	}
+out:
+	if (ret != OSD_OK) {
+		collbm_free(*oids);
+		collbm_free(*cids);
+		*oids = *cids = NULL;
+	}
+	return ret;
+}
+
+/*
+ * The cache entry of pid, read in if it is not cached, in place of the
+ * least recently used one if the cache is full.
+ *
+ * returns:
+ * NULL: out of memory or some other error
+ * the entry otherwise, until the next call into obj
+ */
+static struct obj_idx *obj_idx_get(struct db_context *dbc, uint64_t pid)
+{
+	int ret = 0;
+	uint32_t i = 0;
+	struct collbm *oids = NULL;
+	struct collbm *cids = NULL;
+	struct obj_tab *ot = NULL;
+	struct obj_idx *e = NULL;
+
+	do {
+		e = obj_idx_find(dbc, pid);
+		if (e)
+			return e;
+		ret = obj_idx_read(dbc, pid, &oids, &cids);
+	} while (ret == OSD_REPEAT);
+	if (ret != OSD_OK)
+		return NULL;
+
+	ot = dbc->obj;
+	if (ot->nidx == OBJ_IDX_CACHE) {
+		e = &ot->idx[0];
+		for (i = 1; i < ot->nidx; i++)
+			if (ot->idx[i].tick < e->tick)
+				e = &ot->idx[i];
+		obj_idx_drop(dbc, e);
+	}
+	e = &ot->idx[ot->nidx++];
+	e->pid = pid;
+	e->tick = ++ot->tick;
+	e->oids = oids;
+	e->cids = cids;
+	return e;
+}
+
+/*
+ * Add the ids of the partitions from initial_pid on to pids.
+ *
+ * returns:
+ * -ENOMEM: out of memory
+ * OSD_ERROR: some other error
+ * OSD_REPEAT: the statement was prepared again, pids may be partly filled
+ * OSD_OK: success
+ */
+static int obj_pids_read(struct db_context *dbc, uint64_t initial_pid,
+			 struct collbm *pids)
+{
+	int ret = 0;
+	int bound = 0;
+	sqlite3_stmt *stmt = dbc->obj->getpids;
+
+	ret = sqlite3_bind_int64(stmt, 1, initial_pid);
+	bound = (ret == SQLITE_OK);
+	if (!bound) {
+		error_sql(dbc->db, "%s: bind failed", __func__);
+		goto out_reset;
+	}
+	while ((ret = sqlite3_step(stmt)) == SQLITE_ROW || ret == SQLITE_BUSY) {
+		if (ret == SQLITE_ROW &&
+		    collbm_add(pids, sqlite3_column_int64(stmt, 0)) < 0)
+			break;
+	}
+
+out_reset:
+	if (ret == SQLITE_ROW) {
+		sqlite3_reset(stmt);
+		return -ENOMEM;
+	}
+	return db_reset_stmt(dbc, stmt, bound, __func__);
+}
+
+/*
+ * The ids of all partitions, read in from obj on first use.
+ *
+ * returns:
+ * NULL: out of memory or some other error
+ * the bitmap otherwise, until the next call into obj
+ */
+static struct collbm *obj_pids_get(struct db_context *dbc)
+{
+	int ret = 0;
+	struct collbm *pids = NULL;
+
+repeat:
+	if (dbc->obj->pids)
+		return dbc->obj->pids;
+	pids = collbm_alloc();
+	if (!pids)
+		return NULL;
+
+	ret = obj_pids_read(dbc, 0, pids);
+	if (ret != OSD_OK) {
+		collbm_free(pids);
+		if (ret == OSD_REPEAT)
+			goto repeat;
+		return NULL;
+	}
+	dbc->obj->pids = pids;
+	return pids;
+}
+
+/*
+ * Bring the cached ids in line with obj after (pid, oid) of type was
+ * inserted, or deleted if type is ILLEGAL_OBJ. Whatever cannot be kept
+ * up is dropped.
+ */
+static void obj_idx_update(struct db_context *dbc, uint64_t pid,
+			   uint64_t oid, uint32_t type)
+{
+	struct obj_tab *ot = dbc->obj;
+	struct obj_idx *e = NULL;
+
+	if (oid == PARTITION_OID && ot->pids) {
+		if (type == PARTITION && collbm_add(ot->pids, pid) < 0) {
+			collbm_free(ot->pids);
+			ot->pids = NULL;
+		} else if (type == ILLEGAL_OBJ) {
+			collbm_remove(ot->pids, pid);
+		}
+	}
+
+	e = obj_idx_find(dbc, pid);
+	if (!e)
+		return;
+	if (type == ILLEGAL_OBJ) {
+		collbm_remove(e->oids, oid);
+		collbm_remove(e->cids, oid);
+	} else if ((type == USEROBJECT && collbm_add(e->oids, oid) < 0) ||
+		   (type == COLLECTION && collbm_add(e->cids, oid) < 0)) {
+		obj_idx_drop(dbc, e);
+	}
+}
+
+
 /*
  * returns:
  * -EINVAL: invalid arg
@@ -234,7 +511,7 @@ const char *obj_getname(void *ohandle)
 int obj_insert(void *ohandle, uint64_t pid, uint64_t oid, 
 	       uint32_t type)
 {
-  struct db_context *dbc = ((struct handle*)ohandle)->dbc;
+  struct db_context *dbc = db_shard(ohandle, pid);
 	int ret = 0;
 
 	TICK_TRACE(obj_insert);
@@ -248,12 +525,50 @@ repeat:
 	ret = db_exec_dms(dbc, dbc->obj->insert, ret, __func__);
 	if (ret == OSD_REPEAT)
 		goto repeat;
+	if (ret == OSD_OK)
+		obj_idx_update(dbc, pid, oid, type);
 
 	TICK_TRACE(obj_insert);
 	return ret;
 }
 
 
+/*
+ * insert objects [oid, oid+numoid) of the same type with one statement.
+ *
+ * returns:
+ * -EINVAL: invalid arg
+ * OSD_ERROR: some other error, no rows are inserted
+ * OSD_OK: success
+ */
+int obj_insert_range(void *ohandle, uint64_t pid, uint64_t oid,
+		     uint16_t numoid, uint32_t type)
+{
+	struct db_context *dbc = db_shard(ohandle, pid);
+	int ret = 0;
+	uint16_t i = 0;
+
+	assert(dbc && dbc->db && dbc->obj && dbc->obj->insrange);
+
+	if (numoid == 0)
+		return -EINVAL;
+
+repeat:
+	ret = 0;
+	ret |= sqlite3_bind_int64(dbc->obj->insrange, 1, pid);
+	ret |= sqlite3_bind_int64(dbc->obj->insrange, 2, oid);
+	ret |= sqlite3_bind_int64(dbc->obj->insrange, 3, oid + numoid - 1);
+	ret |= sqlite3_bind_int(dbc->obj->insrange, 4, type);
+	ret = db_exec_dms(dbc, dbc->obj->insrange, ret, __func__);
+	if (ret == OSD_REPEAT)
+		goto repeat;
+	for (i = 0; ret == OSD_OK && i < numoid; i++)
+		obj_idx_update(dbc, pid, oid + i, type);
+
+	return ret;
+}
+
+
 /*
  * NOTE: If the object is not present, the function completes successfully.
  *
@@ -264,7 +579,7 @@ repeat:
  */
 int obj_delete(void *ohandle, uint64_t pid, uint64_t oid)
 {
-  struct db_context *dbc = ((struct handle*)ohandle)->dbc;
+  struct db_context *dbc = db_shard(ohandle, pid);
 	int ret = 0;
 
 	assert(dbc && dbc->db && dbc->obj && dbc->obj->delete);
@@ -276,6 +591,8 @@ repeat:
 	ret = db_exec_dms(dbc, dbc->obj->delete, ret, __func__);
 	if (ret == OSD_REPEAT)
 		goto repeat;
+	if (ret == OSD_OK)
+		obj_idx_update(dbc, pid, oid, ILLEGAL_OBJ);
 
 	return ret;
 }
@@ -289,8 +606,9 @@ repeat:
  */
 int obj_delete_pid(void *ohandle, uint64_t pid)
 {
-  struct db_context *dbc = ((struct handle*)ohandle)->dbc;
+  struct db_context *dbc = db_shard(ohandle, pid);
 	int ret = 0;
+	struct obj_idx *e = NULL;
 
 	assert(dbc && dbc->db && dbc->obj && dbc->obj->delpid);
 
@@ -299,11 +617,28 @@ repeat:
 	ret = db_exec_dms(dbc, dbc->obj->delpid, ret, __func__);
 	if (ret == OSD_REPEAT)
 		goto repeat;
+	if (ret == OSD_OK && (e = obj_idx_find(dbc, pid)))
+		obj_idx_drop(dbc, e);
+	if (ret == OSD_OK)
+		obj_idx_update(dbc, pid, PARTITION_OID, ILLEGAL_OBJ);
 
 	return ret;
 }
 
 
+/*
+ * (pid, oid) was deleted from obj by a statement outside of obj.c, as
+ * mtq_remove_members does for many objects at once: forget it in the
+ * cached ids too.
+ */
+void obj_forget(void *ohandle, uint64_t pid, uint64_t oid)
+{
+	struct db_context *dbc = db_shard(ohandle, pid);
+
+	assert(dbc && dbc->obj);
+	obj_idx_update(dbc, pid, oid, ILLEGAL_OBJ);
+}
+
 /*
  * return values
  * -EINVAL: invalid args
@@ -314,12 +649,26 @@ repeat:
  */
 int obj_get_nextoid(void *ohandle, uint64_t pid, uint64_t *oid)
 {
-  struct db_context *dbc = ((struct handle*)ohandle)->dbc;
+  struct db_context *dbc = db_shard(ohandle, pid);
 	int ret = 0;
 	int bound = 0;
+	uint64_t max = 0;
+	uint64_t cmax = 0;
+	struct obj_idx *e = NULL;
 
 	assert(dbc && dbc->db && dbc->obj && dbc->obj->nextoid);
 
+	e = obj_idx_get(dbc, pid);
+	if (e) {
+		/* the partition itself is oid 0, as good as none */
+		if (!collbm_max(e->oids, &max))
+			max = 0;
+		if (collbm_max(e->cids, &cmax) && cmax > max)
+			max = cmax;
+		*oid = max + 1;
+		return OSD_OK;
+	}
+
 repeat:
 	ret = sqlite3_bind_int64(dbc->obj->nextoid, 1, pid);
 	bound = (ret == SQLITE_OK);
@@ -341,21 +690,22 @@ out:
 }
 
 
-/*
- * return values
- * -EINVAL: invalid args
- * OSD_ERROR: some other sqlite error
- * OSD_OK: success
- * 	pid = next pid if OSD has some pids
- * 	pid = 1 if pid not in db. caller must assign correct pid.
- */
-int obj_get_nextpid(void *ohandle, uint64_t *pid)
+/* the obj_get_nextpid of one shard */
+static int obj_shard_nextpid(struct db_context *dbc, uint64_t *pid)
 {
-  struct db_context *dbc = ((struct handle*)ohandle)->dbc;
 	int ret = 0;
+	uint64_t max = 0;
+	struct collbm *pids = NULL;
 
 	assert(dbc && dbc->db && dbc->obj && dbc->obj->nextpid);
 
+	pids = obj_pids_get(dbc);
+	if (pids) {
+		/* the root is pid 0, as good as none */
+		*pid = collbm_max(pids, &max) ? max + 1 : 1;
+		return OSD_OK;
+	}
+
 repeat:
 	while ((ret = sqlite3_step(dbc->obj->nextpid)) == SQLITE_BUSY);
 	if (ret == SQLITE_ROW)
@@ -369,6 +719,32 @@ out:
 	return ret;
 }
 
+/*
+ * return values
+ * -EINVAL: invalid args
+ * OSD_ERROR: some other sqlite error
+ * OSD_OK: success
+ * 	pid = next pid if OSD has some pids
+ * 	pid = 1 if pid not in db. caller must assign correct pid.
+ */
+int obj_get_nextpid(void *ohandle, uint64_t *pid)
+{
+	struct handle *h = ohandle;
+	int i = 0;
+	int ret = 0;
+	uint64_t next = 0;
+
+	*pid = 1;
+	for (i = 0; i < h->nshard; i++) {
+		ret = obj_shard_nextpid(h->shard[i], &next);
+		if (ret != OSD_OK)
+			return ret;
+		if (next > *pid)
+			*pid = next;
+	}
+	return OSD_OK;
+}
+
 
 /* 
  * NOTE: type not in arg, since USEROBJECT and COLLECTION share namespace 
@@ -384,7 +760,7 @@ out:
 int obj_ispresent(void *ohandle, char *root, uint64_t pid, uint64_t oid, 
 		  int *present)
 {
-  struct db_context *dbc = ((struct handle*)ohandle)->dbc;
+  struct db_context *dbc = db_shard(ohandle, pid);
 	int ret = 0;
 	int bound = 0;
 	*present = 0;
@@ -426,7 +802,7 @@ out:
  */
 int obj_isempty_pid(void *ohandle, char *root, uint64_t pid, int *isempty)
 {
-  struct db_context *dbc = ((struct handle*)ohandle)->dbc;
+  struct db_context *dbc = db_shard(ohandle, pid);
 	int ret = 0;
 	int bound = 0;
 	*isempty = 0;
@@ -466,7 +842,7 @@ out:
 int obj_get_type(void *ohandle, uint64_t pid, uint64_t oid, 
 		 uint8_t *obj_type)
 {
-  struct db_context *dbc = ((struct handle*)ohandle)->dbc;
+  struct db_context *dbc = db_shard(ohandle, pid);
 	int ret = 0;
 	int bound = 0;
 	*obj_type = ILLEGAL_OBJ;
@@ -512,12 +888,20 @@ int obj_get_oids_in_pid(void *ohandle, uint64_t pid,
 			uint8_t *outdata, uint64_t *used_outlen, 
 			uint64_t *add_len, uint64_t *cont_id)
 {
-  struct db_context *dbc = ((struct handle*)ohandle)->dbc;
+  struct db_context *dbc = db_shard(ohandle, pid);
 	int ret = 0;
 	sqlite3_stmt *stmt = NULL;
+	struct obj_idx *e = NULL;
 
 	assert(dbc && dbc->db && dbc->obj && dbc->obj->getoids);
 
+	e = obj_idx_get(dbc, pid);
+	if (e) {
+		collbm_list(e->oids, initial_oid, alloc_len, outdata,
+			    used_outlen, add_len, cont_id);
+		return OSD_OK;
+	}
+
 repeat:
 	ret = 0;
 	stmt = dbc->obj->getoids;
@@ -544,12 +928,20 @@ int obj_get_cids_in_pid(void *ohandle, uint64_t pid,
 			uint8_t *outdata, uint64_t *used_outlen, 
 			uint64_t *add_len, uint64_t *cont_id)
 {
-  struct db_context *dbc = ((struct handle*)ohandle)->dbc;
+  struct db_context *dbc = db_shard(ohandle, pid);
 	int ret = 0;
 	sqlite3_stmt *stmt = NULL;
+	struct obj_idx *e = NULL;
 
 	assert(dbc && dbc->db && dbc->obj && dbc->obj->getcids);
 
+	e = obj_idx_get(dbc, pid);
+	if (e) {
+		collbm_list(e->cids, initial_cid, alloc_len, outdata,
+			    used_outlen, add_len, cont_id);
+		return OSD_OK;
+	}
+
 repeat:
 	ret = 0;
 	stmt = dbc->obj->getcids;
@@ -564,6 +956,53 @@ repeat:
 }
 
 
+/*
+ * obj_get_all_pids over more than one shard: partitions are few, so the
+ * cached ids of every shard are merged and listed. A shard whose ids
+ * cannot be cached has them read straight into the merge instead.
+ */
+static int obj_merge_pids(struct handle *h, uint64_t initial_pid,
+			  uint64_t alloc_len, uint8_t *outdata,
+			  uint64_t *used_outlen, uint64_t *add_len,
+			  uint64_t *cont_id)
+{
+	int i = 0;
+	int ret = 0;
+	uint64_t pid = 0;
+	struct collbm *pids = NULL;
+	struct collbm *all = NULL;
+	struct collbm_iter it;
+
+	all = collbm_alloc();
+	if (!all)
+		return -ENOMEM;
+	for (i = 0; i < h->nshard; i++) {
+		pids = obj_pids_get(h->shard[i]);
+		if (!pids) {
+			do {
+				ret = obj_pids_read(h->shard[i], initial_pid,
+						    all);
+			} while (ret == OSD_REPEAT);
+			if (ret != OSD_OK)
+				goto out;
+			continue;
+		}
+		collbm_iter_seek(&it, pids, initial_pid);
+		while (collbm_iter_next(&it, &pid)) {
+			if (collbm_add(all, pid) < 0) {
+				ret = -ENOMEM;
+				goto out;
+			}
+		}
+	}
+	collbm_list(all, initial_pid, alloc_len, outdata, used_outlen, add_len,
+		    cont_id);
+	ret = OSD_OK;
+out:
+	collbm_free(all);
+	return ret;
+}
+
 /*
  * returns:
  * -EINVAL: invalid arg
@@ -578,9 +1017,21 @@ int obj_get_all_pids(void *ohandle, uint64_t initial_pid,
 {
   struct db_context *dbc = ((struct handle*)ohandle)->dbc;
 	int ret = 0;
+	struct collbm *pids = NULL;
 
 	assert(dbc && dbc->db && dbc->obj && dbc->obj->getpids);
 
+	if (((struct handle *)ohandle)->nshard > 1)
+		return obj_merge_pids(ohandle, initial_pid, alloc_len, outdata,
+				      used_outlen, add_len, cont_id);
+
+	pids = obj_pids_get(dbc);
+	if (pids) {
+		collbm_list(pids, initial_pid, alloc_len, outdata,
+			    used_outlen, add_len, cont_id);
+		return OSD_OK;
+	}
+
 repeat:
 	ret = sqlite3_bind_int64(dbc->obj->getpids, 1, initial_pid);
 	ret = db_exec_id_rtrvl_stmt(dbc, dbc->obj->getpids, ret, __func__,
@@ -591,4 +1042,3 @@ repeat:
 
 	return ret;
 }
-
@@ -29,10 +29,15 @@ const char *obj_getname(void *ohandle);
 int obj_insert(void *ohandle, uint64_t pid, uint64_t oid, 
 	       uint32_t type);
 
+int obj_insert_range(void *ohandle, uint64_t pid, uint64_t oid,
+		     uint16_t numoid, uint32_t type);
+
 int obj_delete(void *ohandle, uint64_t pid, uint64_t oid);
 
 int obj_delete_pid(void *ohandle, uint64_t pid);
 
+void obj_forget(void *ohandle, uint64_t pid, uint64_t oid);
+
 int obj_get_nextoid(void *ohandle, uint64_t pid, uint64_t *oid);
 
 int obj_get_nextpid(void *ohandle, uint64_t *pid);
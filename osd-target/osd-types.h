@@ -21,6 +21,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <time.h>
 
 #include "osd-util/osd-defs.h"
 
@@ -161,10 +162,37 @@ struct id_list {
 	uint64_t *ids;
 };
 
+/*
+ * A LIST or LIST COLLECTION that did not fit in the allocation length,
+ * kept under its list identifier so that it continues where it stopped.
+ * See list-cursor.c.
+ */
+#define LIST_CURSORS (32)
+
+struct list_cursor {
+	uint32_t list_id;  /* 0 when the slot is free */
+	uint8_t kind;      /* see list-cursor.h */
+	uint64_t pid;
+	uint64_t cid;
+	uint64_t next;     /* continuation id handed out */
+	uint64_t add_len;  /* length of the list from next on */
+	time_t expires;
+};
+
+struct list_cursors {
+	uint32_t last_id;  /* last list identifier handed out */
+	struct list_cursor c[LIST_CURSORS];
+};
+
 /* abstract declarations of db tables */
 struct coll_tab;
 struct obj_tab;
 struct attr_tab;
+struct osd_backend;
+struct kv_db;
+struct attr_types;
+struct reaper;
+struct idle;
 
 /*
  * 'osd_context' will replace 'osd_device' in future. Each osd context is a
@@ -180,16 +208,60 @@ struct osd_context {
 
 
 struct handle {
-  struct db_context *dbc;
+  struct db_context *dbc;	/* shard 0, see db_shard */
+  struct db_context **shard;	/* sqlite backend, nshard of them */
+  int nshard;
+  struct tune *tune;	/* sqlite backend, see tune.c */
+  struct kv_db *kv;	/* kv backend only */
+  struct attr_types *qtypes;	/* see attr_sync_query_idx */
   int fd;
 };
 
+/* where osd_open_backend spent its time, in microseconds */
+struct osd_open_times {
+	uint64_t dirs;		/* root directory skeleton */
+	uint64_t md;		/* metadata store open, created if new */
+	uint64_t query;		/* declared query types loaded */
+	uint64_t reaper;
+};
+
+/* metadata vacuum, summed over the shards since the db was opened */
+struct vacuum_stats {
+	uint64_t pages;		/* in the files now */
+	uint64_t free;		/* of them on the free lists now */
+	uint64_t slices;
+	uint64_t reclaimed;	/* pages vacuumed */
+	uint64_t usec;		/* spent in incremental_vacuum */
+};
+
+/* metadata page caches, summed over the shards */
+struct tune_stats {
+	uint64_t cache_used;	/* bytes in the page caches now */
+	uint64_t cache_hit;
+	uint64_t cache_miss;	/* pages read from the files */
+	uint64_t cache_write;	/* pages written to the files */
+	uint64_t cache_spill;	/* dirty pages written out before a commit */
+	uint64_t heap_used;	/* sqlite heap of the whole process */
+	uint64_t heap_limit;	/* soft heap limit of the whole process */
+};
+
+/* see osd_get_stats; zero where the backend has nothing to count */
+struct osd_stats {
+	struct vacuum_stats vacuum;
+	struct tune_stats cache;
+};
+
 struct osd_device {
 	char *root;
 	struct handle *handle;
+	const struct osd_backend *be;	/* bound by osd_open */
 	struct cur_cmd_attr_pg ccap;
 	struct id_cache ic;
 	struct id_list idl;
+	struct list_cursors lc;
+	struct reaper *reaper;		/* see reaper.c */
+	struct idle *idle;		/* see idle.c */
+	struct osd_open_times open_us;
 };
 
 enum {
@@ -39,6 +39,11 @@
 #include "osd-util/osd-sense.h"
 #include "list-entry.h"
 #include "io.h"
+#include "backend.h"
+#include "attr-virt.h"
+#include "list-cursor.h"
+#include "reaper.h"
+#include "idle.h"
 
 #ifdef __DBUS_STATS__
 #include "dbus/osc_osd_dbus.h"
@@ -59,38 +64,6 @@ static int os_sync_file_range(int fd, __off64_t offset, __off64_t bytes,
 }
 #endif
 
-struct incits_page_id {
-    const char root_dir_page[40];
-    const char root_info_page[40];
-    const char root_quota_page[40];
-    const char root_tmstmp_page[40];
-    const char root_policy_page[40];
-    const char part_dir_page[40];
-    const char part_info_page[40];
-    const char coll_dir_page[40];
-    const char coll_info_page[40];
-    const char user_dir_page[40];
-    const char user_info_page[40];
-    const char user_tmstmp_page[40];
-    const char user_atomic_page[40];
-};
-
-static const struct incits_page_id incits = {
-    .root_dir_page = 	"INCITS  T10 Root Directory             ",
-    .root_info_page =       "INCITS  T10 Root Information           ",
-    .root_quota_page =      "INCITS  T10 Root Quotas                ",
-    .root_tmstmp_page =     "INCITS  T10 Root Timestamps            ",
-    .root_policy_page =     "INCITS  T10 Root Policy/Security       ",
-    .part_dir_page =        "INCITS  T10 Partition Directory        ",
-    .part_info_page =       "INCITS  T10 Partition Information      ",
-    .coll_dir_page =        "INCITS  T10 Collection Directory       ",
-    .coll_info_page =       "INCITS  T10 Collection Information     ",
-    .user_dir_page =        "INCITS  T10 User Object Directory      ",
-    .user_info_page =       "INCITS  T10 User Object Information    ",
-    .user_tmstmp_page =     "INCITS  T10 User Object Timestamps     ",
-    .user_atomic_page = 	"INCITS  T10 User Atomics               ",
-};
-
 static inline uint8_t get_obj_type(struct osd_device *osd,
         uint64_t pid, uint64_t oid)
 {
@@ -102,7 +75,7 @@ static inline uint8_t get_obj_type(struct osd_device *osd,
     } else if (pid >= PARTITION_PID_LB && oid == PARTITION_OID) {
         return PARTITION;
     } else if (pid >= OBJECT_PID_LB && oid >= OBJECT_OID_LB) {
-        ret = obj_get_type(osd->handle, pid, oid, &obj_type);
+        ret = osd->be->obj_get_type(osd->handle, pid, oid, &obj_type);
         if (ret == OSD_OK)
             return obj_type;
     }
@@ -153,6 +126,9 @@ static int issettable_page(uint8_t obj_type, uint32_t page)
             return false;
     }
 
+    if (obj_type == ROOT && page == ROOT_QUERY_PG)
+        return true;
+
     rel_page = get_rel_page(obj_type, page);
     osd_debug("%s: rel_page %llu", __func__, llu(page));
     if ((STD_PG_LB <= rel_page && rel_page <= STD_PG_UB) ||
@@ -545,7 +521,7 @@ static int get_uiap(struct osd_device *osd, uint64_t pid, uint64_t oid,
     off_t sz =0;
 
 
-    ret = attr_get_attr(osd, pid, oid, page, number, outlen, outbuf, 
+    ret = osd->be->attr_get_attr(osd, pid, oid, page, number, outlen, outbuf, 
             listfmt, used_outlen);
     if(ret)
     {
@@ -571,7 +547,7 @@ static int set_uiap(struct osd_device *osd, uint64_t pid, uint64_t oid,
     osd_debug("%s: pid %llu oid %llu num %llu val %s\n", __func__, llu(pid), llu(oid), llu(number), (const char *)val);
     switch (number) {
         case UIAP_USERNAME:
-            return attr_set_conversion(osd->handle, pid, oid, USER_INFO_PG, number, val, len);
+            return osd->be->attr_set_conversion(osd->handle, pid, oid, USER_INFO_PG, number, val, len);
         case UIAP_LOGICAL_LEN: 
             len = get_ntohll((const uint8_t *)val);
             get_dfile_name(path, osd->root, pid, oid);
@@ -609,7 +585,7 @@ static int get_riap(struct osd_device *osd, uint64_t pid, uint64_t oid,
         uint32_t page, uint32_t number, void *outbuf,
         uint64_t outlen, uint8_t listfmt, uint32_t *used_outlen)
 {
-    return attr_get_attr(osd, pid, oid, 
+    return osd->be->attr_get_attr(osd, pid, oid, 
             page, number, outlen, outbuf, listfmt,
             used_outlen);
 
@@ -635,10 +611,47 @@ static int set_riap(struct osd_device *osd, uint64_t pid, uint64_t oid,
         }
     }
 
-    return attr_set_attr(osd, pid, oid, ROOT_INFO_PG,
+    return osd->be->attr_set_attr(osd, pid, oid, ROOT_INFO_PG,
             number, val, len);
 }
 
+/*
+ * Declare (len 8, or 12 with a value type) or withdraw (len 0) a
+ * queryable user object attribute, then rebuild the set of value indexes
+ * to match.
+ *
+ * returns:
+ * OSD_ERROR: for error
+ * OSD_OK: on success
+ */
+static int set_rqp(struct osd_device *osd, uint64_t pid, uint64_t oid,
+        uint32_t number, const void *val, uint16_t len)
+{
+    int ret = 0;
+
+    if (len == 0) {
+        ret = osd->be->attr_delete_attr(osd->handle, pid, oid, ROOT_QUERY_PG, number);
+    } else if (number == ATTRNUM_INFO) {
+        ret = osd->be->attr_set_attr(osd, pid, oid, ROOT_QUERY_PG, number, val, len);
+    } else {
+        /* QUERY only matches user object pages, osd2r01 p 120 */
+        if (len != ROOT_QUERY_ATTR_LEN && len != ROOT_QUERY_TYPED_ATTR_LEN)
+            return OSD_ERROR;
+        if (get_ntohl(val) >= PARTITION_PG)
+            return OSD_ERROR;
+        if (len == ROOT_QUERY_TYPED_ATTR_LEN &&
+                get_ntohl((const uint8_t *)val + 8) > ROOT_QUERY_STRING)
+            return OSD_ERROR;
+        ret = osd->be->attr_set_attr(osd, pid, oid, ROOT_QUERY_PG, number, val, len);
+    }
+    if (ret != OSD_OK)
+        return OSD_ERROR;
+    if (number == ATTRNUM_INFO)
+        return OSD_OK;
+
+    return osd->be->attr_sync_query_idx(osd->handle);
+}
+
 /*
  * returns:
  * OSD_ERROR: for error
@@ -663,11 +676,11 @@ static int set_cap(struct osd_device *osd, uint64_t pid, uint64_t oid,
          * Other queries might have to be modified to reflect this
          * development
          */
-        ret = coll_get_cid(osd->handle, pid, oid, number, &cid);
+        ret = osd->be->coll_get_cid(osd->handle, pid, oid, number, &cid);
         if (ret != 0)
             return OSD_ERROR;
 
-        ret = coll_delete(osd->handle, pid, cid, oid);
+        ret = osd->be->coll_delete(osd->handle, pid, cid, oid);
         if (ret != 0)
             return OSD_ERROR;
 
@@ -678,11 +691,11 @@ static int set_cap(struct osd_device *osd, uint64_t pid, uint64_t oid,
         return OSD_ERROR;
 
     cid = get_ntohll(val);
-    ret = obj_ispresent(osd->handle, osd->root, pid, cid, &present);
+    ret = osd->be->obj_ispresent(osd->handle, osd->root, pid, cid, &present);
     if (ret != OSD_OK || !present)
         return OSD_ERROR;
 
-    ret = coll_insert(osd->handle, pid, cid, oid, number);
+    ret = osd->be->coll_insert(osd->handle, pid, cid, oid, number);
     if (ret != 0)
         return OSD_ERROR;
 
@@ -709,7 +722,7 @@ int osd_initialize_db(struct osd_device *osd)
     memset(&osd->idl, 0, sizeof(osd->idl));
 
     /* tables already created by osd_db_open, so insertions can be done */
-    ret = obj_insert(osd->handle, ROOT_PID, ROOT_OID, ROOT);
+    ret = osd->be->obj_insert(osd->handle, ROOT_PID, ROOT_OID, ROOT);
     if (ret)
     {
         osd_error("%s: !obj_insert %d", __func__, ret);
@@ -721,7 +734,7 @@ int osd_initialize_db(struct osd_device *osd)
         struct init_attr *ia = &root_info[i];
         osd_debug("%s: setting root obj attr page %llu name %llu val %s\n", __func__, llu(ia->page), 
                 llu(ia->number), (const char *)ia->s);
-        ret = _attr_set_attr(osd->handle, ROOT_PID , ROOT_OID, 
+        ret = osd->be->_attr_set_attr(osd->handle, ROOT_PID , ROOT_OID, 
                 ia->page, ia->number, ia->s, strlen(ia->s)+1);
         if (ret)
         {
@@ -739,7 +752,7 @@ int osd_initialize_db(struct osd_device *osd)
         struct init_attr *ia = &partition_info[i];
         osd_debug("%s: setting zero page %llu name %llu val %s\n", __func__, llu(ia->page), 
                 llu(ia->number), (const char *)ia->s);
-        ret = _attr_set_attr(osd->handle, ROOT_PID, ROOT_OID, 
+        ret = osd->be->_attr_set_attr(osd->handle, ROOT_PID, ROOT_OID, 
                 ia->page, ia->number, ia->s, strlen(ia->s)+1);
         if (ret)
         {
@@ -750,7 +763,7 @@ int osd_initialize_db(struct osd_device *osd)
 
     /* assign pid as attr, osd2r00 Section 7.1.2.9 table 92  */
     osd_debug("%s: setting pid infopg num 1 pid %llu\n", __func__, llu(pid));
-    ret = attr_set_attr(osd, ROOT_PID, ROOT_OID, PARTITION_PG+1, 1,
+    ret = osd->be->attr_set_attr(osd, ROOT_PID, ROOT_OID, PARTITION_PG+1, 1,
             &pid, sizeof(pid));
     if(ret)
     {
@@ -777,10 +790,66 @@ void osd_device_free(struct osd_device *osd)
 
 int osd_open(const char *root, struct osd_device *osd)
 {
+    return osd_open_backend(root, NULL, osd);
+}
+
+/*
+ * Open the OSD at root with the named backend; NULL picks the default,
+ * see osd_backend_lookup.
+ */
+int osd_open_backend(const char *root, const char *backend,
+        struct osd_device *osd)
+{
+    int ret = 0;
+    const struct osd_backend *be = NULL;
+    struct osd_open_times *t = &osd->open_us;
+    uint64_t start = osd_now_us();
+    uint64_t now = 0;
+
+    osd_debug("%s: root %s backend %s", __func__, root,
+            backend ? backend : "default");
+
+    be = osd_backend_lookup(backend);
+    if (!be) {
+        ret = -EINVAL;
+        goto out;
+    }
+    /* before open, which would make a store of its own in root */
+    ret = osd_backend_check(root, be);
+    if (ret != 0)
+        goto out;
 
-    osd_debug("%s: root %s", __func__, root);
+    osd->be = be;
+    list_cursors_reset(&osd->lc);
+    memset(t, 0, sizeof(*t));
+    ret = be->open(root, osd);  /* sets t->dirs */
+    now = osd_now_us();
+    t->md = now - start - t->dirs;
+    if (ret != 0)
+        goto out;
+    ret = osd_backend_record(root, be);
+    if (ret != 0) {
+        be->close(osd);
+        goto out;
+    }
+    /* load the declared query types */
+    ret = be->attr_sync_query_idx(osd->handle);
+    if (ret != 0) {
+        be->close(osd);
+        goto out;
+    }
+    t->query = osd_now_us() - now;
+    now += t->query;
+    ret = reaper_start(osd);
+    if (ret != 0) {
+        be->close(osd);
+        goto out;
+    }
+    t->reaper = osd_now_us() - now;
 
-    int ret = setup_root_paths(root, osd);
+    osd_info("%s: %s opened in %llu us: dirs %llu md %llu query %llu "
+            "reaper %llu", __func__, root, llu(now + t->reaper - start),
+            llu(t->dirs), llu(t->md), llu(t->query), llu(t->reaper));
 
 #ifdef __DBUS_STATS__
     gsh_dbus_pkginit();
@@ -794,13 +863,57 @@ out:
     return ret;
 }
 
+int osd_close(struct osd_device *osd)
+{
+    idle_stop(osd);
+    reaper_stop(osd);
+    return osd->be->close(osd);
+}
+
+int osd_begin_txn(struct osd_device *osd)
+{
+    return osd->be->begin_txn(osd);
+}
+
+int osd_end_txn(struct osd_device *osd)
+{
+    return osd->be->end_txn(osd);
+}
+
+/*
+ * Hand some free metadata space back to the file system. The idle thread
+ * of idle.c calls this between commands: with idle set when none came
+ * for a tick, and again while it returns 1 and none comes; without when
+ * they keep coming, which only reclaims from a store with much of it
+ * free.
+ *
+ * returns:
+ * 1: there is more to reclaim
+ * 0: there is not
+ */
+int osd_vacuum(struct osd_device *osd, int idle)
+{
+    return osd->be->vacuum(osd->handle, idle);
+}
+
+/*
+ * Counters of the metadata store for monitoring; those the backend does
+ * not keep are zero.
+ */
+void osd_get_stats(struct osd_device *osd, struct osd_stats *st)
+{
+    memset(st, 0, sizeof(*st));
+    osd->be->vacuum_stats(osd->handle, &st->vacuum);
+    osd->be->cache_stats(osd->handle, &st->cache);
+}
+
 int osd_set_name(struct osd_device *osd, char *osdname)
 {
     int ret = 0;
 
     osd_info("Setting osdname => %s",osdname);
 
-    ret = attr_set_attr(osd, 0, 0, ROOT_INFO_PG, RIAP_OSD_NAME,
+    ret = osd->be->attr_set_attr(osd, 0, 0, ROOT_INFO_PG, RIAP_OSD_NAME,
             osdname, strlen(osdname));
 
     if ( OSD_OK != ret){
@@ -1083,24 +1196,13 @@ static int osd_init_attr(struct osd_device *osd, uint64_t pid, uint64_t oid)
     uint64_t val = 0;
 
     osd_debug("%s: pid %llu oid %llu num 0\n", __func__, llu(pid), llu(oid)); 
-    ret = attr_set_attr(osd, pid, oid, USER_TMSTMP_PG, 0,
-            incits.user_tmstmp_page,
-            sizeof(incits.user_tmstmp_page));
-    if (ret != 0)
-        return ret;
-
-    ret = attr_set_attr(osd, pid, oid, USER_ATOMICS_PG, 0,
-            incits.user_atomic_page,
-            sizeof(incits.user_atomic_page));
-    if (ret != 0)
-        return ret;
-
+    /* page names are virtual, see attr-virt.c */
     val = 0;
-    ret = attr_set_attr(osd, pid, oid, USER_ATOMICS_PG, UAP_CAS,
+    ret = osd->be->attr_set_attr(osd, pid, oid, USER_ATOMICS_PG, UAP_CAS,
             &val, sizeof(val));
     if (ret != 0)
         return ret;
-    ret = attr_set_attr(osd, pid, oid, USER_ATOMICS_PG, UAP_FA, &val,
+    ret = osd->be->attr_set_attr(osd, pid, oid, USER_ATOMICS_PG, UAP_FA, &val,
             sizeof(val));
     if (ret != 0)
         return ret;
@@ -1195,16 +1297,16 @@ int osd_copy_user_objects(struct osd_device *osd, uint64_t pid, uint64_t request
     source_oid = get_ntohll(&cuos->source_oid);
 
     /* verify that source_pid & source_oid exist */
-    ret = obj_ispresent(osd->handle, osd->root, source_pid, PARTITION_OID, &present);
+    ret = osd->be->obj_ispresent(osd->handle, osd->root, source_pid, PARTITION_OID, &present);
     if (ret != OSD_OK || !present)
         goto out_cdb_err;
 
-    ret = obj_ispresent(osd->handle, osd->root, source_pid, source_oid, &present);
+    ret = osd->be->obj_ispresent(osd->handle, osd->root, source_pid, source_oid, &present);
     if (ret != OSD_OK || !present)
         goto out_cdb_err;
 
     /* verify that destination_pid exists */
-    ret = obj_ispresent(osd->handle, osd->root, pid, PARTITION_OID, &present);
+    ret = osd->be->obj_ispresent(osd->handle, osd->root, pid, PARTITION_OID, &present);
     if (ret != OSD_OK || !present)
         goto out_cdb_err;
 
@@ -1213,7 +1315,7 @@ int osd_copy_user_objects(struct osd_device *osd, uint64_t pid, uint64_t request
             oid = osd->ic.next_id;
             osd->ic.next_id++;
         } else {
-            ret = obj_get_nextoid(osd->handle, pid, &oid);
+            ret = osd->be->obj_get_nextoid(osd->handle, pid, &oid);
             if (ret != 0)
                 goto out_hw_err;
             osd->ic.cur_pid = pid;
@@ -1224,7 +1326,7 @@ int osd_copy_user_objects(struct osd_device *osd, uint64_t pid, uint64_t request
             osd->ic.next_id = oid + 1;
         }  
     } else {
-        ret = obj_ispresent(osd->handle, osd->root, pid, requested_oid, &present);
+        ret = osd->be->obj_ispresent(osd->handle, osd->root, pid, requested_oid, &present);
         if (ret != OSD_OK || present)
             goto out_cdb_err; /* requested_oid exists! */
         oid = requested_oid; /* requested_oid works! */
@@ -1281,7 +1383,7 @@ int osd_create(struct osd_device *osd, uint64_t pid, uint64_t requested_oid,
         goto out_illegal_req;
 
     /* Make sure partition is present. */
-    ret = obj_ispresent(osd->handle, osd->root, pid, PARTITION_OID, &present);
+    ret = osd->be->obj_ispresent(osd->handle, osd->root, pid, PARTITION_OID, &present);
     if (ret != OSD_OK || !present)
         goto out_illegal_req;
 
@@ -1297,7 +1399,7 @@ int osd_create(struct osd_device *osd, uint64_t pid, uint64_t requested_oid,
             oid = osd->ic.next_id;
             osd->ic.next_id++;
         } else {
-            ret = obj_get_nextoid(osd->handle, pid, &oid);
+            ret = osd->be->obj_get_nextoid(osd->handle, pid, &oid);
             if (ret != 0)
                 goto out_hw_err;
             osd->ic.cur_pid = pid;
@@ -1308,7 +1410,7 @@ int osd_create(struct osd_device *osd, uint64_t pid, uint64_t requested_oid,
             osd->ic.next_id = oid + 1;
         }
     } else {
-        ret = obj_ispresent(osd->handle, osd->root, pid, requested_oid, &present);
+        ret = osd->be->obj_ispresent(osd->handle, osd->root, pid, requested_oid, &present);
         if (ret != OSD_OK || present)
             goto out_illegal_req; /* requested_oid exists! */
         oid = requested_oid; /* requested_oid works! */
@@ -1320,18 +1422,20 @@ int osd_create(struct osd_device *osd, uint64_t pid, uint64_t requested_oid,
     if (numoid == 0)
         numoid = 1; /* create atleast one object */
 
-    for (i = oid; i < (oid + numoid); i++) {
-        ret = obj_insert(osd->handle, pid, i, USEROBJECT);
-        if (ret != 0) {
-            osd_remove_tmp_objects(osd, pid, oid, i, sense, cdb_cont_len);
-            osd_debug("%s: obj_insert failed ret %d", __func__, ret);
-            goto out_hw_err;
-        }
+    /* all objects of a multi-object create go in with one insert */
+    ret = osd->be->obj_insert_range(osd->handle, pid, oid, numoid, USEROBJECT);
+    if (ret != 0) {
+        osd_debug("%s: obj_insert_range failed ret %d", __func__, ret);
+        goto out_hw_err;
+    }
 
+    for (i = oid; i < (oid + numoid); i++) {
         TICK_TRACE(osd_create_datafile);
-        ret = osd_create_datafile(osd, pid, i);
+        ret = osd->be->osd_create_datafile(osd, pid, i);
         if (ret != 0) {
-            obj_delete(osd->handle, pid, i);
+            uint64_t j;
+            for (j = i; j < (oid + numoid); j++)
+                osd->be->obj_delete(osd->handle, pid, j);
             osd_remove_tmp_objects(osd, pid, oid, i, sense, cdb_cont_len);
             osd_debug("%s: obj_create_datafile failed ret %d", __func__, ret);
             goto out_hw_err;
@@ -1343,7 +1447,7 @@ int osd_create(struct osd_device *osd, uint64_t pid, uint64_t requested_oid,
             char path[MAXNAMELEN];
             get_dfile_name(path, osd->root, pid, i);
             unlink(path);
-            obj_delete(osd->handle, pid, i);
+            osd->be->obj_delete(osd->handle, pid, i);
             osd_remove_tmp_objects(osd, pid, oid, i, sense, cdb_cont_len);
             goto out_hw_err;
         }
@@ -1411,7 +1515,7 @@ int osd_create_collection(struct osd_device *osd, uint64_t pid,
         goto out_cdb_err;
 
     /* Make sure partition is present */
-    ret = obj_ispresent(osd->handle, osd->root, pid, PARTITION_OID, &present);
+    ret = osd->be->obj_ispresent(osd->handle, osd->root, pid, PARTITION_OID, &present);
     if (ret != OSD_OK || !present)
         goto out_cdb_err;
 
@@ -1428,7 +1532,7 @@ int osd_create_collection(struct osd_device *osd, uint64_t pid,
             cid = osd->ic.next_id;
             osd->ic.next_id++;
         } else {
-            ret = obj_get_nextoid(osd->handle, pid, &cid);
+            ret = osd->be->obj_get_nextoid(osd->handle, pid, &cid);
             if (ret != 0)
                 goto out_hw_err;
             osd->ic.cur_pid = pid;
@@ -1440,7 +1544,7 @@ int osd_create_collection(struct osd_device *osd, uint64_t pid,
         }
     } else {
         /* Make sure requested_cid doesn't already exist */
-        ret = obj_ispresent(osd->handle, osd->root, pid, requested_cid, &present);
+        ret = osd->be->obj_ispresent(osd->handle, osd->root, pid, requested_cid, &present);
         if (ret != OSD_OK || present)
             goto out_cdb_err;
         cid = requested_cid;
@@ -1450,7 +1554,7 @@ int osd_create_collection(struct osd_device *osd, uint64_t pid,
     }
 
     /* if cid already exists, obj_insert will fail */
-    ret = obj_insert(osd->handle, pid, cid, COLLECTION);
+    ret = osd->be->obj_insert(osd->handle, pid, cid, COLLECTION);
     if (ret)
         goto out_cdb_err;
 
@@ -1485,7 +1589,7 @@ int osd_create_partition(struct osd_device *osd, uint64_t requested_pid,
         goto out_cdb_err;
 
     if (requested_pid == 0) {
-        ret = obj_get_nextpid(osd->handle, &pid);
+        ret = osd->be->obj_get_nextpid(osd->handle, &pid);
         if (ret != 0)
             goto out_hw_err;
         if (pid == 1)
@@ -1495,7 +1599,7 @@ int osd_create_partition(struct osd_device *osd, uint64_t requested_pid,
     }
 
     /* if pid already exists, obj_insert will fail */
-    ret = obj_insert(osd->handle, pid, PARTITION_OID, PARTITION);
+    ret = osd->be->obj_insert(osd->handle, pid, PARTITION_OID, PARTITION);
     if (ret)
         goto out_cdb_err;
 
@@ -1549,12 +1653,12 @@ int osd_create_user_tracking_collection(struct osd_device *osd, uint64_t pid,
         goto out_cdb_err;
 
     /* Make sure partition is present */
-    ret = obj_ispresent(osd->handle, osd->root, pid, PARTITION_OID, &present);
+    ret = osd->be->obj_ispresent(osd->handle, osd->root, pid, PARTITION_OID, &present);
     if (ret != OSD_OK || !present)
         goto out_cdb_err;
 
     /* Make sure source collection is present */
-    ret = obj_ispresent(osd->handle, osd->root, pid, source_cid, &present);
+    ret = osd->be->obj_ispresent(osd->handle, osd->root, pid, source_cid, &present);
     if (ret != OSD_OK || !present)
         goto out_cdb_err;
 
@@ -1585,7 +1689,7 @@ int osd_create_user_tracking_collection(struct osd_device *osd, uint64_t pid,
             cid = osd->ic.next_id;
             osd->ic.next_id++;
         }else {
-            ret = obj_get_nextoid(osd->handle, pid, &cid);
+            ret = osd->be->obj_get_nextoid(osd->handle, pid, &cid);
             if (ret != 0)
                 goto out_hw_err;
             osd->ic.cur_pid = pid;
@@ -1599,7 +1703,7 @@ int osd_create_user_tracking_collection(struct osd_device *osd, uint64_t pid,
 
     else {
         /* Make sure requested_cid doesn't already exist */
-        ret = obj_ispresent(osd->handle, osd->root, pid, requested_cid, &present);
+        ret = osd->be->obj_ispresent(osd->handle, osd->root, pid, requested_cid, &present);
         if (ret != OSD_OK || present)
             goto out_cdb_err;
         cid = requested_cid;
@@ -1610,13 +1714,13 @@ int osd_create_user_tracking_collection(struct osd_device *osd, uint64_t pid,
 
     if (source_cid != 0) {
         /* Copy source collection members to destination collection */ 
-        ret = coll_copyoids(osd->handle, pid, cid, source_cid);
+        ret = osd->be->coll_copyoids(osd->handle, pid, cid, source_cid);
         if (ret != 0)
             goto out_hw_err;
     }
 
     /* if cid already exists, obj_insert will fail */
-    ret = obj_insert(osd->handle, pid, cid, COLLECTION);
+    ret = osd->be->obj_insert(osd->handle, pid, cid, COLLECTION);
     if (ret)
         goto out_cdb_err;
 
@@ -1750,10 +1854,7 @@ int osd_flush_partition(struct osd_device *osd, uint64_t pid, int flush_scope,
 int osd_format_osd(struct osd_device *osd, uint64_t capacity, uint32_t cdb_cont_len, uint8_t *sense)
 {
 
-    int ret = format_osd(osd, capacity, cdb_cont_len, sense);
-
-    free(osd->root);
-    return ret;
+    return osd->be->format_osd(osd, capacity, cdb_cont_len, sense);
 }
 
     static inline int
@@ -1765,17 +1866,22 @@ mutiplex_getattr_list(struct osd_device *osd, uint64_t pid, uint64_t oid,
     osd_debug("%s: page %llu number %llu", __func__, llu(page), llu(number));
 
     if (page == GETALLATTR_PG && number == ATTRNUM_GETALL) {
-        return attr_get_all_attrs(osd->handle, pid, oid, outlen, outbuf,
+        return osd->be->attr_get_all_attrs(osd->handle, pid, oid, outlen, outbuf,
                 listfmt, used_outlen);
+    } else if ((page == USEROBJECT_DIR_PG || page == PARTITION_DIR_PG ||
+                page == COLLECTION_DIR_PG || page == ROOT_DIR_PG) &&
+            number == ATTRNUM_GETALL) {
+        return osd->be->attr_get_dir_page(osd->handle, pid, oid, page, outlen,
+                outbuf, listfmt, used_outlen);
     } else if (page != GETALLATTR_PG && number == ATTRNUM_GETALL) {
-        return attr_get_page_as_list(osd->handle, pid, oid, page, outlen,
+        return osd->be->attr_get_page_as_list(osd->handle, pid, oid, page, outlen,
                 outbuf, listfmt, used_outlen);
     } else if (page == GETALLATTR_PG && number != ATTRNUM_GETALL) {
-        return attr_get_for_all_pages(osd->handle, pid, oid, number,
+        return osd->be->attr_get_for_all_pages(osd->handle, pid, oid, number,
                 outlen, outbuf, listfmt,
                 used_outlen);
     } else {
-        return attr_get_conversion(osd->handle, pid, oid, 
+        return osd->be->attr_get_conversion(osd->handle, pid, oid, 
                 page, number, outlen, outbuf, listfmt, used_outlen);
 
     }
@@ -1799,20 +1905,26 @@ mutiplex_getattr_list(struct osd_device *osd, uint64_t pid, uint64_t oid,
  * page is requested we don't have attr num 0, which defines name of the
  * page. However, if the user has explicitly defined the name of the page,
  * then it would be returned if all the attributes of the page are requested.
+ * Names of the standard pages are virtual attributes and are filled in.
  */
 static int fill_null_attr(struct osd_device *osd, uint64_t pid, uint64_t oid,
         uint32_t page, uint32_t number, uint8_t *outbuf,
         uint32_t outlen, uint8_t listfmt)
 {
     int ret;
+    uint16_t len = 0;
+    const void *val = NULL;
 
     if (page != GETALLATTR_PG && number != ATTRNUM_GETALL) {
+        val = attr_virt_get(page, number);
+        if (val)
+            len = ATTR_PAGE_ID_LEN;
         if (listfmt == RTRVD_CREATE_MULTIOBJ_LIST)
             ret = le_multiobj_pack_attr(outbuf, outlen, oid,
-                    page, number, 0, NULL);
+                    page, number, len, val);
         else
-            ret = le_pack_attr(outbuf, outlen, page, number, 0,
-                    NULL);
+            ret = le_pack_attr(outbuf, outlen, page, number, len,
+                    val);
     } else {
         ret = 0;
     }
@@ -1821,84 +1933,18 @@ static int fill_null_attr(struct osd_device *osd, uint64_t pid, uint64_t oid,
 }
 
 /*
- * XXX:SD We do lazy initialization of non-essential attributes to save time
- * on critical path for core operations like create.  Therefore if any of the
- * non-essential attributes are gotten then we need to set them before
- * accessing them.
+ * Retrieve one (page, number) of an object already checked by the caller.
  *
- * returns:
- * OSD_OK: success
- * OSD_ERROR: some error
- * -EINVAL: invalid arg in downstream function
- */
-static int lazy_init_attr(struct osd_device *osd, uint64_t pid, uint64_t oid,
-        uint32_t page, uint32_t number)
-{
-    int ret;
-    char val[40];
-    uint32_t used_outlen;
-
-    if ((page != GETALLATTR_PG && number != ATTRNUM_GETALL) ||
-            (page <= USER_ATOMICS_PG && number > 0) ||
-            (page >  USER_ATOMICS_PG && page != GETALLATTR_PG))
-        return OSD_OK; /* nothing to be done */
-
-    osd_debug("%s: pid %llu oid %llu page %llu num %llu \n", __func__, llu(pid), llu(oid), llu(page), llu(number));
-    /* check if attrs are already defined */
-    ret = attr_get_val(osd->handle, pid, oid, USER_TMSTMP_PG, 0, 40, val,
-            &used_outlen);
-    if (ret == OSD_OK)
-        return OSD_OK; /* attrs already defined */
-    else if (ret != -ENOENT)
-        return ret;
-
-    /* now initialize the attrs */
-    ret = attr_set_attr(osd, pid, oid, USER_TMSTMP_PG, 0,
-            incits.user_tmstmp_page,
-            sizeof(incits.user_tmstmp_page));
-    if (ret != OSD_OK)
-        return ret;
-
-    ret = attr_set_attr(osd, pid, oid, USER_ATOMICS_PG, 0,
-            incits.user_atomic_page,
-            sizeof(incits.user_atomic_page));
-    if (ret != OSD_OK)
-        return ret;
-
-    return OSD_OK;
-}
-
-/*
  * returns:
  * == OSD_OK: success, used_outlen modified
  *  >0: failed, sense set accordingly
  */
-int osd_getattr_list(struct osd_device *osd, uint64_t pid, uint64_t oid,
+static int getattr_one(struct osd_device *osd, uint64_t pid, uint64_t oid,
         uint32_t page, uint32_t number, uint8_t *outbuf,
         uint32_t outlen, uint8_t isembedded, uint8_t listfmt,
-        uint32_t *used_outlen, uint32_t cdb_cont_len, uint8_t *sense)
+        uint32_t *used_outlen, uint8_t *sense)
 {
     int ret = 0;
-    uint8_t obj_type = 0;
-
-    assert(osd && osd->root && osd->handle && outbuf && used_outlen && sense);
-
-    obj_type = get_obj_type(osd, pid, oid);
-    if (obj_type == ILLEGAL_OBJ) {
-        osd_error("%s: get_obj_type returned %d", __func__, obj_type);
-        goto out_cdb_err;
-    }
-
-    if (isgettable_page(obj_type, page) == false) {
-        osd_error("%s: isgettable_page returned false", __func__);
-        goto out_param_list;
-    }
-
-    ret = lazy_init_attr(osd, pid, oid, page, number);
-    if (ret != OSD_OK) {
-        osd_error("%s: lazy_init_attr returned %d", __func__, ret);
-        goto out_hw_err;
-    }
 
     switch (page) {
         case CUR_CMD_ATTR_PG:
@@ -1921,7 +1967,7 @@ int osd_getattr_list(struct osd_device *osd, uint64_t pid, uint64_t oid,
                     outlen, listfmt, used_outlen);
             break;
         default:
-            osd_error("%s: page %llu num %llu pid %llu oid %llu", __func__, 
+            osd_debug("%s: page %llu num %llu pid %llu oid %llu", __func__, 
                     llu(page), llu(number), llu(pid), llu(oid));
             ret = mutiplex_getattr_list(osd, pid, oid, page,
                     number, outbuf, outlen,
@@ -1949,6 +1995,45 @@ int osd_getattr_list(struct osd_device *osd, uint64_t pid, uint64_t oid,
             goto out_param_list;
     }
 
+    return OSD_OK;
+
+out_param_list:
+    return sense_build_sdd(sense, OSD_SSK_ILLEGAL_REQUEST,
+            OSD_ASC_INVALID_FIELD_IN_PARAM_LIST,
+            pid, oid);
+}
+
+/*
+ * returns:
+ * == OSD_OK: success, used_outlen modified
+ *  >0: failed, sense set accordingly
+ */
+int osd_getattr_list(struct osd_device *osd, uint64_t pid, uint64_t oid,
+        uint32_t page, uint32_t number, uint8_t *outbuf,
+        uint32_t outlen, uint8_t isembedded, uint8_t listfmt,
+        uint32_t *used_outlen, uint32_t cdb_cont_len, uint8_t *sense)
+{
+    int ret = 0;
+    uint8_t obj_type = 0;
+
+    assert(osd && osd->root && osd->handle && outbuf && used_outlen && sense);
+
+    obj_type = get_obj_type(osd, pid, oid);
+    if (obj_type == ILLEGAL_OBJ) {
+        osd_error("%s: get_obj_type returned %d", __func__, obj_type);
+        goto out_cdb_err;
+    }
+
+    if (isgettable_page(obj_type, page) == false) {
+        osd_error("%s: isgettable_page returned false", __func__);
+        goto out_param_list;
+    }
+
+    ret = getattr_one(osd, pid, oid, page, number, outbuf, outlen,
+            isembedded, listfmt, used_outlen, sense);
+    if (ret != OSD_OK)
+        return ret;
+
     if (!isembedded)
         fill_ccap(&osd->ccap, NULL, obj_type, pid, oid, 0);
     return OSD_OK; /* success */
@@ -1970,6 +2055,146 @@ out_hw_err:
     return ret;
 }
 
+struct getattr_list_arg {
+    struct osd_device *osd;
+    uint64_t pid;
+    const struct getattr_list *get_attr;
+    const uint8_t *indb;
+    uint8_t isembedded;
+    uint8_t listfmt;
+    uint8_t *sense;
+};
+
+/*
+ * attr_fill_t for osd_get_attr_list: entries served by the attr table that
+ * have no row are undefined, everything else goes through getattr_one.
+ */
+static int getattr_list_fill(void *arg, uint32_t idx, uint64_t oid,
+        uint8_t *buf, uint32_t buflen, uint32_t *used)
+{
+    int ret;
+    struct getattr_list_arg *ga = arg;
+    uint32_t page = ga->get_attr->le[idx].page;
+    uint32_t number = ga->get_attr->le[idx].number;
+
+    if (!ga->indb[idx])
+        return getattr_one(ga->osd, ga->pid, oid, page, number, buf,
+                buflen, ga->isembedded, ga->listfmt, used, ga->sense);
+
+    ret = fill_null_attr(ga->osd, ga->pid, oid, page, number, buf, buflen,
+            ga->listfmt);
+    if (ret == -EOVERFLOW)
+        *used = 0; /* not an error, Sec 5.2.2.2 */
+    else if (ret >= 0)
+        *used = ret;
+    else
+        return sense_build_sdd(ga->sense, OSD_SSK_ILLEGAL_REQUEST,
+                OSD_ASC_INVALID_FIELD_IN_PARAM_LIST, ga->pid, oid);
+    return OSD_OK;
+}
+
+/*
+ * Bulk form of osd_getattr_list: retrieve every entry of get_attr for the
+ * objects [oid, oid+numoid). Objects are checked once, and all plain
+ * (page, number) entries are fetched by attr_get_attr_list with a single
+ * query. The list is encoded entry-major like repeated osd_getattr_list
+ * calls would produce it.
+ *
+ * returns:
+ * == OSD_OK: success, used_outlen modified
+ *  >0: failed, sense set accordingly
+ */
+int osd_get_attr_list(struct osd_device *osd, uint64_t pid, uint64_t oid,
+        uint16_t numoid, const struct getattr_list *get_attr,
+        uint8_t *outbuf, uint32_t outlen, uint8_t isembedded,
+        uint8_t listfmt, uint32_t *used_outlen, uint32_t cdb_cont_len,
+        uint8_t *sense)
+{
+    int ret = 0;
+    uint32_t i = 0;
+    uint64_t o = 0;
+    uint8_t obj_type = 0;
+    uint8_t *indb = NULL;
+    struct getattr_list_arg arg;
+
+    assert(osd && osd->root && osd->handle && get_attr && outbuf &&
+            used_outlen && sense);
+
+    *used_outlen = 0;
+    if (get_attr->sz == 0 || numoid == 0)
+        return OSD_OK;
+
+    for (o = oid; o < oid + numoid; o++) {
+        obj_type = get_obj_type(osd, pid, o);
+        if (obj_type == ILLEGAL_OBJ)
+            goto out_cdb_err;
+
+        for (i = 0; i < get_attr->sz; i++) {
+            uint32_t page = get_attr->le[i].page;
+            uint32_t number = get_attr->le[i].number;
+
+            if (isgettable_page(obj_type, page) == false)
+                goto out_param_list;
+        }
+    }
+
+    indb = Malloc(get_attr->sz);
+    if (!indb)
+        goto out_hw_err;
+
+    for (i = 0; i < get_attr->sz; i++) {
+        uint32_t page = get_attr->le[i].page;
+        uint32_t number = get_attr->le[i].number;
+
+        switch (page) {
+            case CUR_CMD_ATTR_PG:
+            case PARTITION_DIR_PG + USER_TMSTMP_PG:
+            case USER_TMSTMP_PG:
+            case PARTITION_DIR_PG + USER_QUOTA_PG:
+            case PARTITION_DIR_PG + USER_INFO_PG:
+            case USER_INFO_PG:
+            case ROOT_INFO_PG:
+            case GETALLATTR_PG:
+                indb[i] = 0;
+                break;
+            default:
+                indb[i] = (number != ATTRNUM_GETALL);
+                break;
+        }
+    }
+
+    arg.osd = osd;
+    arg.pid = pid;
+    arg.get_attr = get_attr;
+    arg.indb = indb;
+    arg.isembedded = isembedded;
+    arg.listfmt = listfmt;
+    arg.sense = sense;
+    ret = osd->be->attr_get_attr_list(osd->handle, pid, oid, numoid, get_attr, indb,
+            getattr_list_fill, &arg, outlen, outbuf, listfmt, used_outlen);
+    free(indb);
+    if (ret > 0)
+        return ret; /* sense from getattr_list_fill */
+    else if (ret != OSD_OK)
+        goto out_param_list;
+
+    if (!isembedded)
+        fill_ccap(&osd->ccap, NULL, obj_type, pid, oid + numoid - 1, 0);
+    return OSD_OK; /* success */
+
+out_param_list:
+    return sense_build_sdd(sense, OSD_SSK_ILLEGAL_REQUEST,
+            OSD_ASC_INVALID_FIELD_IN_PARAM_LIST, pid, oid);
+
+out_cdb_err:
+    return sense_build_sdd(sense, OSD_SSK_ILLEGAL_REQUEST,
+            OSD_ASC_INVALID_FIELD_IN_CDB, pid, oid);
+
+out_hw_err:
+    return sense_build_sdd(sense, OSD_SSK_HARDWARE_ERROR,
+            OSD_ASC_INVALID_FIELD_IN_CDB, pid, oid);
+}
+
 /*
  * This function can only be used for pages that have a defined
  * format.  Those appear to be only:
@@ -2020,10 +2245,7 @@ int osd_getattr_page(struct osd_device *osd, uint64_t pid, uint64_t oid,
                     used_outlen);
             break;
         case GETALLATTR_PG:
-            ret = lazy_init_attr(osd, pid, oid, page, 0);
-            if (ret != OSD_OK)
-                goto out_hw_err;
-            ret = attr_get_all_attrs(osd->handle, pid, oid, outlen, outbuf,
+            ret = osd->be->attr_get_all_attrs(osd->handle, pid, oid, outlen, outbuf,
                     RTRVD_SET_ATTR_LIST, used_outlen);
             break;
         default:
@@ -2054,55 +2276,153 @@ out_hw_err:
 }
 
 
-int osd_get_member_attributes(struct osd_device *osd, uint64_t pid,
-        uint64_t cid, uint32_t cdb_cont_len, uint8_t *sense)
+/*
+ * Length of a list left after a page of used bytes out of its add_len,
+ * kept in its cursor for the next page.
+ */
+static inline uint64_t list_rest(uint64_t add_len, uint64_t used)
 {
-    osd_debug(__func__);
-    return osd_error_unimplemented(0, sense);
+    if (add_len == (uint64_t) -1)
+        return add_len;
+    return add_len > used ? add_len - used : 0;
 }
 
 /*
- * @outdata: pointer to start of the data-out-buffer: destination of
- * 	generated list results
+ * Returns the requested attributes of every member of collection cid in
+ * the list format of LIST with attributes, object descriptors in oid
+ * order, from one pass over the membership. A list longer than alloc_len
+ * is continued from initial_oid, or from the cursor of list_id.
  *
  * returns:
  * ==0: success, used_outlen is set
  * > 0: error, sense is set
  */
-int osd_list(struct osd_device *osd, uint8_t list_attr, uint64_t pid,
-        uint64_t alloc_len, uint64_t initial_oid,
+int osd_get_member_attributes(struct osd_device *osd, uint64_t pid,
+        uint64_t cid, uint64_t alloc_len, uint64_t initial_oid,
         struct getattr_list *get_attr, uint32_t list_id,
-        uint8_t *outdata, uint64_t *used_outlen, uint8_t *sense)
+        uint8_t *outdata, uint64_t *used_outlen,
+        uint32_t cdb_cont_len, uint8_t *sense)
 {
     int ret = 0;
-    uint8_t *cp = outdata;
+    int present = 0;
     uint64_t add_len = 0;
     uint64_t cont_id = 0;
+    struct list_cursor *lc = NULL;
 
-    osd_debug("%s: Calling...", __func__);
-    assert(osd && osd->root && osd->handle && get_attr && outdata 
+    osd_debug("%s: pid %llu cid %llu", __func__, llu(pid), llu(cid));
+
+    assert(osd && osd->root && osd->handle && get_attr && outdata
             && used_outlen && sense);
 
+    if (pid < COLLECTION_PID_LB || cid < COLLECTION_OID_LB)
+        goto out_cdb_err;
+
+    if (get_attr->sz == 0)
+        goto out_cdb_err;
+
     if (alloc_len == 0)
-        return 0; /* No space to even send the header */
+        return 0;
 
     if (alloc_len < 24) /* XXX: currently need atleast the header */
         goto out_cdb_err;
 
-    memset(outdata, 0, 24);
+    ret = osd->be->obj_ispresent(osd->handle, osd->root, pid, cid, &present);
+    if (ret != OSD_OK || !present) /* collection absent! */
+        goto out_cdb_err;
 
-    if (list_attr == 0 && get_attr->sz != 0)
-        goto out_cdb_err; /* XXX: unimplemented */
-    if (list_attr == 1 && get_attr->sz == 0)
+    if (get_obj_type(osd, pid, cid) != COLLECTION)
+        goto out_cdb_err;
+
+    if (list_id) {
+        lc = list_cursor_find(&osd->lc, list_id, LIST_CURSOR_MEMBERS, pid,
+                cid);
+        if (!lc)
+            goto out_cdb_err;
+        initial_oid = lc->next;
+        add_len = lc->add_len;
+    }
+
+    memset(outdata, 0, 24);
+    outdata[23] = (0x22 << 2);
+    alloc_len -= 24;
+    ret = osd->be->mtq_list_members_attr(osd->handle, pid, cid,
+            initial_oid, get_attr, alloc_len, &outdata[24], used_outlen,
+            &add_len, &cont_id);
+    if (ret)
+        goto out_hw_err;
+
+    list_id = list_cursor_keep(&osd->lc, lc, LIST_CURSOR_MEMBERS, pid, cid,
+            cont_id, list_rest(add_len, *used_outlen));
+    *used_outlen += 24;
+    if (add_len + 16 > add_len) /* overflow: osd2r01 Sec 6.14.2 */
+        add_len += 16;
+    else
+        add_len = (uint64_t) -1;
+    set_htonll(outdata, add_len);
+    set_htonll(&outdata[8], cont_id);
+    set_htonl(&outdata[16], list_id);
+
+    fill_ccap(&osd->ccap, NULL, COLLECTION, pid, cid, 0);
+    return OSD_OK; /* success */
+
+out_cdb_err:
+    return sense_build_sdd(sense, OSD_SSK_ILLEGAL_REQUEST,
+            OSD_ASC_INVALID_FIELD_IN_CDB, pid, cid);
+
+out_hw_err:
+    return sense_build_sdd(sense, OSD_SSK_HARDWARE_ERROR,
+            OSD_ASC_INVALID_FIELD_IN_CDB, pid, cid);
+}
+
+/*
+ * @outdata: pointer to start of the data-out-buffer: destination of
+ * 	generated list results
+ *
+ * returns:
+ * ==0: success, used_outlen is set
+ * > 0: error, sense is set
+ */
+int osd_list(struct osd_device *osd, uint8_t list_attr, uint64_t pid,
+        uint64_t alloc_len, uint64_t initial_oid,
+        struct getattr_list *get_attr, uint32_t list_id,
+        uint8_t *outdata, uint64_t *used_outlen, uint8_t *sense)
+{
+    int ret = 0;
+    uint8_t *cp = outdata;
+    uint64_t add_len = 0;
+    uint64_t cont_id = 0;
+    struct list_cursor *lc = NULL;
+
+    osd_debug("%s: Calling...", __func__);
+    assert(osd && osd->root && osd->handle && get_attr && outdata 
+            && used_outlen && sense);
+
+    if (alloc_len == 0)
+        return 0; /* No space to even send the header */
+
+    if (alloc_len < 24) /* XXX: currently need atleast the header */
+        goto out_cdb_err;
+
+    memset(outdata, 0, 24);
+
+    if (list_attr == 0 && get_attr->sz != 0)
+        goto out_cdb_err; /* XXX: unimplemented */
+    if (list_attr == 1 && get_attr->sz == 0)
         goto out_cdb_err; /* XXX: this seems like error? */
 
     if (list_attr == 0 && get_attr->sz == 0)  {
         /*
-         * If list_id is not 0, we are continuing an old list,
-         * starting from cont_id
+         * If list_id is not 0, we are continuing an old list, from
+         * where its cursor stopped
          */
-        if (list_id)
-            initial_oid = cont_id;
+        if (list_id) {
+            lc = list_cursor_find(&osd->lc, list_id, LIST_CURSOR_IDS, pid,
+                    0);
+            if (!lc)
+                goto out_cdb_err;
+            initial_oid = lc->next;
+            add_len = lc->add_len;
+        }
         outdata[23] = (0x21 << 2);
         alloc_len -= 24;
         /*
@@ -2111,17 +2431,19 @@ int osd_list(struct osd_device *osd, uint8_t list_attr, uint64_t pid,
          * unless we want attrs
          */
         ret = (pid == 0 ?
-                obj_get_all_pids(osd->handle, initial_oid, alloc_len,
+                osd->be->obj_get_all_pids(osd->handle, initial_oid, alloc_len,
                     &outdata[24], used_outlen, &add_len,
                     &cont_id)
                 :
-                obj_get_oids_in_pid(osd->handle, pid, initial_oid,
+                osd->be->obj_get_oids_in_pid(osd->handle, pid, initial_oid,
                     alloc_len, &outdata[24],
                     used_outlen, &add_len, &cont_id)
               );
         if (ret)
             goto out_hw_err;
 
+        list_id = list_cursor_keep(&osd->lc, lc, LIST_CURSOR_IDS, pid, 0,
+                cont_id, list_rest(add_len, *used_outlen));
         *used_outlen += 24;
         if (add_len + 16 > add_len) /* overflow: osd2r01 Sec 6.14.2 */
             add_len += 16;
@@ -2129,18 +2451,27 @@ int osd_list(struct osd_device *osd, uint8_t list_attr, uint64_t pid,
             add_len = (uint64_t) -1;
         set_htonll(outdata, add_len);
         set_htonll(&outdata[8], cont_id);
+        set_htonl(&outdata[16], list_id);
         osd_error("%s: add_len=%llu cont_id=0x%llu", __func__, llu(add_len), llu(cont_id));
     } else if (list_attr == 1 && get_attr->sz != 0 && pid != 0) {
-        if (list_id)
-            initial_oid = cont_id;
+        if (list_id) {
+            lc = list_cursor_find(&osd->lc, list_id, LIST_CURSOR_ATTR, pid,
+                    0);
+            if (!lc)
+                goto out_cdb_err;
+            initial_oid = lc->next;
+            add_len = lc->add_len;
+        }
         outdata[23] = (0x22 << 2);
         alloc_len -= 24;
-        ret = mtq_list_oids_attr(osd->handle, pid, initial_oid,
+        ret = osd->be->mtq_list_oids_attr(osd->handle, pid, initial_oid,
                 get_attr, alloc_len, &outdata[24],
                 used_outlen, &add_len, &cont_id);
         if (ret)
             goto out_hw_err;
 
+        list_id = list_cursor_keep(&osd->lc, lc, LIST_CURSOR_ATTR, pid, 0,
+                cont_id, list_rest(add_len, *used_outlen));
         *used_outlen += 24;
         if (add_len + 16 > add_len) /* overflow: osd2r01 Sec 6.14.2 */
             add_len += 16;
@@ -2148,6 +2479,7 @@ int osd_list(struct osd_device *osd, uint8_t list_attr, uint64_t pid,
             add_len = (uint64_t) -1;
         set_htonll(outdata, add_len);
         set_htonll(&outdata[8], cont_id);
+        set_htonl(&outdata[16], list_id);
     }
 
     /* XXX: is this correct */
@@ -2183,6 +2515,7 @@ int osd_list_collection(struct osd_device *osd, uint8_t list_attr,
     uint8_t *cp = outdata;
     uint64_t add_len = 0;
     uint64_t cont_id = 0;
+    struct list_cursor *lc = NULL;
 
     assert(osd && osd->root && osd->handle && get_attr && outdata 
             && used_outlen && sense);
@@ -2203,10 +2536,16 @@ int osd_list_collection(struct osd_device *osd, uint8_t list_attr,
     if (list_attr == 0 && get_attr->sz == 0)  {
         /*
          * If list_id is not 0, we are continuing
-         * an old list, starting from cont_id
+         * an old list, from where its cursor stopped
          */
-        if (list_id)
-            initial_oid = cont_id;
+        if (list_id) {
+            lc = list_cursor_find(&osd->lc, list_id, LIST_CURSOR_COLL, pid,
+                    cid);
+            if (!lc)
+                goto out_cdb_err;
+            initial_oid = lc->next;
+            add_len = lc->add_len;
+        }
         outdata[23] = (0x21 << 2);
         alloc_len -= 24;
         /*
@@ -2215,19 +2554,22 @@ int osd_list_collection(struct osd_device *osd, uint8_t list_attr,
          * unless we want attrs
          */
         ret = (cid == 0 ?
-                obj_get_cids_in_pid(osd->handle, pid, initial_oid,
+                osd->be->obj_get_cids_in_pid(osd->handle, pid, initial_oid,
                     alloc_len, &outdata[24],
                     used_outlen, &add_len, &cont_id)
                 :
-                coll_get_oids_in_cid(osd->handle, pid, cid, initial_oid,
+                osd->be->coll_get_oids_in_cid(osd->handle, pid, cid, initial_oid,
                     alloc_len, &outdata[24],
                     used_outlen, &add_len, &cont_id));
         if (ret)
             goto out_hw_err;
+        list_id = list_cursor_keep(&osd->lc, lc, LIST_CURSOR_COLL, pid, cid,
+                cont_id, list_rest(add_len, *used_outlen));
         *used_outlen += 24;
         add_len += 16;
         set_htonll(outdata, add_len);
         set_htonll(&outdata[8], cont_id);
+        set_htonl(&outdata[16], list_id);
 
     } else if (list_attr == 1 && get_attr->sz != 0 && cid != 0) {
         if (list_id)
@@ -2465,7 +2807,7 @@ int osd_query(struct osd_device *osd, uint64_t pid, uint64_t cid,
     if (pid < USEROBJECT_PID_LB)
         goto out_cdb_err;
 
-    ret = obj_ispresent(osd->handle, osd->root, pid, cid, &present);
+    ret = osd->be->obj_ispresent(osd->handle, osd->root, pid, cid, &present);
     if (ret != OSD_OK || !present)
         goto out_cdb_err;
 
@@ -2487,7 +2829,7 @@ int osd_query(struct osd_device *osd, uint64_t pid, uint64_t cid,
 
     memset(cp+8, 0, 4);  /* reserved area */
     cp[12] = (0x21 << 2);
-    ret = mtq_run_query(osd->handle, pid, cid, &qc, outdata, alloc_len,
+    ret = osd->be->mtq_run_query(osd->handle, pid, cid, &qc, outdata, alloc_len,
             used_outlen);
     free_qc(&qc);
     if (ret != OSD_OK)
@@ -2517,15 +2859,15 @@ int osd_read_device(struct osd_device *osd, uint64_t pid, uint64_t oid, uint64_t
 
     switch(ddt) {
         case DDT_CONTIG: {
-                             return contig_read(osd, pid, oid, len, offset, outdata,
+                             return osd->be->contig_read(osd, pid, oid, len, offset, outdata,
                                      used_outlen, sense);
                          }
         case DDT_SGL: {
-                          return sgl_read(osd, pid, oid, len, offset, sglist,
+                          return osd->be->sgl_read(osd, pid, oid, len, offset, sglist,
                                   outdata, used_outlen, sense);
                       }
         case DDT_VEC: {
-                          return vec_read(osd, pid, oid, len, offset, indata,
+                          return osd->be->vec_read(osd, pid, oid, len, offset, indata,
                                   outdata, used_outlen, sense);
                       }
         default: {
@@ -2656,7 +2998,6 @@ int osd_remove(struct osd_device *osd, uint64_t pid, uint64_t oid,
         uint32_t cdb_cont_len, uint8_t *sense)
 {
     int ret = 0;
-    char path[MAXNAMELEN];
 
     osd_debug("%s: removing userobject pid %llu oid %llu", __func__,
             llu(pid), llu(oid));
@@ -2670,27 +3011,26 @@ int osd_remove(struct osd_device *osd, uint64_t pid, uint64_t oid,
     /* XXX: invalidate ic_cache immediately */
     osd->ic.cur_pid = osd->ic.next_id = 0;
 
-    /* if userobject is absent unlink will fail */
-    get_dfile_name(path, osd->root, pid, oid);
-    ret = unlink(path);
+    /* if userobject is absent this will fail; the reaper unlinks it */
+    ret = reaper_strand(osd, pid, oid);
     if (ret != 0)
     {
-        osd_debug("%s: unlink returned %d", __func__, ret);
+        osd_debug("%s: reaper_strand returned %d", __func__, ret);
         //goto out_hw_err;
     }
 
     /* delete all attr of the object */
-    ret = attr_delete_all(osd->handle, pid, oid);
+    ret = osd->be->attr_delete_all(osd->handle, pid, oid);
     if (ret != 0)
         goto out_hw_err;
 
     /* delete all collection memberships */
-    ret = coll_delete_oid(osd->handle, pid, oid);
+    ret = osd->be->coll_delete_oid(osd->handle, pid, oid);
     if (ret != 0)
         goto out_hw_err;
     //#endif
 
-    ret = obj_delete(osd->handle, pid, oid);
+    ret = osd->be->obj_delete(osd->handle, pid, oid);
     if (ret != 0)
         goto out_hw_err;
 
@@ -2728,14 +3068,14 @@ int osd_remove_collection(struct osd_device *osd, uint64_t pid, uint64_t cid,
         goto out_cdb_err;
 
     /* make sure collection object is present */
-    ret = obj_ispresent(osd->handle, osd->root, pid, cid, &present);
+    ret = osd->be->obj_ispresent(osd->handle, osd->root, pid, cid, &present);
     if (ret != OSD_OK || !present)
         goto out_cdb_err;
 
     /* XXX: invalidate ic_cache */
     osd->ic.cur_pid = osd->ic.next_id = 0;
 
-    ret = coll_isempty_cid(osd->handle, pid, cid, &isempty);
+    ret = osd->be->coll_isempty_cid(osd->handle, pid, cid, &isempty);
     if (ret != OSD_OK)
         goto out_hw_err;
 
@@ -2743,16 +3083,16 @@ int osd_remove_collection(struct osd_device *osd, uint64_t pid, uint64_t cid,
         if (fcr == 0)
             goto out_not_empty;
 
-        ret = coll_delete_cid(osd->handle, pid, cid);
+        ret = osd->be->coll_delete_cid(osd->handle, pid, cid);
         if (ret != 0)
             goto out_hw_err;
     }
 
-    ret = attr_delete_all(osd->handle, pid, cid);
+    ret = osd->be->attr_delete_all(osd->handle, pid, cid);
     if (ret != 0)
         goto out_hw_err;
 
-    ret = obj_delete(osd->handle, pid, cid);
+    ret = osd->be->obj_delete(osd->handle, pid, cid);
     if (ret != 0)
         goto out_hw_err;
 
@@ -2777,11 +3117,81 @@ out_hw_err:
 }
 
 
+/*
+ * Removes the user objects that are members of collection cid. Their
+ * metadata goes in one transaction, with set operations over the
+ * membership; their data files are handed to the reaper before it
+ * commits, so that no file outlives its object and turns a later create
+ * of the oid into EEXIST.
+ *
+ * returns:
+ * ==0: OSD_OK on success
+ *  >0: error, sense set approprirately
+ */
 int osd_remove_member_objects(struct osd_device *osd, uint64_t pid,
         uint64_t cid, uint32_t cdb_cont_len, uint8_t *sense)
 {
-    osd_debug(__func__);
-    return osd_error_unimplemented(0, sense);
+    int ret = 0;
+    int present = 0;
+    uint8_t obj_type = 0;
+    uint8_t within_txn = 0;
+    uint64_t *oids = NULL;
+    size_t noid = 0;
+    size_t i = 0;
+
+    osd_debug("%s: pid %llu cid %llu", __func__, llu(pid), llu(cid));
+
+    assert(osd && osd->root && osd->handle && sense);
+
+    if (pid < COLLECTION_PID_LB || cid < COLLECTION_OID_LB)
+        goto out_cdb_err;
+
+    ret = osd_begin_txn(osd);
+    assert(ret == 0);
+    within_txn = 1;
+
+    ret = osd->be->obj_ispresent(osd->handle, osd->root, pid, cid, &present);
+    if (ret != OSD_OK || !present) /* collection absent! */
+        goto out_cdb_err;
+
+    obj_type = get_obj_type(osd, pid, cid);
+    if (obj_type != COLLECTION)
+        goto out_cdb_err;
+
+    /* XXX: invalidate ic_cache */
+    osd->ic.cur_pid = osd->ic.next_id = 0;
+
+    ret = osd->be->mtq_remove_members(osd->handle, pid, cid, &oids, &noid);
+    if (ret != 0)
+        goto out_hw_err;
+
+    for (i = 0; i < noid; i++)
+        if (reaper_strand(osd, pid, oids[i]) != 0)
+            osd_debug("%s: no data file for oid %llu", __func__,
+                    llu(oids[i]));
+    free(oids);
+
+    ret = osd_end_txn(osd);
+    assert(ret == 0);
+
+    fill_ccap(&osd->ccap, NULL, COLLECTION, pid, cid, 0);
+    return OSD_OK; /* success */
+
+out_hw_err:
+    if (within_txn) {
+        ret = osd_end_txn(osd);
+        assert(ret == 0);
+    }
+    return sense_build_sdd(sense, OSD_SSK_HARDWARE_ERROR,
+            OSD_ASC_INVALID_FIELD_IN_CDB, pid, cid);
+
+out_cdb_err:
+    if (within_txn) {
+        ret = osd_end_txn(osd);
+        assert(ret == 0);
+    }
+    return sense_build_sdd(sense, OSD_SSK_ILLEGAL_REQUEST,
+            OSD_ASC_INVALID_FIELD_IN_CDB, pid, cid);
 }
 
 /*
@@ -2802,18 +3212,18 @@ int osd_remove_partition(struct osd_device *osd, uint64_t pid, uint32_t cdb_cont
     if (pid == 0)
         goto out_cdb_err;
 
-    ret = obj_isempty_pid(osd->handle, osd->root, pid, &isempty);
+    ret = osd->be->obj_isempty_pid(osd->handle, osd->root, pid, &isempty);
     if (ret != OSD_OK || !isempty)
         goto out_not_empty;
 
     /* XXX: invalidate ic_cache */
     osd->ic.cur_pid = osd->ic.next_id = 0;
 
-    ret = attr_delete_all(osd->handle, pid, PARTITION_OID);
+    ret = osd->be->attr_delete_all(osd->handle, pid, PARTITION_OID);
     if (ret != 0)
         goto out_err;
 
-    ret = obj_delete(osd->handle, pid, PARTITION_OID);
+    ret = osd->be->obj_delete(osd->handle, pid, PARTITION_OID);
     if (ret != 0)
         goto out_err;
 
@@ -2840,6 +3250,63 @@ out_not_empty:
 }
 
 
+/*
+ * Validate one attribute to be set on an object of type obj_type.
+ *
+ * returns:
+ * ==0: attribute may be set
+ *  >0: failure, sense set accordingly
+ */
+static int check_setattr(uint8_t obj_type, uint64_t pid, uint64_t oid,
+        uint32_t page, uint32_t number, const void *val, uint16_t len,
+        uint8_t *sense)
+{
+    if (issettable_page(obj_type, page) == false)
+        goto out_param_list;
+
+    if (number == ATTRNUM_UNMODIFIABLE)
+        goto out_param_list;
+
+    if ((val == NULL && len != 0) || (val != NULL && len == 0)) {
+        osd_warning("%s: NULLs %llu oid %llu", __func__,
+                llu(pid), llu(oid));
+        goto out_cdb_err;
+    }
+
+    /* information page, make sure null terminated. osd2r00 7.1.2.2 */
+    if (number == ATTRNUM_INFO) {
+        int i;
+        const uint8_t *s = val;
+
+        if (len > ATTR_PAGE_ID_LEN)
+            goto out_cdb_err;
+        for (i=0; i<len; i++) {
+            if (s[i] == 0)
+                break;
+        }
+        if (i == len) {
+            osd_warning("%s: !null terminated %llu oid %llu",
+                    __func__, llu(pid), llu(oid));
+            goto out_cdb_err;
+        }
+    }
+
+    if (len > ATTR_LEN_UB)
+        goto out_param_list;
+
+    return 0;
+
+out_param_list:
+    return sense_build_sdd(sense, OSD_SSK_ILLEGAL_REQUEST,
+            OSD_ASC_INVALID_FIELD_IN_PARAM_LIST,
+            pid, oid);
+
+out_cdb_err:
+    return sense_build_sdd(sense, OSD_SSK_ILLEGAL_REQUEST,
+            OSD_ASC_INVALID_FIELD_IN_CDB, pid, oid);
+}
+
+
 /*
  * Settable page numbers in any given U,P,C,R range are further restricted
  * by osd2r00 p 23:  >= 0x10000 && < 0x20000000.
@@ -2870,7 +3337,7 @@ int osd_set_attributes(struct osd_device *osd, uint64_t pid, uint64_t oid,
 
     assert(osd && osd->root && osd->handle && sense);
 
-    ret = obj_ispresent(osd->handle, osd->root, pid, oid, &present);
+    ret = osd->be->obj_ispresent(osd->handle, osd->root, pid, oid, &present);
     if (ret != OSD_OK || !present) {/* object not present! */
         osd_warning("%s: object not present pid %llu oid %llu", __func__,
                 llu(pid), llu(oid));
@@ -2884,38 +3351,9 @@ int osd_set_attributes(struct osd_device *osd, uint64_t pid, uint64_t oid,
         goto out_cdb_err;
     }
 
-    if (issettable_page(obj_type, page) == false)
-        goto out_param_list;
-
-    if (number == ATTRNUM_UNMODIFIABLE)
-        goto out_param_list;
-
-    if ((val == NULL && len != 0) || (val != NULL && len == 0)) {
-        osd_warning("%s: NULLs %llu oid %llu", __func__,
-                llu(pid), llu(oid));
-        goto out_cdb_err;
-    }
-
-    /* information page, make sure null terminated. osd2r00 7.1.2.2 */
-    if (number == ATTRNUM_INFO) {
-        int i;
-        const uint8_t *s = val;
-
-        if (len > ATTR_PAGE_ID_LEN)
-            goto out_cdb_err;
-        for (i=0; i<len; i++) {
-            if (s[i] == 0)
-                break;
-        }
-        if (i == len) {
-            osd_warning("%s: !null terminated %llu oid %llu",
-                    __func__, llu(pid), llu(oid));
-            goto out_cdb_err;
-        }
-    }
-
-    if (len > ATTR_LEN_UB)
-        goto out_param_list;
+    ret = check_setattr(obj_type, pid, oid, page, number, val, len, sense);
+    if (ret != 0)
+        return ret;
 
     switch (page) {
         case USER_INFO_PG:
@@ -2930,6 +3368,12 @@ int osd_set_attributes(struct osd_device *osd, uint64_t pid, uint64_t oid,
                 goto out_success;
             else
                 goto out_cdb_err;
+        case ROOT_QUERY_PG:
+            ret = set_rqp(osd, pid, oid, number, val, len);
+            if (ret == OSD_OK)
+                goto out_success;
+            else
+                goto out_cdb_err;
         case USER_COLL_PG:
             ret = set_cap(osd, pid, oid, number, val, len);
             if (ret == OSD_OK)
@@ -2947,7 +3391,7 @@ int osd_set_attributes(struct osd_device *osd, uint64_t pid, uint64_t oid,
      * retrieveable
      */
     if (len == 0) {
-        ret = attr_delete_attr(osd->handle, pid, oid, page, number);
+        ret = osd->be->attr_delete_attr(osd->handle, pid, oid, page, number);
         if (ret == 0)
             goto out_success;
         else
@@ -2955,7 +3399,7 @@ int osd_set_attributes(struct osd_device *osd, uint64_t pid, uint64_t oid,
     }
 
     //User defined page
-    ret = attr_set_conversion(osd->handle, pid, oid, page, number, val, len);
+    ret = osd->be->attr_set_conversion(osd->handle, pid, oid, page, number, val, len);
     if (ret != 0)
         goto out_hw_err;
 
@@ -2964,10 +3408,116 @@ out_success:
         fill_ccap(&osd->ccap, NULL, obj_type, pid, oid, 0);
     return OSD_OK; /* success */
 
-out_param_list:
+out_cdb_err:
     return sense_build_sdd(sense, OSD_SSK_ILLEGAL_REQUEST,
-            OSD_ASC_INVALID_FIELD_IN_PARAM_LIST,
-            pid, oid);
+            OSD_ASC_INVALID_FIELD_IN_CDB, pid, oid);
+out_hw_err:
+    return sense_build_sdd(sense, OSD_SSK_HARDWARE_ERROR,
+            OSD_ASC_INVALID_FIELD_IN_CDB, pid, oid);
+}
+
+
+/*
+ * Bulk form of osd_set_attributes for a decoded set attributes list
+ * applied to the objects [oid, oid+numoid). Each object is checked once
+ * and every entry is validated before anything is modified. Entries are
+ * then applied in list order, stopping at the first that fails: those on
+ * the information, root information and collection pages keep their
+ * special handling, and each run of other entries between them is
+ * written by one attr_set_attr_list. The caller wraps the call in a
+ * transaction.
+ *
+ * returns:
+ * ==0: success
+ *  >0: failure, sense set accordingly
+ */
+int osd_set_attr_list(struct osd_device *osd, uint64_t pid, uint64_t oid,
+        uint16_t numoid, const struct setattr_list *set_attr,
+        uint8_t isembedded, uint32_t cdb_cont_len, uint8_t *sense)
+{
+    int ret = 0;
+    int present = 0;
+    uint32_t i = 0;
+    uint32_t run = 0;
+    uint64_t o = 0;
+    uint8_t obj_type = 0;
+    const struct list_entry *le = set_attr->le;
+
+    assert(osd && osd->root && osd->handle && set_attr && sense);
+
+    if (set_attr->sz == 0 || numoid == 0)
+        return OSD_OK;
+
+    for (o = oid; o < oid + numoid; o++) {
+        ret = osd->be->obj_ispresent(osd->handle, osd->root, pid, o, &present);
+        if (ret != OSD_OK || !present) {
+            osd_warning("%s: object not present pid %llu oid %llu",
+                    __func__, llu(pid), llu(o));
+            goto out_cdb_err;
+        }
+
+        obj_type = get_obj_type(osd, pid, o);
+        if (obj_type == ILLEGAL_OBJ)
+            goto out_cdb_err;
+
+        for (i = 0; i < set_attr->sz; i++) {
+#ifdef PVFS_OSD_INTEGRATED
+            if (le[i].page == USER_INFO_PG &&
+                    le[i].number == UIAP_LOGICAL_LEN)
+                continue;
+#endif
+            ret = check_setattr(obj_type, pid, o, le[i].page,
+                    le[i].number, le[i].len ? le[i].cval : NULL,
+                    le[i].len, sense);
+            if (ret != 0)
+                return ret;
+        }
+    }
+
+    for (i = 0; i <= set_attr->sz; i++) {
+        const void *val = NULL;
+
+        if (i < set_attr->sz) {
+            switch (le[i].page) {
+                case USER_INFO_PG:
+                case ROOT_INFO_PG:
+                case USER_COLL_PG:
+                case ROOT_QUERY_PG:
+                    break;
+                default:
+                    continue;
+            }
+        }
+
+        /* the run of plain entries before entry i */
+        if (i > run) {
+            ret = osd->be->attr_set_attr_list(osd->handle, pid, oid, numoid,
+                    &le[run], i - run);
+            if (ret != OSD_OK)
+                goto out_hw_err;
+        }
+        run = i + 1;
+        if (i == set_attr->sz)
+            break;
+
+        val = le[i].len ? le[i].cval : NULL;
+        for (o = oid; o < oid + numoid; o++) {
+            if (le[i].page == USER_INFO_PG)
+                ret = set_uiap(osd, pid, o, le[i].number, val, le[i].len);
+            else if (le[i].page == ROOT_INFO_PG)
+                ret = set_riap(osd, pid, o, le[i].number, val, le[i].len);
+            else if (le[i].page == ROOT_QUERY_PG)
+                ret = set_rqp(osd, pid, o, le[i].number, val, le[i].len);
+            else
+                ret = set_cap(osd, pid, o, le[i].number, val, le[i].len);
+            if (ret != OSD_OK)
+                goto out_cdb_err;
+        }
+    }
+
+    if (!isembedded)
+        fill_ccap(&osd->ccap, NULL, obj_type, pid, oid + numoid - 1, 0);
+    return OSD_OK; /* success */
 
 out_cdb_err:
     return sense_build_sdd(sense, OSD_SSK_ILLEGAL_REQUEST,
@@ -3017,7 +3567,7 @@ int osd_set_member_attributes(struct osd_device *osd, uint64_t pid,
     assert(ret == 0);
     within_txn = 1;
 
-    ret = obj_ispresent(osd->handle, osd->root, pid, cid, &present);
+    ret = osd->be->obj_ispresent(osd->handle, osd->root, pid, cid, &present);
     if (ret != OSD_OK || !present) /* collection absent! */
         goto out_cdb_err;
 
@@ -3034,7 +3584,7 @@ int osd_set_member_attributes(struct osd_device *osd, uint64_t pid,
             goto out_param_list;
     }
 
-    ret = mtq_set_member_attrs(osd->handle, pid, cid, set_attr);
+    ret = osd->be->mtq_set_member_attrs(osd->handle, pid, cid, set_attr);
     if (ret != 0)
         goto out_hw_err;
 
@@ -3079,15 +3629,15 @@ int osd_write(struct osd_device *osd, uint64_t pid, uint64_t oid,
 
     switch(ddt) {
         case DDT_CONTIG: {
-                             return contig_write(osd, pid, oid, len, offset, dinbuf,
+                             return osd->be->contig_write(osd, pid, oid, len, offset, dinbuf,
                                      sense);
                          }
         case DDT_SGL: {
-                          return sgl_write(osd, pid, oid, len, offset, dinbuf,
+                          return osd->be->sgl_write(osd, pid, oid, len, offset, dinbuf,
                                   sglist, sense);
                       }
         case DDT_VEC: {
-                          return vec_write(osd, pid, oid, len, offset, dinbuf,
+                          return osd->be->vec_write(osd, pid, oid, len, offset, dinbuf,
                                   sense);
                       }
         default: {
@@ -3101,8 +3651,8 @@ int osd_write(struct osd_device *osd, uint64_t pid, uint64_t oid,
 
 /*
  * OSD CAS: Available only for USEROBJECTs.
- * TODO: No explicit software locks used. If multithreaded OSD emulator is
- * used behavior is undefined.
+ * The compare and swap is done by the backend in a single update of the
+ * atomics page; the page is lazily initialized there as well.
  *
  */
 int osd_cas(struct osd_device *osd, uint64_t pid, uint64_t oid, uint64_t cmp,
@@ -3110,48 +3660,24 @@ int osd_cas(struct osd_device *osd, uint64_t pid, uint64_t oid, uint64_t cmp,
         uint8_t *sense)
 {
     int ret;
-    int present;
     uint8_t obj_type;
     uint64_t val;
-    uint32_t usedlen;
 
     assert(osd && osd->handle && doutbuf && sense);
 
-    ret = obj_ispresent(osd->handle, osd->root, pid, oid, &present);
-    if (ret != OSD_OK || !present) /* object not present! */
-        goto out_cdb_err;
-
+    /* an absent object is ILLEGAL_OBJ */
     obj_type = get_obj_type(osd, pid, oid);
     if (obj_type != USEROBJECT)
         goto out_cdb_err;
 
-    ret = attr_get_val(osd->handle, pid, oid, USER_ATOMICS_PG, UAP_CAS,
-            sizeof(val), &val, &usedlen);
-    if (ret != -ENOENT && ret != OSD_OK)
+    ret = osd->be->attr_cas(osd->handle, pid, oid, USER_ATOMICS_PG, UAP_CAS,
+            cmp, swap, &val);
+    if (ret != OSD_OK)
         goto out_hw_err;
-    /* 
-     * XXX:SD we do a lazy initialization of atomics page. Hence attr
-     * might not be defined before. In that case we define it and proceed
-     * with rest of the operation
-     */
-    if (ret == -ENOENT) {
-        val = 0;
-        ret = attr_set_attr(osd, pid, oid, USER_ATOMICS_PG, 
-                UAP_CAS, &val, sizeof(val));
-        if (ret != OSD_OK)
-            goto out_hw_err;
-    }
 
     osd_debug("pid %llu oid %llu cmp %llu swap %llu val %llu", llu(pid),
             llu(oid), llu(cmp), llu(swap), llu(val));
 
-    if (val == cmp) {
-        ret = attr_set_attr(osd, pid, oid, USER_ATOMICS_PG,
-                UAP_CAS, &swap, sizeof(swap));
-        if (ret != OSD_OK)
-            goto out_hw_err;
-    }
-
     set_htonll(doutbuf, val);
     *used_outlen = sizeof(val);
     return OSD_OK;
@@ -3170,49 +3696,26 @@ out_cdb_err:
 
 /*
  * OSD FA: Available only for USEROBJECTs.
- * TODO: No explicit software locks used. If multithreaded OSD emulator is
- * used, behavior is undefined.
+ * The backend adds to the atomics page in a single update, lazily
+ * initializing it.
  *
  */
 int osd_fa(struct osd_device *osd, uint64_t pid, uint64_t oid, int64_t add,
         uint8_t *doutbuf, uint64_t *used_outlen, uint8_t *sense)
 {
     int ret;
-    int present;
     uint8_t obj_type;
     uint64_t val;
-    uint32_t usedlen;
 
     assert(osd && osd->handle && doutbuf && sense);
 
-    ret = obj_ispresent(osd->handle, osd->root, pid, oid, &present);
-    if (ret != OSD_OK || !present) /* object not present! */
-        goto out_cdb_err;
-
+    /* an absent object is ILLEGAL_OBJ */
     obj_type = get_obj_type(osd, pid, oid);
     if (obj_type != USEROBJECT)
         goto out_cdb_err;
 
-    ret = attr_get_val(osd->handle, pid, oid, USER_ATOMICS_PG, UAP_FA,
-            sizeof(val), &val, &usedlen);
-    if (ret != -ENOENT && ret != OSD_OK)
-        goto out_hw_err;
-    /* 
-     * XXX:SD we do a lazy initialization of atomics page. Hence attr
-     * might not be defined before. In that case we define it and proceed
-     * with rest of the operation
-     */
-    if (ret == -ENOENT) {
-        val = 0;
-        ret = attr_set_attr(osd, pid, oid, USER_ATOMICS_PG, 
-                UAP_FA, &val, sizeof(val));
-        if (ret != OSD_OK)
-            goto out_hw_err;
-    }
-
-    add += val;
-    ret = attr_set_attr(osd, pid, oid, USER_ATOMICS_PG, UAP_FA,
-            &add, sizeof(add));
+    ret = osd->be->attr_fa(osd->handle, pid, oid, USER_ATOMICS_PG, UAP_FA,
+            add, &val);
     if (ret != OSD_OK)
         goto out_hw_err;
 
@@ -3236,66 +3739,62 @@ out_cdb_err:
  *
  * max(cmp_len and swap_len) == ATTR_LEN_UB == 0xFFFE
  *
+ * The original value, if present, is returned in orig_val, which has room
+ * for orig_max bytes; orig_len is 0 for an absent attribute. The backend
+ * compares the stored value in place and swaps or deletes it in the same
+ * call. The user information page is interpreted by attr_set_attr and is
+ * read and set through it instead.
  */
 int osd_gen_cas(struct osd_device *osd, uint64_t pid, uint64_t oid,
         uint32_t page, uint32_t number, const uint8_t *cmp,
         uint16_t cmp_len, const uint8_t *swap, uint16_t swap_len,
-        uint8_t **orig_val, uint16_t *orig_len, uint8_t *sense)
+        uint8_t *orig_val, uint32_t orig_max, uint16_t *orig_len,
+        uint8_t *sense)
 {
     int ret;
-    int present;
     uint8_t obj_type;
-    uint8_t *val;
-    uint32_t valen;
+    uint32_t valen = 0;
 
     assert(osd && osd->handle && orig_val && orig_len && sense);
 
-    val = malloc(ATTR_LEN_UB);
-    if (!val)
-        goto out_hw_err;
-
-    ret = obj_ispresent(osd->handle, osd->root, pid, oid, &present);
-    if (ret != OSD_OK || !present) /* object not present */
-        goto out_cdb_err;
-
+    /* an absent object is ILLEGAL_OBJ */
     obj_type = get_obj_type(osd, pid, oid);
     if (obj_type != USEROBJECT)
         goto out_cdb_err;
 
-    ret = attr_get_val(osd->handle, pid, oid, page, number, ATTR_LEN_UB,
-            val, &valen);
+    if (page != USER_INFO_PG) {
+        ret = osd->be->attr_gen_cas(osd->handle, pid, oid, page, number,
+                cmp, cmp_len, swap, swap_len, orig_val, orig_max,
+                orig_len);
+        if (ret == -EOVERFLOW)
+            goto out_cdb_err;
+        if (ret != OSD_OK)
+            goto out_hw_err;
+        return OSD_OK;
+    }
+
+    *orig_len = 0;
+    ret = osd->be->attr_get_val(osd->handle, pid, oid, page, number,
+            orig_max, orig_val, &valen);
+    if (ret == -EINVAL)
+        goto out_cdb_err;
     if (ret != OSD_OK && ret != -ENOENT)
         goto out_hw_err;
+    if (ret == OSD_OK)
+        *orig_len = valen;
 
-    /*
-     * swap_len determines if the new entry is being inserted or original
-     * entry is to be removed.
-     */
-    if ((swap_len > 0 && swap != NULL) &&
-            (ret == -ENOENT ||
-             (valen == cmp_len && memcmp(cmp, val, valen) == 0))) {
-        ret = attr_set_attr(osd, pid, oid, page, number, swap,
+    if (swap_len > 0 && (ret == -ENOENT || (valen == cmp_len &&
+                    memcmp(cmp, orig_val, valen) == 0))) {
+        ret = osd->be->attr_set_attr(osd, pid, oid, page, number, swap,
                 swap_len);
         if (ret != OSD_OK)
             goto out_hw_err;
-    } else if ((swap_len == 0 && swap == NULL) &&
-            (valen == cmp_len && memcmp(cmp, val, valen) == 0)) {
-        ret = attr_delete_attr(osd->handle, pid, oid, page, number);
+    } else if (swap_len == 0 && ret == OSD_OK &&
+            (valen == cmp_len && memcmp(cmp, orig_val, valen) == 0)) {
+        ret = osd->be->attr_delete_attr(osd->handle, pid, oid, page, number);
         if (ret != OSD_OK)
             goto out_hw_err;
     }
-
-    /*
-     * regardless of successful swap, we return original value, if
-     * present, else undefined value
-     */
-    if (ret == -ENOENT) {
-        *orig_val = NULL;
-        *orig_len = 0;
-    } else {
-        *orig_val = val;
-        *orig_len = valen;
-    }
     return OSD_OK;
 
 out_hw_err:
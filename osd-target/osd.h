@@ -30,11 +30,15 @@ int osd_error_bad_cdb(uint8_t *sense);
 /* db ops */
 int osd_begin_txn(struct osd_device *osd);
 int osd_end_txn(struct osd_device *osd);
+int osd_vacuum(struct osd_device *osd, int idle);
+void osd_get_stats(struct osd_device *osd, struct osd_stats *st);
 
 static const char *md = "md";
 static const char *dbname = "osd.db";
 static const char *dfiles = "dfiles";
 static const char *stranded = "stranded";
+static const char *formatting = "formatting";
+static const char *backendname = "backend";
 
 /*
  * Commands.
@@ -85,8 +89,17 @@ int osd_getattr_list(struct osd_device *osd, uint64_t pid, uint64_t oid,
 		     uint32_t page, uint32_t number, uint8_t *outbuf,
 		     uint32_t outlen, uint8_t isembedded, uint8_t listfmt,
 		     uint32_t *used_outlen, uint32_t cdb_cont_len, uint8_t *sense);
+int osd_get_attr_list(struct osd_device *osd, uint64_t pid, uint64_t oid,
+		      uint16_t numoid, const struct getattr_list *get_attr,
+		      uint8_t *outbuf, uint32_t outlen, uint8_t isembedded,
+		      uint8_t listfmt, uint32_t *used_outlen,
+		      uint32_t cdb_cont_len, uint8_t *sense);
 int osd_get_member_attributes(struct osd_device *osd, uint64_t pid,
-			      uint64_t cid, uint32_t cdb_cont_len, uint8_t *sense);
+			      uint64_t cid, uint64_t alloc_len,
+			      uint64_t initial_oid,
+			      struct getattr_list *get_attr, uint32_t list_id,
+			      uint8_t *outdata, uint64_t *used_outlen,
+			      uint32_t cdb_cont_len, uint8_t *sense);
 int osd_list(struct osd_device *osd, uint8_t list_attr, uint64_t pid,
 	     uint64_t alloc_len, uint64_t initial_oid,
 	     struct getattr_list *get_attr, uint32_t list_id,
@@ -117,6 +130,9 @@ int osd_remove_partition(struct osd_device *osd, uint64_t pid, uint32_t cdb_cont
 int osd_set_attributes(struct osd_device *osd, uint64_t pid, uint64_t oid,
                        uint32_t page, uint32_t number, const void *val,
 		       uint16_t len, uint8_t cmd_type, uint32_t cdb_cont_len, uint8_t *sense);
+int osd_set_attr_list(struct osd_device *osd, uint64_t pid, uint64_t oid,
+		      uint16_t numoid, const struct setattr_list *set_attr,
+		      uint8_t isembedded, uint32_t cdb_cont_len, uint8_t *sense);
 int osd_set_key(struct osd_device *osd, int key_to_set, uint64_t pid,
 		uint64_t key, uint8_t seed[OSD_CRYPTO_KEYID_SIZE],
 		uint8_t *sense);
@@ -141,7 +157,8 @@ int osd_fa(struct osd_device *osd, uint64_t pid, uint64_t oid, int64_t add,
 int osd_gen_cas(struct osd_device *osd, uint64_t pid, uint64_t oid,
 		uint32_t page, uint32_t number, const uint8_t *cmp,
 		uint16_t cmp_len, const uint8_t *swap, uint16_t swap_len,
-		uint8_t **orig_val, uint16_t *orig_len, uint8_t *sense);
+		uint8_t *orig_val, uint32_t orig_max, uint16_t *orig_len,
+		uint8_t *sense);
 
 int create_dir(const char *dirname);
 int osd_initialize_db(struct osd_device *osd);
@@ -207,5 +224,14 @@ static inline void get_dbname(char *path, const char *root)
 	sprintf(path, "%s/%s/%s", root, md, dbname);
 }
 
+/* shard 0 is dbname itself, see db_shard */
+static inline void get_shard_dbname(char *path, const char *root, int i)
+{
+	if (i == 0)
+		get_dbname(path, root);
+	else
+		sprintf(path, "%s/%s/%s.%d", root, md, dbname, i);
+}
+
 
 #endif /* __OSD_H */
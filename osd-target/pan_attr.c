@@ -210,6 +210,36 @@ int attr_delete_all(void *ohandle, uint64_t pid, uint64_t oid)
     return 0;
 }
 
+/*
+ * the device has no batch interface, set the entries one at a time
+ *
+ * returns:
+ * -EINVAL: invalid arg
+ * OSD_ERROR: some other error
+ * OSD_OK: success
+ */
+int attr_set_attr_list(void *ohandle, uint64_t pid, uint64_t oid,
+        uint16_t numoid, const struct list_entry *le, uint32_t sz)
+{
+    int ret = 0;
+    uint32_t i = 0;
+    uint64_t o = 0;
+
+    for (o = oid; o < oid + numoid; o++) {
+        for (i = 0; i < sz; i++) {
+            if (le[i].len == 0)
+                ret = attr_delete_attr(ohandle, pid, o, le[i].page,
+                        le[i].number);
+            else
+                ret = _attr_set_attr(ohandle, pid, o, le[i].page,
+                        le[i].number, le[i].cval, le[i].len);
+            if (ret != OSD_OK)
+                return ret;
+        }
+    }
+    return OSD_OK;
+}
+
 int attr_get_attr(struct osd_device *osd, uint64_t pid, uint64_t oid,
         uint32_t orig_page, uint32_t orig_number, uint64_t outlen, void *outdata, uint8_t listfmt, 
         uint32_t *used_outlen)
@@ -508,6 +538,79 @@ int attr_get_val(void* ohandle, uint64_t pid, uint64_t oid,
     return 0;
 }
 
+/*
+ * Compare and swap the 8 byte attribute (page, number), read and written
+ * back through the object's attributes. An absent attribute counts as 0.
+ */
+int attr_cas(void* ohandle, uint64_t pid, uint64_t oid, uint32_t page,
+        uint32_t number, uint64_t cmp, uint64_t swap, uint64_t *orig)
+{
+    int ret;
+    uint32_t len = 0;
+
+    *orig = 0;
+    ret = attr_get_val(ohandle, pid, oid, page, number, sizeof(*orig),
+            orig, &len);
+    if (ret != OSD_OK && ret != -ENOENT)
+        return ret;
+    if (*orig != cmp)
+        return OSD_OK;
+    return _attr_set_attr(ohandle, pid, oid, page, number, &swap,
+            sizeof(swap));
+}
+
+/*
+ * Fetch and add on the 8 byte attribute (page, number). An absent
+ * attribute counts as 0.
+ */
+int attr_fa(void* ohandle, uint64_t pid, uint64_t oid, uint32_t page,
+        uint32_t number, int64_t add, uint64_t *orig)
+{
+    int ret;
+    uint32_t len = 0;
+    uint64_t sum;
+
+    *orig = 0;
+    ret = attr_get_val(ohandle, pid, oid, page, number, sizeof(*orig),
+            orig, &len);
+    if (ret != OSD_OK && ret != -ENOENT)
+        return ret;
+    sum = *orig + (uint64_t)add;
+    return _attr_set_attr(ohandle, pid, oid, page, number, &sum,
+            sizeof(sum));
+}
+
+/*
+ * Compare and swap an attribute of any length, read into orig and written
+ * back through the object's attributes. With swap_len 0 a matching
+ * attribute is deleted, an absent one is always set.
+ */
+int attr_gen_cas(void* ohandle, uint64_t pid, uint64_t oid, uint32_t page,
+        uint32_t number, const void *cmp, uint16_t cmp_len,
+        const void *swap, uint16_t swap_len, void *orig,
+        uint32_t orig_max, uint16_t *orig_len)
+{
+    int ret;
+    uint32_t len = 0;
+
+    *orig_len = 0;
+    ret = attr_get_val(ohandle, pid, oid, page, number, orig_max, orig,
+            &len);
+    if (ret == -ENOENT && swap_len > 0)
+        return _attr_set_attr(ohandle, pid, oid, page, number, swap,
+                swap_len);
+    if (ret != OSD_OK)
+        return (ret == -ENOENT ? OSD_OK : ret);
+
+    *orig_len = len;
+    if (len != cmp_len || (len > 0 && memcmp(orig, cmp, len) != 0))
+        return OSD_OK;
+    if (swap_len > 0)
+        return _attr_set_attr(ohandle, pid, oid, page, number, swap,
+                swap_len);
+    return attr_delete_attr(ohandle, pid, oid, page, number);
+}
+
 /*
  * get one page in list format
  *
@@ -593,6 +696,46 @@ int attr_get_all_attrs(void* ohandle, uint64_t pid, uint64_t oid,
  * OSD_ERROR: some other error
  * OSD_OK: success, used_outlen modified
  */
+/*
+ * no query engine on the device, look the entries up one at a time
+ *
+ * returns:
+ * -EINVAL: invalid arg
+ * OSD_ERROR: some other error
+ * >0: error returned by fill
+ * OSD_OK: success, used_outlen modified
+ */
+int attr_get_attr_list(void *ohandle, uint64_t pid, uint64_t oid,
+        uint16_t numoid, const struct getattr_list *ga, const uint8_t *indb,
+        attr_fill_t fill, void *arg, uint64_t outlen, void *outdata,
+        uint8_t listfmt, uint32_t *used_outlen)
+{
+    int ret = 0;
+    uint32_t i = 0;
+    uint32_t used = 0;
+    uint64_t o = 0;
+    uint8_t *cp = outdata;
+
+    *used_outlen = 0;
+    for (i = 0; i < ga->sz; i++) {
+        for (o = oid; o < oid + numoid; o++) {
+            ret = -ENOENT;
+            if (indb[i])
+                ret = _attr_get_attr(ohandle, pid, o, ga->le[i].page,
+                        ga->le[i].number, ga->le[i].page, ga->le[i].number,
+                        outlen, cp, listfmt, &used);
+            if (ret == -ENOENT)
+                ret = fill(arg, i, o, cp, outlen, &used);
+            if (ret != OSD_OK)
+                return ret;
+            cp += used;
+            outlen -= used;
+            *used_outlen += used;
+        }
+    }
+    return OSD_OK;
+}
+
 int attr_get_dir_page(void* ohandle, uint64_t pid, uint64_t oid, 
         uint32_t page, uint64_t outlen, void *outdata,
         uint8_t listfmt, uint32_t *used_outlen)
@@ -630,3 +773,9 @@ int attr_set_conversion(void* ohandle, uint64_t pid, uint64_t oid,
 
     return _attr_set_attr(ohandle, pid, oid, page, number, val, len);
 }
+
+int attr_sync_query_idx(void *ohandle)
+{
+    /* no value indexes on this backend */
+    return OSD_OK;
+}
@@ -9,6 +9,10 @@
 
 
 #include "io.h"
+#include "backend.h"
+#include "obj.h"
+#include "coll.h"
+#include "mtq.h"
 #include "osd.h"
 #include "osd-sense.h"
 #include "osd-types.h"
@@ -469,9 +473,9 @@ setup_root_paths (const char* root, struct osd_device *osd)
     int ret = 0;
     char path[MAXNAMELEN];
     char *argv[] = { strdup("osd-target"), NULL };
+    const struct osd_backend *be = NULL;
 
     osd_set_progname(1, argv);  /* for debug messages from libosdutil */
-    mhz = get_mhz(); /* XXX: find a better way of profiling */
 
     if (strlen(root) > MAXROOTLEN) {
         osd_error("strlen(%s) > MAXROOTLEN", root);
@@ -479,7 +483,10 @@ setup_root_paths (const char* root, struct osd_device *osd)
         goto out;
     }
 
+    /* keep the backend osd_open_backend bound */
+    be = osd->be;
     memset(osd, 0, sizeof(*osd));
+    osd->be = be;
 
     /* test if root exists and is a directory */
     ret = create_dir(root);
@@ -550,7 +557,8 @@ int format_osd(struct osd_device *osd, uint64_t capacity, uint32_t cdb_cont_len,
         goto out_sense;
     }
 create:
-    ret = osd_open(root, osd); /* will create files/dirs under root */
+    /* will create files/dirs under root */
+    ret = osd_open_backend(root, osd->be->name, osd);
     if (ret != 0) {
         osd_error("%s: osd_open %s failed", __func__, root);
         goto out_sense;
@@ -568,18 +576,33 @@ out:
 }
 
 
-int osd_begin_txn(struct osd_device *osd)
+int io_begin_txn(struct osd_device *osd)
 {
     return 0;
 }
 
-int osd_end_txn(struct osd_device *osd)
+int io_end_txn(struct osd_device *osd)
 {
     return 0;
 
 }
 
-int osd_close(struct osd_device *osd)
+static int io_vacuum(void *ohandle, int idle)
+{
+    return 0;
+}
+
+static void io_vacuum_stats(void *ohandle, struct vacuum_stats *vs)
+{
+    memset(vs, 0, sizeof(*vs));
+}
+
+static void io_cache_stats(void *ohandle, struct tune_stats *ts)
+{
+    memset(ts, 0, sizeof(*ts));
+}
+
+int io_close(struct osd_device *osd)
 {
     int ret = 0;
 
@@ -591,3 +614,72 @@ int osd_close(struct osd_device *osd)
     osd->root = NULL;
     return ret;
 }
+
+
+/* the Panasas OSDFS backend, no database */
+const struct osd_backend pan_backend = {
+    .name = "panasas",
+
+    .open = setup_root_paths,
+    .close = io_close,
+    .begin_txn = io_begin_txn,
+    .end_txn = io_end_txn,
+    .vacuum = io_vacuum,
+    .vacuum_stats = io_vacuum_stats,
+    .cache_stats = io_cache_stats,
+
+    .obj_insert = obj_insert,
+    .obj_insert_range = obj_insert_range,
+    .obj_delete = obj_delete,
+    .obj_get_nextoid = obj_get_nextoid,
+    .obj_get_nextpid = obj_get_nextpid,
+    .obj_ispresent = obj_ispresent,
+    .obj_isempty_pid = obj_isempty_pid,
+    .obj_get_type = obj_get_type,
+    .obj_get_oids_in_pid = obj_get_oids_in_pid,
+    .obj_get_cids_in_pid = obj_get_cids_in_pid,
+    .obj_get_all_pids = obj_get_all_pids,
+
+    .attr_set_attr = attr_set_attr,
+    ._attr_set_attr = _attr_set_attr,
+    .attr_set_conversion = attr_set_conversion,
+    .attr_set_attr_list = attr_set_attr_list,
+    .attr_delete_attr = attr_delete_attr,
+    .attr_delete_all = attr_delete_all,
+    .attr_get_attr = attr_get_attr,
+    .attr_get_conversion = attr_get_conversion,
+    .attr_get_val = attr_get_val,
+    .attr_cas = attr_cas,
+    .attr_fa = attr_fa,
+    .attr_gen_cas = attr_gen_cas,
+    .attr_get_page_as_list = attr_get_page_as_list,
+    .attr_get_for_all_pages = attr_get_for_all_pages,
+    .attr_get_all_attrs = attr_get_all_attrs,
+    .attr_get_attr_list = attr_get_attr_list,
+    .attr_get_dir_page = attr_get_dir_page,
+    .attr_sync_query_idx = attr_sync_query_idx,
+
+    .coll_insert = coll_insert,
+    .coll_delete = coll_delete,
+    .coll_delete_cid = coll_delete_cid,
+    .coll_delete_oid = coll_delete_oid,
+    .coll_isempty_cid = coll_isempty_cid,
+    .coll_get_cid = coll_get_cid,
+    .coll_get_oids_in_cid = coll_get_oids_in_cid,
+    .coll_copyoids = coll_copyoids,
+
+    .mtq_run_query = mtq_run_query,
+    .mtq_list_oids_attr = mtq_list_oids_attr,
+    .mtq_list_members_attr = mtq_list_members_attr,
+    .mtq_set_member_attrs = mtq_set_member_attrs,
+    .mtq_remove_members = mtq_remove_members,
+
+    .contig_read = contig_read,
+    .sgl_read = sgl_read,
+    .vec_read = vec_read,
+    .contig_write = contig_write,
+    .sgl_write = sgl_write,
+    .vec_write = vec_write,
+    .osd_create_datafile = osd_create_datafile,
+    .format_osd = format_osd,
+};
@@ -71,6 +71,26 @@ int mtq_list_oids_attr(void *handle, uint64_t pid,
 }
 
 
+/*
+ * returns members of a collection along with requested attributes
+ *
+ * return values:
+ * -EINVAL: invalid argument
+ * -EIO: prepare or some other sqlite function failed
+ * OSD_ERROR: some other error
+ * OSD_OK: success
+ */
+int mtq_list_members_attr(void *handle, uint64_t pid, uint64_t cid,
+			  uint64_t initial_oid, struct getattr_list *get_attr,
+			  uint64_t alloc_len, void *outdata,
+			  uint64_t *used_outlen, uint64_t *add_len,
+			  uint64_t *cont_id)
+{
+  osd_debug("%s: ", __func__);
+  return 0;
+}
+
+
 /*
  * set attributes on members of the give collection
  *
@@ -87,4 +107,19 @@ int mtq_set_member_attrs(void *handle, uint64_t pid, uint64_t cid,
   return 0;
 }
 
-
+/*
+ * remove the members of the given collection
+ *
+ * return values:
+ * -ENOMEM: out of memory
+ * OSD_ERROR: some other error
+ * OSD_OK: success
+ */
+int mtq_remove_members(void *handle, uint64_t pid, uint64_t cid,
+		       uint64_t **oids, size_t *noid)
+{
+  osd_debug("%s: ", __func__);
+  *oids = NULL;
+  *noid = 0;
+  return 0;
+}
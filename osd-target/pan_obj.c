@@ -116,6 +116,32 @@ int obj_insert(void* handle, uint64_t pid, uint64_t oid,
 }
 
 
+/*
+ * insert objects [oid, oid+numoid), one ioctl per object
+ *
+ * returns:
+ * -EINVAL: invalid arg
+ * OSD_ERROR: some other error
+ * OSD_OK: success
+ */
+int obj_insert_range(void* handle, uint64_t pid, uint64_t oid,
+		     uint16_t numoid, uint32_t type)
+{
+	int ret = 0;
+	uint64_t i = 0;
+
+	for (i = oid; i < oid + numoid; i++) {
+		ret = obj_insert(handle, pid, i, type);
+		if (ret != 0) {
+			while (i-- > oid)
+				obj_delete(handle, pid, i);
+			return ret;
+		}
+	}
+	return OSD_OK;
+}
+
+
 /*
  * NOTE: If the object is not present, the function completes successfully.
  *
@@ -0,0 +1,305 @@
+/*
+ * Deferred removal of data files through the stranded directory.
+ *
+ * Copyright (C) 2007 OSD Team <pvfs-osd@osc.edu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "osd.h"
+#include "osd-util/osd-util.h"
+#include "reaper.h"
+
+/*
+ * Unlinking a large file frees its extents before it returns, which can
+ * take a long time. REMOVE instead renames the data file into stranded,
+ * which costs the same for any size, and the reaper thread unlinks what
+ * is there in the background, REAPER_BATCH files at a time.
+ *
+ * The directory is the queue: nothing about a stranded file is kept in
+ * memory, so the files a crash or close left behind are unlinked by the
+ * sweep every start begins with. Stranded names carry a sequence number
+ * as well as the ids, so an oid that is removed, created and removed
+ * again before a sweep strands two files rather than one.
+ *
+ * FORMAT strands whole directories, md and dfiles, the same way; the
+ * sweep removes a directory depth first with the same pacing. The thread
+ * runs in the idle I/O class where there is one, so the disk serves
+ * commands first.
+ */
+struct reaper {
+	char *dir;
+	uint64_t seq;
+	int work;		/* files were stranded since the last sweep */
+	int stop;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+/*
+ * rest between batches; returns 1 if the reaper is asked to stop
+ */
+static int reaper_pause(struct reaper *r)
+{
+	int stop = 0;
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_nsec += REAPER_PAUSE_MS * 1000000L;
+	if (ts.tv_nsec >= 1000000000L) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
+	}
+	pthread_mutex_lock(&r->lock);
+	if (!r->stop)
+		pthread_cond_timedwait(&r->cond, &r->lock, &ts);
+	stop = r->stop;
+	pthread_mutex_unlock(&r->lock);
+	return stop;
+}
+
+/*
+ * Remove everything under path, then path itself when rmself is set.
+ * n counts the files removed so far in this sweep; returns 1 if the
+ * reaper is asked to stop first.
+ */
+static int reaper_rmtree(struct reaper *r, const char *path, int rmself,
+			 int *n)
+{
+	int stop = 0;
+	int isdir = 0;
+	DIR *dir = NULL;
+	struct dirent *ent = NULL;
+	struct stat sb;
+	char sub[MAXNAMELEN];
+
+	dir = opendir(path);
+	if (!dir) {
+		osd_error("%s: opendir %s: %m", __func__, path);
+		return 0;
+	}
+	while (!stop && (ent = readdir(dir)) != NULL) {
+		if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, ".."))
+			continue;
+		if (snprintf(sub, sizeof(sub), "%s/%s", path,
+			     ent->d_name) >= (int)sizeof(sub)) {
+			osd_error("%s: %s/%s: name too long", __func__, path,
+				  ent->d_name);
+			continue;
+		}
+		isdir = (ent->d_type == DT_DIR);
+		if (ent->d_type == DT_UNKNOWN && lstat(sub, &sb) == 0)
+			isdir = S_ISDIR(sb.st_mode);
+		if (isdir) {
+			stop = reaper_rmtree(r, sub, 1, n);
+			continue;
+		}
+		if (unlink(sub) != 0 && errno != ENOENT)
+			osd_error("%s: unlink %s: %m", __func__, sub);
+		if (++*n % REAPER_BATCH == 0)
+			stop = reaper_pause(r);
+	}
+	closedir(dir);
+	if (!stop && rmself && rmdir(path) != 0 && errno != ENOENT)
+		osd_error("%s: rmdir %s: %m", __func__, path);
+	return stop;
+}
+
+/*
+ * put the calling thread in the idle I/O class, where the kernel has one
+ */
+static void reaper_ioprio_idle(void)
+{
+#ifdef SYS_ioprio_set
+	/* IOPRIO_WHO_PROCESS of this thread, IOPRIO_CLASS_IDLE << 13 */
+	if (syscall(SYS_ioprio_set, 1, 0, 3 << 13) != 0)
+		osd_debug("%s: ioprio_set: %m", __func__);
+#endif
+}
+
+static void *reaper_thread(void *arg)
+{
+	struct reaper *r = arg;
+	int n = 0;
+
+	reaper_ioprio_idle();
+	pthread_mutex_lock(&r->lock);
+	while (!r->stop) {
+		if (!r->work) {
+			pthread_cond_wait(&r->cond, &r->lock);
+			continue;
+		}
+		r->work = 0;
+		pthread_mutex_unlock(&r->lock);
+		reaper_rmtree(r, r->dir, 0, &n);
+		pthread_mutex_lock(&r->lock);
+	}
+	pthread_mutex_unlock(&r->lock);
+	return NULL;
+}
+
+/*
+ * Start the reaper of osd, which first sweeps what an earlier run left in
+ * stranded.
+ *
+ * returns:
+ * -ENOMEM: out of memory
+ * -ENAMETOOLONG: the path of stranded does not fit in MAXNAMELEN
+ * -errno: the thread could not be created
+ * OSD_OK: success
+ */
+int reaper_start(struct osd_device *osd)
+{
+	int ret = 0;
+	struct reaper *r = NULL;
+
+	r = Calloc(1, sizeof(*r));
+	if (!r)
+		return -ENOMEM;
+	r->dir = Malloc(MAXNAMELEN);
+	if (!r->dir) {
+		free(r);
+		return -ENOMEM;
+	}
+	if (snprintf(r->dir, MAXNAMELEN, "%s/%s", osd->root,
+		     stranded) >= (int)MAXNAMELEN) {
+		osd_error("%s: %s/%s: name too long", __func__, osd->root,
+			  stranded);
+		free(r->dir);
+		free(r);
+		return -ENAMETOOLONG;
+	}
+	r->seq = (uint64_t)time(NULL) << 20;
+	r->work = 1;
+	pthread_mutex_init(&r->lock, NULL);
+	pthread_cond_init(&r->cond, NULL);
+
+	ret = pthread_create(&r->thread, NULL, reaper_thread, r);
+	if (ret != 0) {
+		osd_error("%s: pthread_create: %d", __func__, ret);
+		pthread_cond_destroy(&r->cond);
+		pthread_mutex_destroy(&r->lock);
+		free(r->dir);
+		free(r);
+		return -ret;
+	}
+	osd->reaper = r;
+	return OSD_OK;
+}
+
+/*
+ * Stop the reaper of osd; files it did not get to stay in stranded for
+ * the next start.
+ */
+void reaper_stop(struct osd_device *osd)
+{
+	struct reaper *r = osd->reaper;
+
+	if (!r)
+		return;
+	pthread_mutex_lock(&r->lock);
+	r->stop = 1;
+	pthread_cond_signal(&r->cond);
+	pthread_mutex_unlock(&r->lock);
+	pthread_join(r->thread, NULL);
+
+	pthread_cond_destroy(&r->cond);
+	pthread_mutex_destroy(&r->lock);
+	free(r->dir);
+	free(r);
+	osd->reaper = NULL;
+}
+
+/*
+ * Move the data file of (pid, oid) into stranded for the reaper to
+ * unlink. Without a reaper it is unlinked right away.
+ *
+ * returns:
+ * -errno: rename or unlink failed, -ENOENT if there is no data file,
+ *         -ENAMETOOLONG if the stranded name does not fit
+ * OSD_OK: success
+ */
+int reaper_strand(struct osd_device *osd, uint64_t pid, uint64_t oid)
+{
+	struct reaper *r = osd->reaper;
+	char path[MAXNAMELEN];
+	char to[MAXNAMELEN];
+	uint64_t seq = 0;
+
+	get_dfile_name(path, osd->root, pid, oid);
+	if (!r)
+		return unlink(path) == 0 ? OSD_OK : -errno;
+
+	pthread_mutex_lock(&r->lock);
+	seq = r->seq++;
+	pthread_mutex_unlock(&r->lock);
+
+	if (snprintf(to, sizeof(to), "%s/%llx.%llx.%llx", r->dir, llu(pid),
+		     llu(oid), llu(seq)) >= (int)sizeof(to))
+		return -ENAMETOOLONG;
+	if (rename(path, to) != 0)
+		return -errno;
+
+	pthread_mutex_lock(&r->lock);
+	r->work = 1;
+	pthread_cond_signal(&r->cond);
+	pthread_mutex_unlock(&r->lock);
+	return OSD_OK;
+}
+
+/*
+ * Move the directory name under root into stranded, where the reaper of
+ * the next start removes it. Used with the osd closed, so the name made
+ * unique here does not come from a reaper.
+ *
+ * returns:
+ * -errno: rename failed, -ENOENT if there is no such directory,
+ *         -ENAMETOOLONG if a path does not fit in MAXNAMELEN
+ * OSD_OK: success
+ */
+int reaper_strand_dir(const char *root, const char *name)
+{
+	char path[MAXNAMELEN];
+	char to[MAXNAMELEN];
+	struct timespec ts;
+	uint64_t seq = 0;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	seq = ((uint64_t)ts.tv_sec << 30) | (uint64_t)ts.tv_nsec;
+
+	if (snprintf(path, sizeof(path), "%s/%s", root,
+		     name) >= (int)sizeof(path))
+		return -ENAMETOOLONG;
+	for (;;) {
+		if (snprintf(to, sizeof(to), "%s/%s/%s.%llx", root, stranded,
+			     name, llu(seq)) >= (int)sizeof(to))
+			return -ENAMETOOLONG;
+		if (rename(path, to) == 0)
+			return OSD_OK;
+		/* a directory of that name from an earlier FORMAT */
+		if (errno != EEXIST && errno != ENOTEMPTY)
+			return -errno;
+		seq++;
+	}
+}
@@ -0,0 +1,36 @@
+/*
+ * Deferred removal of data files through the stranded directory.
+ *
+ * Copyright (C) 2007 OSD Team <pvfs-osd@osc.edu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __REAPER_H
+#define __REAPER_H
+
+#include <stdint.h>
+#include "osd-types.h"
+
+/* the reaper unlinks REAPER_BATCH files, then rests REAPER_PAUSE_MS */
+#define REAPER_BATCH (64)
+#define REAPER_PAUSE_MS (10)
+
+int reaper_start(struct osd_device *osd);
+
+void reaper_stop(struct osd_device *osd);
+
+int reaper_strand(struct osd_device *osd, uint64_t pid, uint64_t oid);
+
+int reaper_strand_dir(const char *root, const char *name);
+
+#endif /* __REAPER_H */
@@ -0,0 +1,197 @@
+/*
+ * Round trips of collbm_encode and collbm_decode.
+ *
+ * Copyright (C) 2007 OSD Team <pvfs-osd@osc.edu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include "osd-types.h"
+#include "collbm.h"
+#include "osd-util/osd-util.h"
+
+/* form byte of the first container, see the format at collbm_encode */
+#define FORM_OFF (4 + 8)
+#define FORM_ARRAY (0)
+#define FORM_BITS (1)
+#define FORM_RUNS (2)
+
+/*
+ * Encode bm, check the form of its first container, decode it and check
+ * that the copy has the same members. Returns the encoding, to be freed.
+ */
+static uint8_t *round_trip(const struct collbm *bm, int form, size_t *len)
+{
+	int ret = 0;
+	void *buf = NULL;
+	uint64_t a = 0, b = 0;
+	struct collbm *copy = NULL;
+	struct collbm_iter ia, ib;
+
+	ret = collbm_encode(bm, &buf, len);
+	assert(ret == 0);
+	if (form >= 0) {
+		assert(*len > FORM_OFF);
+		assert(((uint8_t *)buf)[FORM_OFF] == form);
+	}
+
+	copy = collbm_decode(buf, *len);
+	assert(copy != NULL);
+	assert(copy->card == bm->card);
+	assert(copy->n == bm->n);
+	collbm_iter_seek(&ia, bm, 0);
+	collbm_iter_seek(&ib, copy, 0);
+	while (collbm_iter_next(&ia, &a)) {
+		ret = collbm_iter_next(&ib, &b);
+		assert(ret);
+		assert(a == b);
+	}
+	assert(!collbm_iter_next(&ib, &b));
+	collbm_free(copy);
+	return buf;
+}
+
+static void test_empty(void)
+{
+	size_t len = 0;
+	struct collbm *bm = collbm_alloc();
+	uint8_t *buf = NULL;
+
+	assert(bm != NULL);
+	buf = round_trip(bm, -1, &len);
+	assert(len == 4);
+	free(buf);
+	collbm_free(bm);
+}
+
+/* scattered oids in several containers stay sorted arrays */
+static void test_array(void)
+{
+	int i = 0;
+	size_t len = 0;
+	struct collbm *bm = collbm_alloc();
+	uint8_t *buf = NULL;
+
+	for (i = 0; i < 300; i++) {
+		assert(collbm_add(bm, 0x10000 + i * 7) == 1);
+		assert(collbm_add(bm, (3ULL << 16) + i * 211) == 1);
+	}
+	assert(collbm_add(bm, 0xffffffffffffULL << 16) == 1);
+	buf = round_trip(bm, FORM_ARRAY, &len);
+	free(buf);
+	collbm_free(bm);
+}
+
+/* past COLLBM_ARRAY_MAX, with no long runs, a container is a bitmap */
+static void test_bits(void)
+{
+	uint32_t v = 0;
+	size_t len = 0;
+	struct collbm *bm = collbm_alloc();
+	uint8_t *buf = NULL;
+
+	for (v = 0; v < 65536; v += 3)
+		assert(collbm_add(bm, (1ULL << 16) | v) == 1);
+	assert(bm->card > COLLBM_ARRAY_MAX);
+	buf = round_trip(bm, FORM_BITS, &len);
+	assert(len == 4 + 9 + 8192);
+	free(buf);
+	collbm_free(bm);
+}
+
+/* oids created in sequence are runs, also when they cross containers */
+static void test_runs(void)
+{
+	uint64_t oid = 0;
+	size_t len = 0;
+	struct collbm *bm = collbm_alloc();
+	uint8_t *buf = NULL;
+
+	for (oid = 0x10000 - 100; oid < 0x10000 + 10000; oid++)
+		assert(collbm_add(bm, oid) == 1);
+	for (oid = 0x20000; oid < 0x20000 + 50; oid++)
+		assert(collbm_add(bm, oid) == 1);
+	assert(collbm_remove(bm, 0x10000 + 5000) == 1);
+	buf = round_trip(bm, FORM_RUNS, &len);
+	free(buf);
+	collbm_free(bm);
+}
+
+/* all 65536 members, one run whose length-1 is 0xffff */
+static void test_full(void)
+{
+	uint32_t v = 0;
+	size_t len = 0;
+	struct collbm *bm = collbm_alloc();
+	uint8_t *buf = NULL;
+
+	for (v = 0; v < 65536; v++)
+		assert(collbm_add(bm, (7ULL << 16) | v) == 1);
+	assert(bm->card == 65536);
+	buf = round_trip(bm, FORM_RUNS, &len);
+	assert(len == 4 + 9 + 2 + 4);
+	assert(get_ntohs(buf + FORM_OFF + 1) == 0);
+	assert(get_ntohs(buf + FORM_OFF + 3) == 0);
+	assert(get_ntohs(buf + FORM_OFF + 5) == 0xffff);
+	free(buf);
+	collbm_free(bm);
+}
+
+/* every proper prefix of an encoding, and one byte more, is refused */
+static void test_truncated(void)
+{
+	uint32_t v = 0;
+	size_t len = 0, i = 0;
+	struct collbm *bm = collbm_alloc();
+	uint8_t *buf = NULL, *longer = NULL;
+
+	for (v = 0; v < 100; v++)
+		assert(collbm_add(bm, (1ULL << 16) + v * 5) == 1);
+	for (v = 0; v < 5000; v++)
+		assert(collbm_add(bm, (2ULL << 16) + v * 13) == 1);
+	for (v = 0; v < 300; v++)
+		assert(collbm_add(bm, (4ULL << 16) + v) == 1);
+	buf = round_trip(bm, FORM_ARRAY, &len);
+
+	for (i = 0; i < len; i++)
+		assert(collbm_decode(buf, i) == NULL);
+	longer = Malloc(len + 1);
+	assert(longer != NULL);
+	memcpy(longer, buf, len);
+	longer[len] = 0;
+	assert(collbm_decode(longer, len + 1) == NULL);
+
+	/* a form that does not exist */
+	longer[FORM_OFF] = 3;
+	assert(collbm_decode(longer, len) == NULL);
+
+	free(longer);
+	free(buf);
+	collbm_free(bm);
+}
+
+int main(void)
+{
+	test_empty();
+	test_array();
+	test_bits();
+	test_runs();
+	test_full();
+	test_truncated();
+	printf("collbm-test passed\n");
+	return 0;
+}
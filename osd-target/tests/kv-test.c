@@ -0,0 +1,253 @@
+/*
+ * Replay of the write-ahead log of the kv store after a crash.
+ *
+ * Copyright (C) 2007 OSD Team <pvfs-osd@osc.edu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "osd-types.h"
+#include "kv.h"
+#include "osd-util/osd-util.h"
+
+static const char *dir = "/tmp/osd-kv-test";
+
+/*
+ * A crash is a child that leaves without kv_close, which would write the
+ * memtable out to a segment and empty the log.
+ */
+static void crash(void (*fn)(struct kv_db *kv))
+{
+	int ret = 0;
+	int status = 0;
+	pid_t pid = 0;
+	struct kv_db *kv = NULL;
+
+	pid = fork();
+	assert(pid >= 0);
+	if (pid == 0) {
+		ret = kv_open(dir, &kv);
+		if (ret < 0)
+			_exit(1);
+		fn(kv);
+		_exit(0);
+	}
+	assert(waitpid(pid, &status, 0) == pid);
+	assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+static off_t wal_size(void)
+{
+	char path[MAXNAMELEN];
+	struct stat sb;
+
+	sprintf(path, "%s/wal", dir);
+	if (stat(path, &sb) != 0)
+		return -1;
+	return sb.st_size;
+}
+
+static void put(struct kv_db *kv, const char *key, const char *val)
+{
+	int ret = kv_put(kv, key, strlen(key), val, strlen(val));
+	assert(ret == 0);
+}
+
+/* val is NULL for a key that must not be there */
+static void check(struct kv_db *kv, const char *key, const char *val)
+{
+	int ret = 0;
+	const void *v = NULL;
+	uint32_t vlen = 0;
+
+	ret = kv_get(kv, key, strlen(key), &v, &vlen);
+	if (!val) {
+		assert(ret == -ENOENT);
+		return;
+	}
+	assert(ret == 0);
+	assert(vlen == strlen(val));
+	assert(memcmp(v, val, vlen) == 0);
+}
+
+static int count(struct kv_db *kv)
+{
+	int n = 0;
+	const void *k = NULL, *v = NULL;
+	uint32_t klen = 0, vlen = 0;
+	struct kv_iter *it = NULL;
+
+	assert(kv_iter_open(kv, NULL, 0, &it) == 0);
+	while (kv_iter_next(it, &k, &klen, &v, &vlen) == 1)
+		n++;
+	kv_iter_close(it);
+	return n;
+}
+
+static void write_plain(struct kv_db *kv)
+{
+	put(kv, "a", "1");
+	put(kv, "b", "2");
+	put(kv, "c", "3");
+	put(kv, "b", "22");
+	assert(kv_del(kv, "c", 1) == 0);
+}
+
+/* writes outside of a transaction are in the log as soon as they return */
+static void test_plain(void)
+{
+	struct kv_db *kv = NULL;
+
+	crash(write_plain);
+	assert(wal_size() > 0);
+	assert(kv_open(dir, &kv) == 0);
+	check(kv, "a", "1");
+	check(kv, "b", "22");
+	check(kv, "c", NULL);
+	assert(count(kv) == 2);
+	assert(kv_close(kv) == 0);
+	assert(wal_size() == 0);
+}
+
+static void write_txn(struct kv_db *kv)
+{
+	assert(kv_begin_txn(kv) == 0);
+	put(kv, "t1", "committed");
+	assert(kv_del(kv, "a", 1) == 0);
+	assert(kv_end_txn(kv) == 0);
+
+	assert(kv_begin_txn(kv) == 0);
+	put(kv, "t2", "lost");
+	assert(kv_del(kv, "b", 1) == 0);
+}
+
+/* a transaction is in the log once kv_end_txn returns, and not before */
+static void test_txn(void)
+{
+	struct kv_db *kv = NULL;
+
+	crash(write_txn);
+	assert(kv_open(dir, &kv) == 0);
+	check(kv, "t1", "committed");
+	check(kv, "a", NULL);
+	check(kv, "t2", NULL);
+	check(kv, "b", "22");
+	assert(kv_close(kv) == 0);
+}
+
+static char *big;
+#define BIG_LEN (200U << 10)
+
+static void write_big(struct kv_db *kv)
+{
+	assert(kv_put(kv, "big", 3, big, BIG_LEN) == 0);
+	put(kv, "after", "big");
+	/* deletes a key that is in a segment since the last close */
+	assert(kv_del(kv, "t1", 2) == 0);
+}
+
+/* a record larger than the log buffer, and a delete over a segment */
+static void test_big(void)
+{
+	int ret = 0;
+	struct kv_db *kv = NULL;
+	const void *v = NULL;
+	uint32_t vlen = 0;
+
+	crash(write_big);
+	assert(kv_open(dir, &kv) == 0);
+	ret = kv_get(kv, "big", 3, &v, &vlen);
+	assert(ret == 0);
+	assert(vlen == BIG_LEN);
+	assert(memcmp(v, big, BIG_LEN) == 0);
+	check(kv, "after", "big");
+	check(kv, "t1", NULL);
+	check(kv, "b", "22");
+	assert(kv_close(kv) == 0);
+}
+
+static void write_torn(struct kv_db *kv)
+{
+	put(kv, "x", "before the tear");
+	put(kv, "y", "also");
+}
+
+/* a record torn by a crash is dropped, and the log cut back to before it */
+static void test_torn(void)
+{
+	int fd = 0;
+	off_t good = 0;
+	uint32_t hdr[2] = { 4, 100 };
+	char path[MAXNAMELEN];
+	struct kv_db *kv = NULL;
+
+	crash(write_torn);
+	good = wal_size();
+	assert(good > 0);
+	sprintf(path, "%s/wal", dir);
+	fd = open(path, O_WRONLY | O_APPEND);
+	assert(fd >= 0);
+	assert(write(fd, hdr, sizeof(hdr)) == sizeof(hdr));
+	assert(write(fd, "torn", 4) == 4);
+	assert(write(fd, "partial value", 13) == 13);
+	close(fd);
+
+	assert(kv_open(dir, &kv) == 0);
+	assert(wal_size() == good);
+	check(kv, "x", "before the tear");
+	check(kv, "y", "also");
+	check(kv, "torn", NULL);
+
+	/* the log goes on from there */
+	put(kv, "z", "after the tear");
+	check(kv, "z", "after the tear");
+	assert(kv_close(kv) == 0);
+
+	assert(kv_open(dir, &kv) == 0);
+	check(kv, "x", "before the tear");
+	check(kv, "z", "after the tear");
+	check(kv, "torn", NULL);
+	assert(kv_close(kv) == 0);
+}
+
+int main(void)
+{
+	uint32_t i = 0;
+
+	big = Malloc(BIG_LEN);
+	assert(big != NULL);
+	for (i = 0; i < BIG_LEN; i++)
+		big[i] = i * 7 + (i >> 11);
+
+	system("rm -rf /tmp/osd-kv-test");
+	system("mkdir -p /tmp/osd-kv-test");
+
+	test_plain();
+	test_txn();
+	test_big();
+	test_torn();
+
+	system("rm -rf /tmp/osd-kv-test");
+	free(big);
+	printf("kv-test passed\n");
+	return 0;
+}
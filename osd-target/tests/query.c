@@ -8,6 +8,8 @@
 #include "osd-types.h"
 #include "cdb.h"
 #include "osd.h"
+#include "backend.h"
+#include "mtq.h"
 #include "osd-initiator/command.h"
 #include "osd-util/osd-util.h"
 
@@ -18,14 +20,89 @@ static void run(struct osd_device *osd, struct osd_command *c)
 	uint64_t data_in_len = 0;
 	uint8_t sense_out[252];
 	int senselen_out;
+	char ip[] = "127.0.0.1";
 
-	ret = osdemu_cmd_submit(osd, c->cdb, c->outdata, c->outlen, &data_in,
-				&data_in_len, sense_out, &senselen_out);
+	ret = osdemu_cmd_submit(osd, ip, c->cdb, c->outdata, c->outlen,
+				&data_in, &data_in_len, sense_out,
+				&senselen_out);
 	assert(ret == 0);
 }
 
 #define ATTR_LEN 8
 
+/*
+ * Run the criteria of query_speed through the native executor of the
+ * SQLite backend and through its single SELECT; the matches lists must
+ * be the same.
+ */
+static void query_compare(struct osd_device *osd, uint64_t pid,
+			  uint64_t cid, int numiter, int numcriteria,
+			  const uint8_t *lo, const uint8_t *hi,
+			  uint64_t alloc_len)
+{
+	int i, k;
+	uint64_t start, end;
+	uint64_t used[2];
+	uint8_t *results[2];
+	double *v, mu, sd;
+	struct query_criteria qc;
+	int (*run_query[2])(void *, uint64_t, uint64_t,
+			    struct query_criteria *, void *, uint32_t,
+			    uint64_t *) = { mtq_run_query_sql, mtq_run_query };
+	const char *name[2] = { "sql", "native" };
+
+	v = Malloc(numiter * sizeof(*v));
+	results[0] = Malloc(alloc_len);
+	results[1] = Malloc(alloc_len);
+	qc.query_type = 1;
+	qc.qc_cnt_limit = qc.qc_cnt = numcriteria;
+	qc.qce_len = Malloc(numcriteria * sizeof(*qc.qce_len));
+	qc.page = Malloc(numcriteria * sizeof(*qc.page));
+	qc.number = Malloc(numcriteria * sizeof(*qc.number));
+	qc.min_len = Malloc(numcriteria * sizeof(*qc.min_len));
+	qc.min_val = Malloc(numcriteria * sizeof(*qc.min_val));
+	qc.max_len = Malloc(numcriteria * sizeof(*qc.max_len));
+	qc.max_val = Malloc(numcriteria * sizeof(*qc.max_val));
+	assert(v && results[0] && results[1] && qc.qce_len && qc.page &&
+	       qc.number && qc.min_len && qc.min_val && qc.max_len &&
+	       qc.max_val);
+	for (i=0; i<numcriteria; i++) {
+		qc.page[i] = LUN_PG_LB;
+		qc.number[i] = 1 + i;
+		qc.min_len[i] = ATTR_LEN;
+		qc.min_val[i] = lo;
+		qc.max_len[i] = ATTR_LEN;
+		qc.max_val[i] = hi;
+	}
+
+	for (k=0; k<2; k++) {
+		for (i=0; i<numiter; i++) {
+			rdtsc(start);
+			run_query[k](osd->handle, pid, cid, &qc, results[k],
+				     alloc_len, &used[k]);
+			rdtsc(end);
+			v[i] = (double)(end - start) / mhz;
+		}
+		mu = mean(v, numiter);
+		sd = stddev(v, mu, numiter);
+		printf("query %s numcriteria %d avg %lf +/- %lf us\n",
+		       name[k], numcriteria, mu, sd);
+	}
+	assert(used[0] == used[1]);
+	assert(memcmp(results[0], results[1], used[0]) == 0);
+
+	free(qc.qce_len);
+	free(qc.page);
+	free(qc.number);
+	free(qc.min_len);
+	free(qc.min_val);
+	free(qc.max_len);
+	free(qc.max_val);
+	free(results[0]);
+	free(results[1]);
+	free(v);
+}
+
 static void query_speed(struct osd_device *osd, int numiter, int numobj,
 			int numobj_in_coll, int nummatch, int numattr,
 			int numcriteria)
@@ -153,6 +230,10 @@ static void query_speed(struct osd_device *osd, int numiter, int numobj,
 	       " numattr %d numcriteria %d avg %lf +/- %lf us\n",
 	       numiter, numobj, numobj_in_coll, nummatch, numattr,
 	       numcriteria, mu, sd);
+
+	if (numcriteria > 0 && strcmp(osd->be->name, "sqlite") == 0)
+		query_compare(osd, pid, cid, numiter, numcriteria,
+			      attr_val_lo, attr_val_hi, alloc_len);
 	free(query);
 	free(attr_val_lo);
 	free(attr);
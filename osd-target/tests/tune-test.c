@@ -0,0 +1,175 @@
+/*
+ * Parsing of the tunables of tune.c.
+ *
+ * Copyright (C) 2007 OSD Team <pvfs-osd@osc.edu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "osd-types.h"
+#include "tune.h"
+#include "osd-util/osd-util.h"
+
+static void tune_unset(struct tune *t)
+{
+	memset(t, 0, sizeof(*t));
+	t->mmap_size = -1;
+	t->temp_store = -1;
+}
+
+/* the cache_size opts parses to, -1 if it is refused */
+static int64_t cache_size(const char *opts)
+{
+	struct tune t;
+
+	tune_unset(&t);
+	if (tune_parse(&t, opts, __func__) != 0)
+		return -1;
+	return t.cache_size;
+}
+
+static void test_sizes(void)
+{
+	assert(cache_size("cache_size = 4096") == 4096);
+	assert(cache_size("cache_size=16k") == 16LL << 10);
+	assert(cache_size("cache_size=16K") == 16LL << 10);
+	assert(cache_size("cache_size=10m") == 10LL << 20);
+	assert(cache_size("cache_size=1g") == 1LL << 30);
+
+	/* decimal only: not octal, not hex */
+	assert(cache_size("cache_size=010m") == 10LL << 20);
+	assert(cache_size("cache_size=0x10") == -1);
+
+	/* the largest that fits an int64_t, and one past it */
+	assert(cache_size("cache_size=8589934591g") == 8589934591LL << 30);
+	assert(cache_size("cache_size=8589934592g") == -1);
+	assert(cache_size("cache_size=9223372036854775807") == INT64_MAX);
+	assert(cache_size("cache_size=9223372036854775808") == -1);
+	assert(cache_size("cache_size=99999999999999999999") == -1);
+
+	assert(cache_size("cache_size=-1") == -1);
+	assert(cache_size("cache_size=0") == -1);
+	assert(cache_size("cache_size=") == -1);
+	assert(cache_size("cache_size=1t") == -1);
+	assert(cache_size("cache_size=1kb") == -1);
+}
+
+static void test_keys(void)
+{
+	int ret = 0;
+	struct tune t;
+
+	tune_unset(&t);
+	ret = tune_parse(&t, "mmap_size=0; page_size=8k; temp_store=memory;"
+			 " soft_heap_limit=64m", __func__);
+	assert(ret == 0);
+	assert(t.mmap_size == 0);
+	assert(t.page_size == 8192);
+	assert(t.temp_store == 2);
+	assert(t.heap_limit == 64LL << 20);
+	assert(t.cache_size == 0);
+
+	tune_unset(&t);
+	assert(tune_parse(&t, "temp_store=FILE", __func__) == 0);
+	assert(t.temp_store == 1);
+	assert(tune_parse(&t, "temp_store=0", __func__) == 0);
+	assert(t.temp_store == 0);
+	assert(tune_parse(&t, "temp_store=3", __func__) == -EINVAL);
+
+	/* powers of two from 512 to 65536 */
+	assert(tune_parse(&t, "page_size=512", __func__) == 0);
+	assert(tune_parse(&t, "page_size=64k", __func__) == 0);
+	assert(t.page_size == 65536);
+	assert(tune_parse(&t, "page_size=256", __func__) == -EINVAL);
+	assert(tune_parse(&t, "page_size=128k", __func__) == -EINVAL);
+	assert(tune_parse(&t, "page_size=3000", __func__) == -EINVAL);
+
+	assert(tune_parse(&t, "cache_sise=1m", __func__) == -EINVAL);
+	assert(tune_parse(&t, "cache_size", __func__) == -EINVAL);
+}
+
+/* separators, comments, and the last of a key winning */
+static void test_syntax(void)
+{
+	struct tune t;
+
+	tune_unset(&t);
+	assert(tune_parse(&t, "", __func__) == 0);
+	assert(tune_parse(&t, " ; ;\n", __func__) == 0);
+	assert(tune_parse(&t, "# cache_size=1m", __func__) == 0);
+	assert(t.cache_size == 0);
+	assert(tune_parse(&t, "cache_size=1m # the cache\n"
+			  "cache_size = 2m ;", __func__) == 0);
+	assert(t.cache_size == 2LL << 20);
+
+	/* parsing stops at the first error */
+	assert(tune_parse(&t, "cache_size=3m; bogus=1; cache_size=4m",
+			  __func__) == -EINVAL);
+	assert(t.cache_size == 3LL << 20);
+}
+
+static void test_load(void)
+{
+	int ret = 0;
+	FILE *fp = NULL;
+	struct tune *t = NULL;
+	const char *root = "/tmp/osd-tune-test";
+	char path[MAXNAMELEN];
+
+	system("rm -rf /tmp/osd-tune-test");
+	system("mkdir -p /tmp/osd-tune-test");
+
+	/* no file, everything unset */
+	ret = tune_load(root, &t);
+	assert(ret == 0);
+	assert(t->cache_size == 0 && t->mmap_size == -1 && t->page_size == 0);
+	assert(t->temp_store == -1 && t->heap_limit == 0);
+	free(t);
+
+	sprintf(path, "%s/%s", root, TUNE_FILE);
+	fp = fopen(path, "w");
+	assert(fp != NULL);
+	fprintf(fp, "# tunables\n\ncache_size = 32m\n  mmap_size=1g  \n");
+	fclose(fp);
+	ret = tune_load(root, &t);
+	assert(ret == 0);
+	assert(t->cache_size == 32LL << 20);
+	assert(t->mmap_size == 1LL << 30);
+	free(t);
+
+	fp = fopen(path, "a");
+	assert(fp != NULL);
+	fprintf(fp, "page_size = 1000\n");
+	fclose(fp);
+	t = NULL;
+	ret = tune_load(root, &t);
+	assert(ret == -EINVAL);
+	assert(t == NULL);
+
+	system("rm -rf /tmp/osd-tune-test");
+}
+
+int main(void)
+{
+	test_sizes();
+	test_keys();
+	test_syntax();
+	test_load();
+	printf("tune-test passed\n");
+	return 0;
+}
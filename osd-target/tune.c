@@ -0,0 +1,361 @@
+/*
+ * Per-LUN sqlite memory tunables and page cache counters.
+ *
+ * Copyright (C) 2007 OSD Team <pvfs-osd@osc.edu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sqlite3.h>
+
+#include "osd.h"
+#include "db.h"
+#include "tune.h"
+#include "osd-util/osd-util.h"
+
+/*
+ * TUNE_FILE holds one "key = value" a line, '#' starting a comment; the
+ * same pairs separated by ';' are what a backing-store option string
+ * hands to tune_parse. Sizes take a k, m or g suffix.
+ *
+ *   cache_size       page cache
+ *   mmap_size        bytes of the files sqlite may map
+ *   page_size        of shards created from now on, 512 to 65536
+ *   temp_store       default, file or memory
+ *   soft_heap_limit  see below
+ *
+ * The soft heap limit of sqlite is one for the whole process, so each
+ * open LUN adds its own to it and takes it back on close; LUNs without
+ * one add nothing.
+ */
+static pthread_mutex_t tune_heap_lock = PTHREAD_MUTEX_INITIALIZER;
+static int64_t tune_heap_total;
+
+static int tune_size(const char *val, int64_t *size)
+{
+	char *end = NULL;
+	unsigned long long n = 0;
+	int shift = 0;
+
+	/* decimal only, so that 010m is not read as octal */
+	errno = 0;
+	n = strtoull(val, &end, 10);
+	if (errno || end == val || val[0] == '-')
+		return OSD_ERROR;
+	switch (tolower(*end)) {
+	case 'g':
+		shift = 30;
+		break;
+	case 'm':
+		shift = 20;
+		break;
+	case 'k':
+		shift = 10;
+		break;
+	}
+	if (shift)
+		end++;
+	if (*end != '\0' || n > ((uint64_t)INT64_MAX >> shift))
+		return OSD_ERROR;
+	*size = n << shift;
+	return OSD_OK;
+}
+
+static char *tune_trim(char *s)
+{
+	char *e = NULL;
+
+	while (isspace(*s))
+		s++;
+	e = s + strlen(s);
+	while (e > s && isspace(e[-1]))
+		*--e = '\0';
+	return s;
+}
+
+/* set one key of t, src naming where it came from for errors */
+static int tune_set(struct tune *t, char *key, char *val, const char *src)
+{
+	int64_t n = 0;
+
+	if (!strcmp(key, "cache_size")) {
+		if (tune_size(val, &n) != OSD_OK || n == 0)
+			goto out_bad;
+		t->cache_size = n;
+	} else if (!strcmp(key, "mmap_size")) {
+		if (tune_size(val, &n) != OSD_OK)
+			goto out_bad;
+		t->mmap_size = n;
+	} else if (!strcmp(key, "page_size")) {
+		if (tune_size(val, &n) != OSD_OK || n < 512 || n > 65536 ||
+		    (n & (n - 1)))
+			goto out_bad;
+		t->page_size = n;
+	} else if (!strcmp(key, "temp_store")) {
+		if (!strcasecmp(val, "default") || !strcmp(val, "0"))
+			t->temp_store = 0;
+		else if (!strcasecmp(val, "file") || !strcmp(val, "1"))
+			t->temp_store = 1;
+		else if (!strcasecmp(val, "memory") || !strcmp(val, "2"))
+			t->temp_store = 2;
+		else
+			goto out_bad;
+	} else if (!strcmp(key, "soft_heap_limit")) {
+		if (tune_size(val, &n) != OSD_OK)
+			goto out_bad;
+		t->heap_limit = n;
+	} else {
+		osd_error("%s: %s: unknown option %s", __func__, src, key);
+		return -EINVAL;
+	}
+	return OSD_OK;
+
+out_bad:
+	osd_error("%s: %s: bad value %s for %s", __func__, src, val, key);
+	return -EINVAL;
+}
+
+/*
+ * Set t from opts, "key = value" pairs separated by ';' or newlines.
+ *
+ * returns:
+ * -EINVAL: an unknown key or a bad value
+ * -ENOMEM: out of memory
+ * OSD_OK: success
+ */
+int tune_parse(struct tune *t, const char *opts, const char *src)
+{
+	int ret = OSD_OK;
+	char *buf = NULL;
+	char *save = NULL;
+	char *s = NULL;
+	char *eq = NULL;
+
+	buf = strdup(opts);
+	if (!buf)
+		return -ENOMEM;
+	for (s = strtok_r(buf, ";\n", &save); s && ret == OSD_OK;
+	     s = strtok_r(NULL, ";\n", &save)) {
+		if ((eq = strchr(s, '#')) != NULL)
+			*eq = '\0';
+		s = tune_trim(s);
+		if (s[0] == '\0')
+			continue;
+		eq = strchr(s, '=');
+		if (!eq) {
+			osd_error("%s: %s: no value for %s", __func__, src, s);
+			ret = -EINVAL;
+			break;
+		}
+		*eq = '\0';
+		ret = tune_set(t, tune_trim(s), tune_trim(eq + 1), src);
+	}
+	free(buf);
+	return ret;
+}
+
+/*
+ * Read TUNE_FILE of the LUN at root into a new *pt, all unset if there is
+ * none.
+ *
+ * returns:
+ * -EINVAL: the file has an unknown key or a bad value
+ * -ENOMEM: out of memory
+ * -errno: the file could not be read
+ * OSD_OK: success
+ */
+int tune_load(const char *root, struct tune **pt)
+{
+	int ret = OSD_OK;
+	int line = 0;
+	FILE *fp = NULL;
+	struct tune *t = NULL;
+	char path[MAXNAMELEN];
+	char src[MAXNAMELEN + 16];
+	char s[512];
+
+	t = Calloc(1, sizeof(*t));
+	if (!t)
+		return -ENOMEM;
+	t->mmap_size = -1;
+	t->temp_store = -1;
+
+	snprintf(path, sizeof(path), "%s/%s", root, TUNE_FILE);
+	fp = fopen(path, "r");
+	if (!fp) {
+		if (errno != ENOENT) {
+			ret = -errno;
+			osd_error("%s: open %s: %m", __func__, path);
+			free(t);
+			return ret;
+		}
+		*pt = t;
+		return OSD_OK;
+	}
+	while (ret == OSD_OK && fgets(s, sizeof(s), fp)) {
+		snprintf(src, sizeof(src), "%s:%d", path, ++line);
+		ret = tune_parse(t, s, src);
+	}
+	fclose(fp);
+	if (ret != OSD_OK) {
+		free(t);
+		return ret;
+	}
+	*pt = t;
+	return OSD_OK;
+}
+
+static int tune_exec(struct db_context *dbc, const char *SQL)
+{
+	int ret = 0;
+	char *err = NULL;
+
+	ret = sqlite3_exec(dbc->db, SQL, NULL, NULL, &err);
+	if (ret != SQLITE_OK) {
+		osd_error("%s: %s failed: %s", __func__, SQL, err);
+		sqlite3_free(err);
+		return OSD_ERROR;
+	}
+	return OSD_OK;
+}
+
+/*
+ * Settings of a shard that has no tables yet.
+ *
+ * returns:
+ * OSD_ERROR: the pragma failed
+ * OSD_OK: success
+ */
+int tune_new_shard(void *db, const struct tune *t)
+{
+	char SQL[MAXSQLEN];
+
+	if (!t->page_size)
+		return OSD_OK;
+	sprintf(SQL, "PRAGMA page_size = %d;", t->page_size);
+	return tune_exec(db, SQL);
+}
+
+/*
+ * Apply the tunables of handle to each of its shards, and add its heap
+ * limit to that of the process.
+ *
+ * returns:
+ * OSD_ERROR: a pragma failed
+ * OSD_OK: success
+ */
+int tune_apply(void *handle)
+{
+	struct handle *h = handle;
+	struct tune *t = h->tune;
+	char SQL[MAXSQLEN];
+	int64_t kb = 0;
+	int i = 0;
+
+	for (i = 0; i < h->nshard; i++) {
+		if (t->cache_size) {
+			/* negative is in KiB rather than pages */
+			kb = t->cache_size / h->nshard / 1024;
+			sprintf(SQL, "PRAGMA cache_size = -%lld;",
+				(long long)(kb > 0 ? kb : 1));
+			if (tune_exec(h->shard[i], SQL) != OSD_OK)
+				return OSD_ERROR;
+		}
+		if (t->mmap_size >= 0) {
+			sprintf(SQL, "PRAGMA mmap_size = %lld;",
+				(long long)(t->mmap_size / h->nshard));
+			if (tune_exec(h->shard[i], SQL) != OSD_OK)
+				return OSD_ERROR;
+		}
+		if (t->temp_store >= 0) {
+			sprintf(SQL, "PRAGMA temp_store = %d;", t->temp_store);
+			if (tune_exec(h->shard[i], SQL) != OSD_OK)
+				return OSD_ERROR;
+		}
+	}
+
+	if (t->heap_limit && !t->heap_held) {
+		pthread_mutex_lock(&tune_heap_lock);
+		tune_heap_total += t->heap_limit;
+		sqlite3_soft_heap_limit64(tune_heap_total);
+		pthread_mutex_unlock(&tune_heap_lock);
+		t->heap_held = t->heap_limit;
+	}
+	return OSD_OK;
+}
+
+/*
+ * Give back the heap limit of handle and free its tunables.
+ */
+void tune_release(void *handle)
+{
+	struct handle *h = handle;
+	struct tune *t = h->tune;
+	struct tune_stats ts;
+
+	if (!t)
+		return;
+	if (h->nshard) {
+		tune_get_stats(h, &ts);
+		osd_debug("%s: cache %llu hits %llu misses %llu writes %llu "
+			  "spills", __func__, llu(ts.cache_hit),
+			  llu(ts.cache_miss), llu(ts.cache_write),
+			  llu(ts.cache_spill));
+	}
+	if (t->heap_held) {
+		pthread_mutex_lock(&tune_heap_lock);
+		tune_heap_total -= t->heap_held;
+		sqlite3_soft_heap_limit64(tune_heap_total);
+		pthread_mutex_unlock(&tune_heap_lock);
+	}
+	free(t);
+	h->tune = NULL;
+}
+
+static uint64_t tune_status(struct db_context *dbc, int op)
+{
+	int cur = 0;
+	int hi = 0;
+
+	if (sqlite3_db_status(dbc->db, op, &cur, &hi, 0) != SQLITE_OK)
+		return 0;
+	return cur;
+}
+
+void tune_get_stats(void *handle, struct tune_stats *ts)
+{
+	struct handle *h = handle;
+	int i = 0;
+
+	memset(ts, 0, sizeof(*ts));
+	for (i = 0; i < h->nshard; i++) {
+		ts->cache_used += tune_status(h->shard[i],
+					      SQLITE_DBSTATUS_CACHE_USED);
+		ts->cache_hit += tune_status(h->shard[i],
+					     SQLITE_DBSTATUS_CACHE_HIT);
+		ts->cache_miss += tune_status(h->shard[i],
+					      SQLITE_DBSTATUS_CACHE_MISS);
+		ts->cache_write += tune_status(h->shard[i],
+					       SQLITE_DBSTATUS_CACHE_WRITE);
+		ts->cache_spill += tune_status(h->shard[i],
+					       SQLITE_DBSTATUS_CACHE_SPILL);
+	}
+	ts->heap_used = sqlite3_memory_used();
+	ts->heap_limit = sqlite3_soft_heap_limit64(-1);
+}
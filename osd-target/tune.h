@@ -0,0 +1,52 @@
+/*
+ * Per-LUN sqlite memory tunables and page cache counters.
+ *
+ * Copyright (C) 2007 OSD Team <pvfs-osd@osc.edu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __TUNE_H
+#define __TUNE_H
+
+#include <stdint.h>
+#include "osd-types.h"
+
+/* read from the root of the LUN, so FORMAT keeps it */
+#define TUNE_FILE "osd.conf"
+
+/*
+ * Sizes are in bytes and for the whole LUN; they are split evenly over
+ * its shards. A field left unset keeps the sqlite default.
+ */
+struct tune {
+	int64_t cache_size;	/* 0: unset */
+	int64_t mmap_size;	/* -1: unset, 0 turns mmap off */
+	int page_size;		/* 0: unset, only for new shards */
+	int temp_store;		/* -1: unset, else 0 default, 1 file, 2 memory */
+	int64_t heap_limit;	/* 0: unset */
+	int64_t heap_held;	/* added to the process limit by tune_apply */
+};
+
+int tune_parse(struct tune *t, const char *opts, const char *src);
+
+int tune_load(const char *root, struct tune **pt);
+
+int tune_new_shard(void *db, const struct tune *t);
+
+int tune_apply(void *handle);
+
+void tune_release(void *handle);
+
+void tune_get_stats(void *handle, struct tune_stats *ts);
+
+#endif /* __TUNE_H */
@@ -0,0 +1,232 @@
+/*
+ * Incremental vacuum of the metadata shards.
+ *
+ * Copyright (C) 2007 OSD Team <pvfs-osd@osc.edu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sqlite3.h>
+#include <assert.h>
+
+#include "osd.h"
+#include "db.h"
+#include "vacuum.h"
+#include "osd-util/osd-util.h"
+
+/*
+ * Shards are created with auto_vacuum = INCREMENTAL: a commit that frees
+ * pages only puts them on the free list, instead of moving pages to
+ * shrink the file before it returns as FULL does, which made bulk
+ * removals pay for the shrinking inline. The pages go back to the file
+ * system VACUUM_SLICE at a time through vacuum_run, which the idle thread
+ * calls between commands: on every call when the transport is idle, and
+ * when the commands keep coming, only once a shard has VACUUM_FREE_PCT of
+ * its pages free. Shards from before have
+ * auto_vacuum NONE, which no PRAGMA can change short of a VACUUM; they
+ * are left alone.
+ */
+struct vacuum_tab {
+	int incremental;	/* auto_vacuum is INCREMENTAL */
+	int changes;		/* sqlite3_total_changes when last looked */
+	uint64_t pages;
+	uint64_t free;
+	sqlite3_stmt *freecnt;
+	sqlite3_stmt *pagecnt;
+	sqlite3_stmt *slice;
+};
+
+/* the single integer a PRAGMA statement returns, -1 on error */
+static int64_t vacuum_pragma(struct db_context *dbc, sqlite3_stmt *stmt)
+{
+	int ret = 0;
+	int64_t val = -1;
+
+	while ((ret = sqlite3_step(stmt)) == SQLITE_BUSY);
+	if (ret == SQLITE_ROW)
+		val = sqlite3_column_int64(stmt, 0);
+	else
+		error_sql(dbc->db, "%s: step", __func__);
+	sqlite3_reset(stmt);
+	return val;
+}
+
+int vacuum_initialize(void *db)
+{
+	int ret = 0;
+	char SQL[MAXSQLEN];
+	struct db_context *dbc = db;
+	struct vacuum_tab *vt = NULL;
+	sqlite3_stmt *stmt = NULL;
+
+	if (!dbc || !dbc->db)
+		return -EINVAL;
+
+	vt = Calloc(1, sizeof(*vt));
+	if (!vt)
+		return -ENOMEM;
+	dbc->vac = vt;
+
+	/*
+	 * prepared with sqlite3_prepare_v2, which handles schema changes
+	 * itself, since they run between commands rather than after a
+	 * statement of the command has brought the schema up to date
+	 */
+	sprintf(SQL, "PRAGMA freelist_count;");
+	ret = sqlite3_prepare_v2(dbc->db, SQL, -1, &vt->freecnt, NULL);
+	if (ret != SQLITE_OK)
+		goto out_err;
+	sprintf(SQL, "PRAGMA page_count;");
+	ret = sqlite3_prepare_v2(dbc->db, SQL, -1, &vt->pagecnt, NULL);
+	if (ret != SQLITE_OK)
+		goto out_err;
+	sprintf(SQL, "PRAGMA incremental_vacuum(%d);", VACUUM_SLICE);
+	ret = sqlite3_prepare_v2(dbc->db, SQL, -1, &vt->slice, NULL);
+	if (ret != SQLITE_OK)
+		goto out_err;
+
+	sprintf(SQL, "PRAGMA auto_vacuum;");
+	ret = sqlite3_prepare_v2(dbc->db, SQL, -1, &stmt, NULL);
+	if (ret != SQLITE_OK)
+		goto out_err;
+	vt->incremental = (vacuum_pragma(dbc, stmt) == 2);
+	sqlite3_finalize(stmt);
+	vt->changes = -1;
+	return OSD_OK;
+
+out_err:
+	error_sql(dbc->db, "%s: prepare %s", __func__, SQL);
+	vacuum_finalize(dbc);
+	return OSD_ERROR;
+}
+
+int vacuum_finalize(void *db)
+{
+	struct db_context *dbc = db;
+	struct vacuum_tab *vt = NULL;
+
+	if (!dbc || !dbc->vac)
+		return OSD_ERROR;
+
+	vt = dbc->vac;
+	if (dbc->vac_slices)
+		osd_debug("%s: %llu slices reclaimed %llu pages in %llu us",
+			  __func__, llu(dbc->vac_slices),
+			  llu(dbc->vac_reclaimed), llu(dbc->vac_usec));
+	sqlite3_finalize(vt->freecnt);
+	sqlite3_finalize(vt->pagecnt);
+	sqlite3_finalize(vt->slice);
+	free(vt);
+	dbc->vac = NULL;
+	return OSD_OK;
+}
+
+/* bring the page counts of a shard up to date if it was written to */
+static void vacuum_refresh(struct db_context *dbc)
+{
+	int64_t val = 0;
+	struct vacuum_tab *vt = dbc->vac;
+	int changes = sqlite3_total_changes(dbc->db);
+
+	if (changes == vt->changes)
+		return;
+	vt->changes = changes;
+	val = vacuum_pragma(dbc, vt->freecnt);
+	vt->free = val < 0 ? 0 : val;
+	val = vacuum_pragma(dbc, vt->pagecnt);
+	vt->pages = val < 0 ? 0 : val;
+}
+
+/*
+ * One slice of vacuum_run for one shard.
+ *
+ * returns:
+ * 1: free pages are left
+ * 0: none, or the shard is not vacuumed
+ */
+static int vacuum_shard(struct db_context *dbc, int idle)
+{
+	int ret = 0;
+	uint64_t before = 0;
+	uint64_t t0 = 0;
+	struct vacuum_tab *vt = dbc->vac;
+
+	/* not while a command transaction is open */
+	if (!vt->incremental || !sqlite3_get_autocommit(dbc->db))
+		return 0;
+	vacuum_refresh(dbc);
+	if (vt->free == 0)
+		return 0;
+	if (!idle && vt->free * 100 < vt->pages * VACUUM_FREE_PCT)
+		return 1;
+
+	before = vt->free;
+	t0 = osd_now_us();
+	while ((ret = sqlite3_step(vt->slice)) == SQLITE_ROW ||
+	       ret == SQLITE_BUSY);
+	sqlite3_reset(vt->slice);
+	if (ret != SQLITE_DONE) {
+		error_sql(dbc->db, "%s: incremental_vacuum", __func__);
+		return 0;
+	}
+	dbc->vac_usec += osd_now_us() - t0;
+	dbc->vac_slices++;
+
+	vt->changes = -1;
+	vacuum_refresh(dbc);
+	if (vt->free < before)
+		dbc->vac_reclaimed += before - vt->free;
+	return vt->free > 0;
+}
+
+/*
+ * Hand free pages of the shards back to the file system, a slice per
+ * shard at most. With idle set the caller has nothing better to do and
+ * every shard with free pages gets a slice; without, only those past
+ * VACUUM_FREE_PCT do. Shards in a transaction are skipped.
+ *
+ * returns:
+ * 1: free pages are left, idle callers may call again
+ * 0: none
+ */
+int vacuum_run(void *handle, int idle)
+{
+	struct handle *h = handle;
+	int i = 0;
+	int more = 0;
+
+	for (i = 0; i < h->nshard; i++)
+		more |= vacuum_shard(h->shard[i], idle);
+	return more;
+}
+
+void vacuum_get_stats(void *handle, struct vacuum_stats *vs)
+{
+	struct handle *h = handle;
+	struct db_context *dbc = NULL;
+	int i = 0;
+
+	memset(vs, 0, sizeof(*vs));
+	for (i = 0; i < h->nshard; i++) {
+		dbc = h->shard[i];
+		vacuum_refresh(dbc);
+		vs->pages += dbc->vac->pages;
+		vs->free += dbc->vac->free;
+		vs->slices += dbc->vac_slices;
+		vs->reclaimed += dbc->vac_reclaimed;
+		vs->usec += dbc->vac_usec;
+	}
+}
@@ -0,0 +1,38 @@
+/*
+ * Incremental vacuum of the metadata shards.
+ *
+ * Copyright (C) 2007 OSD Team <pvfs-osd@osc.edu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __VACUUM_H
+#define __VACUUM_H
+
+#include <stdint.h>
+#include "osd-types.h"
+
+/* pages one slice of incremental_vacuum hands back to the file system */
+#define VACUUM_SLICE (256)
+
+/* percentage of free pages past which a shard is vacuumed when busy */
+#define VACUUM_FREE_PCT (20)
+
+int vacuum_initialize(void *db);
+
+int vacuum_finalize(void *db);
+
+int vacuum_run(void *handle, int idle);
+
+void vacuum_get_stats(void *handle, struct vacuum_stats *vs);
+
+#endif /* __VACUUM_H */
@@ -198,6 +198,31 @@ enum {
 	USER_ATOMICS_PG = 0x6,
 };
 
+/*
+ * Vendor specific root page declaring which user object attributes are
+ * queryable. Each attribute (number > 0) holds an 8-byte (page, number)
+ * pair, big-endian; the target keeps a value index for every declared
+ * pair. Setting an attribute to length zero withdraws the declaration.
+ *
+ * A 12-byte declaration adds the value type of the attribute, big-endian
+ * too. QUERY compares the values of a typed attribute, and the bounds of
+ * its criteria, by that type rather than as raw bytes: numbers of 1 to 8
+ * bytes by their value, strings up to the first NUL. Values that are not
+ * of the type meet no criterion with a bound.
+ */
+enum {
+	ROOT_QUERY_PG = (ROOT_PG + VEND_PG_LB),
+	ROOT_QUERY_ATTR_LEN = 8,
+	ROOT_QUERY_TYPED_ATTR_LEN = 12,
+};
+
+enum {
+	ROOT_QUERY_BLOB = 0,
+	ROOT_QUERY_U64 = 1,
+	ROOT_QUERY_I64 = 2,
+	ROOT_QUERY_STRING = 3,
+};
+
 /* in all attribute pages, attribute number 0 is a 40-byte identification */
 #define PAGE_ID (0x0)
 #define ATTR_PAGE_ID_LEN (40)
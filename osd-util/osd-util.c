@@ -26,6 +26,7 @@
 #include <math.h>
 #include <ctype.h>
 #include <time.h>
+#include <pthread.h>
 #include <sys/time.h>
 
 #include "osd-util.h"
@@ -633,7 +634,7 @@ double median(double *v, int N)
 	return median;
 }
 
-double get_mhz(void)
+static double read_mhz(void)
 {
 	FILE *fp;
 	char s[1024];
@@ -696,6 +697,37 @@ no_cpufrequency:
 	return mhz != 0 ? mhz : cpufrequency_not_found ;
 }
 
+static pthread_once_t mhz_once = PTHREAD_ONCE_INIT;
+static double cached_mhz;
+
+static void mhz_init(void)
+{
+	cached_mhz = read_mhz();
+}
+
+/*
+ * The cpu frequency, read once per process: every osd_open used to parse
+ * /proc/cpuinfo again. pthread_once makes the first callers wait for the
+ * one read rather than race on cached_mhz.
+ */
+double get_mhz(void)
+{
+	pthread_once(&mhz_once, mhz_init);
+	return cached_mhz;
+}
+
+/*
+ * Microseconds on the monotonic clock, for timing that does not depend
+ * on the cpu frequency.
+ */
+uint64_t osd_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
 /*
  * Jenkins One-at-a-time hash.
  * http://en.wikipedia.org/wiki/Hash_table
@@ -54,6 +54,7 @@ double mean(double *v, int N);
 double stddev(double *v, double mu, int N);
 double median(double *v, int N);
 double get_mhz(void);
+uint64_t osd_now_us(void);
 uint32_t jenkins_one_at_a_time_hash(uint8_t *key, size_t key_len);
 
 /*